@@ -20,6 +20,13 @@
 #include "tier1/strtools.h"
 #include "convar.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
+#include "tier0/threadtools.h"
+#include "tier1/mempool.h"
+#include "shaderlib_drawstats.h"
+#include "shaderlib_drawstream.h"
+#include "shaderlib_statecache.h"
+#include "shaderlib_startupstats.h"
 
 // NOTE: This must be the last include file in a .cpp file!
 #include "tier0/memdbgon.h"
@@ -27,39 +34,189 @@
 //-----------------------------------------------------------------------------
 // Storage buffer used for instance command buffers
 //-----------------------------------------------------------------------------
+// The context and its command bytes are a single block from a size-classed
+// pool. The material system frees these through the virtual destructor, which
+// routes back to our operator delete.
 class CPerInstanceContextData : public CBasePerInstanceContextData
 {
 public:
-	CPerInstanceContextData() : m_pCommandBuffer( NULL ), m_nSize( 0 ) {}
-	virtual ~CPerInstanceContextData()
-	{ 
-		if ( m_pCommandBuffer )
+	static CPerInstanceContextData *Create( int nCapacity );
+
+	virtual ~CPerInstanceContextData() {}
+
+	void operator delete( void *pMem );
+
+	unsigned char *m_pCommandBuffer;
+	int m_nSize;		// Capacity of m_pCommandBuffer
+
+private:
+	CPerInstanceContextData( int nCapacity ) : m_pCommandBuffer( (unsigned char *)( this + 1 ) ), m_nSize( nCapacity ) {}
+
+	void *operator new( size_t nSize, int nCapacity );
+	void operator delete( void *pMem, int nCapacity );
+};
+
+
+//-----------------------------------------------------------------------------
+// Pools backing CPerInstanceContextData
+//-----------------------------------------------------------------------------
+// Every block starts with the index of the pool it came from
+struct InstanceDataBlockHeader_t
+{
+	int m_nPool;		// -1 if it was too big for the pools
+	int m_nUnused;		// Keeps the context 8-byte aligned
+};
+
+static CUtlMemoryPool s_InstanceDataPool64( 64, 512, CUtlMemoryPool::GROW_SLOW, "CPerInstanceContextData" );
+static CUtlMemoryPool s_InstanceDataPool128( 128, 512, CUtlMemoryPool::GROW_SLOW, "CPerInstanceContextData" );
+static CUtlMemoryPool s_InstanceDataPool256( 256, 256, CUtlMemoryPool::GROW_SLOW, "CPerInstanceContextData" );
+static CUtlMemoryPool s_InstanceDataPool1024( 1024, 64, CUtlMemoryPool::GROW_SLOW, "CPerInstanceContextData" );
+
+static CUtlMemoryPool *s_pInstanceDataPools[] =
+{
+	&s_InstanceDataPool64,
+	&s_InstanceDataPool128,
+	&s_InstanceDataPool256,
+	&s_InstanceDataPool1024,
+};
+
+static CThreadFastMutex s_InstanceDataPoolMutex;
+static int s_nOversizeInstanceDataCount = 0;
+
+void *CPerInstanceContextData::operator new( size_t nSize, int nCapacity )
+{
+	size_t nBlockSize = sizeof( InstanceDataBlockHeader_t ) + nSize + nCapacity;
+
+	InstanceDataBlockHeader_t *pBlock = NULL;
+	int nPool = 0;
+
+	{
+		AUTO_LOCK( s_InstanceDataPoolMutex );
+
+		while ( ( nPool < ARRAYSIZE( s_pInstanceDataPools ) ) && ( (size_t)s_pInstanceDataPools[nPool]->BlockSize() < nBlockSize ) )
 		{
-			delete m_pCommandBuffer; 
+			++nPool;
+		}
+
+		if ( nPool < ARRAYSIZE( s_pInstanceDataPools ) )
+		{
+			pBlock = (InstanceDataBlockHeader_t *)s_pInstanceDataPools[nPool]->Alloc();
+		}
+		else
+		{
+			nPool = -1;
+			++s_nOversizeInstanceDataCount;
 		}
 	}
-	unsigned char *m_pCommandBuffer;
-	int m_nSize;
+
+	if ( nPool < 0 )
+	{
+		pBlock = (InstanceDataBlockHeader_t *)malloc( nBlockSize );
+	}
+
+	pBlock->m_nPool = nPool;
+	return pBlock + 1;
+}
+
+void CPerInstanceContextData::operator delete( void *pMem )
+{
+	if ( !pMem )
+		return;
+
+	InstanceDataBlockHeader_t *pBlock = (InstanceDataBlockHeader_t *)pMem - 1;
+	if ( pBlock->m_nPool < 0 )
+	{
+		free( pBlock );
+
+		AUTO_LOCK( s_InstanceDataPoolMutex );
+		--s_nOversizeInstanceDataCount;
+		return;
+	}
+
+	AUTO_LOCK( s_InstanceDataPoolMutex );
+	s_pInstanceDataPools[pBlock->m_nPool]->Free( pBlock );
+}
+
+void CPerInstanceContextData::operator delete( void *pMem, int nCapacity )
+{
+	CPerInstanceContextData::operator delete( pMem );
+}
+
+// Placement new doesn't survive the memdbgon new macro
+#include "tier0/memdbgoff.h"
+
+CPerInstanceContextData *CPerInstanceContextData::Create( int nCapacity )
+{
+	return new( nCapacity ) CPerInstanceContextData( nCapacity );
+}
+
+#include "tier0/memdbgon.h"
+
+CON_COMMAND( mat_pbr_instancedata_stats, "Print occupancy of the per-instance command buffer pools." )
+{
+	AUTO_LOCK( s_InstanceDataPoolMutex );
+
+	for ( int i = 0; i < ARRAYSIZE( s_pInstanceDataPools ); ++i )
+	{
+		const CUtlMemoryPool *pPool = s_pInstanceDataPools[i];
+		Msg( "%5d byte blocks: %6d in use, %6d peak, %8d bytes reserved\n",
+			pPool->BlockSize(), pPool->Count(), pPool->PeakCount(), pPool->Size() );
+	}
+	Msg( "oversize blocks:  %6d in use\n", s_nOversizeInstanceDataCount );
+}
+
+
+//-----------------------------------------------------------------------------
+// The DrawElements in flight on one thread. DrawElements keeps it on its
+// stack and s_pDrawContext points at it, so a snapshot taken on one thread
+// and a draw made on another don't share their passes or command buffers.
+//-----------------------------------------------------------------------------
+struct ShaderDrawContext_t
+{
+	int m_nPassCount;
+	int m_nModulationFlags;
+	CPerInstanceContextData **m_pInstanceDataPtr;
+	unsigned int m_nDrawStatsKey;
+
+	bool m_bBuildingInstanceCommandBuffer;
+	CInstanceCommandBufferBuilder< CFixedCommandStorageBuffer< 512 > > m_InstanceCommandBuffer;
+
+	// Draw stream recording (mat_pbr_drawstream). The textures bound since
+	// the last Draw are collected per sampler and recorded along with the
+	// info the shader set for the draw.
+	bool m_bRecordDrawStream;
+	bool m_bDrawStreamInfoSet;
+	uint64 m_nDrawStreamSortKey;
+	int m_nDrawStreamVertexShader;
+	int m_nDrawStreamPixelShader;
+	int m_nDrawStreamPass;
+	unsigned int m_DrawStreamSamplers[DRAW_STREAM_SAMPLER_COUNT];
 };
 
 
 //-----------------------------------------------------------------------------
 // Globals
 //-----------------------------------------------------------------------------
-const char *CBaseShader::s_pTextureGroupName = NULL;
-IMaterialVar **CBaseShader::s_ppParams;
-IShaderShadow *CBaseShader::s_pShaderShadow;
-IShaderDynamicAPI *CBaseShader::s_pShaderAPI;
-IShaderInit *CBaseShader::s_pShaderInit;
-int CBaseShader::s_nModulationFlags;
-int CBaseShader::s_nPassCount = 0;
-CPerInstanceContextData** CBaseShader::s_pInstanceDataPtr = NULL;
-static bool s_bBuildingInstanceCommandBuffer = false;
-static CInstanceCommandBufferBuilder< CFixedCommandStorageBuffer< 512 > > s_InstanceCommandBuffer;
+DECL_THREAD_LOCAL const char *CBaseShader::s_pTextureGroupName = NULL;
+DECL_THREAD_LOCAL IMaterialVar **CBaseShader::s_ppParams = NULL;
+DECL_THREAD_LOCAL IShaderShadow *CBaseShader::s_pShaderShadow = NULL;
+DECL_THREAD_LOCAL IShaderDynamicAPI *CBaseShader::s_pShaderAPI = NULL;
+DECL_THREAD_LOCAL IShaderInit *CBaseShader::s_pShaderInit = NULL;
+DECL_THREAD_LOCAL ShaderDrawContext_t *CBaseShader::s_pDrawContext = NULL;
 
 bool g_shaderConfigDumpEnable = false; //true;		//DO NOT CHECK IN ENABLED FIXME
 static ConVar mat_fullbright( "mat_fullbright","0", FCVAR_CHEAT );
-	
+
+// pTexture is NULL for standard textures
+static void RecordDrawStreamBinding( ShaderDrawContext_t *pContext, Sampler_t sampler, ITexture *pTexture, int nFrameOrTextureId )
+{
+	if ( pContext->m_bRecordDrawStream && ( (unsigned int)sampler < DRAW_STREAM_SAMPLER_COUNT ) )
+	{
+		pContext->m_DrawStreamSamplers[sampler] = pTexture ? ShaderDrawStream_TextureID( pTexture, nFrameOrTextureId ) :
+			ShaderDrawStream_StandardTextureID( nFrameOrTextureId );
+	}
+}
+
 //-----------------------------------------------------------------------------
 // constructor
 //-----------------------------------------------------------------------------
@@ -149,9 +306,33 @@ void CBaseShader::DrawElements( IMaterialVar **ppParams, int nModulationFlags,
 	s_ppParams = ppParams;
 	s_pShaderAPI = pShaderAPI;
 	s_pShaderShadow = pShaderShadow;
-	s_nModulationFlags = nModulationFlags;
-	s_pInstanceDataPtr = (CPerInstanceContextData**)( pInstanceDataPtr );
-	s_nPassCount = 0;
+
+	ShaderDrawContext_t context;
+	context.m_nPassCount = 0;
+	context.m_nModulationFlags = nModulationFlags;
+	context.m_pInstanceDataPtr = (CPerInstanceContextData**)( pInstanceDataPtr );
+	context.m_nDrawStatsKey = 0;
+	context.m_bBuildingInstanceCommandBuffer = false;
+	context.m_bRecordDrawStream = !IsSnapshotting() && ShaderDrawStream_IsEnabled();
+	context.m_bDrawStreamInfoSet = false;
+	if ( context.m_bRecordDrawStream )
+	{
+		memset( context.m_DrawStreamSamplers, 0, sizeof( context.m_DrawStreamSamplers ) );
+	}
+	s_pDrawContext = &context;
+
+	if ( !IsSnapshotting() )
+	{
+		ShaderStateCache_BeginDraw();
+	}
+
+	bool bRecordDrawStats = ShaderDrawStats_IsEnabled();
+	bool bFirstSnapshot = IsSnapshotting() && ShaderStartupStats_ClaimFirstSnapshot();
+	CFastTimer drawTimer;
+	if ( bRecordDrawStats || bFirstSnapshot )
+	{
+		drawTimer.Start();
+	}
 
 	if ( IsSnapshotting() )
 	{
@@ -161,9 +342,28 @@ void CBaseShader::DrawElements( IMaterialVar **ppParams, int nModulationFlags,
 
 	OnDrawElements( ppParams, pShaderShadow, pShaderAPI, vertexCompression, pContextDataPtr );
 
-	s_pInstanceDataPtr = NULL;
-	s_nPassCount = 0;
-	s_nModulationFlags = 0;
+	if ( bRecordDrawStats || bFirstSnapshot )
+	{
+		drawTimer.End();
+	}
+
+	if ( bRecordDrawStats )
+	{
+		int nStateCallsIssued = 0, nStateCallsElided = 0;
+		if ( !IsSnapshotting() )
+		{
+			ShaderStateCache_GetDrawCounts( &nStateCallsIssued, &nStateCallsElided );
+		}
+		ShaderDrawStats_Record( GetName(), context.m_nDrawStatsKey, IsSnapshotting(), drawTimer.GetDuration(), nStateCallsIssued, nStateCallsElided );
+	}
+
+	if ( bFirstSnapshot )
+	{
+		ShaderStartupStats_Add( SHADER_STARTUP_FIRST_SNAPSHOT, drawTimer.GetDuration() );
+		ShaderStartupStats_Report();
+	}
+
+	s_pDrawContext = NULL;
 	s_ppParams = NULL;
 	s_pShaderAPI = NULL;
 	s_pShaderShadow = NULL;
@@ -221,8 +421,11 @@ void CBaseShader::SetInitialShadowState( )
 //-----------------------------------------------------------------------------
 void CBaseShader::Draw( bool bMakeActualDrawCall )
 {
+	ShaderDrawContext_t *pContext = s_pDrawContext;
+	CPerInstanceContextData **pInstanceDataPtr = pContext->m_pInstanceDataPtr;
+
 	// You forgot to call PI_EndCommandBuffer
-	Assert( !s_bBuildingInstanceCommandBuffer );
+	Assert( !pContext->m_bBuildingInstanceCommandBuffer );
 
 	if ( IsSnapshotting() )
 	{
@@ -237,7 +440,7 @@ void CBaseShader::Draw( bool bMakeActualDrawCall )
 		GetShaderSystem()->TakeSnapshot();
 
 		// Automagically add skinning + vertex lighting
-		if ( !s_pInstanceDataPtr[s_nPassCount] )
+		if ( !pInstanceDataPtr[pContext->m_nPassCount] )
 		{
 			bool bIsSkinning = CShader_IsFlag2Set( s_ppParams, MATERIAL_VAR2_SUPPORTS_HW_SKINNING );
 			bool bIsVertexLit = CShader_IsFlag2Set( s_ppParams, MATERIAL_VAR2_LIGHTING_VERTEX_LIT );
@@ -252,11 +455,18 @@ void CBaseShader::Draw( bool bMakeActualDrawCall )
 	}
 	else
 	{
-		GetShaderSystem()->DrawSnapshot( s_pInstanceDataPtr[s_nPassCount] ? 
-			s_pInstanceDataPtr[s_nPassCount]->m_pCommandBuffer : NULL, bMakeActualDrawCall );
+		GetShaderSystem()->DrawSnapshot( pInstanceDataPtr[pContext->m_nPassCount] ? 
+			pInstanceDataPtr[pContext->m_nPassCount]->m_pCommandBuffer : NULL, bMakeActualDrawCall );
+
+		if ( pContext->m_bRecordDrawStream && pContext->m_bDrawStreamInfoSet && bMakeActualDrawCall )
+		{
+			ShaderDrawStream_RecordDraw( GetName(), pContext->m_nDrawStreamSortKey, pContext->m_nDrawStreamVertexShader,
+				pContext->m_nDrawStreamPixelShader, (DrawStreamPass_t)pContext->m_nDrawStreamPass, pContext->m_DrawStreamSamplers );
+			memset( pContext->m_DrawStreamSamplers, 0, sizeof( pContext->m_DrawStreamSamplers ) );
+		}
 	}
 
-	++s_nPassCount;
+	++pContext->m_nPassCount;
 }
 
 
@@ -270,14 +480,16 @@ void CBaseShader::PI_BeginCommandBuffer()
 	// rethink in that case.
 	Assert( IsSnapshotting() );
 
-	Assert( !s_bBuildingInstanceCommandBuffer );
-	s_bBuildingInstanceCommandBuffer = true;
-	s_InstanceCommandBuffer.Reset();
+	ShaderDrawContext_t *pContext = s_pDrawContext;
+	Assert( !pContext->m_bBuildingInstanceCommandBuffer );
+	pContext->m_bBuildingInstanceCommandBuffer = true;
+	pContext->m_InstanceCommandBuffer.Reset();
 }
 
 void CBaseShader::PI_EndCommandBuffer()
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
+	ShaderDrawContext_t *pContext = s_pDrawContext;
+	Assert( pContext->m_bBuildingInstanceCommandBuffer );
 
 	// Automagically add skinning
 	if ( CShader_IsFlag2Set( s_ppParams, MATERIAL_VAR2_SUPPORTS_HW_SKINNING ) )
@@ -290,29 +502,23 @@ void CBaseShader::PI_EndCommandBuffer()
 		PI_SetVertexShaderLocalLighting();
 	}
 
-	s_bBuildingInstanceCommandBuffer = false;
-	s_InstanceCommandBuffer.End();
-	int nSize = s_InstanceCommandBuffer.Size();
+	pContext->m_bBuildingInstanceCommandBuffer = false;
+	pContext->m_InstanceCommandBuffer.End();
+	int nSize = pContext->m_InstanceCommandBuffer.Size();
 	if ( nSize > 0 )
 	{
-		CPerInstanceContextData *pContextData = s_pInstanceDataPtr[ s_nPassCount ];
-		if ( !pContextData )
+		CPerInstanceContextData *pContextData = pContext->m_pInstanceDataPtr[ pContext->m_nPassCount ];
+		if ( pContextData && ( pContextData->m_nSize < nSize ) )
 		{
-			pContextData = new CPerInstanceContextData;
-			s_pInstanceDataPtr[ s_nPassCount ] = pContextData;
+			delete pContextData;
+			pContextData = NULL;
 		}
-		unsigned char *pBuf = pContextData->m_pCommandBuffer;
-		if ( pContextData->m_nSize < nSize )
+		if ( !pContextData )
 		{
-			if ( pContextData->m_pCommandBuffer )
-			{
-				delete pContextData->m_pCommandBuffer;
-			}
-			pBuf = new unsigned char[nSize];
-			pContextData->m_pCommandBuffer = pBuf;
-			pContextData->m_nSize = nSize;
+			pContextData = CPerInstanceContextData::Create( nSize );
+			pContext->m_pInstanceDataPtr[ pContext->m_nPassCount ] = pContextData;
 		}
-		memcpy( pBuf, s_InstanceCommandBuffer.Base(), nSize );
+		memcpy( pContextData->m_pCommandBuffer, pContext->m_InstanceCommandBuffer.Base(), nSize );
 	}
 }
 
@@ -322,106 +528,116 @@ void CBaseShader::PI_EndCommandBuffer()
 //-----------------------------------------------------------------------------
 void CBaseShader::PI_SetPixelShaderAmbientLightCube( int nFirstRegister )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
-	s_InstanceCommandBuffer.SetPixelShaderAmbientLightCube( nFirstRegister );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nFirstRegister, 6 );
+	s_pDrawContext->m_InstanceCommandBuffer.SetPixelShaderAmbientLightCube( nFirstRegister );
 }
 
 void CBaseShader::PI_SetPixelShaderLocalLighting( int nFirstRegister )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
-	s_InstanceCommandBuffer.SetPixelShaderLocalLighting( nFirstRegister );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nFirstRegister, 6 );
+	s_pDrawContext->m_InstanceCommandBuffer.SetPixelShaderLocalLighting( nFirstRegister );
 }
 
 void CBaseShader::PI_SetVertexShaderAmbientLightCube( /*int nFirstRegister*/ )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
-	s_InstanceCommandBuffer.SetVertexShaderAmbientLightCube( /*nFirstRegister*/ );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	s_pDrawContext->m_InstanceCommandBuffer.SetVertexShaderAmbientLightCube( /*nFirstRegister*/ );
 }
 
 void CBaseShader::PI_SetVertexShaderLocalLighting()
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
-	s_InstanceCommandBuffer.SetVertexShaderLocalLighting( );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	s_pDrawContext->m_InstanceCommandBuffer.SetVertexShaderLocalLighting( );
 }
 
 void CBaseShader::PI_SetSkinningMatrices()
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
-	s_InstanceCommandBuffer.SetSkinningMatrices();
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	s_pDrawContext->m_InstanceCommandBuffer.SetSkinningMatrices();
 }
 
 void CBaseShader::PI_SetPixelShaderAmbientLightCubeLuminance( int nFirstRegister )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
-	s_InstanceCommandBuffer.SetPixelShaderAmbientLightCubeLuminance( nFirstRegister );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nFirstRegister, 1 );
+	s_pDrawContext->m_InstanceCommandBuffer.SetPixelShaderAmbientLightCubeLuminance( nFirstRegister );
 }
 
 void CBaseShader::PI_SetPixelShaderGlintDamping( int nFirstRegister )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
-	s_InstanceCommandBuffer.SetPixelShaderGlintDamping( nFirstRegister );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nFirstRegister, 1 );
+	s_pDrawContext->m_InstanceCommandBuffer.SetPixelShaderGlintDamping( nFirstRegister );
 }
 
 void CBaseShader::PI_SetModulationPixelShaderDynamicState_LinearColorSpace_LinearScale( int nRegister, float scale )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nRegister, 1 );
 	Vector color2( 1.0f, 1.0f, 1.0f );
 	ApplyColor2Factor( color2.Base() );
-	s_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_LinearColorSpace_LinearScale( nRegister, color2, scale );
+	s_pDrawContext->m_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_LinearColorSpace_LinearScale( nRegister, color2, scale );
 }
 
 void CBaseShader::PI_SetModulationPixelShaderDynamicState_LinearScale( int nRegister, float scale )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nRegister, 1 );
 	Vector color2( 1.0f, 1.0f, 1.0f );
 	ApplyColor2Factor( color2.Base() );
-	s_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_LinearScale( nRegister, color2, scale );
+	s_pDrawContext->m_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_LinearScale( nRegister, color2, scale );
 }
 
 void CBaseShader::PI_SetModulationPixelShaderDynamicState_LinearScale_ScaleInW( int nRegister, float scale )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nRegister, 1 );
 	Vector color2( 1.0f, 1.0f, 1.0f );
 	ApplyColor2Factor( color2.Base() );
-	s_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_LinearScale_ScaleInW( nRegister, color2, scale );
+	s_pDrawContext->m_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_LinearScale_ScaleInW( nRegister, color2, scale );
 }
 
 void CBaseShader::PI_SetModulationPixelShaderDynamicState_LinearColorSpace( int nRegister )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nRegister, 1 );
 	Vector color2( 1.0f, 1.0f, 1.0f );
 	ApplyColor2Factor( color2.Base() );
-	s_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_LinearColorSpace( nRegister, color2 );
+	s_pDrawContext->m_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_LinearColorSpace( nRegister, color2 );
 }
 
 void CBaseShader::PI_SetModulationPixelShaderDynamicState( int nRegister )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nRegister, 1 );
 	Vector color2( 1.0f, 1.0f, 1.0f );
 	ApplyColor2Factor( color2.Base() );
-	s_InstanceCommandBuffer.SetModulationPixelShaderDynamicState( nRegister, color2 );
+	s_pDrawContext->m_InstanceCommandBuffer.SetModulationPixelShaderDynamicState( nRegister, color2 );
 }
 
 void CBaseShader::PI_SetModulationVertexShaderDynamicState()
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
 	Vector color2( 1.0f, 1.0f, 1.0f );
 	ApplyColor2Factor( color2.Base() );
-	s_InstanceCommandBuffer.SetModulationVertexShaderDynamicState( VERTEX_SHADER_MODULATION_COLOR, color2 );
+	s_pDrawContext->m_InstanceCommandBuffer.SetModulationVertexShaderDynamicState( VERTEX_SHADER_MODULATION_COLOR, color2 );
 }
 
 void CBaseShader::PI_SetModulationVertexShaderDynamicState_LinearScale( float flScale )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
 	Vector color2( 1.0f, 1.0f, 1.0f );
 	ApplyColor2Factor( color2.Base() );
-	s_InstanceCommandBuffer.SetModulationVertexShaderDynamicState_LinearScale( VERTEX_SHADER_MODULATION_COLOR, color2, flScale );
+	s_pDrawContext->m_InstanceCommandBuffer.SetModulationVertexShaderDynamicState_LinearScale( VERTEX_SHADER_MODULATION_COLOR, color2, flScale );
 }
 
 void CBaseShader::PI_SetModulationPixelShaderDynamicState_Identity( int nRegister )
 {
-	Assert( s_bBuildingInstanceCommandBuffer );
-	s_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_Identity( nRegister );
+	Assert( s_pDrawContext->m_bBuildingInstanceCommandBuffer );
+	ShaderStateCache_ExcludePixelShaderConstants( nRegister, 1 );
+	s_pDrawContext->m_InstanceCommandBuffer.SetModulationPixelShaderDynamicState_Identity( nRegister );
 }
 
 //-----------------------------------------------------------------------------
@@ -535,6 +751,30 @@ ShaderAPITextureHandle_t CBaseShader::GetShaderAPITextureBindHandle( ITexture *p
 	return GetShaderSystem()->GetShaderAPITextureBindHandle( pTexture, nFrame, nTextureChannel );
 }
 
+//-----------------------------------------------------------------------------
+// Sets the key this draw is grouped under in the draw stats
+//-----------------------------------------------------------------------------
+void CBaseShader::SetDrawStatsKey( unsigned int nKey )
+{
+	s_pDrawContext->m_nDrawStatsKey = nKey;
+}
+
+//-----------------------------------------------------------------------------
+// Identifies the passes of this draw in the draw stream recording
+//-----------------------------------------------------------------------------
+void CBaseShader::SetDrawStreamInfo( uint64 nSortKey, int nVertexShader, int nPixelShader, int nPass )
+{
+	Assert( !IsSnapshotting() );
+
+	ShaderDrawContext_t *pContext = s_pDrawContext;
+	pContext->m_nDrawStreamSortKey = nSortKey;
+	pContext->m_nDrawStreamVertexShader = nVertexShader;
+	pContext->m_nDrawStreamPixelShader = nPixelShader;
+	pContext->m_nDrawStreamPass = nPass;
+	pContext->m_bDrawStreamInfoSet = true;
+}
+
+
 //-----------------------------------------------------------------------------
 // Four different flavors of BindTexture(), handling the two-sampler
 // case as well as ITexture* versus textureVar forms
@@ -560,10 +800,16 @@ void CBaseShader::BindTexture( Sampler_t sampler1, Sampler_t sampler2, int nText
 
 		if ( sampler2 == -1 )
 		{
+			RecordDrawStreamBinding( s_pDrawContext, sampler1, pTextureVar->GetTextureValue(), nFrame );
+			ShaderStateCache_BindTexture( sampler1 );
 			GetShaderSystem()->BindTexture( sampler1, pTextureVar->GetTextureValue(), nFrame );
 		}
 		else
 		{
+			RecordDrawStreamBinding( s_pDrawContext, sampler1, pTextureVar->GetTextureValue(), nFrame );
+			ShaderStateCache_BindTexture( sampler1 );
+			ShaderStateCache_BindTexture( sampler2 );
+			RecordDrawStreamBinding( s_pDrawContext, sampler2, pTextureVar->GetTextureValue(), nFrame );
 			GetShaderSystem()->BindTexture( sampler1, sampler2, pTextureVar->GetTextureValue(), nFrame );
 		}
 	}
@@ -581,15 +827,37 @@ void CBaseShader::BindTexture( Sampler_t sampler1, Sampler_t sampler2, ITexture
 
 	if ( sampler2 == -1 )
 	{
+		RecordDrawStreamBinding( s_pDrawContext, sampler1, pTexture, nFrame );
+		ShaderStateCache_BindTexture( sampler1 );
 		GetShaderSystem()->BindTexture( sampler1, pTexture, nFrame );
 	}
 	else
 	{
+		RecordDrawStreamBinding( s_pDrawContext, sampler1, pTexture, nFrame );
+		ShaderStateCache_BindTexture( sampler1 );
+		ShaderStateCache_BindTexture( sampler2 );
+		RecordDrawStreamBinding( s_pDrawContext, sampler2, pTexture, nFrame );
 		GetShaderSystem()->BindTexture( sampler1, sampler2, pTexture, nFrame );
 	}
 }
 
 
+//-----------------------------------------------------------------------------
+// Binds a standard texture, recording it for mat_pbr_drawstream, unless an
+// earlier draw this frame left it bound
+//-----------------------------------------------------------------------------
+void CBaseShader::BindStandardTexture( Sampler_t sampler, StandardTextureId_t nTextureId )
+{
+	Assert( !IsSnapshotting() );
+
+	RecordDrawStreamBinding( s_pDrawContext, sampler, NULL, nTextureId );
+	if ( ShaderStateCache_BindStandardTexture( sampler, nTextureId ) )
+	{
+		s_pShaderAPI->BindStandardTexture( sampler, nTextureId );
+	}
+}
+
+
 //-----------------------------------------------------------------------------
 // Does the texture store translucency in its alpha channel?
 //-----------------------------------------------------------------------------
@@ -646,7 +914,7 @@ bool CBaseShader::TextureIsTranslucent( int textureVar, bool isBaseTexture )
 //-----------------------------------------------------------------------------
 bool CBaseShader::IsAlphaModulating()
 {
-	return (s_nModulationFlags & SHADER_USING_ALPHA_MODULATION) != 0;
+	return (s_pDrawContext->m_nModulationFlags & SHADER_USING_ALPHA_MODULATION) != 0;
 }
 // FIXME: Figure out a better way to do this?
 //-----------------------------------------------------------------------------
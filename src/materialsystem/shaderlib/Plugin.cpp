@@ -5,12 +5,18 @@
 
 #include "materialsystem/ishadersystem.h"
 
+#include "shaderlib_combousage.h"
+#include "shaderlib_drawstream.h"
+#include "shaderlib_statecache.h"
+#include "shaderlib_startupstats.h"
+#include "stdshaders/pbr_envambient.h"
+
 #include <Windows.h>
 
 class CPlugin_ShaderPBR : public IServerPluginCallbacks
 {
 	bool Load( CreateInterfaceFn interfaceFactory, CreateInterfaceFn gameServerFactory ) override;
-	void Unload( void ) override {}
+	void Unload( void ) override;
 	void Pause( void ) override {}
 	void UnPause( void ) override {}
 	const char* GetPluginDescription( void ) override { return "ZMR PBR Shader"; }
@@ -38,14 +44,47 @@ bool CPlugin_ShaderPBR::Load( CreateInterfaceFn interfaceFactory, CreateInterfac
 {
 	ConColorMsg( Color( 255, 255, 255, 255 ), "[ZMR PBR Shader] Loading...\n" ); 
 
-	materials = ( IMaterialSystem* )interfaceFactory( MATERIAL_SYSTEM_INTERFACE_VERSION, NULL );
+	ShaderStartupStats_MarkLoadStart();
+	CFastTimer loadTimer;
+	loadTimer.Start();
+
+	{
+		CShaderStartupScope startupScope( SHADER_STARTUP_INTERFACE_LOOKUP );
+		materials = ( IMaterialSystem* )interfaceFactory( MATERIAL_SYSTEM_INTERFACE_VERSION, NULL );
+		// For reading cubemaps off disk (pbr_envambient)
+		g_pFullFileSystem = ( IFileSystem* )interfaceFactory( FILESYSTEM_INTERFACE_VERSION, NULL );
+	}
 
 	if ( !LoadShaders() )
 		return false;
 
+	// Frame boundaries for mat_pbr_drawstream
+	materials->AddEndFrameCleanupFunc( ShaderDrawStream_EndFrame );
+	// and for the mat_pbr_statecache, which only trusts state set within a frame
+	materials->AddEndFrameCleanupFunc( ShaderStateCache_EndFrame );
+	// Cubemap reads queued by $useenvambient draws
+	materials->AddEndFrameCleanupFunc( PBR_UpdateEnvAmbientCubes );
+
+	loadTimer.End();
+	ShaderStartupStats_Add( SHADER_STARTUP_PLUGIN_LOAD, loadTimer.GetDuration() );
+	ShaderStartupStats_Report();
+
 	return true;
 }
 
+void CPlugin_ShaderPBR::Unload( void )
+{
+	// Leave the mat_pbr_combousage histogram behind for the offline SKIP tooling
+	ShaderComboUsage_WriteDefaultFile();
+
+	// and the mat_pbr_drawstream recording for drawsort
+	materials->RemoveEndFrameCleanupFunc( ShaderDrawStream_EndFrame );
+	ShaderDrawStream_WriteDefaultFile();
+
+	materials->RemoveEndFrameCleanupFunc( PBR_UpdateEnvAmbientCubes );
+	materials->RemoveEndFrameCleanupFunc( ShaderStateCache_EndFrame );
+}
+
 HMODULE g_hModule = NULL;
 
 class CShaderSystem : public IShaderSystemInternal
@@ -56,13 +95,20 @@ public:
 
 bool CPlugin_ShaderPBR::LoadShaders()
 {
-	CShaderSystem* pShaderSystem = dynamic_cast< CShaderSystem* >(
-		static_cast< IShaderSystem* >( materials->QueryInterface( SHADERSYSTEM_INTERFACE_VERSION ) ) );
+	CShaderSystem* pShaderSystem;
+	{
+		CShaderStartupScope startupScope( SHADER_STARTUP_INTERFACE_LOOKUP );
+		pShaderSystem = dynamic_cast< CShaderSystem* >(
+			static_cast< IShaderSystem* >( materials->QueryInterface( SHADERSYSTEM_INTERFACE_VERSION ) ) );
+	}
 
 	char szFileName[MAX_PATH];
 	GetModuleFileName( g_hModule, szFileName, sizeof( szFileName ) );
 
-	pShaderSystem->LoadShaderDLL( szFileName, "GAME", true );
+	{
+		CShaderStartupScope startupScope( SHADER_STARTUP_LOAD_SHADER_DLL );
+		pShaderSystem->LoadShaderDLL( szFileName, "GAME", true );
+	}
 
 	return true;
 }
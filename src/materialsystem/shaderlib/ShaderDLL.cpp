@@ -14,6 +14,7 @@
 #include "IShaderSystem.h"
 #include "materialsystem/ishaderapi.h"
 #include "shaderlib_cvar.h"
+#include "shaderlib_startupstats.h"
 #include "mathlib/mathlib.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -40,6 +41,9 @@ public:
 
 private:
 	CUtlVector< IShader * >	m_ShaderList;
+
+	// Started when the first shader's global constructor creates us
+	CFastTimer m_RegistrationTimer;
 };
 
 
@@ -95,6 +99,7 @@ EXPOSE_INTERFACE_FN( (InstantiateInterfaceFn)GetShaderDLLInternal, IShaderDLLInt
 //-----------------------------------------------------------------------------
 CShaderDLL::CShaderDLL()
 {
+	m_RegistrationTimer.Start();
 	MathLib_Init( 2.2f, 2.2f, 0.0f, 2.0f );
 }
 
@@ -110,8 +115,14 @@ bool CShaderDLL::Connect( CreateInterfaceFn factory, bool bIsMaterialSystem )
 
 	if ( !bIsMaterialSystem )
 	{
-		ConnectTier1Libraries( &factory, 1 );
-  		InitShaderLibCVars( factory );
+		{
+			CShaderStartupScope startupScope( SHADER_STARTUP_TIER1_CONNECT );
+			ConnectTier1Libraries( &factory, 1 );
+		}
+		{
+			CShaderStartupScope startupScope( SHADER_STARTUP_CVAR_REGISTRATION );
+			InitShaderLibCVars( factory );
+		}
 	}
 
 	return ( g_pConfig != NULL ) && (g_pHardwareConfig != NULL) && ( g_pSLShaderSystem != NULL );
@@ -165,5 +176,8 @@ void CShaderDLL::InsertShader( IShader *pShader )
 {
 	Assert( pShader );
 	m_ShaderList.AddToTail( pShader );
+
+	// Shaders register from global constructors, so the last call ends the span
+	ShaderStartupStats_SetSpan( SHADER_STARTUP_REGISTRATION, m_RegistrationTimer.GetDurationInProgress(), m_ShaderList.Count() );
 }
 
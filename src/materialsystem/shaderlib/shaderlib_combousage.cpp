@@ -0,0 +1,148 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Records which static and dynamic shader combos are used, so SKIP
+//			rules can be written from real sessions.
+//
+// The file written on plugin unload (or by mat_pbr_combousage_dump) has one
+// header line followed by one line per combo:
+//
+//	shader <TAB> pass <TAB> static <TAB> dynamic <TAB> count
+//
+// pass is "snapshot" (dynamic is -1, count is the number of state snapshots
+// taken with that static combo) or "draw" (count is the number of dynamic
+// passes drawn with that static/dynamic pair). Indices are the values the
+// generated .inc GetIndex() returned.
+//
+//===========================================================================//
+
+#include "shaderlib_combousage.h"
+#include "tier0/dbg.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlmap.h"
+#include "tier1/strtools.h"
+#include "convar.h"
+#include <stdio.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static ConVar mat_pbr_combousage( "mat_pbr_combousage", "0", 0, "Count the shader combos used by each draw. The histogram is written to mat_pbr_combousage_file on unload." );
+static ConVar mat_pbr_combousage_file( "mat_pbr_combousage_file", "pbr_combo_usage.txt", 0, "File the mat_pbr_combousage histogram is written to." );
+
+
+//-----------------------------------------------------------------------------
+// One entry per shader, static and dynamic index
+//-----------------------------------------------------------------------------
+struct ComboUsageKey_t
+{
+	const char *m_pShaderName;
+	int m_nStaticIndex;
+	int m_nDynamicIndex;	// -1 for snapshots
+};
+
+static bool ComboUsageKeyLessFunc( const ComboUsageKey_t &lhs, const ComboUsageKey_t &rhs )
+{
+	int nCmp = V_strcmp( lhs.m_pShaderName, rhs.m_pShaderName );
+	if ( nCmp != 0 )
+		return nCmp < 0;
+	if ( lhs.m_nStaticIndex != rhs.m_nStaticIndex )
+		return lhs.m_nStaticIndex < rhs.m_nStaticIndex;
+	return lhs.m_nDynamicIndex < rhs.m_nDynamicIndex;
+}
+
+// Snapshots and draws can come from several threads, the dump runs on the main thread
+static CThreadFastMutex s_ComboUsageMutex;
+static CUtlMap< ComboUsageKey_t, uint64 > s_ComboUsage( 0, 0, ComboUsageKeyLessFunc );
+
+
+//-----------------------------------------------------------------------------
+// Recording
+//-----------------------------------------------------------------------------
+bool ShaderComboUsage_IsEnabled()
+{
+	return mat_pbr_combousage.GetBool();
+}
+
+static void RecordCombo( const char *pShaderName, int nStaticIndex, int nDynamicIndex )
+{
+	ComboUsageKey_t key;
+	key.m_pShaderName = pShaderName;
+	key.m_nStaticIndex = nStaticIndex;
+	key.m_nDynamicIndex = nDynamicIndex;
+
+	AUTO_LOCK( s_ComboUsageMutex );
+
+	unsigned short i = s_ComboUsage.Find( key );
+	if ( i == s_ComboUsage.InvalidIndex() )
+	{
+		i = s_ComboUsage.Insert( key, 0 );
+	}
+	++s_ComboUsage[i];
+}
+
+void ShaderComboUsage_RecordSnapshot( const char *pShaderName, int nStaticIndex )
+{
+	RecordCombo( pShaderName, nStaticIndex, -1 );
+}
+
+void ShaderComboUsage_RecordDraw( const char *pShaderName, int nStaticIndex, int nDynamicIndex )
+{
+	RecordCombo( pShaderName, nStaticIndex, nDynamicIndex );
+}
+
+void ShaderComboUsage_Reset()
+{
+	AUTO_LOCK( s_ComboUsageMutex );
+	s_ComboUsage.RemoveAll();
+}
+
+
+//-----------------------------------------------------------------------------
+// Reporting
+//-----------------------------------------------------------------------------
+bool ShaderComboUsage_WriteFile( const char *pFileName )
+{
+	AUTO_LOCK( s_ComboUsageMutex );
+
+	if ( s_ComboUsage.Count() == 0 )
+		return false;
+
+	FILE *fp = fopen( pFileName, "wt" );
+	if ( !fp )
+	{
+		Warning( "Unable to write shader combo usage to %s\n", pFileName );
+		return false;
+	}
+
+	fprintf( fp, "shader\tpass\tstatic\tdynamic\tcount\n" );
+	for ( unsigned short i = s_ComboUsage.FirstInorder(); i != s_ComboUsage.InvalidIndex(); i = s_ComboUsage.NextInorder( i ) )
+	{
+		const ComboUsageKey_t &key = s_ComboUsage.Key( i );
+		fprintf( fp, "%s\t%s\t%d\t%d\t%llu\n", key.m_pShaderName, key.m_nDynamicIndex < 0 ? "snapshot" : "draw",
+			key.m_nStaticIndex, key.m_nDynamicIndex, (unsigned long long)s_ComboUsage[i] );
+	}
+
+	fclose( fp );
+
+	Msg( "Wrote %d shader combo usage entries to %s\n", s_ComboUsage.Count(), pFileName );
+	return true;
+}
+
+void ShaderComboUsage_WriteDefaultFile()
+{
+	ShaderComboUsage_WriteFile( mat_pbr_combousage_file.GetString() );
+}
+
+CON_COMMAND( mat_pbr_combousage_dump, "Write the combos recorded while mat_pbr_combousage is enabled. Optional argument: file name." )
+{
+	const char *pFileName = ( args.ArgC() > 1 ) ? args[1] : mat_pbr_combousage_file.GetString();
+	if ( !ShaderComboUsage_WriteFile( pFileName ) )
+	{
+		Msg( "No shader combo usage recorded%s.\n", mat_pbr_combousage.GetBool() ? "" : " (mat_pbr_combousage is 0)" );
+	}
+}
+
+CON_COMMAND( mat_pbr_combousage_reset, "Clear the combos recorded by mat_pbr_combousage." )
+{
+	ShaderComboUsage_Reset();
+}
@@ -0,0 +1,32 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Records which static and dynamic shader combos are used, so SKIP
+//			rules can be written from real sessions. Enabled with
+//			mat_pbr_combousage.
+//
+//===========================================================================//
+
+#ifndef SHADERLIB_COMBOUSAGE_H
+#define SHADERLIB_COMBOUSAGE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+bool ShaderComboUsage_IsEnabled();
+
+// pShaderName must stay valid for the lifetime of the DLL (use the .fxc name literal).
+// A snapshot records the static combo once per state snapshot; a draw records the
+// static and dynamic combo pair used by one dynamic pass.
+void ShaderComboUsage_RecordSnapshot( const char *pShaderName, int nStaticIndex );
+void ShaderComboUsage_RecordDraw( const char *pShaderName, int nStaticIndex, int nDynamicIndex );
+
+void ShaderComboUsage_Reset();
+
+// Writes the histogram as tab separated text, one combo per line. Does nothing
+// if nothing was recorded.
+bool ShaderComboUsage_WriteFile( const char *pFileName );
+void ShaderComboUsage_WriteDefaultFile();
+
+
+#endif // SHADERLIB_COMBOUSAGE_H
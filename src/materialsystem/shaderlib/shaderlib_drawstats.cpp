@@ -0,0 +1,163 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: CPU timing of CBaseShader::DrawElements, grouped by shader and
+//			by a shader-defined feature key.
+//
+//===========================================================================//
+
+#include "shaderlib_drawstats.h"
+#include "tier0/dbg.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlmap.h"
+#include "convar.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static ConVar mat_pbr_drawstats( "mat_pbr_drawstats", "0", 0, "Record the CPU time spent in shader DrawElements. Use mat_pbr_drawstats_dump to print the results." );
+
+
+//-----------------------------------------------------------------------------
+// One entry per shader and feature key
+//-----------------------------------------------------------------------------
+struct DrawStatsKey_t
+{
+	const char *m_pShaderName;
+	unsigned int m_nKey;
+};
+
+struct DrawStatsPass_t
+{
+	int m_nCount;
+	uint64 m_nTotalCycles;
+	uint64 m_nMinCycles;
+	uint64 m_nMaxCycles;
+	uint64 m_nStateCallsIssued;
+	uint64 m_nStateCallsElided;
+};
+
+struct DrawStatsEntry_t
+{
+	DrawStatsPass_t m_Snapshot;
+	DrawStatsPass_t m_Dynamic;
+};
+
+static bool DrawStatsKeyLessFunc( const DrawStatsKey_t &lhs, const DrawStatsKey_t &rhs )
+{
+	if ( lhs.m_pShaderName != rhs.m_pShaderName )
+		return lhs.m_pShaderName < rhs.m_pShaderName;
+	return lhs.m_nKey < rhs.m_nKey;
+}
+
+// Draws happen on the material system thread, the dump command runs on the main thread
+static CThreadFastMutex s_DrawStatsMutex;
+static CUtlMap< DrawStatsKey_t, DrawStatsEntry_t > s_DrawStats( 0, 0, DrawStatsKeyLessFunc );
+
+
+//-----------------------------------------------------------------------------
+// Recording
+//-----------------------------------------------------------------------------
+bool ShaderDrawStats_IsEnabled()
+{
+	return mat_pbr_drawstats.GetBool();
+}
+
+static void AccumulatePass( DrawStatsPass_t &pass, uint64 nCycles, int nStateCallsIssued, int nStateCallsElided )
+{
+	if ( pass.m_nCount == 0 || nCycles < pass.m_nMinCycles )
+	{
+		pass.m_nMinCycles = nCycles;
+	}
+	if ( pass.m_nCount == 0 || nCycles > pass.m_nMaxCycles )
+	{
+		pass.m_nMaxCycles = nCycles;
+	}
+	pass.m_nTotalCycles += nCycles;
+	pass.m_nStateCallsIssued += nStateCallsIssued;
+	pass.m_nStateCallsElided += nStateCallsElided;
+	++pass.m_nCount;
+}
+
+void ShaderDrawStats_Record( const char *pShaderName, unsigned int nKey, bool bSnapshot, const CCycleCount &duration,
+							 int nStateCallsIssued, int nStateCallsElided )
+{
+	DrawStatsKey_t key;
+	key.m_pShaderName = pShaderName;
+	key.m_nKey = nKey;
+
+	AUTO_LOCK( s_DrawStatsMutex );
+
+	unsigned short i = s_DrawStats.Find( key );
+	if ( i == s_DrawStats.InvalidIndex() )
+	{
+		DrawStatsEntry_t entry;
+		memset( &entry, 0, sizeof( entry ) );
+		i = s_DrawStats.Insert( key, entry );
+	}
+
+	DrawStatsEntry_t &entry = s_DrawStats[i];
+	AccumulatePass( bSnapshot ? entry.m_Snapshot : entry.m_Dynamic, duration.GetLongCycles(), nStateCallsIssued, nStateCallsElided );
+}
+
+void ShaderDrawStats_Reset()
+{
+	AUTO_LOCK( s_DrawStatsMutex );
+	s_DrawStats.RemoveAll();
+}
+
+
+//-----------------------------------------------------------------------------
+// Reporting
+//-----------------------------------------------------------------------------
+static double CyclesToNanoseconds( uint64 nCycles )
+{
+	CCycleCount count( nCycles );
+	return count.GetMicrosecondsF() * 1000.0;
+}
+
+static void PrintPass( const char *pPassName, const DrawStatsPass_t &pass )
+{
+	if ( pass.m_nCount == 0 )
+		return;
+
+	Msg( "    %-8s %8d draws  %10.0f ns/draw  (min %.0f, max %.0f)\n", pPassName, pass.m_nCount,
+		CyclesToNanoseconds( pass.m_nTotalCycles ) / pass.m_nCount,
+		CyclesToNanoseconds( pass.m_nMinCycles ), CyclesToNanoseconds( pass.m_nMaxCycles ) );
+
+	if ( pass.m_nStateCallsIssued || pass.m_nStateCallsElided )
+	{
+		Msg( "             %.1f state calls issued/draw, %.1f elided/draw\n",
+			(double)pass.m_nStateCallsIssued / pass.m_nCount, (double)pass.m_nStateCallsElided / pass.m_nCount );
+	}
+}
+
+void ShaderDrawStats_Dump()
+{
+	AUTO_LOCK( s_DrawStatsMutex );
+
+	if ( s_DrawStats.Count() == 0 )
+	{
+		Msg( "No shader draw stats recorded%s.\n", mat_pbr_drawstats.GetBool() ? "" : " (mat_pbr_drawstats is 0)" );
+		return;
+	}
+
+	for ( unsigned short i = s_DrawStats.FirstInorder(); i != s_DrawStats.InvalidIndex(); i = s_DrawStats.NextInorder( i ) )
+	{
+		const DrawStatsKey_t &key = s_DrawStats.Key( i );
+		const DrawStatsEntry_t &entry = s_DrawStats[i];
+
+		Msg( "%s [features 0x%08x]\n", key.m_pShaderName, key.m_nKey );
+		PrintPass( "snapshot", entry.m_Snapshot );
+		PrintPass( "dynamic", entry.m_Dynamic );
+	}
+}
+
+CON_COMMAND( mat_pbr_drawstats_dump, "Print the DrawElements timings recorded while mat_pbr_drawstats is enabled." )
+{
+	ShaderDrawStats_Dump();
+}
+
+CON_COMMAND( mat_pbr_drawstats_reset, "Clear the DrawElements timings recorded by mat_pbr_drawstats." )
+{
+	ShaderDrawStats_Reset();
+}
@@ -0,0 +1,30 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: CPU timing of CBaseShader::DrawElements, grouped by shader and
+//			by a shader-defined feature key. Enabled with mat_pbr_drawstats.
+//
+//===========================================================================//
+
+#ifndef SHADERLIB_DRAWSTATS_H
+#define SHADERLIB_DRAWSTATS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/fasttimer.h"
+
+
+bool ShaderDrawStats_IsEnabled();
+
+// pShaderName must stay valid for the lifetime of the DLL (IShader::GetName is).
+// The call counts are the texture binds and constant uploads that went through
+// the state cache (shaderlib_statecache.h), split into those passed on to the
+// shader API and those it dropped.
+void ShaderDrawStats_Record( const char *pShaderName, unsigned int nKey, bool bSnapshot, const CCycleCount &duration,
+							 int nStateCallsIssued, int nStateCallsElided );
+
+void ShaderDrawStats_Reset();
+void ShaderDrawStats_Dump();
+
+
+#endif // SHADERLIB_DRAWSTATS_H
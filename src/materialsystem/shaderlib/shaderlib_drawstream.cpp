@@ -0,0 +1,190 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Records the stream of dynamic passes drawn by the shaders that
+//			identify their draws, so draw orders can be compared offline.
+//
+// The file written on plugin unload (or by mat_pbr_drawstream_dump) has one
+// header line followed by one line per pass, in draw order:
+//
+//	frame <TAB> shader <TAB> pass <TAB> vs <TAB> ps <TAB> sortkey <TAB> s0 ... s15
+//
+// pass is "opaque", "flashlight" or "translucent". vs and ps are the full
+// combo indices of the shaders used. sortkey is the shader's material sort
+// key in hex, and s0 to s15 are the ids of the textures the pass bound to each
+// sampler, in hex, 0 for samplers it left alone.
+//
+// Frames are counted by the material system's end frame callback, which runs
+// on the main thread; with queued rendering the boundaries can be a few
+// passes off.
+//
+//===========================================================================//
+
+#include "shaderlib_drawstream.h"
+#include "tier0/dbg.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlvector.h"
+#include "tier1/generichash.h"
+#include "materialsystem/itexture.h"
+#include "convar.h"
+#include <stdio.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static ConVar mat_pbr_drawstream( "mat_pbr_drawstream", "0", 0, "Record the passes drawn by the PBR shader and the textures they bind. The stream is written to mat_pbr_drawstream_file on unload." );
+static ConVar mat_pbr_drawstream_file( "mat_pbr_drawstream_file", "pbr_draw_stream.txt", 0, "File the mat_pbr_drawstream recording is written to." );
+static ConVar mat_pbr_drawstream_maxdraws( "mat_pbr_drawstream_maxdraws", "500000", 0, "Stop mat_pbr_drawstream recording after this many passes." );
+
+
+struct DrawStreamRecord_t
+{
+	const char *m_pShaderName;
+	uint64 m_nSortKey;
+	unsigned int m_nFrame;
+	int m_nVertexShader;
+	int m_nPixelShader;
+	DrawStreamPass_t m_nPass;
+	unsigned int m_Samplers[DRAW_STREAM_SAMPLER_COUNT];
+};
+
+// Passes are drawn on the material system thread, frames end and the dump runs on the main thread
+static CThreadFastMutex s_DrawStreamMutex;
+static CUtlVector< DrawStreamRecord_t > s_DrawStream;
+static CInterlockedUInt s_nDrawStreamFrame;
+static bool s_bDrawStreamFull = false;
+
+
+//-----------------------------------------------------------------------------
+// Texture ids
+//-----------------------------------------------------------------------------
+unsigned int ShaderDrawStream_TextureID( ITexture *pTexture, int nFrame )
+{
+	if ( !pTexture )
+		return 0;
+
+	unsigned int nID = ( HashStringCaseless( pTexture->GetName() ) + (unsigned int)nFrame * 0x9E3779B1 ) & 0x7FFFFFFF;
+	return nID ? nID : 1;
+}
+
+unsigned int ShaderDrawStream_StandardTextureID( int nTextureId )
+{
+	return 0x80000000 | (unsigned int)nTextureId;
+}
+
+
+//-----------------------------------------------------------------------------
+// Recording
+//-----------------------------------------------------------------------------
+bool ShaderDrawStream_IsEnabled()
+{
+	return mat_pbr_drawstream.GetBool();
+}
+
+void ShaderDrawStream_RecordDraw( const char *pShaderName, uint64 nSortKey, int nVertexShader, int nPixelShader,
+								  DrawStreamPass_t nPass, const unsigned int *pSamplers )
+{
+	AUTO_LOCK( s_DrawStreamMutex );
+
+	if ( s_DrawStream.Count() >= mat_pbr_drawstream_maxdraws.GetInt() )
+	{
+		if ( !s_bDrawStreamFull )
+		{
+			Warning( "mat_pbr_drawstream: recorded %d passes, not recording any more\n", s_DrawStream.Count() );
+			s_bDrawStreamFull = true;
+		}
+		return;
+	}
+
+	DrawStreamRecord_t &record = s_DrawStream[s_DrawStream.AddToTail()];
+	record.m_pShaderName = pShaderName;
+	record.m_nSortKey = nSortKey;
+	record.m_nFrame = s_nDrawStreamFrame;
+	record.m_nVertexShader = nVertexShader;
+	record.m_nPixelShader = nPixelShader;
+	record.m_nPass = nPass;
+	memcpy( record.m_Samplers, pSamplers, sizeof( record.m_Samplers ) );
+}
+
+void ShaderDrawStream_EndFrame()
+{
+	++s_nDrawStreamFrame;
+}
+
+void ShaderDrawStream_Reset()
+{
+	AUTO_LOCK( s_DrawStreamMutex );
+	s_DrawStream.Purge();
+	s_bDrawStreamFull = false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Reporting
+//-----------------------------------------------------------------------------
+static const char *s_pDrawStreamPassNames[] =
+{
+	"opaque",
+	"flashlight",
+	"translucent",
+};
+
+bool ShaderDrawStream_WriteFile( const char *pFileName )
+{
+	AUTO_LOCK( s_DrawStreamMutex );
+
+	if ( s_DrawStream.Count() == 0 )
+		return false;
+
+	FILE *fp = fopen( pFileName, "wt" );
+	if ( !fp )
+	{
+		Warning( "Unable to write the shader draw stream to %s\n", pFileName );
+		return false;
+	}
+
+	fprintf( fp, "frame\tshader\tpass\tvs\tps\tsortkey" );
+	for ( int s = 0; s < DRAW_STREAM_SAMPLER_COUNT; ++s )
+	{
+		fprintf( fp, "\ts%d", s );
+	}
+	fprintf( fp, "\n" );
+
+	// Frame numbers start from 0 at the first recorded pass
+	unsigned int nFirstFrame = s_DrawStream[0].m_nFrame;
+	for ( int i = 0; i < s_DrawStream.Count(); ++i )
+	{
+		const DrawStreamRecord_t &record = s_DrawStream[i];
+		fprintf( fp, "%u\t%s\t%s\t%d\t%d\t%016llx", record.m_nFrame - nFirstFrame, record.m_pShaderName,
+			s_pDrawStreamPassNames[record.m_nPass], record.m_nVertexShader, record.m_nPixelShader,
+			(unsigned long long)record.m_nSortKey );
+		for ( int s = 0; s < DRAW_STREAM_SAMPLER_COUNT; ++s )
+		{
+			fprintf( fp, "\t%x", record.m_Samplers[s] );
+		}
+		fprintf( fp, "\n" );
+	}
+
+	fclose( fp );
+
+	Msg( "Wrote %d shader draw stream passes to %s\n", s_DrawStream.Count(), pFileName );
+	return true;
+}
+
+void ShaderDrawStream_WriteDefaultFile()
+{
+	ShaderDrawStream_WriteFile( mat_pbr_drawstream_file.GetString() );
+}
+
+CON_COMMAND( mat_pbr_drawstream_dump, "Write the passes recorded while mat_pbr_drawstream is enabled. Optional argument: file name." )
+{
+	const char *pFileName = ( args.ArgC() > 1 ) ? args[1] : mat_pbr_drawstream_file.GetString();
+	if ( !ShaderDrawStream_WriteFile( pFileName ) )
+	{
+		Msg( "No shader draw stream recorded%s.\n", mat_pbr_drawstream.GetBool() ? "" : " (mat_pbr_drawstream is 0)" );
+	}
+}
+
+CON_COMMAND( mat_pbr_drawstream_reset, "Clear the passes recorded by mat_pbr_drawstream." )
+{
+	ShaderDrawStream_Reset();
+}
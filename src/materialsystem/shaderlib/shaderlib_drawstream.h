@@ -0,0 +1,60 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Records the stream of dynamic passes drawn by the shaders that
+//			identify their draws (CBaseShader::SetDrawStreamInfo), with the
+//			textures each pass bound, so draw orders can be compared offline.
+//			Enabled with mat_pbr_drawstream.
+//
+//===========================================================================//
+
+#ifndef SHADERLIB_DRAWSTREAM_H
+#define SHADERLIB_DRAWSTREAM_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/platform.h"
+
+class ITexture;
+
+
+#define DRAW_STREAM_SAMPLER_COUNT	16
+
+//-----------------------------------------------------------------------------
+// Where a pass may be moved to. Opaque and flashlight passes can be reordered
+// among neighbours of the same kind, translucent passes stay where they are.
+//-----------------------------------------------------------------------------
+enum DrawStreamPass_t
+{
+	DRAW_STREAM_PASS_OPAQUE = 0,
+	DRAW_STREAM_PASS_FLASHLIGHT,
+	DRAW_STREAM_PASS_TRANSLUCENT,
+};
+
+bool ShaderDrawStream_IsEnabled();
+
+// Ids written to the stream for bound textures; also used by shaders to build
+// their sort keys. A texture's id is a hash of its name and frame, so it is
+// the same from one session to the next. Standard textures have the high bit
+// set; 0 means nothing was bound.
+unsigned int ShaderDrawStream_TextureID( ITexture *pTexture, int nFrame );
+unsigned int ShaderDrawStream_StandardTextureID( int nTextureId );
+
+// pShaderName must stay valid for the lifetime of the DLL (IShader::GetName is).
+// nVertexShader and nPixelShader are the full combo indices (static + dynamic).
+// pSamplers holds DRAW_STREAM_SAMPLER_COUNT texture ids.
+void ShaderDrawStream_RecordDraw( const char *pShaderName, uint64 nSortKey, int nVertexShader, int nPixelShader,
+								  DrawStreamPass_t nPass, const unsigned int *pSamplers );
+
+// Marks the end of a frame. Registered as a material system end frame callback.
+void ShaderDrawStream_EndFrame();
+
+void ShaderDrawStream_Reset();
+
+// Writes the stream as tab separated text, one pass per line. Does nothing if
+// nothing was recorded.
+bool ShaderDrawStream_WriteFile( const char *pFileName );
+void ShaderDrawStream_WriteDefaultFile();
+
+
+#endif // SHADERLIB_DRAWSTREAM_H
@@ -0,0 +1,200 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Timing of the shader DLL's startup.
+//
+// The JSON file is rewritten after the plugin load and again after the first
+// snapshot:
+//
+//	{
+//		"time": <unix time of the write>,
+//		"phases": [ { "name": "plugin_load", "ms": 12.345, "count": 1 }, ... ],
+//		"load_to_first_snapshot_ms": 1234.567
+//	}
+//
+// Phases that never ran are left out, as is load_to_first_snapshot_ms until
+// there has been a snapshot. Keep the files from several sessions to track
+// the plugin's startup impact over time.
+//
+//===========================================================================//
+
+#include "shaderlib_startupstats.h"
+#include "tier0/dbg.h"
+#include "tier0/threadtools.h"
+#include "Color.h"
+#include "convar.h"
+#include <stdio.h>
+#include <time.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static ConVar mat_pbr_startupstats_file( "mat_pbr_startupstats_file", "pbr_startup.json", 0, "File the PBR shader DLL startup timings are written to. Empty to not write them." );
+
+
+//-----------------------------------------------------------------------------
+// Plain data only: shaders register from global constructors, which can run
+// before this file's constructors.
+//-----------------------------------------------------------------------------
+struct StartupPhaseStats_t
+{
+	uint64 m_nCycles;
+	int m_nCount;
+	bool m_bReported;
+};
+
+static StartupPhaseStats_t s_StartupPhases[SHADER_STARTUP_PHASE_COUNT];
+static uint64 s_nLoadStartCycles;
+static uint64 s_nLoadToFirstSnapshotCycles;
+static bool s_bLoadStarted;
+static bool s_bFirstSnapshotDone;
+
+static CInterlockedInt s_nFirstSnapshotClaimed;
+
+// The first snapshot can be taken on the material system thread
+static CThreadFastMutex s_StartupStatsMutex;
+
+static const char *s_pStartupPhaseNames[SHADER_STARTUP_PHASE_COUNT][2] =
+{
+	{ "shader_registration",	"shader registration" },
+	{ "tier1_connect",			"tier1 connect" },
+	{ "cvar_registration",		"cvar registration" },
+	{ "interface_lookup",		"interface lookup" },
+	{ "load_shader_dll",		"LoadShaderDLL" },
+	{ "plugin_load",			"plugin load" },
+	{ "first_snapshot",			"first snapshot" },
+};
+
+
+//-----------------------------------------------------------------------------
+// Recording
+//-----------------------------------------------------------------------------
+void ShaderStartupStats_Add( ShaderStartupPhase_t nPhase, const CCycleCount &duration )
+{
+	AUTO_LOCK( s_StartupStatsMutex );
+
+	StartupPhaseStats_t &phase = s_StartupPhases[nPhase];
+	phase.m_nCycles += duration.GetLongCycles();
+	++phase.m_nCount;
+	phase.m_bReported = false;
+}
+
+void ShaderStartupStats_SetSpan( ShaderStartupPhase_t nPhase, const CCycleCount &duration, int nCount )
+{
+	StartupPhaseStats_t &phase = s_StartupPhases[nPhase];
+	phase.m_nCycles = duration.GetLongCycles();
+	phase.m_nCount = nCount;
+	phase.m_bReported = false;
+}
+
+void ShaderStartupStats_MarkLoadStart()
+{
+	CCycleCount now;
+	now.Sample();
+	s_nLoadStartCycles = now.GetLongCycles();
+	s_bLoadStarted = true;
+}
+
+bool ShaderStartupStats_ClaimFirstSnapshot()
+{
+	if ( s_nFirstSnapshotClaimed || !s_nFirstSnapshotClaimed.AssignIf( 0, 1 ) )
+		return false;
+
+	CCycleCount now;
+	now.Sample();
+
+	AUTO_LOCK( s_StartupStatsMutex );
+	if ( s_bLoadStarted )
+	{
+		s_nLoadToFirstSnapshotCycles = now.GetLongCycles() - s_nLoadStartCycles;
+	}
+	s_bFirstSnapshotDone = true;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Reporting
+//-----------------------------------------------------------------------------
+static double CyclesToMilliseconds( uint64 nCycles )
+{
+	CCycleCount count( nCycles );
+	return count.GetMillisecondsF();
+}
+
+static void WriteStartupStatsFile( const char *pFileName )
+{
+	FILE *fp = fopen( pFileName, "wt" );
+	if ( !fp )
+	{
+		Warning( "Unable to write the shader startup timings to %s\n", pFileName );
+		return;
+	}
+
+	fprintf( fp, "{\n\t\"time\": %lld,\n\t\"phases\": [", (long long)time( NULL ) );
+
+	bool bFirst = true;
+	for ( int i = 0; i < SHADER_STARTUP_PHASE_COUNT; ++i )
+	{
+		const StartupPhaseStats_t &phase = s_StartupPhases[i];
+		if ( phase.m_nCount == 0 )
+			continue;
+
+		fprintf( fp, "%s\n\t\t{ \"name\": \"%s\", \"ms\": %.3f, \"count\": %d }", bFirst ? "" : ",",
+			s_pStartupPhaseNames[i][0], CyclesToMilliseconds( phase.m_nCycles ), phase.m_nCount );
+		bFirst = false;
+	}
+	fprintf( fp, "\n\t]" );
+
+	if ( s_bFirstSnapshotDone && s_bLoadStarted )
+	{
+		fprintf( fp, ",\n\t\"load_to_first_snapshot_ms\": %.3f", CyclesToMilliseconds( s_nLoadToFirstSnapshotCycles ) );
+	}
+	fprintf( fp, "\n}\n" );
+
+	fclose( fp );
+}
+
+static void PrintStartupStats( bool bAll )
+{
+	Color clr( 255, 255, 255, 255 );
+	for ( int i = 0; i < SHADER_STARTUP_PHASE_COUNT; ++i )
+	{
+		StartupPhaseStats_t &phase = s_StartupPhases[i];
+		if ( phase.m_nCount == 0 || ( phase.m_bReported && !bAll ) )
+			continue;
+
+		if ( phase.m_nCount > 1 )
+		{
+			ConColorMsg( clr, "[ZMR PBR Shader] %-20s %9.3f ms (%d)\n", s_pStartupPhaseNames[i][1], CyclesToMilliseconds( phase.m_nCycles ), phase.m_nCount );
+		}
+		else
+		{
+			ConColorMsg( clr, "[ZMR PBR Shader] %-20s %9.3f ms\n", s_pStartupPhaseNames[i][1], CyclesToMilliseconds( phase.m_nCycles ) );
+		}
+		phase.m_bReported = true;
+
+		if ( i == SHADER_STARTUP_FIRST_SNAPSHOT && s_bLoadStarted )
+		{
+			ConColorMsg( clr, "[ZMR PBR Shader] %-20s %9.3f ms\n", "load to 1st snapshot", CyclesToMilliseconds( s_nLoadToFirstSnapshotCycles ) );
+		}
+	}
+}
+
+void ShaderStartupStats_Report()
+{
+	AUTO_LOCK( s_StartupStatsMutex );
+
+	PrintStartupStats( false );
+
+	const char *pFileName = mat_pbr_startupstats_file.GetString();
+	if ( pFileName[0] )
+	{
+		WriteStartupStatsFile( pFileName );
+	}
+}
+
+CON_COMMAND( mat_pbr_startupstats, "Print the PBR shader DLL startup timings." )
+{
+	AUTO_LOCK( s_StartupStatsMutex );
+	PrintStartupStats( true );
+}
@@ -0,0 +1,73 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Timing of the shader DLL's startup, from the shaders registering
+//			themselves in global constructors to the first material
+//			snapshot. Printed to the console and written as JSON to
+//			mat_pbr_startupstats_file.
+//
+//===========================================================================//
+
+#ifndef SHADERLIB_STARTUPSTATS_H
+#define SHADERLIB_STARTUPSTATS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier0/fasttimer.h"
+
+
+enum ShaderStartupPhase_t
+{
+	SHADER_STARTUP_REGISTRATION = 0,		// Global constructors: CShaderDLL creation to the last InsertShader
+	SHADER_STARTUP_TIER1_CONNECT,			// ConnectTier1Libraries in CShaderDLL::Connect
+	SHADER_STARTUP_CVAR_REGISTRATION,		// InitShaderLibCVars
+	SHADER_STARTUP_INTERFACE_LOOKUP,		// Plugin: material system and shader system interfaces
+	SHADER_STARTUP_LOAD_SHADER_DLL,			// Plugin: IShaderSystemInternal::LoadShaderDLL, including the connect
+	SHADER_STARTUP_PLUGIN_LOAD,				// All of CPlugin_ShaderPBR::Load
+	SHADER_STARTUP_FIRST_SNAPSHOT,			// DrawElements of the first material snapshot
+
+	SHADER_STARTUP_PHASE_COUNT
+};
+
+// Adds one timed run of a phase
+void ShaderStartupStats_Add( ShaderStartupPhase_t nPhase, const CCycleCount &duration );
+
+// Sets a phase that is measured as a growing span, with the number of steps
+// in it so far. Safe to call from global constructors.
+void ShaderStartupStats_SetSpan( ShaderStartupPhase_t nPhase, const CCycleCount &duration, int nCount );
+
+// Starts the clock the first snapshot is measured from (the plugin load)
+void ShaderStartupStats_MarkLoadStart();
+
+// True for exactly one caller, the first snapshot
+bool ShaderStartupStats_ClaimFirstSnapshot();
+
+// Prints the phases recorded since the last report with ConColorMsg and
+// rewrites the JSON file with everything recorded so far
+void ShaderStartupStats_Report();
+
+
+//-----------------------------------------------------------------------------
+// Times the enclosing scope as one run of a phase
+//-----------------------------------------------------------------------------
+class CShaderStartupScope
+{
+public:
+	CShaderStartupScope( ShaderStartupPhase_t nPhase ) : m_nPhase( nPhase )
+	{
+		m_Timer.Start();
+	}
+
+	~CShaderStartupScope()
+	{
+		m_Timer.End();
+		ShaderStartupStats_Add( m_nPhase, m_Timer.GetDuration() );
+	}
+
+private:
+	ShaderStartupPhase_t m_nPhase;
+	CFastTimer m_Timer;
+};
+
+
+#endif // SHADERLIB_STARTUPSTATS_H
@@ -0,0 +1,207 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Remembers the standard textures and shader constants the shaders
+//			in this DLL have handed to the shader API during the current
+//			frame, so dynamic passes can skip binds and uploads that would
+//			not change anything.
+//
+//===========================================================================//
+
+#include "shaderlib_statecache.h"
+#include "tier0/dbg.h"
+#include "tier0/threadtools.h"
+#include "materialsystem/IShader.h"
+#include "convar.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static ConVar mat_pbr_statecache( "mat_pbr_statecache", "1", 0, "Skip standard texture binds and shader constant uploads that repeat what an earlier PBR draw set in the same frame. "
+	"Assumes nothing else rebinds those samplers or rewrites those registers between PBR draws." );
+
+
+//-----------------------------------------------------------------------------
+// Cached state
+//-----------------------------------------------------------------------------
+// Only touched by the thread that draws. The cache is dropped at the end of
+// every frame, and whenever it is turned off, so state set by the engine and
+// by other shader DLLs at frame boundaries isn't mistaken for ours.
+#define STATE_CACHE_SAMPLER_COUNT		16
+#define STATE_CACHE_PS_CONSTANT_COUNT	64
+
+// The shader specific vertex shader constants; the engine owns the rest
+#define STATE_CACHE_VS_FIRST_CONSTANT	VERTEX_SHADER_SHADER_SPECIFIC_CONST_0
+#define STATE_CACHE_VS_CONSTANT_COUNT	( VERTEX_SHADER_MODEL - VERTEX_SHADER_SHADER_SPECIFIC_CONST_0 )
+
+struct ConstantCache_t
+{
+	float m_Values[STATE_CACHE_PS_CONSTANT_COUNT][4];
+	uint64 m_nValid;
+};
+
+static bool s_bStateCacheEnabled = false;
+static int s_StandardTextures[STATE_CACHE_SAMPLER_COUNT];		// -1 if unknown
+static ConstantCache_t s_PSConstants;
+static ConstantCache_t s_VSConstants;
+static int s_nStateCallsIssued = 0;
+static int s_nStateCallsElided = 0;
+
+static unsigned int s_nStateCacheFrame = 0;
+static CInterlockedUInt s_nStateCacheEndedFrame;
+
+// Excluded registers are added while snapshotting, which may happen on another thread
+static CThreadFastMutex s_ExcludedMutex;
+static uint64 s_nExcludedPSConstants = 0;
+static CInterlockedInt s_nExcludedGeneration;
+static int s_nStateCacheExcludedGeneration = 0;
+static uint64 s_nStateCacheExcludedPSConstants = 0;
+
+static uint64 RegisterRangeMask( int nFirstRegister, int nConstants )
+{
+	return ( ( nConstants < 64 ) ? ( ( (uint64)1 << nConstants ) - 1 ) : ~(uint64)0 ) << nFirstRegister;
+}
+
+void ShaderStateCache_Invalidate()
+{
+	for ( int i = 0; i < STATE_CACHE_SAMPLER_COUNT; ++i )
+	{
+		s_StandardTextures[i] = -1;
+	}
+	s_PSConstants.m_nValid = 0;
+	s_VSConstants.m_nValid = 0;
+}
+
+void ShaderStateCache_BeginDraw()
+{
+	s_nStateCallsIssued = 0;
+	s_nStateCallsElided = 0;
+
+	bool bEnabled = mat_pbr_statecache.GetBool();
+	unsigned int nFrame = s_nStateCacheEndedFrame;
+	if ( !bEnabled || !s_bStateCacheEnabled || ( nFrame != s_nStateCacheFrame ) )
+	{
+		ShaderStateCache_Invalidate();
+		s_nStateCacheFrame = nFrame;
+	}
+	s_bStateCacheEnabled = bEnabled;
+
+	if ( s_nExcludedGeneration != s_nStateCacheExcludedGeneration )
+	{
+		AUTO_LOCK( s_ExcludedMutex );
+		s_nStateCacheExcludedGeneration = s_nExcludedGeneration;
+		s_nStateCacheExcludedPSConstants = s_nExcludedPSConstants;
+		s_PSConstants.m_nValid &= ~s_nStateCacheExcludedPSConstants;
+	}
+}
+
+void ShaderStateCache_GetDrawCounts( int *pIssued, int *pElided )
+{
+	*pIssued = s_nStateCallsIssued;
+	*pElided = s_nStateCallsElided;
+}
+
+void ShaderStateCache_EndFrame()
+{
+	++s_nStateCacheEndedFrame;
+}
+
+
+//-----------------------------------------------------------------------------
+// Texture binds
+//-----------------------------------------------------------------------------
+bool ShaderStateCache_BindStandardTexture( Sampler_t sampler, StandardTextureId_t nTextureId )
+{
+	if ( s_bStateCacheEnabled && ( (unsigned int)sampler < STATE_CACHE_SAMPLER_COUNT ) )
+	{
+		switch ( nTextureId )
+		{
+		case TEXTURE_WHITE:
+		case TEXTURE_BLACK:
+		case TEXTURE_GREY:
+		case TEXTURE_NORMALMAP_FLAT:
+			if ( s_StandardTextures[sampler] == nTextureId )
+			{
+				++s_nStateCallsElided;
+				return false;
+			}
+			s_StandardTextures[sampler] = nTextureId;
+			break;
+
+		default:
+			// Lightmaps, the frame buffer and the like change under us
+			s_StandardTextures[sampler] = -1;
+			break;
+		}
+	}
+
+	++s_nStateCallsIssued;
+	return true;
+}
+
+void ShaderStateCache_BindTexture( Sampler_t sampler )
+{
+	if ( (unsigned int)sampler < STATE_CACHE_SAMPLER_COUNT )
+	{
+		s_StandardTextures[sampler] = -1;
+	}
+	++s_nStateCallsIssued;
+}
+
+
+//-----------------------------------------------------------------------------
+// Constants
+//-----------------------------------------------------------------------------
+// Returns false if every register in the range already holds these values
+static bool SetCachedConstants( ConstantCache_t &cache, int nFirstRegister, const float *pData, int nConstants, uint64 nExcluded )
+{
+	if ( s_bStateCacheEnabled && ( nFirstRegister >= 0 ) && ( nFirstRegister + nConstants <= STATE_CACHE_PS_CONSTANT_COUNT ) )
+	{
+		uint64 nRangeMask = RegisterRangeMask( nFirstRegister, nConstants );
+		if ( ( ( cache.m_nValid & nRangeMask ) == nRangeMask ) &&
+			 !memcmp( cache.m_Values[nFirstRegister], pData, nConstants * 4 * sizeof( float ) ) )
+		{
+			++s_nStateCallsElided;
+			return false;
+		}
+
+		memcpy( cache.m_Values[nFirstRegister], pData, nConstants * 4 * sizeof( float ) );
+		cache.m_nValid |= nRangeMask & ~nExcluded;
+	}
+
+	++s_nStateCallsIssued;
+	return true;
+}
+
+bool ShaderStateCache_SetPixelShaderConstant( int nFirstRegister, const float *pData, int nConstants )
+{
+	return SetCachedConstants( s_PSConstants, nFirstRegister, pData, nConstants, s_nStateCacheExcludedPSConstants );
+}
+
+bool ShaderStateCache_SetVertexShaderConstant( int nFirstRegister, const float *pData, int nConstants )
+{
+	COMPILE_TIME_ASSERT( STATE_CACHE_VS_CONSTANT_COUNT <= STATE_CACHE_PS_CONSTANT_COUNT );
+
+	if ( ( nFirstRegister < STATE_CACHE_VS_FIRST_CONSTANT ) ||
+		 ( nFirstRegister + nConstants > STATE_CACHE_VS_FIRST_CONSTANT + STATE_CACHE_VS_CONSTANT_COUNT ) )
+	{
+		++s_nStateCallsIssued;
+		return true;
+	}
+	return SetCachedConstants( s_VSConstants, nFirstRegister - STATE_CACHE_VS_FIRST_CONSTANT, pData, nConstants, 0 );
+}
+
+void ShaderStateCache_ExcludePixelShaderConstants( int nFirstRegister, int nConstants )
+{
+	if ( nFirstRegister < 0 || nFirstRegister >= STATE_CACHE_PS_CONSTANT_COUNT )
+		return;
+
+	nConstants = MIN( nConstants, STATE_CACHE_PS_CONSTANT_COUNT - nFirstRegister );
+	uint64 nRangeMask = RegisterRangeMask( nFirstRegister, nConstants );
+
+	AUTO_LOCK( s_ExcludedMutex );
+	if ( ( s_nExcludedPSConstants & nRangeMask ) != nRangeMask )
+	{
+		s_nExcludedPSConstants |= nRangeMask;
+		++s_nExcludedGeneration;
+	}
+}
@@ -0,0 +1,43 @@
+//===== Copyright � 1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Remembers the standard textures and shader constants the shaders
+//			in this DLL have handed to the shader API during the current
+//			frame, so dynamic passes can skip binds and uploads that would
+//			not change anything. Enabled with mat_pbr_statecache.
+//
+//===========================================================================//
+
+#ifndef SHADERLIB_STATECACHE_H
+#define SHADERLIB_STATECACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "shaderapi/ishaderdynamic.h"
+
+
+// Called at the start of every dynamic DrawElements. Starts the draw's
+// issued/elided counts and drops the cache if a frame ended since the last draw.
+void ShaderStateCache_BeginDraw();
+void ShaderStateCache_GetDrawCounts( int *pIssued, int *pElided );
+
+// Each returns false if the call can be skipped. Only the constant standard
+// textures are remembered; binding anything else to a sampler forgets it.
+// CBaseShader's binds and CBaseVSShader::FlushConstants go through these;
+// constants set straight on IShaderDynamicAPI are not seen.
+bool ShaderStateCache_BindStandardTexture( Sampler_t sampler, StandardTextureId_t nTextureId );
+void ShaderStateCache_BindTexture( Sampler_t sampler );
+bool ShaderStateCache_SetPixelShaderConstant( int nFirstRegister, const float *pData, int nConstants );
+bool ShaderStateCache_SetVertexShaderConstant( int nFirstRegister, const float *pData, int nConstants );
+
+// For registers written behind the cache's back, by command buffers. They are
+// never cached again.
+void ShaderStateCache_ExcludePixelShaderConstants( int nFirstRegister, int nConstants );
+
+void ShaderStateCache_Invalidate();
+
+// Marks the end of a frame. Registered as a material system end frame callback.
+void ShaderStateCache_EndFrame();
+
+
+#endif // SHADERLIB_STATECACHE_H
@@ -13,6 +13,7 @@
 #include "mathlib/bumpvects.h"
 #include "ConVar.h"
 #include "tier0/icommandline.h"
+#include "shaderlib/shaderlib_statecache.h"
 
 #ifdef HDR
 #include "vertexlit_and_unlit_generic_hdr_ps20.inc"
@@ -135,6 +136,69 @@ void CBaseVSShader::SetPixelShaderConstant( int pixelReg, int constantVar )
 	s_pShaderAPI->SetPixelShaderConstant( pixelReg, val );	
 }
 
+void CBaseVSShader::SetPixelShaderConstant( CShaderConstantStage &stage, int pixelReg, int constantVar )
+{
+	Assert( !IsSnapshotting() && stage.GetTarget() == SHADER_CONSTANT_TARGET_PIXEL );
+	if ((!s_ppParams) || (constantVar == -1))
+		return;
+
+	IMaterialVar* pPixelVar = s_ppParams[constantVar];
+	Assert( pPixelVar );
+
+	float *val = stage.Stage( pixelReg );
+	if (pPixelVar->GetType() == MATERIAL_VAR_TYPE_VECTOR)
+		pPixelVar->GetVecValue( val, 4 );
+	else
+		val[0] = val[1] = val[2] = val[3] = pPixelVar->GetFloatValue();
+}
+
+void CBaseVSShader::SetPixelShaderConstant_W( CShaderConstantStage &stage, int pixelReg, int constantVar, float fWValue )
+{
+	Assert( !IsSnapshotting() && stage.GetTarget() == SHADER_CONSTANT_TARGET_PIXEL );
+	if ((!s_ppParams) || (constantVar == -1))
+		return;
+
+	IMaterialVar* pPixelVar = s_ppParams[constantVar];
+	Assert( pPixelVar );
+
+	float *val = stage.Stage( pixelReg );
+	if (pPixelVar->GetType() == MATERIAL_VAR_TYPE_VECTOR)
+		pPixelVar->GetVecValue( val, 4 );
+	else
+		val[0] = val[1] = val[2] = val[3] = pPixelVar->GetFloatValue();
+	val[3]=fWValue;
+}
+
+//-----------------------------------------------------------------------------
+// Uploads the staged constants, one call per run of consecutive dirty registers.
+// Runs an earlier draw this frame already uploaded are skipped.
+//-----------------------------------------------------------------------------
+void CBaseVSShader::FlushConstants( CShaderConstantStage &stage )
+{
+	Assert( !IsSnapshotting() );
+
+	int nFirstRegister, nCount;
+	while ( stage.GetFirstDirtyRange( &nFirstRegister, &nCount ) )
+	{
+		const float *pData = stage.GetData( nFirstRegister );
+		if ( stage.GetTarget() == SHADER_CONSTANT_TARGET_PIXEL )
+		{
+			if ( ShaderStateCache_SetPixelShaderConstant( nFirstRegister, pData, nCount ) )
+			{
+				s_pShaderAPI->SetPixelShaderConstant( nFirstRegister, pData, nCount );
+			}
+		}
+		else
+		{
+			if ( ShaderStateCache_SetVertexShaderConstant( nFirstRegister, pData, nCount ) )
+			{
+				s_pShaderAPI->SetVertexShaderConstant( nFirstRegister, pData, nCount );
+			}
+		}
+		stage.ClearDirty( nFirstRegister, nCount );
+	}
+}
+
 void CBaseVSShader::SetPixelShaderConstantGammaToLinear( int pixelReg, int constantVar )
 {
 	Assert( !IsSnapshotting() );
@@ -289,6 +353,25 @@ void CBaseVSShader::SetVertexShaderTextureTransform( int vertexReg, int transfor
 	s_pShaderAPI->SetVertexShaderConstant( vertexReg, transformation[0].Base(), 2 ); 
 }
 
+void CBaseVSShader::SetVertexShaderTextureTransform( CShaderConstantStage &stage, int vertexReg, int transformVar )
+{
+	Assert( stage.GetTarget() == SHADER_CONSTANT_TARGET_VERTEX );
+
+	float *transformation = stage.Stage( vertexReg, 2 );
+	IMaterialVar* pTransformationVar = s_ppParams[transformVar];
+	if (pTransformationVar && (pTransformationVar->GetType() == MATERIAL_VAR_TYPE_MATRIX))
+	{
+		const VMatrix &mat = pTransformationVar->GetMatrixValue();
+		memcpy( transformation, mat[0], 4 * sizeof( float ) );
+		memcpy( transformation + 4, mat[1], 4 * sizeof( float ) );
+	}
+	else
+	{
+		static const float s_Identity[8] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f };
+		memcpy( transformation, s_Identity, sizeof( s_Identity ) );
+	}
+}
+
 void CBaseVSShader::SetVertexShaderTextureScaledTransform( int vertexReg, int transformVar, int scaleVar )
 {
 	Vector4D transformation[2];
@@ -1186,7 +1269,7 @@ bool ToolsEnabled()
 }
 
 // ficool2: uninlined this here so I can step through it in the debugger properly
-void SetFlashLightColorFromState( FlashlightState_t const& state, IShaderDynamicAPI* pShaderAPI, bool bSinglePassFlashlight, int nPSRegister, bool bFlashlightNoLambert )
+static void FlashlightColorFromState( FlashlightState_t const& state, bool bSinglePassFlashlight, bool bFlashlightNoLambert, float *vPsConst )
 {
 	// Old code
 	//float flToneMapScale = ( pShaderAPI->GetToneMappingScaleLinear() ).x;
@@ -1216,42 +1299,69 @@ void SetFlashLightColorFromState( FlashlightState_t const& state, IShaderDynamic
 
 	// Generate pixel shader constant
 	float const* pFlashlightColor = state.m_Color;
-	float vPsConst[4] = { flFlashlightScale * pFlashlightColor[0], flFlashlightScale * pFlashlightColor[1], flFlashlightScale * pFlashlightColor[2], pFlashlightColor[3] };
+	vPsConst[0] = flFlashlightScale * pFlashlightColor[0];
+	vPsConst[1] = flFlashlightScale * pFlashlightColor[1];
+	vPsConst[2] = flFlashlightScale * pFlashlightColor[2];
 	vPsConst[3] = bFlashlightNoLambert ? 2.0f : 0.0f; // This will be added to N.L before saturate to force a 1.0 N.L term
 
 	// Red flashlight for testing
 	//vPsConst[0] = 0.5f; vPsConst[1] = 0.0f; vPsConst[2] = 0.0f;
+}
 
-	pShaderAPI->SetPixelShaderConstant( nPSRegister, ( float* )vPsConst );
+void SetFlashLightColorFromState( FlashlightState_t const& state, IShaderDynamicAPI* pShaderAPI, bool bSinglePassFlashlight, int nPSRegister, bool bFlashlightNoLambert )
+{
+	float vPsConst[4];
+	FlashlightColorFromState( state, bSinglePassFlashlight, bFlashlightNoLambert, vPsConst );
+	pShaderAPI->SetPixelShaderConstant( nPSRegister, vPsConst );
 }
 
-void SetupUberlightFromState( IShaderDynamicAPI* pShaderAPI, FlashlightState_t const& state )
+void SetFlashLightColorFromState( FlashlightState_t const& state, CShaderConstantStage &stage, bool bSinglePassFlashlight, int nPSRegister, bool bFlashlightNoLambert )
+{
+	FlashlightColorFromState( state, bSinglePassFlashlight, bFlashlightNoLambert, stage.Stage( nPSRegister ) );
+}
+
+void SetupUberlightFromState( CShaderConstantStage &stage, FlashlightState_t const& state )
 {
 	// Bail if we can't do ps30 or we don't even want an uberlight
-	if ( !g_pHardwareConfig->HasFastVertexTextures() || !state.m_bUberlight || !pShaderAPI )
+	if ( !g_pHardwareConfig->HasFastVertexTextures() || !state.m_bUberlight )
 		return;
 
 	UberlightState_t u = state.m_uberlightState;
 
 	// Set uberlight shader parameters as function of user controls from UberlightState_t
-	Vector4D vSmoothEdge0 = Vector4D( 0.0f, u.m_fCutOn - u.m_fNearEdge, u.m_fCutOff, 0.0f );
-	Vector4D vSmoothEdge1 = Vector4D( 0.0f, u.m_fCutOn, u.m_fCutOff + u.m_fFarEdge, 0.0f );
-	Vector4D vSmoothOneOverW = Vector4D( 0.0f, 1.0f / u.m_fNearEdge, 1.0f / u.m_fFarEdge, 0.0f );
-	Vector4D vShearRound = Vector4D( u.m_fShearx, u.m_fSheary, 2.0f / u.m_fRoundness, -u.m_fRoundness / 2.0f );
-	Vector4D vaAbB = Vector4D( u.m_fWidth, u.m_fWidth + u.m_fWedge, u.m_fHeight, u.m_fHeight + u.m_fHedge );
-
-	pShaderAPI->SetPixelShaderConstant( PSREG_UBERLIGHT_SMOOTH_EDGE_0, vSmoothEdge0.Base(), 1 );
-	pShaderAPI->SetPixelShaderConstant( PSREG_UBERLIGHT_SMOOTH_EDGE_1, vSmoothEdge1.Base(), 1 );
-	pShaderAPI->SetPixelShaderConstant( PSREG_UBERLIGHT_SMOOTH_EDGE_OOW, vSmoothOneOverW.Base(), 1 );
-	pShaderAPI->SetPixelShaderConstant( PSREG_UBERLIGHT_SHEAR_ROUND, vShearRound.Base(), 1 );
-	pShaderAPI->SetPixelShaderConstant( PSREG_UBERLIGHT_AABB, vaAbB.Base(), 1 );
+	stage.Set4( PSREG_UBERLIGHT_SMOOTH_EDGE_0, 0.0f, u.m_fCutOn - u.m_fNearEdge, u.m_fCutOff, 0.0f );
+	stage.Set4( PSREG_UBERLIGHT_SMOOTH_EDGE_1, 0.0f, u.m_fCutOn, u.m_fCutOff + u.m_fFarEdge, 0.0f );
+	stage.Set4( PSREG_UBERLIGHT_SMOOTH_EDGE_OOW, 0.0f, 1.0f / u.m_fNearEdge, 1.0f / u.m_fFarEdge, 0.0f );
+	stage.Set4( PSREG_UBERLIGHT_SHEAR_ROUND, u.m_fShearx, u.m_fSheary, 2.0f / u.m_fRoundness, -u.m_fRoundness / 2.0f );
+	stage.Set4( PSREG_UBERLIGHT_AABB, u.m_fWidth, u.m_fWidth + u.m_fWedge, u.m_fHeight, u.m_fHeight + u.m_fHedge );
 
 	QAngle angles;
 	QuaternionAngles( state.m_quatOrientation, angles );
 
-	// World to Light's View matrix
+	// World to Light's View matrix. The fourth register completes the 3x4
+	// matrix rather than reading past it.
 	matrix3x4_t viewMatrix, viewMatrixInverse;
 	AngleMatrix( angles, state.m_vecLightOrigin, viewMatrixInverse );
 	MatrixInvert( viewMatrixInverse, viewMatrix );
-	pShaderAPI->SetPixelShaderConstant( PSREG_UBERLIGHT_WORLD_TO_LIGHT, viewMatrix.Base(), 4 );
+	float *pWorldToLight = stage.Stage( PSREG_UBERLIGHT_WORLD_TO_LIGHT, 4 );
+	memcpy( pWorldToLight, viewMatrix.Base(), 12 * sizeof( float ) );
+	pWorldToLight[12] = pWorldToLight[13] = pWorldToLight[14] = 0.0f;
+	pWorldToLight[15] = 1.0f;
+}
+
+void SetupUberlightFromState( IShaderDynamicAPI* pShaderAPI, FlashlightState_t const& state )
+{
+	if ( !pShaderAPI )
+		return;
+
+	// The uberlight registers are consecutive, so this is a single upload
+	CShaderConstantStage stage( SHADER_CONSTANT_TARGET_PIXEL );
+	SetupUberlightFromState( stage, state );
+
+	int nFirstRegister, nCount;
+	while ( stage.GetFirstDirtyRange( &nFirstRegister, &nCount ) )
+	{
+		pShaderAPI->SetPixelShaderConstant( nFirstRegister, stage.GetData( nFirstRegister ), nCount );
+		stage.ClearDirty( nFirstRegister, nCount );
+	}
 }
@@ -60,6 +60,94 @@
 		}
 
 
+//-----------------------------------------------------------------------------
+// Float4 constants for one draw, gathered in an aligned local buffer instead
+// of being uploaded one helper call at a time. The registers written are
+// tracked as dirty, and CBaseVSShader::FlushConstants uploads each run of
+// consecutive dirty registers with a single call. Holds MAX_REGISTERS
+// registers starting at nFirstRegister.
+//-----------------------------------------------------------------------------
+enum ShaderConstantTarget_t
+{
+	SHADER_CONSTANT_TARGET_PIXEL = 0,
+	SHADER_CONSTANT_TARGET_VERTEX,
+};
+
+class CShaderConstantStage
+{
+public:
+	enum { MAX_REGISTERS = 64 };
+
+	CShaderConstantStage( ShaderConstantTarget_t nTarget, int nFirstRegister = 0 ) :
+		m_nTarget( nTarget ), m_nFirstRegister( nFirstRegister ), m_nDirty( 0 )
+	{
+	}
+
+	ShaderConstantTarget_t GetTarget() const { return m_nTarget; }
+
+	// Room for nCount registers from nRegister, which are marked dirty.
+	// Holds whatever was staged there before.
+	float *Stage( int nRegister, int nCount = 1 )
+	{
+		int nOffset = nRegister - m_nFirstRegister;
+		Assert( nOffset >= 0 && nCount > 0 && nOffset + nCount <= MAX_REGISTERS );
+		m_nDirty |= ( ( nCount < 64 ) ? ( ( (uint64)1 << nCount ) - 1 ) : ~(uint64)0 ) << nOffset;
+		return m_Data[nOffset];
+	}
+
+	void Set( int nRegister, const float *pData, int nCount = 1 )
+	{
+		memcpy( Stage( nRegister, nCount ), pData, nCount * 4 * sizeof( float ) );
+	}
+
+	void Set4( int nRegister, float x, float y, float z, float w )
+	{
+		float *pData = Stage( nRegister );
+		pData[0] = x;
+		pData[1] = y;
+		pData[2] = z;
+		pData[3] = w;
+	}
+
+	bool IsDirty() const { return m_nDirty != 0; }
+
+	// Lowest run of consecutive dirty registers, false if there is none
+	bool GetFirstDirtyRange( int *pFirstRegister, int *pCount ) const
+	{
+		if ( !m_nDirty )
+			return false;
+
+		int nStart = 0;
+		while ( !( m_nDirty & ( (uint64)1 << nStart ) ) )
+		{
+			++nStart;
+		}
+		int nEnd = nStart + 1;
+		while ( nEnd < MAX_REGISTERS && ( m_nDirty & ( (uint64)1 << nEnd ) ) )
+		{
+			++nEnd;
+		}
+
+		*pFirstRegister = m_nFirstRegister + nStart;
+		*pCount = nEnd - nStart;
+		return true;
+	}
+
+	const float *GetData( int nRegister ) const { return m_Data[nRegister - m_nFirstRegister]; }
+
+	void ClearDirty( int nFirstRegister, int nCount )
+	{
+		m_nDirty &= ~( ( ( nCount < 64 ) ? ( ( (uint64)1 << nCount ) - 1 ) : ~(uint64)0 ) << ( nFirstRegister - m_nFirstRegister ) );
+	}
+
+private:
+	ALIGN16 float m_Data[MAX_REGISTERS][4] ALIGN16_POST;
+	ShaderConstantTarget_t m_nTarget;
+	int m_nFirstRegister;
+	uint64 m_nDirty;
+};
+
+
 //-----------------------------------------------------------------------------
 // Base class for shaders, contains helper methods.
 //-----------------------------------------------------------------------------
@@ -91,6 +179,13 @@ public:
 	// set rgb components of constant from a color parm and give an explicit w value
 	void SetPixelShaderConstant_W( int pixelReg, int constantVar, float fWValue );
 
+	// Staged versions of the helpers above, see CShaderConstantStage
+	void SetPixelShaderConstant( CShaderConstantStage &stage, int pixelReg, int constantVar );
+	void SetPixelShaderConstant_W( CShaderConstantStage &stage, int pixelReg, int constantVar, float fWValue );
+
+	// Uploads the dirty registers of a stage, one call per consecutive run
+	void FlushConstants( CShaderConstantStage &stage );
+
 	// GR - fix for const/lerp issues
 	void SetPixelShaderConstantFudge( int pixelReg, int constantVar );
 
@@ -98,6 +193,7 @@ public:
 	void SetVertexShaderTextureTranslation( int vertexReg, int translationVar );
 	void SetVertexShaderTextureScale( int vertexReg, int scaleVar );
  	void SetVertexShaderTextureTransform( int vertexReg, int transformVar );
+ 	void SetVertexShaderTextureTransform( CShaderConstantStage &stage, int vertexReg, int transformVar );
 	void SetVertexShaderTextureScaledTransform( int vertexReg, 
 											int transformVar, int scaleVar );
 
@@ -204,6 +300,7 @@ FORCEINLINE char * GetFlashlightTextureFilename()
 extern ConVar r_flashlightbrightness;
 
 void SetFlashLightColorFromState( FlashlightState_t const& state, IShaderDynamicAPI* pShaderAPI, bool bSinglePassFlashlight, int nPSRegister = 28, bool bFlashlightNoLambert = false );
+void SetFlashLightColorFromState( FlashlightState_t const& state, CShaderConstantStage &stage, bool bSinglePassFlashlight, int nPSRegister = 28, bool bFlashlightNoLambert = false );
 
 FORCEINLINE float ShadowAttenFromState( FlashlightState_t const &state )
 {
@@ -222,6 +319,7 @@ FORCEINLINE float ShadowFilterFromState( FlashlightState_t const &state )
 
 
 void SetupUberlightFromState( IShaderDynamicAPI* pShaderAPI, FlashlightState_t const& state );
+void SetupUberlightFromState( CShaderConstantStage &stage, FlashlightState_t const& state );
 
 // convenient material variable access functions for helpers to use.
 FORCEINLINE bool IsTextureSet( int nVar, IMaterialVar **params )
@@ -60,4 +60,6 @@
 #define PSREG_CONSTANT_47	47
 #define PSREG_CONSTANT_48	48
 #define PSREG_CONSTANT_49	49
-#define PSREG_CONSTANT_50	50
\ No newline at end of file
+#define PSREG_CONSTANT_50	50
+#define PSREG_CONSTANT_51	51
+#define PSREG_CONSTANT_52	52
\ No newline at end of file
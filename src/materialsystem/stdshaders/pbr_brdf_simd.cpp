@@ -0,0 +1,646 @@
+//==================================================================================================
+//
+// Checks and benchmark for the CPU port of the PBR BRDF (pbr_brdf_simd.h)
+//
+// mat_pbr_brdf_selftest [msamples] runs:
+//  - the golden values: fixed shading points whose results were worked out in double precision
+//    straight from the HLSL, for EnvBRDFApprox, fresnelSchlickRoughness, calculateLight in five
+//    combos and ComputeSubsurfaceScattering
+//  - the SIMD port against a scalar transliteration of the HLSL on random shading points, in
+//    every combo
+//  - the throughput of both, in millions of shading points per second
+//
+// When a change to pbr_common_ps2_3_x.h changes the results on purpose, update the scalar
+// reference, the SIMD port and the golden values together.
+//
+//==================================================================================================
+
+#include "pbr_brdf_simd.h"
+#include "tier0/dbg.h"
+#include "tier0/fasttimer.h"
+#include "tier1/strtools.h"
+#include "convar.h"
+#include <stdlib.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+//-----------------------------------------------------------------------------
+// Scalar reference, line for line from the HLSL
+//-----------------------------------------------------------------------------
+static Vector RefFresnelSchlick(const Vector &F0, float cosTheta)
+{
+    return F0 + (Vector(1, 1, 1) - F0) * powf(1.0f - cosTheta, 5.0f);
+}
+
+static float RefNdfGGX(float cosLh, float roughness)
+{
+    float alpha = roughness * roughness;
+    float alphaSq = alpha * alpha;
+
+    float denom = (cosLh * cosLh) * (alphaSq - 1.0f) + 1.0f;
+    return alphaSq / (PBR_BRDF_PI * denom * denom);
+}
+
+static float RefGaSchlickG1(float cosTheta, float k)
+{
+    return cosTheta / (cosTheta * (1.0f - k) + k);
+}
+
+static float RefGaSchlickGGX(float cosLi, float cosLo, float roughness)
+{
+    float r = roughness + 1.0f;
+    float k = (r * r) / 8.0f;
+    return RefGaSchlickG1(cosLi, k) * RefGaSchlickG1(cosLo, k);
+}
+
+static Vector RefFresnelSchlickRoughness(const Vector &F0, float cosTheta, float roughness)
+{
+    Vector result;
+    for (int i = 0; i < 3; ++i)
+    {
+        result[i] = F0[i] + MAX(0.0f, (1.0f - roughness) - F0[i]) * powf(1.0f - cosTheta, 5.0f);
+    }
+    return result;
+}
+
+static Vector RefEnvBRDFApprox(const Vector &specularColor, float roughness, float NoV)
+{
+    const float c0[4] = { -1, -0.0275f, -0.572f, 0.022f };
+    const float c1[4] = { 1, 0.0425f, 1.04f, -0.04f };
+    float r[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        r[i] = roughness * c0[i] + c1[i];
+    }
+    float a004 = MIN(r[0] * r[0], powf(2.0f, -9.28f * NoV)) * r[0] + r[1];
+    float A = -1.04f * a004 + r[2];
+    float B = 1.04f * a004 + r[3];
+    return specularColor * A + Vector(B, B, B);
+}
+
+static Vector RefCalculateLight(int nCombos, const Vector &lightIn, const Vector &lightIntensity, const Vector &lightOut, const Vector &normal,
+                                const Vector &fresnelReflectance, float roughness, float metalness, float lightDirectionAngle,
+                                const Vector &albedo, const PBRLightwarp_t *pLightwarp)
+{
+    Vector halfAngle = lightIn + lightOut;
+    VectorNormalize(halfAngle);
+    float NDotL = DotProduct(normal, lightIn);
+    float cosLightIn = MAX(0.0f, NDotL);
+    float cosHalfAngle = MAX(0.0f, DotProduct(normal, halfAngle));
+
+    Vector F = RefFresnelSchlick(fresnelReflectance, MAX(0.0f, DotProduct(halfAngle, lightOut)));
+    float D = RefNdfGGX(cosHalfAngle, roughness);
+    float G = RefGaSchlickGGX(cosLightIn, lightDirectionAngle, roughness);
+
+    Vector kd;
+    if (nCombos & PBR_BRDF_SPECULAR)
+    {
+        kd = Vector(1, 1, 1) - F;
+    }
+    else
+    {
+        kd = (Vector(1, 1, 1) - F) * (1.0f - metalness);
+    }
+
+    Vector diffuseBRDF = kd * albedo;
+    Vector specularBRDF = (F * D * G) / MAX(PBR_BRDF_EPSILON, 4.0f * cosLightIn * lightDirectionAngle);
+
+    Vector result;
+    if ((nCombos & PBR_BRDF_LIGHTMAPPED) && !(nCombos & PBR_BRDF_FLASHLIGHT))
+    {
+        result = specularBRDF * lightIntensity * cosLightIn;
+    }
+    else
+    {
+        result = (diffuseBRDF + specularBRDF) * lightIntensity * cosLightIn;
+    }
+
+    if (nCombos & PBR_BRDF_LIGHTWARPTEXTURE)
+    {
+        float fHalfLambert = clamp(NDotL * 0.5f + 0.5f, 0.0f, 1.0f);
+        Vector warp = PBR_SampleLightwarp(*pLightwarp, fHalfLambert) * 3.0f;
+
+        result = (diffuseBRDF * warp + specularBRDF) * lightIntensity;
+    }
+
+    return result;
+}
+
+static Vector RefSubsurfaceScattering(const Vector &N, const Vector &L, const Vector &V, float thickness, const Vector &sssColor,
+                                      float intensity, float powerScale)
+{
+    float backlit = MAX(0.0f, -DotProduct(N, L));
+    backlit = powf(backlit, 0.3f);
+
+    float transmittance = powf(1.0f - thickness, powerScale);
+
+    float sssStrength = backlit * transmittance;
+    float ambientSSS = transmittance * 0.3f;
+    sssStrength = MAX(sssStrength, ambientSSS);
+
+    Vector sssResult = sssColor * sssStrength * intensity;
+
+    float facingFactor = clamp(DotProduct(V, N), 0.0f, 1.0f);
+    sssResult *= (0.7f + 0.3f * facingFactor);
+
+    return sssResult;
+}
+
+//-----------------------------------------------------------------------------
+// Shading points
+//-----------------------------------------------------------------------------
+struct BrdfPoint_t
+{
+    Vector m_Normal;
+    Vector m_LightIn;
+    Vector m_LightOut;
+    Vector m_LightIntensity;
+    Vector m_F0;
+    Vector m_Albedo;
+    float m_flRoughness;
+    float m_flMetalness;
+    float m_flThickness;
+    Vector m_SSSColor;
+    float m_flSSSIntensity;
+    float m_flSSSPowerScale;
+
+    float LightDirectionAngle() const { return MAX(0.0f, DotProduct(m_Normal, m_LightOut)); }
+};
+
+// Four points in SIMD form
+struct BrdfPoint4_t
+{
+    FourVectors m_Normal;
+    FourVectors m_LightIn;
+    FourVectors m_LightOut;
+    FourVectors m_LightIntensity;
+    FourVectors m_F0;
+    FourVectors m_Albedo;
+    FourVectors m_SSSColor;
+    fltx4 m_Roughness;
+    fltx4 m_Metalness;
+    fltx4 m_LightDirectionAngle;
+    fltx4 m_Thickness;
+    fltx4 m_SSSIntensity;
+    fltx4 m_SSSPowerScale;
+};
+
+static void LoadPoints4(BrdfPoint4_t &out, const BrdfPoint_t *pPoints)
+{
+    out.m_Normal.LoadAndSwizzle(pPoints[0].m_Normal, pPoints[1].m_Normal, pPoints[2].m_Normal, pPoints[3].m_Normal);
+    out.m_LightIn.LoadAndSwizzle(pPoints[0].m_LightIn, pPoints[1].m_LightIn, pPoints[2].m_LightIn, pPoints[3].m_LightIn);
+    out.m_LightOut.LoadAndSwizzle(pPoints[0].m_LightOut, pPoints[1].m_LightOut, pPoints[2].m_LightOut, pPoints[3].m_LightOut);
+    out.m_LightIntensity.LoadAndSwizzle(pPoints[0].m_LightIntensity, pPoints[1].m_LightIntensity, pPoints[2].m_LightIntensity, pPoints[3].m_LightIntensity);
+    out.m_F0.LoadAndSwizzle(pPoints[0].m_F0, pPoints[1].m_F0, pPoints[2].m_F0, pPoints[3].m_F0);
+    out.m_Albedo.LoadAndSwizzle(pPoints[0].m_Albedo, pPoints[1].m_Albedo, pPoints[2].m_Albedo, pPoints[3].m_Albedo);
+    out.m_SSSColor.LoadAndSwizzle(pPoints[0].m_SSSColor, pPoints[1].m_SSSColor, pPoints[2].m_SSSColor, pPoints[3].m_SSSColor);
+    for (int i = 0; i < 4; ++i)
+    {
+        SubFloat(out.m_Roughness, i) = pPoints[i].m_flRoughness;
+        SubFloat(out.m_Metalness, i) = pPoints[i].m_flMetalness;
+        SubFloat(out.m_LightDirectionAngle, i) = pPoints[i].LightDirectionAngle();
+        SubFloat(out.m_Thickness, i) = pPoints[i].m_flThickness;
+        SubFloat(out.m_SSSIntensity, i) = pPoints[i].m_flSSSIntensity;
+        SubFloat(out.m_SSSPowerScale, i) = pPoints[i].m_flSSSPowerScale;
+    }
+}
+
+// One output per point and per function
+enum BrdfOutput_t
+{
+    BRDF_OUTPUT_ENVBRDF = 0,
+    BRDF_OUTPUT_FRESNEL_ROUGHNESS,
+    BRDF_OUTPUT_LIGHT,
+    BRDF_OUTPUT_SSS,
+};
+
+typedef FourVectors (*CalculateLight4Func_t)(const BrdfPoint4_t &points, const PBRLightwarp_t *pLightwarp);
+
+template <int nCombos>
+static FourVectors CalculateLight4(const BrdfPoint4_t &points, const PBRLightwarp_t *pLightwarp)
+{
+    return PBR_CalculateLight4<nCombos>(points.m_LightIn, points.m_LightIntensity, points.m_LightOut, points.m_Normal, points.m_F0,
+                                        points.m_Roughness, points.m_Metalness, points.m_LightDirectionAngle, points.m_Albedo, pLightwarp);
+}
+
+static const CalculateLight4Func_t s_CalculateLight4Funcs[PBR_BRDF_COMBO_COUNT] =
+{
+    CalculateLight4<0x0>, CalculateLight4<0x1>, CalculateLight4<0x2>, CalculateLight4<0x3>,
+    CalculateLight4<0x4>, CalculateLight4<0x5>, CalculateLight4<0x6>, CalculateLight4<0x7>,
+    CalculateLight4<0x8>, CalculateLight4<0x9>, CalculateLight4<0xA>, CalculateLight4<0xB>,
+    CalculateLight4<0xC>, CalculateLight4<0xD>, CalculateLight4<0xE>, CalculateLight4<0xF>,
+};
+
+static FourVectors Evaluate4(BrdfOutput_t nOutput, int nCombos, const BrdfPoint4_t &points, const PBRLightwarp_t *pLightwarp)
+{
+    switch (nOutput)
+    {
+    case BRDF_OUTPUT_ENVBRDF:
+        return PBR_EnvBRDFApprox4(points.m_F0, points.m_Roughness, points.m_LightDirectionAngle);
+    case BRDF_OUTPUT_FRESNEL_ROUGHNESS:
+        return PBR_FresnelSchlickRoughness4(points.m_F0, points.m_LightDirectionAngle, points.m_Roughness);
+    case BRDF_OUTPUT_LIGHT:
+        return s_CalculateLight4Funcs[nCombos](points, pLightwarp);
+    default:
+        return PBR_SubsurfaceScattering4(points.m_Normal, points.m_LightIn, points.m_LightOut, points.m_Thickness, points.m_SSSColor,
+                                         points.m_SSSIntensity, points.m_SSSPowerScale);
+    }
+}
+
+static Vector Evaluate(BrdfOutput_t nOutput, int nCombos, const BrdfPoint_t &point, const PBRLightwarp_t *pLightwarp)
+{
+    switch (nOutput)
+    {
+    case BRDF_OUTPUT_ENVBRDF:
+        return RefEnvBRDFApprox(point.m_F0, point.m_flRoughness, point.LightDirectionAngle());
+    case BRDF_OUTPUT_FRESNEL_ROUGHNESS:
+        return RefFresnelSchlickRoughness(point.m_F0, point.LightDirectionAngle(), point.m_flRoughness);
+    case BRDF_OUTPUT_LIGHT:
+        return RefCalculateLight(nCombos, point.m_LightIn, point.m_LightIntensity, point.m_LightOut, point.m_Normal, point.m_F0,
+                                 point.m_flRoughness, point.m_flMetalness, point.LightDirectionAngle(), point.m_Albedo, pLightwarp);
+    default:
+        return RefSubsurfaceScattering(point.m_Normal, point.m_LightIn, point.m_LightOut, point.m_flThickness, point.m_SSSColor,
+                                       point.m_flSSSIntensity, point.m_flSSSPowerScale);
+    }
+}
+
+static float RelativeError(const Vector &value, const Vector &expected)
+{
+    float flError = 0.0f;
+    for (int i = 0; i < 3; ++i)
+    {
+        flError = MAX(flError, fabsf(value[i] - expected[i]) / MAX(1.0f, fabsf(expected[i])));
+    }
+    return flError;
+}
+
+static void GetComboName(int nCombos, char *pBuf, int nBufLen)
+{
+    static const char *s_pComboNames[] = { "SPECULAR", "LIGHTMAPPED", "FLASHLIGHT", "LIGHTWARPTEXTURE" };
+
+    V_strncpy(pBuf, nCombos ? "" : "default", nBufLen);
+    for (int i = 0; i < ARRAYSIZE(s_pComboNames); ++i)
+    {
+        if (nCombos & (1 << i))
+        {
+            if (pBuf[0])
+            {
+                V_strncat(pBuf, " ", nBufLen);
+            }
+            V_strncat(pBuf, s_pComboNames[i], nBufLen);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Golden values
+//-----------------------------------------------------------------------------
+static const Vector s_GoldenLightwarpTexels[] =
+{
+    Vector(0.0f, 0.0f, 0.05f), Vector(0.25f, 0.2f, 0.2f), Vector(0.6f, 0.55f, 0.5f), Vector(1.0f, 1.0f, 1.0f),
+};
+static const PBRLightwarp_t s_GoldenLightwarp = { s_GoldenLightwarpTexels, ARRAYSIZE(s_GoldenLightwarpTexels) };
+
+static const BrdfPoint_t s_GoldenPoints[] =
+{
+    // Normal, light in, light out, intensity, F0, albedo, roughness, metalness, thickness, SSS color, intensity, power
+    // Mirror direction, dielectric
+    { Vector(0, 0, 1), Vector(0, 0.6f, 0.8f), Vector(0, -0.6f, 0.8f), Vector(1, 1, 1), Vector(0.04f, 0.04f, 0.04f), Vector(0.8f, 0.5f, 0.3f),
+      0.5f, 0.0f, 0.3f, Vector(1, 0.4f, 0.3f), 1.0f, 2.0f },
+    // Gold, off-specular
+    { Vector(0, 0, 1), Vector(0.6f, 0, 0.8f), Vector(0, 0.8f, 0.6f), Vector(2, 1.5f, 1), Vector(0.95f, 0.64f, 0.54f), Vector(0.95f, 0.64f, 0.54f),
+      0.25f, 1.0f, 0.8f, Vector(1, 0.4f, 0.3f), 1.0f, 2.0f },
+    // Rough, grazing light
+    { Vector(0, 1, 0), Vector(0.8f, 0.6f, 0), Vector(-0.28f, 0.96f, 0), Vector(5, 5, 5), Vector(0.04f, 0.04f, 0.04f), Vector(0.2f, 0.6f, 0.2f),
+      0.9f, 0.3f, 0.5f, Vector(0.9f, 0.5f, 0.4f), 0.5f, 1.0f },
+    // Lit from behind
+    { Vector(0, 0, 1), Vector(0, 0.6f, -0.8f), Vector(0, 0, 1), Vector(1, 0.9f, 0.8f), Vector(0.04f, 0.04f, 0.04f), Vector(0.9f, 0.7f, 0.6f),
+      0.6f, 0.0f, 0.1f, Vector(1, 0.4f, 0.3f), 2.0f, 1.5f },
+    // Smooth, at the specular peak
+    { Vector(0.6f, 0, 0.8f), Vector(0, 0, 1), Vector(0.96f, 0, 0.28f), Vector(1, 1, 1), Vector(0.5f, 0.5f, 0.5f), Vector(0.5f, 0.5f, 0.5f),
+      0.1f, 0.5f, 0.6f, Vector(0.8f, 0.3f, 0.2f), 1.0f, 4.0f },
+    // Viewed edge on
+    { Vector(0, 0, 1), Vector(0, 0.6f, 0.8f), Vector(1, 0, 0), Vector(1, 1, 1), Vector(0.04f, 0.04f, 0.04f), Vector(0.5f, 0.5f, 0.5f),
+      1.0f, 0.0f, 0.0f, Vector(1, 1, 1), 1.0f, 1.0f },
+};
+
+static const int s_GoldenCombos[] =
+{
+    0,
+    PBR_BRDF_SPECULAR,
+    PBR_BRDF_LIGHTMAPPED,
+    PBR_BRDF_LIGHTWARPTEXTURE,
+    PBR_BRDF_SPECULAR | PBR_BRDF_LIGHTWARPTEXTURE,
+};
+
+// EnvBRDFApprox, fresnelSchlickRoughness, calculateLight in each of s_GoldenCombos,
+// ComputeSubsurfaceScattering
+#define GOLDEN_VALUES_PER_POINT ( 3 + ARRAYSIZE(s_GoldenCombos) )
+
+static const Vector s_GoldenValues[][GOLDEN_VALUES_PER_POINT] =
+{
+    { Vector(3.277089e-02f, 3.277089e-02f, 3.277089e-02f), Vector(4.014720e-02f, 4.014720e-02f, 4.014720e-02f),
+      Vector(6.702026e-01f, 4.398763e-01f, 2.863255e-01f), Vector(6.702026e-01f, 4.398763e-01f, 2.863255e-01f),
+      Vector(5.599918e-02f, 5.599918e-02f, 5.599918e-02f), Vector(2.373262e+00f, 1.509538e+00f, 9.337225e-01f),
+      Vector(2.373262e+00f, 1.509538e+00f, 9.337225e-01f), Vector(1.381800e-01f, 5.527200e-02f, 4.145400e-02f) },
+    { Vector(8.203246e-01f, 5.588372e-01f, 4.744864e-01f), Vector(9.500000e-01f, 6.411264e-01f, 5.421504e-01f),
+      Vector(7.165551e-03f, 3.620588e-03f, 2.036612e-03f), Vector(8.316150e-02f, 2.800858e-01f, 2.007460e-01f),
+      Vector(7.165551e-03f, 3.620588e-03f, 2.036612e-03f), Vector(8.956939e-03f, 4.525734e-03f, 2.545765e-03f),
+      Vector(2.939417e-01f, 1.041270e+00f, 7.477060e-01f), Vector(1.056000e-02f, 4.224000e-03f, 3.168000e-03f) },
+    { Vector(1.873732e-02f, 1.873732e-02f, 1.873732e-02f), Vector(4.000001e-02f, 4.000001e-02f, 4.000001e-02f),
+      Vector(4.204162e-01f, 1.226673e+00f, 4.204162e-01f), Vector(5.931855e-01f, 1.744981e+00f, 5.931855e-01f),
+      Vector(1.728786e-02f, 1.728786e-02f, 1.728786e-02f), Vector(1.802578e+00f, 5.259403e+00f, 1.742109e+00f),
+      Vector(2.562763e+00f, 7.501085e+00f, 2.476378e+00f), Vector(6.669000e-02f, 3.705000e-02f, 2.964000e-02f) },
+    { Vector(2.767280e-02f, 2.767280e-02f, 2.767280e-02f), Vector(4.000000e-02f, 4.000000e-02f, 4.000000e-02f),
+      Vector(0.000000e+00f, 0.000000e+00f, 0.000000e+00f), Vector(0.000000e+00f, 0.000000e+00f, 0.000000e+00f),
+      Vector(0.000000e+00f, 0.000000e+00f, 0.000000e+00f), Vector(0.000000e+00f, 0.000000e+00f, 5.878856e-02f),
+      Vector(0.000000e+00f, 0.000000e+00f, 5.878856e-02f), Vector(1.597058e+00f, 6.388233e-01f, 4.791175e-01f) },
+    { Vector(4.769952e-01f, 4.769952e-01f, 4.769952e-01f), Vector(5.001280e-01f, 5.001280e-01f, 5.001280e-01f),
+      Vector(4.620249e+02f, 4.620249e+02f, 4.620249e+02f), Vector(4.621249e+02f, 4.621249e+02f, 4.621249e+02f),
+      Vector(4.619249e+02f, 4.619249e+02f, 4.619249e+02f), Vector(5.777810e+02f, 5.777810e+02f, 5.777810e+02f),
+      Vector(5.781559e+02f, 5.781559e+02f, 5.781559e+02f), Vector(5.775360e-03f, 2.165760e-03f, 1.443840e-03f) },
+    { Vector(1.569600e-02f, 1.569600e-02f, 1.569600e-02f), Vector(4.000000e-02f, 4.000000e-02f, 4.000000e-02f),
+      Vector(3.831723e-01f, 3.831723e-01f, 3.831723e-01f), Vector(3.831723e-01f, 3.831723e-01f, 3.831723e-01f),
+      Vector(0.000000e+00f, 0.000000e+00f, 0.000000e+00f), Vector(1.436896e+00f, 1.436896e+00f, 1.436896e+00f),
+      Vector(1.436896e+00f, 1.436896e+00f, 1.436896e+00f), Vector(2.100000e-01f, 2.100000e-01f, 2.100000e-01f) },
+};
+
+// The goldens are worked out in double precision. The float code loses a few more digits at
+// the GGX peak of smooth surfaces, where the denominator cancels out to alpha^2.
+#define GOLDEN_TOLERANCE    1e-3f
+
+// The SIMD port only differs from the reference in rounding
+#define REFERENCE_TOLERANCE 1e-4f
+
+static bool CheckGoldenValue(const char *pName, int nPoint, const Vector &value, const Vector &expected)
+{
+    float flError = RelativeError(value, expected);
+    if (flError <= GOLDEN_TOLERANCE)
+        return true;
+
+    Warning("  %s, golden point %d: got (%g %g %g), expected (%g %g %g)\n", pName, nPoint,
+            value.x, value.y, value.z, expected.x, expected.y, expected.z);
+    return false;
+}
+
+static bool CheckGoldenValues()
+{
+    COMPILE_TIME_ASSERT(ARRAYSIZE(s_GoldenValues) == ARRAYSIZE(s_GoldenPoints));
+
+    bool bOk = true;
+    for (int nPoint = 0; nPoint < ARRAYSIZE(s_GoldenPoints); nPoint += 4)
+    {
+        // Pad the last group of four with copies of the first point
+        BrdfPoint_t points[4];
+        int nCount = MIN(4, ARRAYSIZE(s_GoldenPoints) - nPoint);
+        for (int i = 0; i < 4; ++i)
+        {
+            points[i] = s_GoldenPoints[(i < nCount) ? nPoint + i : 0];
+        }
+
+        BrdfPoint4_t points4;
+        LoadPoints4(points4, points);
+
+        for (int nValue = 0; nValue < GOLDEN_VALUES_PER_POINT; ++nValue)
+        {
+            char szName[128];
+            BrdfOutput_t nOutput;
+            int nCombos = 0;
+            if (nValue == 0)
+            {
+                nOutput = BRDF_OUTPUT_ENVBRDF;
+                V_strncpy(szName, "EnvBRDFApprox", sizeof(szName));
+            }
+            else if (nValue == 1)
+            {
+                nOutput = BRDF_OUTPUT_FRESNEL_ROUGHNESS;
+                V_strncpy(szName, "fresnelSchlickRoughness", sizeof(szName));
+            }
+            else if (nValue == GOLDEN_VALUES_PER_POINT - 1)
+            {
+                nOutput = BRDF_OUTPUT_SSS;
+                V_strncpy(szName, "ComputeSubsurfaceScattering", sizeof(szName));
+            }
+            else
+            {
+                nOutput = BRDF_OUTPUT_LIGHT;
+                nCombos = s_GoldenCombos[nValue - 2];
+                char szCombos[64];
+                GetComboName(nCombos, szCombos, sizeof(szCombos));
+                V_snprintf(szName, sizeof(szName), "calculateLight (%s)", szCombos);
+            }
+
+            FourVectors simd = Evaluate4(nOutput, nCombos, points4, &s_GoldenLightwarp);
+            for (int i = 0; i < nCount; ++i)
+            {
+                const Vector &expected = s_GoldenValues[nPoint + i][nValue];
+                char szSimdName[160];
+                V_snprintf(szSimdName, sizeof(szSimdName), "SIMD %s", szName);
+                bOk &= CheckGoldenValue(szSimdName, nPoint + i, simd.Vec(i), expected);
+                bOk &= CheckGoldenValue(szName, nPoint + i, Evaluate(nOutput, nCombos, points[i], &s_GoldenLightwarp), expected);
+            }
+        }
+    }
+    return bOk;
+}
+
+//-----------------------------------------------------------------------------
+// Random shading points
+//-----------------------------------------------------------------------------
+#define RANDOM_POINT_COUNT      4096
+#define RANDOM_LIGHTWARP_WIDTH  64
+
+static BrdfPoint_t s_RandomPoints[RANDOM_POINT_COUNT];
+static BrdfPoint4_t s_RandomPoints4[RANDOM_POINT_COUNT / 4];
+static Vector s_RandomLightwarpTexels[RANDOM_LIGHTWARP_WIDTH];
+static const PBRLightwarp_t s_RandomLightwarp = { s_RandomLightwarpTexels, RANDOM_LIGHTWARP_WIDTH };
+static bool s_bRandomPointsBuilt = false;
+
+// The same points every run, whatever the CRT's rand does
+static float NextRandomFloat(unsigned int &nSeed, float flMin, float flMax)
+{
+    nSeed = nSeed * 1664525u + 1013904223u;
+    return flMin + (flMax - flMin) * ((nSeed >> 8) * (1.0f / 16777216.0f));
+}
+
+static Vector NextRandomDirection(unsigned int &nSeed)
+{
+    Vector dir;
+    do
+    {
+        dir.Init(NextRandomFloat(nSeed, -1, 1), NextRandomFloat(nSeed, -1, 1), NextRandomFloat(nSeed, -1, 1));
+    } while (dir.LengthSqr() < 0.01f || dir.LengthSqr() > 1.0f);
+    VectorNormalize(dir);
+    return dir;
+}
+
+static void BuildRandomPoints()
+{
+    if (s_bRandomPointsBuilt)
+        return;
+
+    unsigned int nSeed = 0x50425242;
+    for (int i = 0; i < RANDOM_POINT_COUNT; ++i)
+    {
+        BrdfPoint_t &point = s_RandomPoints[i];
+        point.m_Normal = NextRandomDirection(nSeed);
+        // Light from anywhere, so backlit points are covered; the eye on the front side
+        point.m_LightIn = NextRandomDirection(nSeed);
+        point.m_LightOut = NextRandomDirection(nSeed);
+        if (DotProduct(point.m_LightOut, point.m_Normal) < 0.0f)
+        {
+            point.m_LightOut = -point.m_LightOut;
+        }
+        point.m_LightIntensity.Init(NextRandomFloat(nSeed, 0, 4), NextRandomFloat(nSeed, 0, 4), NextRandomFloat(nSeed, 0, 4));
+        point.m_Albedo.Init(NextRandomFloat(nSeed, 0, 1), NextRandomFloat(nSeed, 0, 1), NextRandomFloat(nSeed, 0, 1));
+        point.m_flMetalness = NextRandomFloat(nSeed, 0, 1);
+        point.m_F0 = Vector(0.04f, 0.04f, 0.04f) + (point.m_Albedo - Vector(0.04f, 0.04f, 0.04f)) * point.m_flMetalness;
+        // The shader doesn't go below this either (the MRAO maps are 8 bit)
+        point.m_flRoughness = NextRandomFloat(nSeed, 0.05f, 1);
+        point.m_flThickness = NextRandomFloat(nSeed, 0, 1);
+        point.m_SSSColor.Init(NextRandomFloat(nSeed, 0, 1), NextRandomFloat(nSeed, 0, 1), NextRandomFloat(nSeed, 0, 1));
+        point.m_flSSSIntensity = NextRandomFloat(nSeed, 0, 2);
+        point.m_flSSSPowerScale = NextRandomFloat(nSeed, 0.5f, 4);
+    }
+
+    for (int i = 0; i < RANDOM_POINT_COUNT / 4; ++i)
+    {
+        LoadPoints4(s_RandomPoints4[i], &s_RandomPoints[i * 4]);
+    }
+
+    for (int i = 0; i < RANDOM_LIGHTWARP_WIDTH; ++i)
+    {
+        float t = (float)i / (RANDOM_LIGHTWARP_WIDTH - 1);
+        s_RandomLightwarpTexels[i].Init(t * t, t, sqrtf(t));
+    }
+
+    s_bRandomPointsBuilt = true;
+}
+
+static bool CheckOutputAgainstReference(BrdfOutput_t nOutput, int nCombos, const char *pName)
+{
+    float flMaxError = 0.0f;
+    int nWorstPoint = 0;
+    for (int i = 0; i < RANDOM_POINT_COUNT / 4; ++i)
+    {
+        FourVectors simd = Evaluate4(nOutput, nCombos, s_RandomPoints4[i], &s_RandomLightwarp);
+        for (int j = 0; j < 4; ++j)
+        {
+            float flError = RelativeError(simd.Vec(j), Evaluate(nOutput, nCombos, s_RandomPoints[i * 4 + j], &s_RandomLightwarp));
+            if (!(flError <= flMaxError))
+            {
+                flMaxError = flError;
+                nWorstPoint = i * 4 + j;
+            }
+        }
+    }
+
+    if (flMaxError <= REFERENCE_TOLERANCE)
+        return true;
+
+    Warning("  %s: SIMD differs from the reference by %g at random point %d\n", pName, flMaxError, nWorstPoint);
+    return false;
+}
+
+static bool CheckAgainstReference()
+{
+    bool bOk = CheckOutputAgainstReference(BRDF_OUTPUT_ENVBRDF, 0, "EnvBRDFApprox");
+    bOk &= CheckOutputAgainstReference(BRDF_OUTPUT_FRESNEL_ROUGHNESS, 0, "fresnelSchlickRoughness");
+    bOk &= CheckOutputAgainstReference(BRDF_OUTPUT_SSS, 0, "ComputeSubsurfaceScattering");
+    for (int nCombos = 0; nCombos < PBR_BRDF_COMBO_COUNT; ++nCombos)
+    {
+        char szCombos[64], szName[128];
+        GetComboName(nCombos, szCombos, sizeof(szCombos));
+        V_snprintf(szName, sizeof(szName), "calculateLight (%s)", szCombos);
+        bOk &= CheckOutputAgainstReference(BRDF_OUTPUT_LIGHT, nCombos, szName);
+    }
+    return bOk;
+}
+
+//-----------------------------------------------------------------------------
+// Throughput
+//-----------------------------------------------------------------------------
+// Written so the benchmark loops can't be optimized away
+static volatile float s_flBenchmarkSink;
+
+static double BenchmarkSIMD(BrdfOutput_t nOutput, int nCombos, int nPasses)
+{
+    CFastTimer timer;
+    timer.Start();
+    fltx4 sum = Four_Zeros;
+    for (int nPass = 0; nPass < nPasses; ++nPass)
+    {
+        for (int i = 0; i < RANDOM_POINT_COUNT / 4; ++i)
+        {
+            FourVectors result = Evaluate4(nOutput, nCombos, s_RandomPoints4[i], &s_RandomLightwarp);
+            sum = AddSIMD(sum, AddSIMD(result.x, AddSIMD(result.y, result.z)));
+        }
+    }
+    timer.End();
+    s_flBenchmarkSink = SubFloat(sum, 0);
+    return (double)nPasses * RANDOM_POINT_COUNT / MAX(timer.GetDuration().GetSeconds(), 1e-9) / 1e6;
+}
+
+static double BenchmarkScalar(BrdfOutput_t nOutput, int nCombos, int nPasses)
+{
+    CFastTimer timer;
+    timer.Start();
+    float flSum = 0.0f;
+    for (int nPass = 0; nPass < nPasses; ++nPass)
+    {
+        for (int i = 0; i < RANDOM_POINT_COUNT; ++i)
+        {
+            Vector result = Evaluate(nOutput, nCombos, s_RandomPoints[i], &s_RandomLightwarp);
+            flSum += result.x + result.y + result.z;
+        }
+    }
+    timer.End();
+    s_flBenchmarkSink = flSum;
+    return (double)nPasses * RANDOM_POINT_COUNT / MAX(timer.GetDuration().GetSeconds(), 1e-9) / 1e6;
+}
+
+static void Benchmark(BrdfOutput_t nOutput, int nCombos, const char *pName, int nPasses)
+{
+    double flSIMD = BenchmarkSIMD(nOutput, nCombos, nPasses);
+    double flScalar = BenchmarkScalar(nOutput, nCombos, nPasses);
+    Msg("  %-44s %9.2f Msamples/s  (scalar %8.2f, %.1fx)\n", pName, flSIMD, flScalar, flSIMD / MAX(flScalar, 1e-9));
+}
+
+//-----------------------------------------------------------------------------
+// Runs the checks and, if nBenchmarkSamples > 0, the benchmark. True if the checks passed.
+//-----------------------------------------------------------------------------
+bool PBR_BrdfSelfTest(int nBenchmarkSamples)
+{
+    BuildRandomPoints();
+
+    bool bGoldenOk = CheckGoldenValues();
+    Msg("PBR BRDF golden values: %s\n", bGoldenOk ? "passed" : "FAILED");
+
+    bool bReferenceOk = CheckAgainstReference();
+    Msg("PBR BRDF SIMD against the scalar reference (%d points, %d combos): %s\n", RANDOM_POINT_COUNT, PBR_BRDF_COMBO_COUNT,
+        bReferenceOk ? "passed" : "FAILED");
+
+    if (nBenchmarkSamples > 0)
+    {
+        int nPasses = MAX(1, nBenchmarkSamples / RANDOM_POINT_COUNT);
+        Msg("PBR BRDF throughput, %d samples each:\n", nPasses * RANDOM_POINT_COUNT);
+        Benchmark(BRDF_OUTPUT_ENVBRDF, 0, "EnvBRDFApprox", nPasses);
+        for (int i = 0; i < ARRAYSIZE(s_GoldenCombos); ++i)
+        {
+            char szCombos[64], szName[128];
+            GetComboName(s_GoldenCombos[i], szCombos, sizeof(szCombos));
+            V_snprintf(szName, sizeof(szName), "calculateLight (%s)", szCombos);
+            Benchmark(BRDF_OUTPUT_LIGHT, s_GoldenCombos[i], szName, nPasses);
+        }
+        Benchmark(BRDF_OUTPUT_SSS, 0, "ComputeSubsurfaceScattering", nPasses);
+    }
+
+    return bGoldenOk && bReferenceOk;
+}
+
+CON_COMMAND(mat_pbr_brdf_selftest, "Check the CPU port of the PBR BRDF against its golden values and the HLSL reference, and time it. Optional argument: millions of samples to time per function (default 4, 0 to skip).")
+{
+    float flMSamples = (args.ArgC() > 1) ? atof(args[1]) : 4.0f;
+    PBR_BrdfSelfTest((int)(flMSamples * 1e6f));
+}
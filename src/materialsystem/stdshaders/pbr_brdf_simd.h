@@ -0,0 +1,287 @@
+//==================================================================================================
+//
+// CPU port of the PBR BRDF in pbr_common_ps2_3_x.h, evaluating four shading points per call
+//
+// Each function matches its HLSL namesake, with FourVectors for float3 and fltx4 for float.
+// The static combos that change calculateLight are template flags (PBR_BRDF_*), so every
+// combination compiles to its own branch-free function like the pixel shader does.
+// Keep this in step with the HLSL: mat_pbr_brdf_selftest checks it against a scalar
+// transliteration and against golden values (pbr_brdf_simd.cpp).
+//
+//==================================================================================================
+
+#ifndef PBR_BRDF_SIMD_H
+#define PBR_BRDF_SIMD_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "mathlib/ssemath.h"
+
+// Static combos of pbr_ps30 that change calculateLight
+enum PBRBrdfCombo_t
+{
+    PBR_BRDF_SPECULAR = 0x1,
+    PBR_BRDF_LIGHTMAPPED = 0x2,
+    PBR_BRDF_FLASHLIGHT = 0x4,
+    PBR_BRDF_LIGHTWARPTEXTURE = 0x8,
+
+    PBR_BRDF_COMBO_COUNT = 0x10
+};
+
+// Same values as the HLSL, not the mathlib ones
+#define PBR_BRDF_PI         3.141592f
+#define PBR_BRDF_EPSILON    0.00001f
+
+//-----------------------------------------------------------------------------
+// The lightwarp texture: a row of linear RGB texels, sampled like tex1D with
+// bilinear filtering and clamp addressing
+//-----------------------------------------------------------------------------
+struct PBRLightwarp_t
+{
+    const Vector *m_pTexels;
+    int m_nWidth;
+};
+
+inline Vector PBR_SampleLightwarp(const PBRLightwarp_t &lightwarp, float u)
+{
+    float x = u * lightwarp.m_nWidth - 0.5f;
+    int x0 = (int)floorf(x);
+    float t = x - x0;
+    int x1 = clamp(x0 + 1, 0, lightwarp.m_nWidth - 1);
+    x0 = clamp(x0, 0, lightwarp.m_nWidth - 1);
+    return lightwarp.m_pTexels[x0] + (lightwarp.m_pTexels[x1] - lightwarp.m_pTexels[x0]) * t;
+}
+
+//-----------------------------------------------------------------------------
+// Helpers
+//-----------------------------------------------------------------------------
+FORCEINLINE FourVectors PBR_Scale4(const FourVectors &v, const fltx4 &scale)
+{
+    FourVectors result;
+    result.x = MulSIMD(v.x, scale);
+    result.y = MulSIMD(v.y, scale);
+    result.z = MulSIMD(v.z, scale);
+    return result;
+}
+
+FORCEINLINE FourVectors PBR_Mul4(const FourVectors &a, const FourVectors &b)
+{
+    FourVectors result;
+    result.x = MulSIMD(a.x, b.x);
+    result.y = MulSIMD(a.y, b.y);
+    result.z = MulSIMD(a.z, b.z);
+    return result;
+}
+
+FORCEINLINE FourVectors PBR_Add4(const FourVectors &a, const FourVectors &b)
+{
+    FourVectors result;
+    result.x = AddSIMD(a.x, b.x);
+    result.y = AddSIMD(a.y, b.y);
+    result.z = AddSIMD(a.z, b.z);
+    return result;
+}
+
+FORCEINLINE fltx4 PBR_SaturateSIMD(const fltx4 &x)
+{
+    return MinSIMD(Four_Ones, MaxSIMD(Four_Zeros, x));
+}
+
+// pow(x, 5) as the compiler expands it for a constant exponent
+FORCEINLINE fltx4 PBR_Pow5SIMD(const fltx4 &x)
+{
+    fltx4 x2 = MulSIMD(x, x);
+    return MulSIMD(MulSIMD(x2, x2), x);
+}
+
+// pow for fractional exponents. PowSIMD only keeps two bits of the fraction, so go per lane.
+FORCEINLINE fltx4 PBR_PowSIMD(const fltx4 &x, const fltx4 &y)
+{
+    fltx4 result;
+    SubFloat(result, 0) = powf(SubFloat(x, 0), SubFloat(y, 0));
+    SubFloat(result, 1) = powf(SubFloat(x, 1), SubFloat(y, 1));
+    SubFloat(result, 2) = powf(SubFloat(x, 2), SubFloat(y, 2));
+    SubFloat(result, 3) = powf(SubFloat(x, 3), SubFloat(y, 3));
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+// The BRDF terms
+//-----------------------------------------------------------------------------
+FORCEINLINE FourVectors PBR_FresnelSchlick4(const FourVectors &F0, const fltx4 &cosTheta)
+{
+    fltx4 f = PBR_Pow5SIMD(SubSIMD(Four_Ones, cosTheta));
+    FourVectors result;
+    result.x = MaddSIMD(SubSIMD(Four_Ones, F0.x), f, F0.x);
+    result.y = MaddSIMD(SubSIMD(Four_Ones, F0.y), f, F0.y);
+    result.z = MaddSIMD(SubSIMD(Four_Ones, F0.z), f, F0.z);
+    return result;
+}
+
+FORCEINLINE FourVectors PBR_FresnelSchlickRoughness4(const FourVectors &F0, const fltx4 &cosTheta, const fltx4 &roughness)
+{
+    fltx4 f = PBR_Pow5SIMD(SubSIMD(Four_Ones, cosTheta));
+    fltx4 smooth = SubSIMD(Four_Ones, roughness);
+    FourVectors result;
+    result.x = MaddSIMD(MaxSIMD(Four_Zeros, SubSIMD(smooth, F0.x)), f, F0.x);
+    result.y = MaddSIMD(MaxSIMD(Four_Zeros, SubSIMD(smooth, F0.y)), f, F0.y);
+    result.z = MaddSIMD(MaxSIMD(Four_Zeros, SubSIMD(smooth, F0.z)), f, F0.z);
+    return result;
+}
+
+FORCEINLINE fltx4 PBR_NdfGGX4(const fltx4 &cosLh, const fltx4 &roughness)
+{
+    fltx4 alpha = MulSIMD(roughness, roughness);
+    fltx4 alphaSq = MulSIMD(alpha, alpha);
+
+    fltx4 denom = MaddSIMD(MulSIMD(cosLh, cosLh), SubSIMD(alphaSq, Four_Ones), Four_Ones);
+    return DivSIMD(alphaSq, MulSIMD(ReplicateX4(PBR_BRDF_PI), MulSIMD(denom, denom)));
+}
+
+FORCEINLINE fltx4 PBR_GaSchlickG14(const fltx4 &cosTheta, const fltx4 &k)
+{
+    return DivSIMD(cosTheta, MaddSIMD(cosTheta, SubSIMD(Four_Ones, k), k));
+}
+
+FORCEINLINE fltx4 PBR_GaSchlickGGX4(const fltx4 &cosLi, const fltx4 &cosLo, const fltx4 &roughness)
+{
+    fltx4 r = AddSIMD(roughness, Four_Ones);
+    fltx4 k = MulSIMD(MulSIMD(r, r), ReplicateX4(1.0f / 8.0f));
+    return MulSIMD(PBR_GaSchlickG14(cosLi, k), PBR_GaSchlickG14(cosLo, k));
+}
+
+FORCEINLINE FourVectors PBR_EnvBRDFApprox4(const FourVectors &specularColor, const fltx4 &roughness, const fltx4 &NoV)
+{
+    // r = Roughness * c0 + c1
+    fltx4 rx = SubSIMD(Four_Ones, roughness);
+    fltx4 ry = MaddSIMD(roughness, ReplicateX4(-0.0275f), ReplicateX4(0.0425f));
+    fltx4 rz = MaddSIMD(roughness, ReplicateX4(-0.572f), ReplicateX4(1.04f));
+    fltx4 rw = MaddSIMD(roughness, ReplicateX4(0.022f), ReplicateX4(-0.04f));
+
+    fltx4 a004 = MaddSIMD(MinSIMD(MulSIMD(rx, rx), ExpSIMD(MulSIMD(ReplicateX4(-9.28f), NoV))), rx, ry);
+    fltx4 A = MaddSIMD(ReplicateX4(-1.04f), a004, rz);
+    fltx4 B = MaddSIMD(ReplicateX4(1.04f), a004, rw);
+
+    FourVectors result;
+    result.x = MaddSIMD(specularColor.x, A, B);
+    result.y = MaddSIMD(specularColor.y, A, B);
+    result.z = MaddSIMD(specularColor.z, A, B);
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+// PixelShaderAmbientLight from common_vertexlitgeneric_dx9.h. pAmbientCube
+// holds the +X, -X, +Y, -Y, +Z and -Z colors.
+//-----------------------------------------------------------------------------
+FORCEINLINE FourVectors PBR_AmbientLight4(const FourVectors &worldNormal, const Vector *pAmbientCube)
+{
+    FourVectors result;
+    result.x = result.y = result.z = Four_Zeros;
+    for (int nAxis = 0; nAxis < 3; ++nAxis)
+    {
+        fltx4 n = worldNormal[nAxis];
+        fltx4 nSquared = MulSIMD(n, n);
+        fltx4 isNegative = CmpLtSIMD(n, Four_Zeros);
+        const Vector &positive = pAmbientCube[nAxis * 2];
+        const Vector &negative = pAmbientCube[nAxis * 2 + 1];
+        result.x = MaddSIMD(nSquared, MaskedAssign(isNegative, ReplicateX4(negative.x), ReplicateX4(positive.x)), result.x);
+        result.y = MaddSIMD(nSquared, MaskedAssign(isNegative, ReplicateX4(negative.y), ReplicateX4(positive.y)), result.y);
+        result.z = MaddSIMD(nSquared, MaskedAssign(isNegative, ReplicateX4(negative.z), ReplicateX4(positive.z)), result.z);
+    }
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+// Direct light from one source. nCombos is a mask of PBRBrdfCombo_t; pLightwarp
+// is only read with PBR_BRDF_LIGHTWARPTEXTURE.
+//-----------------------------------------------------------------------------
+template <int nCombos>
+FORCEINLINE FourVectors PBR_CalculateLight4(const FourVectors &lightIn, const FourVectors &lightIntensity, const FourVectors &lightOut,
+                                            const FourVectors &normal, const FourVectors &fresnelReflectance, const fltx4 &roughness,
+                                            const fltx4 &metalness, const fltx4 &lightDirectionAngle, const FourVectors &albedo,
+                                            const PBRLightwarp_t *pLightwarp)
+{
+    // Lh
+    FourVectors halfAngle = PBR_Add4(lightIn, lightOut);
+    halfAngle.VectorNormalize();
+    fltx4 NDotL = normal * lightIn;
+    fltx4 cosLightIn = MaxSIMD(Four_Zeros, NDotL);
+    fltx4 cosHalfAngle = MaxSIMD(Four_Zeros, normal * halfAngle);
+
+    FourVectors F = PBR_FresnelSchlick4(fresnelReflectance, MaxSIMD(Four_Zeros, halfAngle * lightOut));
+    fltx4 D = PBR_NdfGGX4(cosHalfAngle, roughness);
+    fltx4 G = PBR_GaSchlickGGX4(cosLightIn, lightDirectionAngle, roughness);
+
+    // kd = 1 - F, lerped to 0 by metalness unless there's an F0 map
+    FourVectors kd;
+    kd.x = SubSIMD(Four_Ones, F.x);
+    kd.y = SubSIMD(Four_Ones, F.y);
+    kd.z = SubSIMD(Four_Ones, F.z);
+    if (!(nCombos & PBR_BRDF_SPECULAR))
+    {
+        kd = PBR_Scale4(kd, SubSIMD(Four_Ones, metalness));
+    }
+
+    FourVectors diffuseBRDF = PBR_Mul4(kd, albedo);
+
+    // Cook-Torrance specular microfacet BRDF
+    fltx4 specDenom = MaxSIMD(ReplicateX4(PBR_BRDF_EPSILON), MulSIMD(ReplicateX4(4.0f), MulSIMD(cosLightIn, lightDirectionAngle)));
+    FourVectors specularBRDF = PBR_Scale4(F, DivSIMD(MulSIMD(D, G), specDenom));
+
+    FourVectors result;
+    if (nCombos & PBR_BRDF_LIGHTWARPTEXTURE)
+    {
+        // Diffuse term from the half lambert through the warp
+        fltx4 halfLambert = PBR_SaturateSIMD(MaddSIMD(NDotL, Four_PointFives, Four_PointFives));
+        FourVectors warp;
+        for (int i = 0; i < 4; ++i)
+        {
+            Vector texel = PBR_SampleLightwarp(*pLightwarp, SubFloat(halfLambert, i)) * 3.0f;
+            SubFloat(warp.x, i) = texel.x;
+            SubFloat(warp.y, i) = texel.y;
+            SubFloat(warp.z, i) = texel.z;
+        }
+        result = PBR_Mul4(PBR_Add4(PBR_Mul4(diffuseBRDF, warp), specularBRDF), lightIntensity);
+    }
+    else if ((nCombos & PBR_BRDF_LIGHTMAPPED) && !(nCombos & PBR_BRDF_FLASHLIGHT))
+    {
+        // Diffuse from static lights is already in the lightmap
+        result = PBR_Scale4(PBR_Mul4(specularBRDF, lightIntensity), cosLightIn);
+    }
+    else
+    {
+        result = PBR_Scale4(PBR_Mul4(PBR_Add4(diffuseBRDF, specularBRDF), lightIntensity), cosLightIn);
+    }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+// Subsurface scattering for one light. N, L and V are normalized.
+//-----------------------------------------------------------------------------
+FORCEINLINE FourVectors PBR_SubsurfaceScattering4(const FourVectors &N, const FourVectors &L, const FourVectors &V, const fltx4 &thickness,
+                                                  const FourVectors &sssColor, const fltx4 &intensity, const fltx4 &powerScale)
+{
+    fltx4 backlit = MaxSIMD(Four_Zeros, SubSIMD(Four_Zeros, N * L));
+    backlit = PBR_PowSIMD(backlit, ReplicateX4(0.3f));
+
+    fltx4 transmittance = PBR_PowSIMD(SubSIMD(Four_Ones, thickness), powerScale);
+
+    fltx4 sssStrength = MulSIMD(backlit, transmittance);
+    fltx4 ambientSSS = MulSIMD(transmittance, ReplicateX4(0.3f));
+    sssStrength = MaxSIMD(sssStrength, ambientSSS);
+
+    fltx4 facingFactor = PBR_SaturateSIMD(V * N);
+    fltx4 scale = MulSIMD(MulSIMD(sssStrength, intensity), MaddSIMD(ReplicateX4(0.3f), facingFactor, ReplicateX4(0.7f)));
+    return PBR_Scale4(sssColor, scale);
+}
+
+//-----------------------------------------------------------------------------
+// Checks the port against its golden values and the scalar reference, and if
+// nBenchmarkSamples > 0 times it. Prints the results; true if the checks passed.
+// Also run by mat_pbr_brdf_selftest.
+//-----------------------------------------------------------------------------
+bool PBR_BrdfSelfTest(int nBenchmarkSamples);
+
+#endif // PBR_BRDF_SIMD_H
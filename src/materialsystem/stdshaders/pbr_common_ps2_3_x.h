@@ -183,7 +183,9 @@ float3 ambientLookup(float3 normal, float3 EnvAmbientCube[6], float3 textureNorm
 #endif
 }
 
-// Create an ambient cube from the envmap
+// Create an ambient cube from the envmap. Only the USEENVAMBIENT combo does this per pixel;
+// with mat_pbr_envambient_cpu, pbr_envambient.cpp reads the same six colors once per cubemap
+// and pbr_dx9 uploads them to cAmbientCube.
 void setupEnvMapAmbientCube(out float3 EnvAmbientCube[6], sampler EnvmapSampler)
 {
     float4 directionPosX = { 1, 0, 0, 12 }; float4 directionNegX = { -1, 0, 0, 12 };
@@ -8,6 +8,14 @@
 #include "BaseVSShader.h"
 #include "cpp_shader_constant_register_map.h"
 #include "vtf/vtf.h"
+#include "shaderlib/commandbuilder.h"
+#include "materialsystem/imaterialsystem.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/jobthread.h"
+#include "shaderlib/shaderlib_combousage.h"
+#include "shaderlib/shaderlib_drawstream.h"
+#include "shaderlib/shaderlib_statecache.h"
+#include "pbr_envambient.h"
 
 #include "pbr_vs30.inc"
 #include "pbr_ps30.inc"
@@ -20,6 +28,7 @@ const Sampler_t SAMPLER_SHADOWDEPTH = SHADER_SAMPLER4;
 const Sampler_t SAMPLER_RANDOMROTATION = SHADER_SAMPLER5;
 const Sampler_t SAMPLER_FLASHLIGHT = SHADER_SAMPLER6;
 const Sampler_t SAMPLER_LIGHTMAP = SHADER_SAMPLER7;
+const Sampler_t SAMPLER_ENVBRDFLUT = SHADER_SAMPLER8;
 const Sampler_t SAMPLER_MRAO = SHADER_SAMPLER10;
 const Sampler_t SAMPLER_EMISSIVE = SHADER_SAMPLER11;
 const Sampler_t SAMPLER_SPECULAR = SHADER_SAMPLER12;
@@ -30,11 +39,91 @@ static ConVar mat_fullbright("mat_fullbright", "0", FCVAR_CHEAT);
 static ConVar mat_specular("mat_specular", "1", FCVAR_NONE);
 static ConVar mat_pbr_parallaxmap("mat_pbr_parallaxmap", "1");
 static ConVar mat_pbr_subsurfacescattering("mat_pbr_subsurfacescattering", "1");
+static ConVar mat_pbr_envbrdflut("mat_pbr_envbrdflut", "1", FCVAR_NONE, "Use $envbrdflut where materials set it, instead of the analytic EnvBRDFApprox fit");
+static ConVar mat_pbr_envambient_cpu("mat_pbr_envambient_cpu", "1", FCVAR_NONE, "Read the $useenvambient ambient cube from each cubemap once on the CPU, instead of in every pixel");
 static ConVar mat_pbr_ssr("mat_pbr_ssr", "1", FCVAR_NONE, "Enable screen-space reflections");
 static ConVar mat_pbr_ssr_intensity("mat_pbr_ssr_intensity", "1.0", FCVAR_NONE, "SSR intensity multiplier");
 static ConVar mat_pbr_ssr_step_count("mat_pbr_ssr_step_count", "8", FCVAR_NONE, "SSR ray march step count");
 static ConVar mat_pbr_ssr_roughness_threshold("mat_pbr_ssr_roughness_threshold", "0.6", FCVAR_NONE, "Only apply SSR below this roughness");
 
+//-----------------------------------------------------------------------------
+// Snapshot of the cvars above. Their change callbacks bump the generation and
+// draws only re-read the cvars when it moved, picking up the SSR constants
+// already packed. Like CBaseShader's draw state each thread has its own, since
+// the engine snapshots materials on one thread while another draws.
+//-----------------------------------------------------------------------------
+struct PBR_Settings_t
+{
+    int m_nGeneration;
+    int m_nFullbright;
+    bool m_bSpecular;
+    bool m_bParallaxMap;
+    bool m_bSubsurfaceScattering;
+    bool m_bSSR;
+    bool m_bEnvBRDFLUT;
+    bool m_bEnvAmbientCPU;
+    float m_vSSRParams[2][4];   // PSREG_SSR_PARAMS_1 and _2
+};
+
+static DECL_THREAD_LOCAL PBR_Settings_t s_PBRSettings;
+static volatile int s_nPBRSettingsGeneration = 1;
+
+static void OnPBRSettingChanged(IConVar* var, const char* pOldValue, float flOldValue)
+{
+    ++s_nPBRSettingsGeneration;
+}
+
+// Called from shader init, after ConVar_Register has linked mat_fullbright and
+// mat_specular to the engine's copies, so the callbacks land on those.
+static void InstallPBRSettingsCallbacks()
+{
+    static bool s_bInstalled = false;
+    if (s_bInstalled)
+        return;
+
+    s_bInstalled = true;
+    mat_fullbright.InstallChangeCallback(OnPBRSettingChanged, false);
+    mat_specular.InstallChangeCallback(OnPBRSettingChanged, false);
+    mat_pbr_parallaxmap.InstallChangeCallback(OnPBRSettingChanged, false);
+    mat_pbr_subsurfacescattering.InstallChangeCallback(OnPBRSettingChanged, false);
+    mat_pbr_envbrdflut.InstallChangeCallback(OnPBRSettingChanged, false);
+    mat_pbr_envambient_cpu.InstallChangeCallback(OnPBRSettingChanged, false);
+    mat_pbr_ssr.InstallChangeCallback(OnPBRSettingChanged, false);
+    mat_pbr_ssr_intensity.InstallChangeCallback(OnPBRSettingChanged, false);
+    mat_pbr_ssr_step_count.InstallChangeCallback(OnPBRSettingChanged, false);
+    mat_pbr_ssr_roughness_threshold.InstallChangeCallback(OnPBRSettingChanged, false);
+    ++s_nPBRSettingsGeneration;
+}
+
+static const PBR_Settings_t& GetPBRSettings()
+{
+    PBR_Settings_t& settings = s_PBRSettings;
+    if (settings.m_nGeneration == s_nPBRSettingsGeneration)
+        return settings;
+
+    // Take the generation first, so a change made while we read is picked up next draw
+    settings.m_nGeneration = s_nPBRSettingsGeneration;
+    settings.m_nFullbright = mat_fullbright.GetInt();
+    settings.m_bSpecular = mat_specular.GetBool();
+    settings.m_bParallaxMap = mat_pbr_parallaxmap.GetBool();
+    settings.m_bSubsurfaceScattering = mat_pbr_subsurfacescattering.GetBool();
+    settings.m_bSSR = mat_pbr_ssr.GetBool();
+    settings.m_bEnvBRDFLUT = mat_pbr_envbrdflut.GetBool();
+    settings.m_bEnvAmbientCPU = mat_pbr_envambient_cpu.GetBool();
+
+    settings.m_vSSRParams[0][0] = 0.5f;
+    settings.m_vSSRParams[0][1] = 0.25f;
+    settings.m_vSSRParams[0][2] = 0.1f;
+    settings.m_vSSRParams[0][3] = mat_pbr_ssr_intensity.GetFloat();
+
+    settings.m_vSSRParams[1][0] = (float)mat_pbr_ssr_step_count.GetInt();
+    settings.m_vSSRParams[1][1] = 0.35f;
+    settings.m_vSSRParams[1][2] = 0.5f;
+    settings.m_vSSRParams[1][3] = mat_pbr_ssr_roughness_threshold.GetFloat();
+
+    return settings;
+}
+
 struct PBR_Vars_t
 {
     PBR_Vars_t()
@@ -75,6 +164,101 @@ struct PBR_Vars_t
     int ssrIntensity;
     int ssrQuality;
     int ssrRoughnessThreshold;
+    int envMapPrefiltered;
+    int envBRDFLUT;
+};
+
+//-----------------------------------------------------------------------------
+// The per-material pixel shader constants, in the order the register map
+// packs them from PSREG_MRAO_FACTORS
+//-----------------------------------------------------------------------------
+enum PBRMaterialConst_t
+{
+    PBR_CONST_MRAO_FACTORS = 0,
+    PBR_CONST_EXTRA_FACTORS,
+    PBR_CONST_SSS_COLOR,
+    PBR_CONST_BASE_COLOR,
+    PBR_CONST_PARALLAX_PARAMS,
+
+    PBR_MATERIAL_CONST_COUNT
+};
+
+//-----------------------------------------------------------------------------
+// Per-material state resolved from the material vars. Rebuilt only when the
+// material system flags the vars as changed, so the dynamic path doesn't
+// have to re-query every IMaterialVar on every draw.
+//-----------------------------------------------------------------------------
+class CPBR_DX9_Context : public CBasePerMaterialContextData
+{
+public:
+    CPBR_DX9_Context() : m_pEnvMapTexture(NULL), m_flEnvMapLOD(0.0f), m_bEnvMapIsEnvCubemap(false), m_bEnvMapLODValid(false),
+        m_pEnvAmbientTexture(NULL), m_nEnvAmbientGeneration(0), m_bSnapshotEnvBRDFLUT(false)
+    {
+        m_bSnapshotEnvAmbientCPU[0] = m_bSnapshotEnvAmbientCPU[1] = false;
+        m_nStaticVSIndex[0] = m_nStaticVSIndex[1] = -1;
+        m_nStaticPSIndex[0] = m_nStaticPSIndex[1] = -1;
+        m_nSortKey[0] = m_nSortKey[1] = 0;
+    }
+
+    // Draws sorted by this key switch shaders and textures as little as possible.
+    // See ComputeSortKeyTextureBits for the layout.
+    uint64 GetSortKey(bool bFlashlight = false) const { return m_nSortKey[bFlashlight]; }
+
+    PBR_Vars_t m_Info;
+
+    bool m_bHasBaseTexture;
+    bool m_bHasNormalTexture;
+    bool m_bHasMraoTexture;
+    bool m_bHasEmissionTexture;
+    bool m_bHasEnvTexture;
+    bool m_bHasSpecularTexture;
+    bool m_bHasLightwarpTexture;
+    bool m_bHasEnvBRDFLUT;
+    bool m_bIsAlphaTested;
+    bool m_bLightMapped;
+    bool m_bUseEnvAmbient;
+    bool m_bFullyOpaque;        // ignores alpha modulation, which is per-draw
+
+    // Material side of the SSS/SSR switches; the matching cvars are applied per-draw
+    bool m_bWantsSSS;
+    bool m_bWantsSSR;
+
+    // In register order from PSREG_MRAO_FACTORS, uploaded with one call.
+    // MRAO w is the SSAO factor before the flashlight AO scale.
+    float m_vMaterialConsts[PBR_MATERIAL_CONST_COUNT][4];
+
+    // Cubemap the LOD and env_cubemap test below were worked out for. Proxies
+    // can swap the texture, so this is checked every draw, and the vars
+    // changing clears m_bEnvMapLODValid.
+    ITexture* m_pEnvMapTexture;
+    float m_flEnvMapLOD;        // Mip sampled at roughness 1
+    bool m_bEnvMapIsEnvCubemap; // $useenvambient resolves it to the local cubemap
+    bool m_bEnvMapLODValid;
+
+    // $useenvambient's ambient cube for the cubemap last drawn with, copied from
+    // pbr_envambient's cache as of m_nEnvAmbientGeneration
+    ITexture* m_pEnvAmbientTexture;
+    int m_nEnvAmbientGeneration;
+    float m_vEnvAmbientCube[PBR_ENV_AMBIENT_CUBE_REGISTERS][4];
+
+    // mat_pbr_envbrdflut as the non-flashlight snapshot baked it into the ENVBRDFLUT combo.
+    // Draws follow it until the snapshots are rebuilt, not the live cvar.
+    bool m_bSnapshotEnvBRDFLUT;
+    // mat_pbr_envambient_cpu as each snapshot, indexed by the flashlight pass, baked it into the
+    // USEENVAMBIENT combo and the ambient cube command
+    bool m_bSnapshotEnvAmbientCPU[2];
+
+    // Static combos chosen by each snapshot, indexed by the flashlight pass, for
+    // mat_pbr_combousage and mat_pbr_drawstream
+    int m_nStaticVSIndex[2];
+    int m_nStaticPSIndex[2];
+
+    // Sort key of each pass, indexed like m_nStaticVSIndex. Static combo bits are set by
+    // that pass's snapshot, the texture bits whenever the material vars change.
+    uint64 m_nSortKey[2];
+
+    // Material constants, recorded once and replayed every draw
+    CCommandBufferBuilder< CFixedCommandStorageBuffer< 256 > > m_SemiStaticCmdsOut;
 };
 
 BEGIN_VS_SHADER(PBR, "PBR shader with SSR")
@@ -87,8 +271,10 @@ SHADER_PARAM(EMISSIONTEXTURE, SHADER_PARAM_TYPE_TEXTURE, "", "Emission texture")
 SHADER_PARAM(NORMALTEXTURE, SHADER_PARAM_TYPE_TEXTURE, "", "Normal texture (deprecated, use $bumpmap)");
 SHADER_PARAM(BUMPMAP, SHADER_PARAM_TYPE_TEXTURE, "", "Normal texture");
 SHADER_PARAM(USEENVAMBIENT, SHADER_PARAM_TYPE_BOOL, "0", "Use the cubemaps to compute ambient light.");
+SHADER_PARAM(ENVMAPPREFILTERED, SHADER_PARAM_TYPE_BOOL, "0", "The cubemap's mips are GGX prefiltered (pbrenvfilter), so rough reflections use them alone.");
 SHADER_PARAM(SPECULARTEXTURE, SHADER_PARAM_TYPE_TEXTURE, "", "Specular F0 RGB map");
 SHADER_PARAM(LIGHTWARPTEXTURE, SHADER_PARAM_TYPE_TEXTURE, "", "Lightwarp Texture");
+SHADER_PARAM(ENVBRDFLUT, SHADER_PARAM_TYPE_TEXTURE, "", "Split-sum GGX scale and bias over (NoV, roughness), baked by pbrbrdflut. Replaces the EnvBRDFApprox fit.");
 SHADER_PARAM(PARALLAX, SHADER_PARAM_TYPE_BOOL, "0", "Use Parallax Occlusion Mapping.");
 SHADER_PARAM(PARALLAXDEPTH, SHADER_PARAM_TYPE_FLOAT, "0.0030", "Depth of the Parallax Map");
 SHADER_PARAM(PARALLAXCENTER, SHADER_PARAM_TYPE_FLOAT, "0.5", "Center depth of the Parallax Map");
@@ -144,10 +330,14 @@ void SetupVars(PBR_Vars_t& info)
     info.ssrIntensity = SSRINTENSITY;
     info.ssrQuality = SSRQUALITY;
     info.ssrRoughnessThreshold = SSRROUGHNESSTHRESHOLD;
+    info.envMapPrefiltered = ENVMAPPREFILTERED;
+    info.envBRDFLUT = ENVBRDFLUT;
 }
 
 SHADER_INIT_PARAMS()
 {
+    InstallPBRSettingsCallbacks();
+
     if (params[NORMALTEXTURE]->IsDefined())
         params[BUMPMAP]->SetStringValue(params[NORMALTEXTURE]->GetStringValue());
 
@@ -201,6 +391,12 @@ SHADER_INIT
     envMapFlags |= TEXTUREFLAGS_ALL_MIPS;
     LoadCubeMap(info.envMap, envMapFlags);
 
+    // Read the ambient cube now rather than in the first draw. env_cubemap is left to the draws.
+    if (GetIntParam(info.useEnvAmbient, params) == 1 && mat_pbr_envambient_cpu.GetBool() && params[info.envMap]->IsTexture())
+    {
+        PBR_PrecacheEnvAmbientCube(params[info.envMap]->GetTextureValue());
+    }
+
     if (info.emissionTexture >= 0 && params[EMISSIONTEXTURE]->IsDefined())
         LoadTexture(info.emissionTexture, TEXTUREFLAGS_SRGB);
 
@@ -227,6 +423,11 @@ SHADER_INIT
         LoadTexture(info.thicknessTexture, 0);
     }
 
+    if (params[info.envBRDFLUT]->IsDefined())
+    {
+        LoadTexture(info.envBRDFLUT, 0);
+    }
+
     if (IS_FLAG_SET(MATERIAL_VAR_MODEL))
     {
         SET_FLAGS2(MATERIAL_VAR2_SUPPORTS_HW_SKINNING);
@@ -249,28 +450,207 @@ SHADER_INIT
     SET_FLAGS2(MATERIAL_VAR2_USE_GBUFFER1);
 }
 
-SHADER_DRAW
+// The specular lookup samples mip roughness * LOD, so LOD is the mip count
+// of the cubemap, kept away from the tiny and the blurry ends.
+static float ComputeEnvMapLOD(ITexture* pEnvTexture)
 {
-    PBR_Vars_t info;
+    int iEnvMapLOD = 6;
+    if (pEnvTexture)
+    {
+        int width = pEnvTexture->GetMappingWidth();
+        int mips = 0;
+        while (width >>= 1)
+            ++mips;
+        iEnvMapLOD = mips;
+    }
+
+    return (float)clamp(iEnvMapLOD, 4, 12);
+}
+
+//-----------------------------------------------------------------------------
+// Material sort key. The static combo comes first since shader switches cost
+// the most, then the cubemap, which is shared by everything around the same
+// env_cubemap, then the textures that are mostly unique to a material:
+//
+//  63..49  static combo (pixel static combo * vertex static combos + vertex static combo)
+//  48..36  envmap
+//  35..20  base texture
+//  19..10  normal map
+//   9..0   MRAO, emissive, specular, lightwarp and thickness textures
+//
+// Texture fields hold the low bits of the draw stream texture ids, so the key
+// is the same from one session to the next.
+//-----------------------------------------------------------------------------
+#define PBR_SORTKEY_COMBO_SHIFT     49
+#define PBR_SORTKEY_TEXTURE_MASK    ((1ull << PBR_SORTKEY_COMBO_SHIFT) - 1)
+
+static unsigned int SortKeyTextureID(IMaterialVar** params, int nTextureVar)
+{
+    if (!IsTextureSet(nTextureVar, params))
+        return 0;
+    return ShaderDrawStream_TextureID(params[nTextureVar]->GetTextureValue(), 0);
+}
+
+static uint64 ComputeSortKeyTextureBits(IMaterialVar** params, const PBR_Vars_t& info)
+{
+    unsigned int nOther = SortKeyTextureID(params, info.mraoTexture);
+    nOther = nOther * 31 + SortKeyTextureID(params, info.emissionTexture);
+    nOther = nOther * 31 + SortKeyTextureID(params, info.specularTexture);
+    nOther = nOther * 31 + SortKeyTextureID(params, info.lightwarpTexture);
+    nOther = nOther * 31 + SortKeyTextureID(params, info.thicknessTexture);
+
+    return ((uint64)(SortKeyTextureID(params, info.envMap) & 0x1FFF) << 36) |
+           ((uint64)(SortKeyTextureID(params, info.baseTexture) & 0xFFFF) << 20) |
+           ((uint64)(SortKeyTextureID(params, info.bumpMap) & 0x3FF) << 10) |
+           (uint64)((nOther ^ (nOther >> 10) ^ (nOther >> 20)) & 0x3FF);
+}
+
+static uint64 ComputeSortKeyComboBits(int nStaticVSIndex, int nStaticPSIndex)
+{
+    COMPILE_TIME_ASSERT(pbr_ps30_Combos::NUM_STATIC_COMBOS * pbr_vs30_Combos::NUM_STATIC_COMBOS <= (1 << (64 - PBR_SORTKEY_COMBO_SHIFT)));
+    int nCombo = (nStaticPSIndex / pbr_ps30_Combos::NUM_DYNAMIC_COMBOS) * pbr_vs30_Combos::NUM_STATIC_COMBOS +
+                 nStaticVSIndex / pbr_vs30_Combos::NUM_DYNAMIC_COMBOS;
+    return (uint64)nCombo << PBR_SORTKEY_COMBO_SHIFT;
+}
+
+void UpdateContextData(IMaterialVar** params, CPBR_DX9_Context* pContextData)
+{
+    PBR_Vars_t& info = pContextData->m_Info;
     SetupVars(info);
 
-    bool bHasBaseTexture = (info.baseTexture != -1) && params[info.baseTexture]->IsTexture();
-    bool bHasNormalTexture = (info.bumpMap != -1) && params[info.bumpMap]->IsTexture();
-    bool bHasMraoTexture = (info.mraoTexture != -1) && params[info.mraoTexture]->IsTexture();
-    bool bHasEmissionTexture = (info.emissionTexture != -1) && params[info.emissionTexture]->IsTexture();
-    bool bHasEnvTexture = (info.envMap != -1) && params[info.envMap]->IsTexture();
-    bool bIsAlphaTested = IS_FLAG_SET(MATERIAL_VAR_ALPHATEST) != 0;
+    pContextData->m_bEnvMapLODValid = false;
+    pContextData->m_nEnvAmbientGeneration = 0;
+
+    pContextData->m_bHasBaseTexture = IsTextureSet(info.baseTexture, params);
+    pContextData->m_bHasNormalTexture = IsTextureSet(info.bumpMap, params);
+    pContextData->m_bHasMraoTexture = IsTextureSet(info.mraoTexture, params);
+    pContextData->m_bHasEmissionTexture = IsTextureSet(info.emissionTexture, params);
+    pContextData->m_bHasEnvTexture = IsTextureSet(info.envMap, params);
+    pContextData->m_bHasSpecularTexture = IsTextureSet(info.specularTexture, params);
+    pContextData->m_bHasLightwarpTexture = IsTextureSet(info.lightwarpTexture, params);
+    pContextData->m_bHasEnvBRDFLUT = IsTextureSet(info.envBRDFLUT, params);
+    pContextData->m_bIsAlphaTested = IS_FLAG_SET(MATERIAL_VAR_ALPHATEST) != 0;
+    pContextData->m_bLightMapped = !IS_FLAG_SET(MATERIAL_VAR_MODEL);
+    pContextData->m_bUseEnvAmbient = GetIntParam(info.useEnvAmbient, params) == 1;
+    pContextData->m_bWantsSSS = IsTextureSet(info.thicknessTexture, params) && (GetIntParam(info.useSubsurfaceScattering, params) == 1);
+    pContextData->m_bWantsSSR = GetIntParam(info.useSSR, params) == 1;
+
+    // Same as EvaluateBlendRequirements, minus the alpha modulation which can change every draw
+    bool bTranslucent = IS_FLAG_SET(MATERIAL_VAR_VERTEXALPHA) ||
+        (TextureIsTranslucent(info.baseTexture, true) && !pContextData->m_bIsAlphaTested);
+    pContextData->m_bFullyOpaque = !bTranslucent && !pContextData->m_bIsAlphaTested;
+
+    float* pBaseColor = pContextData->m_vMaterialConsts[PBR_CONST_BASE_COLOR];
+    pBaseColor[0] = pBaseColor[1] = pBaseColor[2] = pBaseColor[3] = 1.0f;
+    if (IS_PARAM_DEFINED(info.baseColor))
+    {
+        params[info.baseColor]->GetVecValue(pBaseColor, 3);
+    }
+
+    float* pMRAOFactors = pContextData->m_vMaterialConsts[PBR_CONST_MRAO_FACTORS];
+    pMRAOFactors[0] = GetFloatParam(info.metalnessFactor, params, 1.0f);
+    pMRAOFactors[1] = GetFloatParam(info.roughnessFactor, params, 1.0f);
+    pMRAOFactors[2] = GetFloatParam(info.aoFactor, params, 1.0f);
+    pMRAOFactors[3] = GetFloatParam(info.ssaoFactor, params, 1.0f);
+
+    float* pExtraFactors = pContextData->m_vMaterialConsts[PBR_CONST_EXTRA_FACTORS];
+    pExtraFactors[0] = GetFloatParam(info.emissiveFactor, params, 1.0f);
+    pExtraFactors[1] = GetFloatParam(info.specularFactor, params, 1.0f);
+    pExtraFactors[2] = GetFloatParam(info.sssIntensity, params, 1.0f);
+    pExtraFactors[3] = GetFloatParam(info.sssPowerScale, params, 1.0f);
+
+    float* pSSSColor = pContextData->m_vMaterialConsts[PBR_CONST_SSS_COLOR];
+    pSSSColor[0] = pSSSColor[1] = pSSSColor[2] = pSSSColor[3] = 1.0f;
+    if (IS_PARAM_DEFINED(info.sssColor))
+    {
+        params[info.sssColor]->GetVecValue(pSSSColor, 3);
+    }
+
+    float* pParallaxParams = pContextData->m_vMaterialConsts[PBR_CONST_PARALLAX_PARAMS];
+    pParallaxParams[0] = GetFloatParam(info.parallaxDepth, params, 3.0f);
+    pParallaxParams[1] = GetFloatParam(info.parallaxCenter, params, 3.0f);
+    // How far rough reflections blend from the cubemap toward the ambient cube
+    pParallaxParams[2] = (GetIntParam(info.envMapPrefiltered, params) == 1) ? 0.0f : 1.0f;
+    pParallaxParams[3] = 0.0f;
+
+    uint64 nTextureBits = ComputeSortKeyTextureBits(params, info);
+    for (int i = 0; i < 2; ++i)
+    {
+        pContextData->m_nSortKey[i] = (pContextData->m_nSortKey[i] & ~PBR_SORTKEY_TEXTURE_MASK) | nTextureBits;
+    }
+}
+
+SHADER_DRAW
+{
+    CPBR_DX9_Context* pContextData = reinterpret_cast<CPBR_DX9_Context*>(*pContextDataPtr);
+    if (!pContextData)
+    {
+        pContextData = new CPBR_DX9_Context;
+        *pContextDataPtr = pContextData;
+    }
+
+    if (pShaderShadow || pContextData->m_bMaterialVarsChanged)
+    {
+        UpdateContextData(params, pContextData);
+
+        // Leave the flag set while snapshotting so the first dynamic pass still sees it
+        if (pShaderAPI)
+        {
+            pContextData->m_SemiStaticCmdsOut.Reset();
+            COMPILE_TIME_ASSERT(PSREG_EXTRA_FACTORS == PSREG_MRAO_FACTORS + PBR_CONST_EXTRA_FACTORS);
+            COMPILE_TIME_ASSERT(PSREG_CUSTOM_SSS_PARAMS == PSREG_MRAO_FACTORS + PBR_CONST_SSS_COLOR);
+            COMPILE_TIME_ASSERT(PSREG_BASE_COLOR == PSREG_MRAO_FACTORS + PBR_CONST_BASE_COLOR);
+            COMPILE_TIME_ASSERT(PSREG_PARALLAX_PARAMS == PSREG_MRAO_FACTORS + PBR_CONST_PARALLAX_PARAMS);
+            pContextData->m_SemiStaticCmdsOut.SetPixelShaderConstant(PSREG_MRAO_FACTORS,
+                pContextData->m_vMaterialConsts[0], PBR_MATERIAL_CONST_COUNT);
+            pContextData->m_SemiStaticCmdsOut.End();
+
+            // The flashlight pass stages PSREG_MRAO_FACTORS too; the command buffer rewrites it unseen
+            ShaderStateCache_ExcludePixelShaderConstants(PSREG_MRAO_FACTORS, PBR_MATERIAL_CONST_COUNT);
+
+            pContextData->m_bMaterialVarsChanged = false;
+        }
+    }
+
+    const PBR_Vars_t& info = pContextData->m_Info;
+
+    bool bHasBaseTexture = pContextData->m_bHasBaseTexture;
+    bool bHasNormalTexture = pContextData->m_bHasNormalTexture;
+    bool bHasMraoTexture = pContextData->m_bHasMraoTexture;
+    bool bHasEmissionTexture = pContextData->m_bHasEmissionTexture;
+    bool bHasEnvTexture = pContextData->m_bHasEnvTexture;
+    bool bIsAlphaTested = pContextData->m_bIsAlphaTested;
     bool bHasFlashlight = UsingFlashlight(params);
-    bool bHasColor = (info.baseColor != -1) && params[info.baseColor]->IsDefined();
-    bool bLightMapped = !IS_FLAG_SET(MATERIAL_VAR_MODEL);
-    bool bUseEnvAmbient = (info.useEnvAmbient != -1) && (params[info.useEnvAmbient]->GetIntValue() == 1);
-    bool bHasSpecularTexture = (info.specularTexture != -1) && params[info.specularTexture]->IsTexture();
-    bool bLightwarpTexture = (info.lightwarpTexture != -1) && params[info.lightwarpTexture]->IsTexture();
-    bool bHasSSS = (info.thicknessTexture != -1) && params[info.thicknessTexture]->IsTexture() && params[info.useSubsurfaceScattering]->GetIntValue() == 1 && mat_pbr_subsurfacescattering.GetBool();
-    bool bHasSSR = (info.useSSR != -1) && (params[info.useSSR]->GetIntValue() == 1) && mat_pbr_ssr.GetBool();
+    bool bLightMapped = pContextData->m_bLightMapped;
+    bool bUseEnvAmbient = pContextData->m_bUseEnvAmbient;
+    bool bHasSpecularTexture = pContextData->m_bHasSpecularTexture;
+    bool bLightwarpTexture = pContextData->m_bHasLightwarpTexture;
+    const PBR_Settings_t& settings = GetPBRSettings();
 
-    BlendType_t nBlendType = EvaluateBlendRequirements(info.baseTexture, true);
-    bool bFullyOpaque = (nBlendType != BT_BLENDADD) && (nBlendType != BT_BLEND) && !bIsAlphaTested;
+    bool bHasSSS = pContextData->m_bWantsSSS && settings.m_bSubsurfaceScattering;
+    bool bHasSSR = pContextData->m_bWantsSSR && settings.m_bSSR;
+
+    // The flashlight pass has no ambient specular to look up
+    if (IsSnapshotting() && !bHasFlashlight)
+    {
+        pContextData->m_bSnapshotEnvBRDFLUT = pContextData->m_bHasEnvBRDFLUT && settings.m_bEnvBRDFLUT;
+    }
+    bool bEnvBRDFLUT = pContextData->m_bSnapshotEnvBRDFLUT && !bHasFlashlight;
+
+    // The CPU-side ambient cube goes where the engine's would, so the shader reads it with
+    // USEENVAMBIENT off and skips the six cubemap lookups per pixel
+    if (IsSnapshotting())
+    {
+        pContextData->m_bSnapshotEnvAmbientCPU[bHasFlashlight] = bUseEnvAmbient && settings.m_bEnvAmbientCPU;
+    }
+    bool bEnvAmbientCPU = pContextData->m_bSnapshotEnvAmbientCPU[bHasFlashlight];
+
+    bool bFullyOpaque = pContextData->m_bFullyOpaque && !IsAlphaModulating();
+
+    SetDrawStatsKey((bHasFlashlight << 0) | (bLightMapped << 1) | (bUseEnvAmbient << 2) | (bHasEmissionTexture << 3) |
+                    (bHasSpecularTexture << 4) | (bLightwarpTexture << 5) | (bHasSSS << 6) | (bHasSSR << 7) |
+                    (bHasNormalTexture << 8) | (bHasMraoTexture << 9) | (bHasEnvTexture << 10) | (bIsAlphaTested << 11) |
+                    (bEnvBRDFLUT << 12) | (bEnvAmbientCPU << 13));
 
     if (IsSnapshotting())
     {
@@ -295,16 +675,12 @@ SHADER_DRAW
 
         pShaderShadow->EnableTexture(SAMPLER_BASETEXTURE, true);
         pShaderShadow->EnableSRGBRead(SAMPLER_BASETEXTURE, true);
-        pShaderShadow->EnableTexture(SAMPLER_EMISSIVE, true);
-        pShaderShadow->EnableSRGBRead(SAMPLER_EMISSIVE, true);
         pShaderShadow->EnableTexture(SAMPLER_LIGHTMAP, true);
         pShaderShadow->EnableSRGBRead(SAMPLER_LIGHTMAP, false);
         pShaderShadow->EnableTexture(SAMPLER_MRAO, true);
         pShaderShadow->EnableSRGBRead(SAMPLER_MRAO, false);
         pShaderShadow->EnableTexture(SAMPLER_NORMAL, true);
         pShaderShadow->EnableSRGBRead(SAMPLER_NORMAL, false);
-        pShaderShadow->EnableTexture(SAMPLER_SPECULAR, true);
-        pShaderShadow->EnableSRGBRead(SAMPLER_SPECULAR, true);
         pShaderShadow->EnableTexture(SAMPLER_SSAO, true);
         pShaderShadow->EnableSRGBRead(SAMPLER_SSAO, true);
         pShaderShadow->EnableTexture(SAMPLER_THICKNESS, true);
@@ -335,6 +711,25 @@ SHADER_DRAW
             pShaderShadow->EnableSRGBRead(SAMPLER_LIGHTWARP, false);
         }
 
+        if (bEnvBRDFLUT)
+        {
+            pShaderShadow->EnableTexture(SAMPLER_ENVBRDFLUT, true);
+            pShaderShadow->EnableSRGBRead(SAMPLER_ENVBRDFLUT, false);
+        }
+
+        // The emissive and specular samplers only exist in the combos that use them
+        if (bHasEmissionTexture)
+        {
+            pShaderShadow->EnableTexture(SAMPLER_EMISSIVE, true);
+            pShaderShadow->EnableSRGBRead(SAMPLER_EMISSIVE, true);
+        }
+
+        if (bHasSpecularTexture)
+        {
+            pShaderShadow->EnableTexture(SAMPLER_SPECULAR, true);
+            pShaderShadow->EnableSRGBRead(SAMPLER_SPECULAR, true);
+        }
+
         pShaderShadow->EnableSRGBWrite(true);
 
         if (IS_FLAG_SET(MATERIAL_VAR_MODEL))
@@ -349,7 +744,7 @@ SHADER_DRAW
         }
 
         int useParallax = params[info.useParallax]->GetIntValue();
-        if (!mat_pbr_parallaxmap.GetBool())
+        if (!settings.m_bParallaxMap)
         {
             useParallax = 0;
         }
@@ -366,7 +761,7 @@ SHADER_DRAW
         SET_STATIC_PIXEL_SHADER_COMBO(FLASHLIGHT, bHasFlashlight);
         SET_STATIC_PIXEL_SHADER_COMBO(FLASHLIGHTDEPTHFILTERMODE, nShadowFilterMode);
         SET_STATIC_PIXEL_SHADER_COMBO(LIGHTMAPPED, bLightMapped);
-        SET_STATIC_PIXEL_SHADER_COMBO(USEENVAMBIENT, bUseEnvAmbient);
+        SET_STATIC_PIXEL_SHADER_COMBO(USEENVAMBIENT, bUseEnvAmbient && !bEnvAmbientCPU);
         SET_STATIC_PIXEL_SHADER_COMBO(EMISSIVE, bHasEmissionTexture);
         SET_STATIC_PIXEL_SHADER_COMBO(SPECULAR, bHasSpecularTexture);
         SET_STATIC_PIXEL_SHADER_COMBO(PARALLAXOCCLUSION, useParallax);
@@ -374,8 +769,19 @@ SHADER_DRAW
         SET_STATIC_PIXEL_SHADER_COMBO(LIGHTWARPTEXTURE, bLightwarpTexture);
         SET_STATIC_PIXEL_SHADER_COMBO(SUBSURFACESCATTERING, bHasSSS);
         SET_STATIC_PIXEL_SHADER_COMBO(SCREEN_SPACE_REFLECTIONS, bHasSSR);
+        SET_STATIC_PIXEL_SHADER_COMBO(ENVBRDFLUT, bEnvBRDFLUT);
         SET_STATIC_PIXEL_SHADER(pbr_ps30);
 
+        pContextData->m_nStaticVSIndex[bHasFlashlight] = _vshIndex.GetIndex();
+        pContextData->m_nStaticPSIndex[bHasFlashlight] = _pshIndex.GetIndex();
+        pContextData->m_nSortKey[bHasFlashlight] = (pContextData->m_nSortKey[bHasFlashlight] & PBR_SORTKEY_TEXTURE_MASK) |
+            ComputeSortKeyComboBits(_vshIndex.GetIndex(), _pshIndex.GetIndex());
+        if (ShaderComboUsage_IsEnabled())
+        {
+            ShaderComboUsage_RecordSnapshot("pbr_vs30", _vshIndex.GetIndex());
+            ShaderComboUsage_RecordSnapshot("pbr_ps30", _pshIndex.GetIndex());
+        }
+
         if (bHasFlashlight)
             FogToBlack();
         else
@@ -386,52 +792,42 @@ SHADER_DRAW
         float flLScale = pShaderShadow->GetLightMapScaleFactor();
 
         PI_BeginCommandBuffer();
-        PI_SetPixelShaderAmbientLightCube(PSREG_AMBIENT_CUBE);
+        if (!bEnvAmbientCPU)
+        {
+            PI_SetPixelShaderAmbientLightCube(PSREG_AMBIENT_CUBE);
+        }
         PI_SetPixelShaderLocalLighting(PSREG_LIGHT_INFO_ARRAY);
         PI_SetModulationPixelShaderDynamicState_LinearScale_ScaleInW(PSREG_DIFFUSE_MODULATION, flLScale);
         PI_EndCommandBuffer();
     }
     else
     {
-        bool bLightingOnly = mat_fullbright.GetInt() == 2 && !IS_FLAG_SET(MATERIAL_VAR_NO_DEBUG_OVERRIDE);
+        bool bLightingOnly = settings.m_nFullbright == 2 && !IS_FLAG_SET(MATERIAL_VAR_NO_DEBUG_OVERRIDE);
 
-        if (bHasBaseTexture)
+        if (bHasBaseTexture && !bLightingOnly)
         {
             BindTexture(SAMPLER_BASETEXTURE, info.baseTexture, info.baseTextureFrame);
         }
         else
         {
-            pShaderAPI->BindStandardTexture(SAMPLER_BASETEXTURE, TEXTURE_GREY);
+            BindStandardTexture(SAMPLER_BASETEXTURE, TEXTURE_GREY);
         }
 
-        Vector color;
-        if (bHasColor)
-        {
-            params[info.baseColor]->GetVecValue(color.Base(), 3);
-        }
-        else
-        {
-            color = Vector(1.f, 1.f, 1.f);
-        }
-        pShaderAPI->SetPixelShaderConstant(PSREG_SELFILLUMTINT, color.Base());
+        pShaderAPI->ExecuteCommandBuffer(pContextData->m_SemiStaticCmdsOut.Base());
 
-        if (bHasEnvTexture)
+        if (bHasEnvTexture && settings.m_bSpecular)
         {
             BindTexture(SAMPLER_ENVMAP, info.envMap, 0);
         }
         else
         {
-            pShaderAPI->BindStandardTexture(SAMPLER_ENVMAP, TEXTURE_BLACK);
+            BindStandardTexture(SAMPLER_ENVMAP, TEXTURE_BLACK);
         }
 
         if (bHasEmissionTexture)
         {
             BindTexture(SAMPLER_EMISSIVE, info.emissionTexture, 0);
         }
-        else
-        {
-            pShaderAPI->BindStandardTexture(SAMPLER_EMISSIVE, TEXTURE_BLACK);
-        }
 
         if (bHasNormalTexture)
         {
@@ -439,7 +835,7 @@ SHADER_DRAW
         }
         else
         {
-            pShaderAPI->BindStandardTexture(SAMPLER_NORMAL, TEXTURE_NORMALMAP_FLAT);
+            BindStandardTexture(SAMPLER_NORMAL, TEXTURE_NORMALMAP_FLAT);
         }
 
         if (bHasMraoTexture)
@@ -448,30 +844,31 @@ SHADER_DRAW
         }
         else
         {
-            pShaderAPI->BindStandardTexture(SAMPLER_MRAO, TEXTURE_WHITE);
+            BindStandardTexture(SAMPLER_MRAO, TEXTURE_WHITE);
         }
 
         if (bHasSpecularTexture)
         {
             BindTexture(SAMPLER_SPECULAR, info.specularTexture, 0);
         }
-        else
-        {
-            pShaderAPI->BindStandardTexture(SAMPLER_SPECULAR, TEXTURE_BLACK);
-        }
 
         if (bLightwarpTexture)
         {
             BindTexture(SAMPLER_LIGHTWARP, info.lightwarpTexture, 0);
         }
 
+        if (bEnvBRDFLUT)
+        {
+            BindTexture(SAMPLER_ENVBRDFLUT, info.envBRDFLUT, 0);
+        }
+
         if (bHasSSS)
         {
             BindTexture(SAMPLER_THICKNESS, info.thicknessTexture, 0);
         }
         else
         {
-            pShaderAPI->BindStandardTexture(SAMPLER_THICKNESS, TEXTURE_WHITE);
+            BindStandardTexture(SAMPLER_THICKNESS, TEXTURE_WHITE);
         }
 
         LightState_t lightState;
@@ -488,19 +885,14 @@ SHADER_DRAW
         bool bFlashlightShadows = false;
         if (bHasFlashlight)
         {
-            Assert(info.flashlightTexture >= 0 && info.flashlightTextureFrame >= 0);
-            Assert(params[info.flashlightTexture]->IsTexture());
-            BindTexture(SAMPLER_FLASHLIGHT, info.flashlightTexture, info.flashlightTextureFrame);
             ITexture* pFlashlightDepthTexture;
             flashlightState = pShaderAPI->GetFlashlightStateEx(flashlightWorldToTexture, &pFlashlightDepthTexture);
             bFlashlightShadows = flashlightState.m_bEnableShadows && (pFlashlightDepthTexture != NULL);
 
-            SetFlashLightColorFromState(flashlightState, pShaderAPI, false, PSREG_FLASHLIGHT_COLOR);
-
             if (pFlashlightDepthTexture && g_pConfig->ShadowDepthTexture() && flashlightState.m_bEnableShadows)
             {
                 BindTexture(SAMPLER_SHADOWDEPTH, pFlashlightDepthTexture, 0);
-                pShaderAPI->BindStandardTexture(SAMPLER_RANDOMROTATION, TEXTURE_SHADOW_NOISE_2D);
+                BindStandardTexture(SAMPLER_RANDOMROTATION, TEXTURE_SHADOW_NOISE_2D);
             }
         }
 
@@ -522,26 +914,39 @@ SHADER_DRAW
         float vEyePos_SpecExponent[4];
         pShaderAPI->GetWorldSpaceCameraPosition(vEyePos_SpecExponent);
 
-        int iEnvMapLOD = 6;
-        ITexture* envTexture = params[info.envMap]->GetTextureValue();
-        if (envTexture)
+        ITexture* pEnvTexture = params[info.envMap]->GetTextureValue();
+        if (!pContextData->m_bEnvMapLODValid || (pEnvTexture != pContextData->m_pEnvMapTexture))
         {
-            int width = envTexture->GetMappingWidth();
-            int mips = 0;
-            while (width >>= 1)
-                ++mips;
-            iEnvMapLOD = mips;
+            pContextData->m_pEnvMapTexture = pEnvTexture;
+            pContextData->m_flEnvMapLOD = ComputeEnvMapLOD(pEnvTexture);
+            pContextData->m_bEnvMapIsEnvCubemap = PBR_IsEnvCubemap(pEnvTexture);
+            pContextData->m_bEnvMapLODValid = true;
         }
 
-        if (iEnvMapLOD > 12)
-            iEnvMapLOD = 12;
-        if (iEnvMapLOD < 4)
-            iEnvMapLOD = 4;
+        vEyePos_SpecExponent[3] = pContextData->m_flEnvMapLOD;
+
+        // Per-draw constants are staged and uploaded in contiguous runs right before the draw
+        CShaderConstantStage psConsts(SHADER_CONSTANT_TARGET_PIXEL);
+        CShaderConstantStage vsConsts(SHADER_CONSTANT_TARGET_VERTEX, VERTEX_SHADER_SHADER_SPECIFIC_CONST_0);
+
+        psConsts.Set(PSREG_EYEPOS_SPEC_EXPONENT, vEyePos_SpecExponent);
+
+        if (bEnvAmbientCPU && !bHasFlashlight)
+        {
+            // Black without a bound cubemap, like the lookups into TEXTURE_BLACK were
+            ITexture* pAmbientTexture = (bHasEnvTexture && settings.m_bSpecular) ? PBR_ResolveEnvAmbientTexture(pEnvTexture, pContextData->m_bEnvMapIsEnvCubemap) : NULL;
+            int nGeneration = PBR_GetEnvAmbientCacheGeneration();
+            if ((pAmbientTexture != pContextData->m_pEnvAmbientTexture) || (nGeneration != pContextData->m_nEnvAmbientGeneration))
+            {
+                pContextData->m_pEnvAmbientTexture = pAmbientTexture;
+                pContextData->m_nEnvAmbientGeneration = nGeneration;
+                PBR_GetEnvAmbientCube(pAmbientTexture, pContextData->m_vEnvAmbientCube);
+            }
 
-        vEyePos_SpecExponent[3] = iEnvMapLOD;
-        pShaderAPI->SetPixelShaderConstant(PSREG_EYEPOS_SPEC_EXPONENT, vEyePos_SpecExponent, 1);
+            psConsts.Set(PSREG_AMBIENT_CUBE, pContextData->m_vEnvAmbientCube[0], PBR_ENV_AMBIENT_CUBE_REGISTERS);
+        }
 
-        pShaderAPI->BindStandardTexture(SAMPLER_LIGHTMAP, TEXTURE_LIGHTMAP_BUMPED);
+        BindStandardTexture(SAMPLER_LIGHTMAP, TEXTURE_LIGHTMAP_BUMPED);
 
         DECLARE_DYNAMIC_VERTEX_SHADER(pbr_vs30);
         SET_DYNAMIC_VERTEX_SHADER_COMBO(DOWATERFOG, fogIndex);
@@ -559,18 +964,28 @@ SHADER_DRAW
         SET_DYNAMIC_PIXEL_SHADER_COMBO(UBERLIGHT, flashlightState.m_bUberlight);
         SET_DYNAMIC_PIXEL_SHADER(pbr_ps30);
 
-        SetVertexShaderTextureTransform(VERTEX_SHADER_SHADER_SPECIFIC_CONST_0, info.baseTextureTransform);
-
-        if (bLightingOnly)
+        int nStaticVSIndex = pContextData->m_nStaticVSIndex[bHasFlashlight];
+        int nStaticPSIndex = pContextData->m_nStaticPSIndex[bHasFlashlight];
+        if (ShaderComboUsage_IsEnabled() && nStaticPSIndex >= 0)
         {
-            pShaderAPI->BindStandardTexture(SAMPLER_BASETEXTURE, TEXTURE_GREY);
+            ShaderComboUsage_RecordDraw("pbr_vs30", nStaticVSIndex, _vshIndex.GetIndex());
+            ShaderComboUsage_RecordDraw("pbr_ps30", nStaticPSIndex, _pshIndex.GetIndex());
         }
 
-        if (!mat_specular.GetBool())
+        if (ShaderDrawStream_IsEnabled() && nStaticPSIndex >= 0)
         {
-            pShaderAPI->BindStandardTexture(SAMPLER_ENVMAP, TEXTURE_BLACK);
+            DrawStreamPass_t nPass = DRAW_STREAM_PASS_OPAQUE;
+            if (bHasFlashlight)
+                nPass = DRAW_STREAM_PASS_FLASHLIGHT;
+            else if (IsAlphaModulating() || (!pContextData->m_bFullyOpaque && !bIsAlphaTested))
+                nPass = DRAW_STREAM_PASS_TRANSLUCENT;
+
+            SetDrawStreamInfo(pContextData->GetSortKey(bHasFlashlight), nStaticVSIndex + _vshIndex.GetIndex(),
+                              nStaticPSIndex + _pshIndex.GetIndex(), nPass);
         }
 
+        SetVertexShaderTextureTransform(vsConsts, VERTEX_SHADER_SHADER_SPECIFIC_CONST_0, info.baseTextureTransform);
+
         pShaderAPI->SetPixelShaderFogParams(PSREG_FOG_PARAMS);
 
         ITexture* pAOTexture = pShaderAPI->GetTextureRenderingParameter(TEXTURE_RENDERPARM_AMBIENT_OCCLUSION);
@@ -578,57 +993,20 @@ SHADER_DRAW
         if (pAOTexture)
             BindTexture(SAMPLER_SSAO, pAOTexture);
         else
-            pShaderAPI->BindStandardTexture(SAMPLER_SSAO, TEXTURE_WHITE);
+            BindStandardTexture(SAMPLER_SSAO, TEXTURE_WHITE);
 
-        float flSSAOStrength = 1.0f;
+        // The baked MRAO factors assume no flashlight; the flashlight pass scales SSAO by its own AO amount
         if (bHasFlashlight)
-            flSSAOStrength *= flashlightState.m_flAmbientOcclusion;
-
-        float vMRAOFactors[4] =
-        {
-            GetFloatParam(info.metalnessFactor, params, 1.0f),
-            GetFloatParam(info.roughnessFactor, params, 1.0f),
-            GetFloatParam(info.aoFactor, params, 1.0f),
-            GetFloatParam(info.ssaoFactor, params, 1.0f) * flSSAOStrength
-        };
-        pShaderAPI->SetPixelShaderConstant(PSREG_MRAO_FACTORS, vMRAOFactors, 1);
-
-        float vExtraFactors[4] =
-        {
-            GetFloatParam(info.emissiveFactor, params, 1.0f),
-            GetFloatParam(info.specularFactor, params, 1.0f),
-            GetFloatParam(info.sssIntensity, params, 1.0f),
-            GetFloatParam(info.sssPowerScale, params, 1.0f)
-        };
-        pShaderAPI->SetPixelShaderConstant(PSREG_EXTRA_FACTORS, vExtraFactors, 1);
-
-        Vector sssColor = Vector(1.0f, 1.0f, 1.0f);
-        if (info.sssColor != -1 && params[info.sssColor]->IsDefined())
         {
-            params[info.sssColor]->GetVecValue(sssColor.Base(), 3);
+            const float *vMRAOFactors = pContextData->m_vMaterialConsts[PBR_CONST_MRAO_FACTORS];
+            psConsts.Set4(PSREG_MRAO_FACTORS, vMRAOFactors[0], vMRAOFactors[1], vMRAOFactors[2],
+                          vMRAOFactors[3] * flashlightState.m_flAmbientOcclusion);
         }
-        float vSSSColor[4] = { sssColor.x, sssColor.y, sssColor.z, 1.0f };
-        pShaderAPI->SetPixelShaderConstant(PSREG_CUSTOM_SSS_PARAMS, vSSSColor, 1);
 
         if (bHasSSR)
         {
-            float vSSRParams[4] =
-            {
-                0.5f,
-                0.25f,
-                0.1f,
-                mat_pbr_ssr_intensity.GetFloat()
-            };
-            pShaderAPI->SetPixelShaderConstant(50, vSSRParams, 1);
-
-            float vSSRParams2[4] =
-            {
-                (float)mat_pbr_ssr_step_count.GetInt(),
-                0.35f,
-                0.5f,
-                mat_pbr_ssr_roughness_threshold.GetFloat()
-            };
-            pShaderAPI->SetPixelShaderConstant(51, vSSRParams2, 1);
+            COMPILE_TIME_ASSERT(PSREG_SSR_PARAMS_2 == PSREG_SSR_PARAMS_1 + 1);
+            psConsts.Set(PSREG_SSR_PARAMS_1, settings.m_vSSRParams[0], 2);
         }
 
         pShaderAPI->SetScreenSizeForVPOS();
@@ -636,51 +1014,97 @@ SHADER_DRAW
         int nLightingPreviewMode = pShaderAPI->GetIntRenderingParameter(INT_RENDERPARM_ENABLE_FIXED_LIGHTING);
         if (nLightingPreviewMode == ENABLE_FIXED_LIGHTING_OUTPUTNORMAL_AND_DEPTH)
         {
-            float vEyeDir[4];
+            float *vEyeDir = vsConsts.Stage(VERTEX_SHADER_SHADER_SPECIFIC_CONST_8);
             pShaderAPI->GetWorldSpaceCameraDirection(vEyeDir);
 
             float flFarZ = pShaderAPI->GetFarZ();
             vEyeDir[0] /= flFarZ;
             vEyeDir[1] /= flFarZ;
             vEyeDir[2] /= flFarZ;
-            pShaderAPI->SetVertexShaderConstant(VERTEX_SHADER_SHADER_SPECIFIC_CONST_8, vEyeDir);
         }
 
         if (bHasFlashlight)
         {
-            float atten[4], pos[4], tweaks[4];
-            SetFlashLightColorFromState(flashlightState, pShaderAPI, false, PSREG_FLASHLIGHT_COLOR);
+            SetFlashLightColorFromState(flashlightState, psConsts, false, PSREG_FLASHLIGHT_COLOR);
 
             BindTexture(SAMPLER_FLASHLIGHT, flashlightState.m_pSpotlightTexture, flashlightState.m_nSpotlightTextureFrame);
 
-            atten[0] = flashlightState.m_fConstantAtten;
-            atten[1] = flashlightState.m_fLinearAtten;
-            atten[2] = flashlightState.m_fQuadraticAtten;
-            atten[3] = flashlightState.m_FarZAtten;
-            pShaderAPI->SetPixelShaderConstant(PSREG_FLASHLIGHT_ATTENUATION, atten, 1);
+            psConsts.Set4(PSREG_FLASHLIGHT_ATTENUATION, flashlightState.m_fConstantAtten, flashlightState.m_fLinearAtten,
+                          flashlightState.m_fQuadraticAtten, flashlightState.m_FarZAtten);
 
-            pos[0] = flashlightState.m_vecLightOrigin[0];
-            pos[1] = flashlightState.m_vecLightOrigin[1];
-            pos[2] = flashlightState.m_vecLightOrigin[2];
-            pShaderAPI->SetPixelShaderConstant(PSREG_FLASHLIGHT_POSITION_RIM_BOOST, pos, 1);
+            psConsts.Set4(PSREG_FLASHLIGHT_POSITION_RIM_BOOST, flashlightState.m_vecLightOrigin[0],
+                          flashlightState.m_vecLightOrigin[1], flashlightState.m_vecLightOrigin[2], 0.0f);
 
-            pShaderAPI->SetPixelShaderConstant(PSREG_FLASHLIGHT_TO_WORLD_TEXTURE, flashlightWorldToTexture.Base(), 4);
+            psConsts.Set(PSREG_FLASHLIGHT_TO_WORLD_TEXTURE, flashlightWorldToTexture.Base(), 4);
 
+            float *tweaks = psConsts.Stage(PSREG_ENVMAP_TINT__SHADOW_TWEAKS);
             tweaks[0] = ShadowFilterFromState(flashlightState);
             tweaks[1] = ShadowAttenFromState(flashlightState);
             HashShadow2DJitter(flashlightState.m_flShadowJitterSeed, &tweaks[2], &tweaks[3]);
-            pShaderAPI->SetPixelShaderConstant(PSREG_ENVMAP_TINT__SHADOW_TWEAKS, tweaks, 1);
 
-            SetupUberlightFromState(pShaderAPI, flashlightState);
+            SetupUberlightFromState(psConsts, flashlightState);
         }
 
-        float flParams[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-        flParams[0] = GetFloatParam(info.parallaxDepth, params, 3.0f);
-        flParams[1] = GetFloatParam(info.parallaxCenter, params, 3.0f);
-        pShaderAPI->SetPixelShaderConstant(PSREG_SHADER_CONTROLS, flParams, 1);
+        FlushConstants(psConsts);
+        FlushConstants(vsConsts);
     }
 
     Draw();
 }
 
-END_SHADER
\ No newline at end of file
+END_SHADER
+
+//-----------------------------------------------------------------------------
+// Redoes the load work of every loaded PBR material and reports the time taken,
+// to time it in isolation. The $useenvambient cubemap reads are this DLL's own
+// work and run in parallel on g_pThreadPool. The snapshots go through the
+// engine's single shadow state object, so they stay on the calling thread,
+// one material after another.
+//-----------------------------------------------------------------------------
+CON_COMMAND(mat_pbr_precache, "Read the $useenvambient ambient cubes and rebuild the state snapshots of all loaded PBR materials, and report the time taken. "
+    "Cubes already read are kept; run mat_pbr_envambient_flush first to time the reads too.")
+{
+    CUtlVector<IMaterial*> pbrMaterials;
+    CUtlVector<ITexture*> envTextures;
+    for (MaterialHandle_t h = materials->FirstMaterial(); h != materials->InvalidMaterial(); h = materials->NextMaterial(h))
+    {
+        IMaterial* pMaterial = materials->GetMaterial(h);
+        if (!pMaterial || V_stricmp(pMaterial->GetShaderName(), "PBR"))
+            continue;
+
+        pbrMaterials.AddToTail(pMaterial);
+
+        bool bFound;
+        IMaterialVar* pUseEnvAmbient = pMaterial->FindVar("$useenvambient", &bFound, false);
+        IMaterialVar* pEnvMap = pMaterial->FindVar("$envmap", &bFound, false);
+        if (pUseEnvAmbient && pUseEnvAmbient->GetIntValue() == 1 && pEnvMap && pEnvMap->IsTexture())
+        {
+            envTextures.AddToTail(pEnvMap->GetTextureValue());
+        }
+    }
+
+    CFastTimer readTimer;
+    readTimer.Start();
+    if (mat_pbr_envambient_cpu.GetBool())
+    {
+        PBR_PrecacheEnvAmbientCubes(envTextures.Base(), envTextures.Count());
+    }
+    readTimer.End();
+
+    CFastTimer snapshotTimer;
+    snapshotTimer.Start();
+    for (int i = 0; i < pbrMaterials.Count(); ++i)
+    {
+        pbrMaterials[i]->RecomputeStateSnapshots();
+    }
+    snapshotTimer.End();
+
+    // And read the cubemaps draws have queued, so the next frame has their ambient cubes
+    PBR_UpdateEnvAmbientCubes();
+
+    int nThreads = g_pThreadPool ? g_pThreadPool->NumThreads() + 1 : 1;
+    Msg("Read the ambient cubes of %d materials in %.2f ms on %d threads\n", envTextures.Count(),
+        readTimer.GetDuration().GetMillisecondsF(), nThreads);
+    Msg("Rebuilt snapshots for %d PBR materials in %.2f ms\n", pbrMaterials.Count(),
+        snapshotTimer.GetDuration().GetMillisecondsF());
+}
@@ -0,0 +1,770 @@
+//==================================================================================================
+//
+// $useenvambient's ambient cube, worked out once per cubemap on the CPU (pbr_envambient.h)
+//
+// texCUBElod at mip 12 clamps to the smallest mip, and each of the six axis directions lands
+// in the middle of its face there. So each color is the middle of that face in the smallest
+// mip: the texel itself at 1x1, the four around the middle when the chain stops short of that.
+// The texels are decoded the way the sampler reads them, sRGB to linear when the shader
+// enables sRGB reads (no HDR), and scaled by ENV_MAP_SCALE. With HDR on, the .hdr.vtf is read
+// when there is one, like the material system does. mat_pbr_envambient_selftest checks all of
+// this against a transliteration of the GPU lookups.
+//
+// Reading a VTF takes a file read, so it never happens inside a draw. Cubemaps set on the
+// material are read when the material is initialized. The local cubemaps env_cubemap stands for
+// are only known at draw time: a draw that finds one missing queues it and gets black, and the
+// queue is read at the end of the frame, or by mat_pbr_precache.
+//
+// Several cubemaps read at once are spread over g_pThreadPool. The jobs only run the code here,
+// the VTF library and the file system; everything asked of the textures and the hardware config
+// is asked on the calling thread first.
+//
+//==================================================================================================
+
+#include "pbr_envambient.h"
+#include "tier0/dbg.h"
+#include "tier0/threadtools.h"
+#include "mathlib/mathlib.h"
+#include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utldict.h"
+#include "tier1/utlstring.h"
+#include "convar.h"
+#include "filesystem.h"
+#include "vtf/vtf.h"
+#include "vstdlib/jobthread.h"
+#include "materialsystem/imaterialsystem.h"
+#include "materialsystem/imaterialsystemhardwareconfig.h"
+#include "materialsystem/itexture.h"
+#include "interfaces/interfaces.h"
+#include "common_hlsl_cpp_consts.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+extern IMaterialSystemHardwareConfig* g_pHardwareConfig;
+
+struct EnvAmbientCube_t
+{
+    float m_vColor[PBR_ENV_AMBIENT_CUBE_REGISTERS][4];
+    bool m_bPending;    // Queued by a draw, still black
+};
+
+// Every cubemap seen since the last flush, failures included so their files are only tried once
+static CUtlDict<EnvAmbientCube_t, int> s_EnvAmbientCubes(k_eDictCompareTypeCaseInsensitive);
+static CThreadFastMutex s_EnvAmbientMutex;
+static volatile int s_nEnvAmbientGeneration = 1;
+static volatile int s_nEnvAmbientPending = 0;
+
+static float HalfToFloat(uint16 nHalf)
+{
+    uint32 nSign = (uint32)(nHalf & 0x8000) << 16;
+    uint32 nExponent = (nHalf >> 10) & 0x1F;
+    uint32 nMantissa = nHalf & 0x3FF;
+
+    if (nExponent == 0)
+    {
+        // Zero and denormals
+        float flValue = nMantissa * (1.0f / (1 << 24));
+        return nSign ? -flValue : flValue;
+    }
+
+    uint32 nBits = (nExponent == 31) ? (nSign | 0x7F800000 | (nMantissa << 13)) :
+                                       (nSign | ((nExponent + 112) << 23) | (nMantissa << 13));
+    float flValue;
+    memcpy(&flValue, &nBits, sizeof(flValue));
+    return flValue;
+}
+
+//-----------------------------------------------------------------------------
+// How the texels of a cubemap turn into what setupEnvMapAmbientCube reads,
+// ENV_MAP_SCALE * texCUBElod(...)
+//-----------------------------------------------------------------------------
+struct EnvAmbientDecode_t
+{
+    ImageFormat m_Format;
+    bool m_bSRGB;               // LDR cubemap with sRGB reads, which the snapshot enables without HDR
+    bool m_bCompressedHDR;      // 8 bit .hdr.vtf, see IsCompressedHDRFormat
+    float m_flEnvMapScale;      // What the shader API puts in ENV_MAP_SCALE
+};
+
+// buildcubemaps can write a .hdr.vtf as 8 bit RGBA holding DecompressHDR's encoding (common_fxc.h),
+// rgb * a * MAX_HDR_OVERBRIGHT. The material system expands those texels when it loads the
+// texture, into the range the HDR mode keeps cubemaps in, so ENV_MAP_SCALE * the sampled value
+// is the expanded color itself.
+static bool IsCompressedHDRFormat(ImageFormat format)
+{
+    return format == IMAGE_FORMAT_RGBA8888 || format == IMAGE_FORMAT_BGRA8888 ||
+           format == IMAGE_FORMAT_ABGR8888 || format == IMAGE_FORMAT_ARGB8888;
+}
+
+static EnvAmbientDecode_t GetEnvAmbientDecode(ImageFormat format, bool bHDRFile, HDRType_t hdrType)
+{
+    EnvAmbientDecode_t decode;
+    decode.m_Format = format;
+    decode.m_bSRGB = (hdrType == HDR_TYPE_NONE);
+    decode.m_bCompressedHDR = bHDRFile && IsCompressedHDRFormat(format);
+    decode.m_flEnvMapScale = (hdrType == HDR_TYPE_INTEGER) ? 16.0f : 1.0f;
+    return decode;
+}
+
+// A texel of the smallest mip as setupEnvMapAmbientCube sees it, ENV_MAP_SCALE included. 8 bit
+// formats have been converted to RGBA8888 by the caller.
+static void DecodeTexel(const uint8* pTexel, const EnvAmbientDecode_t& decode, float* pColor)
+{
+    switch (decode.m_Format)
+    {
+    case IMAGE_FORMAT_RGBA16161616F:
+        for (int i = 0; i < 3; ++i)
+        {
+            uint16 nHalf;
+            memcpy(&nHalf, pTexel + i * 2, sizeof(nHalf));
+            pColor[i] = HalfToFloat(nHalf) * decode.m_flEnvMapScale;
+        }
+        break;
+
+    case IMAGE_FORMAT_RGBA16161616:
+        for (int i = 0; i < 3; ++i)
+        {
+            uint16 nValue;
+            memcpy(&nValue, pTexel + i * 2, sizeof(nValue));
+            pColor[i] = nValue * (1.0f / 65535.0f) * decode.m_flEnvMapScale;
+        }
+        break;
+
+    case IMAGE_FORMAT_RGBA32323232F:
+        for (int i = 0; i < 3; ++i)
+        {
+            float flValue;
+            memcpy(&flValue, pTexel + i * sizeof(float), sizeof(flValue));
+            pColor[i] = flValue * decode.m_flEnvMapScale;
+        }
+        break;
+
+    default:
+        if (decode.m_bCompressedHDR)
+        {
+            float flScale = pTexel[3] * (MAX_HDR_OVERBRIGHT / (255.0f * 255.0f));
+            for (int i = 0; i < 3; ++i)
+            {
+                pColor[i] = pTexel[i] * flScale;
+            }
+            break;
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            pColor[i] = pTexel[i] * (1.0f / 255.0f);
+            if (decode.m_bSRGB)
+            {
+                pColor[i] = SrgbGammaToLinear(pColor[i]);
+            }
+            pColor[i] *= decode.m_flEnvMapScale;
+        }
+        break;
+    }
+}
+
+// The cube from a cubemap VTF as read off disk. Converts pVTF to RGBA8888 unless it's in one of
+// the 16 or 32 bit formats DecodeTexel reads.
+static void ComputeEnvAmbientCube(IVTFTexture* pVTF, bool bHDRFile, HDRType_t hdrType, EnvAmbientCube_t& cube)
+{
+    EnvAmbientDecode_t decode = GetEnvAmbientDecode(pVTF->Format(), bHDRFile, hdrType);
+    if (decode.m_Format != IMAGE_FORMAT_RGBA16161616F && decode.m_Format != IMAGE_FORMAT_RGBA16161616 &&
+        decode.m_Format != IMAGE_FORMAT_RGBA32323232F)
+    {
+        // Keeps the alpha compressed HDR needs
+        pVTF->ConvertImageFormat(IMAGE_FORMAT_RGBA8888, false);
+        decode.m_Format = IMAGE_FORMAT_RGBA8888;
+    }
+
+    int nMip = pVTF->MipCount() - 1;
+    int nWidth, nHeight, nDepth;
+    pVTF->ComputeMipLevelDimensions(nMip, &nWidth, &nHeight, &nDepth);
+    int nTexelSize = ImageLoader::SizeInBytes(decode.m_Format);
+    int x0 = (nWidth - 1) / 2, x1 = nWidth / 2;
+    int y0 = (nHeight - 1) / 2, y1 = nHeight / 2;
+
+    // VTF faces are in ambient cube order
+    for (int nFace = 0; nFace < PBR_ENV_AMBIENT_CUBE_REGISTERS; ++nFace)
+    {
+        const uint8* pFace = pVTF->ImageData(0, nFace, nMip);
+        const int nTexels[4][2] = { { x0, y0 }, { x1, y0 }, { x0, y1 }, { x1, y1 } };
+
+        float vSum[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 4; ++i)
+        {
+            float vColor[3];
+            DecodeTexel(pFace + (nTexels[i][1] * nWidth + nTexels[i][0]) * nTexelSize, decode, vColor);
+            vSum[0] += vColor[0];
+            vSum[1] += vColor[1];
+            vSum[2] += vColor[2];
+        }
+
+        float* pColor = cube.m_vColor[nFace];
+        pColor[0] = vSum[0] * 0.25f;
+        pColor[1] = vSum[1] * 0.25f;
+        pColor[2] = vSum[2] * 0.25f;
+        pColor[3] = 1.0f;
+    }
+}
+
+// The cubemap file the material system loads for pTextureName: in HDR modes the .hdr.vtf
+// buildcubemaps writes next to the LDR one, when there is one. NULL if it can't be read.
+static IVTFTexture* ReadEnvAmbientVTF(const char* pTextureName, HDRType_t hdrType, bool& bHDRFile)
+{
+    if (!g_pFullFileSystem)
+        return NULL;
+
+    int nNameLength = V_strlen(pTextureName);
+    bool bNameIsHDR = (nNameLength > 4) && !V_stricmp(pTextureName + nNameLength - 4, ".hdr");
+
+    char szFileName[MAX_PATH];
+    CUtlBuffer buf;
+    bool bRead = false;
+    if (hdrType != HDR_TYPE_NONE && !bNameIsHDR)
+    {
+        V_snprintf(szFileName, sizeof(szFileName), "materials/%s.hdr.vtf", pTextureName);
+        bRead = g_pFullFileSystem->ReadFile(szFileName, "GAME", buf);
+        bHDRFile = bRead;
+    }
+    if (!bRead)
+    {
+        V_snprintf(szFileName, sizeof(szFileName), "materials/%s.vtf", pTextureName);
+        bRead = g_pFullFileSystem->ReadFile(szFileName, "GAME", buf);
+        bHDRFile = bNameIsHDR;
+    }
+    if (!bRead)
+        return NULL;
+
+    IVTFTexture* pVTF = CreateVTFTexture();
+    if (!pVTF->Unserialize(buf) || !pVTF->IsCubeMap() || pVTF->FaceCount() < 6)
+    {
+        DestroyVTFTexture(pVTF);
+        return NULL;
+    }
+    return pVTF;
+}
+
+static bool ReadEnvAmbientCube(const char* pTextureName, HDRType_t hdrType, EnvAmbientCube_t& cube)
+{
+    bool bHDRFile;
+    IVTFTexture* pVTF = ReadEnvAmbientVTF(pTextureName, hdrType, bHDRFile);
+    if (!pVTF)
+        return false;
+
+    ComputeEnvAmbientCube(pVTF, bHDRFile, hdrType, cube);
+    DestroyVTFTexture(pVTF);
+    return true;
+}
+
+static void WarnEnvAmbientUnreadable(const char* pName)
+{
+    Warning("$useenvambient: can't read %s from disk, its ambient cube is black. Set mat_pbr_envambient_cpu 0 to sample it on the GPU.\n", pName);
+}
+
+// A cubemap to read, with what PrecacheEnvAmbientCube needs from its texture
+struct EnvAmbientRead_t
+{
+    const char* m_pName;
+    bool m_bCanRead;
+    HDRType_t m_HDRType;
+};
+
+// Reads the cube unless it's already cached. The lock isn't held across the file read, so
+// draws and other reads only wait for the dictionary.
+static void PrecacheEnvAmbientCube(EnvAmbientRead_t& read)
+{
+    const char* pName = read.m_pName;
+    {
+        AUTO_LOCK(s_EnvAmbientMutex);
+        int nIndex = s_EnvAmbientCubes.Find(pName);
+        if (nIndex != s_EnvAmbientCubes.InvalidIndex() && !s_EnvAmbientCubes[nIndex].m_bPending)
+            return;
+    }
+
+    EnvAmbientCube_t cube;
+    memset(&cube, 0, sizeof(cube));
+    if (!read.m_bCanRead || !ReadEnvAmbientCube(pName, read.m_HDRType, cube))
+    {
+        WarnEnvAmbientUnreadable(pName);
+    }
+
+    AUTO_LOCK(s_EnvAmbientMutex);
+    int nIndex = s_EnvAmbientCubes.Find(pName);
+    if (nIndex == s_EnvAmbientCubes.InvalidIndex())
+    {
+        nIndex = s_EnvAmbientCubes.Insert(pName);
+    }
+    s_EnvAmbientCubes[nIndex] = cube;
+    ++s_nEnvAmbientGeneration;
+}
+
+static bool CanReadEnvAmbientCube(ITexture* pEnvTexture)
+{
+    return !pEnvTexture->IsRenderTarget() && !pEnvTexture->IsProcedural();
+}
+
+bool PBR_IsEnvCubemap(ITexture* pEnvTexture)
+{
+    return pEnvTexture && !V_stricmp(pEnvTexture->GetName(), "env_cubemap");
+}
+
+ITexture* PBR_ResolveEnvAmbientTexture(ITexture* pEnvTexture, bool bEnvCubemap)
+{
+    Assert(bEnvCubemap == PBR_IsEnvCubemap(pEnvTexture));
+    if (bEnvCubemap)
+    {
+        // Draws run inside the engine's render, so the context is already set up
+        CMatRenderContextPtr pRenderContext(materials);
+        ITexture* pLocalCubemap = pRenderContext->GetLocalCubemap();
+        if (pLocalCubemap)
+            return pLocalCubemap;
+    }
+
+    return pEnvTexture;
+}
+
+void PBR_PrecacheEnvAmbientCube(ITexture* pEnvTexture)
+{
+    PBR_PrecacheEnvAmbientCubes(&pEnvTexture, 1);
+}
+
+void PBR_PrecacheEnvAmbientCubes(ITexture** ppEnvTextures, int nTextures)
+{
+    HDRType_t hdrType = g_pHardwareConfig->GetHDRType();
+
+    // Materials share cubemaps, and two jobs reading the same one would both read it
+    CUtlDict<bool, int> names(k_eDictCompareTypeCaseInsensitive);
+    CUtlVector<EnvAmbientRead_t> reads;
+    for (int i = 0; i < nTextures; ++i)
+    {
+        ITexture* pEnvTexture = ppEnvTextures[i];
+        if (IsErrorTexture(pEnvTexture) || PBR_IsEnvCubemap(pEnvTexture))
+            continue;
+
+        const char* pName = pEnvTexture->GetName();
+        if (names.Find(pName) != names.InvalidIndex())
+            continue;
+        names.Insert(pName, true);
+
+        EnvAmbientRead_t& read = reads[reads.AddToTail()];
+        read.m_pName = pName;
+        read.m_bCanRead = CanReadEnvAmbientCube(pEnvTexture);
+        read.m_HDRType = hdrType;
+    }
+
+    ParallelProcess(reads.Base(), reads.Count(), PrecacheEnvAmbientCube);
+}
+
+void PBR_GetEnvAmbientCube(ITexture* pEnvTexture, float vAmbientCube[PBR_ENV_AMBIENT_CUBE_REGISTERS][4])
+{
+    memset(vAmbientCube, 0, PBR_ENV_AMBIENT_CUBE_REGISTERS * 4 * sizeof(float));
+    if (IsErrorTexture(pEnvTexture))
+        return;
+
+    const char* pName = pEnvTexture->GetName();
+
+    AUTO_LOCK(s_EnvAmbientMutex);
+    int nIndex = s_EnvAmbientCubes.Find(pName);
+    if (nIndex == s_EnvAmbientCubes.InvalidIndex())
+    {
+        // Leave the read for PBR_UpdateEnvAmbientCubes, this one draws black. Render
+        // targets have nothing to read, so they're settled here.
+        EnvAmbientCube_t cube;
+        memset(&cube, 0, sizeof(cube));
+        cube.m_bPending = CanReadEnvAmbientCube(pEnvTexture);
+        s_EnvAmbientCubes.Insert(pName, cube);
+        if (cube.m_bPending)
+        {
+            ++s_nEnvAmbientPending;
+        }
+        else
+        {
+            WarnEnvAmbientUnreadable(pName);
+        }
+        return;
+    }
+
+    memcpy(vAmbientCube, s_EnvAmbientCubes[nIndex].m_vColor, sizeof(s_EnvAmbientCubes[nIndex].m_vColor));
+}
+
+void PBR_UpdateEnvAmbientCubes()
+{
+    if (!s_nEnvAmbientPending)
+        return;
+
+    CUtlVector<CUtlString> pending;
+    {
+        AUTO_LOCK(s_EnvAmbientMutex);
+        for (int i = s_EnvAmbientCubes.First(); i != s_EnvAmbientCubes.InvalidIndex(); i = s_EnvAmbientCubes.Next(i))
+        {
+            if (s_EnvAmbientCubes[i].m_bPending)
+                pending.AddToTail(s_EnvAmbientCubes.GetElementName(i));
+        }
+        s_nEnvAmbientPending = 0;
+    }
+
+    // Only drawn textures with a file behind them were queued
+    HDRType_t hdrType = g_pHardwareConfig->GetHDRType();
+    CUtlVector<EnvAmbientRead_t> reads;
+    reads.SetCount(pending.Count());
+    for (int i = 0; i < pending.Count(); ++i)
+    {
+        reads[i].m_pName = pending[i].Get();
+        reads[i].m_bCanRead = true;
+        reads[i].m_HDRType = hdrType;
+    }
+
+    ParallelProcess(reads.Base(), reads.Count(), PrecacheEnvAmbientCube);
+}
+
+int PBR_GetEnvAmbientCacheGeneration()
+{
+    return s_nEnvAmbientGeneration;
+}
+
+CON_COMMAND(mat_pbr_envambient_flush, "Forget the $useenvambient ambient cubes read from the cubemaps, after buildcubemaps for example.")
+{
+    AUTO_LOCK(s_EnvAmbientMutex);
+    Msg("Flushed %d $useenvambient ambient cubes\n", s_EnvAmbientCubes.Count());
+    s_EnvAmbientCubes.Purge();
+    s_nEnvAmbientPending = 0;
+    ++s_nEnvAmbientGeneration;
+}
+
+//-----------------------------------------------------------------------------
+// Self test: the CPU cube against setupEnvMapAmbientCube as the GPU runs it
+// with USEENVAMBIENT 1. The lookups are transliterated from the sampler
+// rather than shared with the code above: the face and (u, v) come from the
+// direction's major axis, the LOD is clamped to the mips there are, and
+// each texel is decoded as loaded before it's filtered bilinearly with clamp
+// addressing. A slip in the face order, the texels picked or their decode
+// shows up as a difference.
+//-----------------------------------------------------------------------------
+struct RefEnvMap_t
+{
+    IVTFTexture* m_pVTF;
+    ImageFormat m_Format;       // As read, before ComputeEnvAmbientCube converts it
+    bool m_bHDRFile;
+    HDRType_t m_HDRType;
+};
+
+// By the definition, not by moving bits
+static float RefHalfToFloat(uint16 nHalf)
+{
+    int nExponent = (nHalf >> 10) & 0x1F;
+    int nMantissa = nHalf & 0x3FF;
+    float flValue = (nExponent == 0) ? ldexpf((float)nMantissa, -24) : ldexpf((float)(nMantissa | 0x400), nExponent - 25);
+    return (nHalf & 0x8000) ? -flValue : flValue;
+}
+
+static float RefSrgbToLinear(float flValue)
+{
+    return (flValue <= 0.04045f) ? (flValue / 12.92f) : powf((flValue + 0.055f) / 1.055f, 2.4f);
+}
+
+static float RefEnvMapScale(const RefEnvMap_t& envMap)
+{
+    return (envMap.m_HDRType == HDR_TYPE_INTEGER) ? 16.0f : 1.0f;
+}
+
+static bool RefCanFetch(ImageFormat format)
+{
+    return format == IMAGE_FORMAT_RGBA8888 || format == IMAGE_FORMAT_BGRA8888 || format == IMAGE_FORMAT_ABGR8888 ||
+           format == IMAGE_FORMAT_ARGB8888 || format == IMAGE_FORMAT_RGBA16161616 || format == IMAGE_FORMAT_RGBA16161616F ||
+           format == IMAGE_FORMAT_RGBA32323232F;
+}
+
+// What the sampler returns for one texel of the texture the material system loaded
+static Vector RefFetch(const RefEnvMap_t& envMap, int nFace, int nMip, int x, int y)
+{
+    int nWidth, nHeight, nDepth;
+    envMap.m_pVTF->ComputeMipLevelDimensions(nMip, &nWidth, &nHeight, &nDepth);
+    const uint8* pTexel = envMap.m_pVTF->ImageData(0, nFace, nMip) + (y * nWidth + x) * ImageLoader::SizeInBytes(envMap.m_Format);
+
+    const uint16* pTexel16 = (const uint16*)pTexel;
+    const float* pTexel32 = (const float*)pTexel;
+    switch (envMap.m_Format)
+    {
+    case IMAGE_FORMAT_RGBA16161616F:
+        return Vector(RefHalfToFloat(pTexel16[0]), RefHalfToFloat(pTexel16[1]), RefHalfToFloat(pTexel16[2]));
+
+    case IMAGE_FORMAT_RGBA16161616:
+        return Vector(pTexel16[0], pTexel16[1], pTexel16[2]) / 65535.0f;
+
+    case IMAGE_FORMAT_RGBA32323232F:
+        return Vector(pTexel32[0], pTexel32[1], pTexel32[2]);
+
+    default:
+        break;
+    }
+
+    float r, g, b, a;
+    switch (envMap.m_Format)
+    {
+    case IMAGE_FORMAT_BGRA8888: b = pTexel[0]; g = pTexel[1]; r = pTexel[2]; a = pTexel[3]; break;
+    case IMAGE_FORMAT_ABGR8888: a = pTexel[0]; b = pTexel[1]; g = pTexel[2]; r = pTexel[3]; break;
+    case IMAGE_FORMAT_ARGB8888: a = pTexel[0]; r = pTexel[1]; g = pTexel[2]; b = pTexel[3]; break;
+    default:                    r = pTexel[0]; g = pTexel[1]; b = pTexel[2]; a = pTexel[3]; break;
+    }
+
+    Vector color(r / 255.0f, g / 255.0f, b / 255.0f);
+    if (envMap.m_bHDRFile)
+    {
+        // DecompressHDR, stored in the HDR mode's range
+        return color * (a / 255.0f) * MAX_HDR_OVERBRIGHT / RefEnvMapScale(envMap);
+    }
+    if (envMap.m_HDRType == HDR_TYPE_NONE)
+    {
+        color.Init(RefSrgbToLinear(color.x), RefSrgbToLinear(color.y), RefSrgbToLinear(color.z));
+    }
+    return color;
+}
+
+static Vector RefBilinear(const RefEnvMap_t& envMap, int nFace, int nMip, float u, float v)
+{
+    int nWidth, nHeight, nDepth;
+    envMap.m_pVTF->ComputeMipLevelDimensions(nMip, &nWidth, &nHeight, &nDepth);
+
+    float x = u * nWidth - 0.5f, y = v * nHeight - 0.5f;
+    int x0 = (int)floorf(x), y0 = (int)floorf(y);
+    float tx = x - x0, ty = y - y0;
+    int x1 = clamp(x0 + 1, 0, nWidth - 1), y1 = clamp(y0 + 1, 0, nHeight - 1);
+    x0 = clamp(x0, 0, nWidth - 1);
+    y0 = clamp(y0, 0, nHeight - 1);
+
+    Vector top = RefFetch(envMap, nFace, nMip, x0, y0) * (1.0f - tx) + RefFetch(envMap, nFace, nMip, x1, y0) * tx;
+    Vector bottom = RefFetch(envMap, nFace, nMip, x0, y1) * (1.0f - tx) + RefFetch(envMap, nFace, nMip, x1, y1) * tx;
+    return top * (1.0f - ty) + bottom * ty;
+}
+
+// texCUBElod(sampler, float4(dir, flLod)).rgb, with the faces in D3D order like the VTF's
+static Vector RefTexCUBElod(const RefEnvMap_t& envMap, const Vector& dir, float flLod)
+{
+    int nFace;
+    float sc, tc, ma;
+    Vector absDir(fabsf(dir.x), fabsf(dir.y), fabsf(dir.z));
+    if (absDir.x >= absDir.y && absDir.x >= absDir.z)
+    {
+        nFace = (dir.x >= 0.0f) ? 0 : 1;
+        sc = (dir.x >= 0.0f) ? -dir.z : dir.z;
+        tc = -dir.y;
+        ma = absDir.x;
+    }
+    else if (absDir.y >= absDir.z)
+    {
+        nFace = (dir.y >= 0.0f) ? 2 : 3;
+        sc = dir.x;
+        tc = (dir.y >= 0.0f) ? dir.z : -dir.z;
+        ma = absDir.y;
+    }
+    else
+    {
+        nFace = (dir.z >= 0.0f) ? 4 : 5;
+        sc = (dir.z >= 0.0f) ? dir.x : -dir.x;
+        tc = -dir.y;
+        ma = absDir.z;
+    }
+    float u = 0.5f * (sc / ma + 1.0f);
+    float v = 0.5f * (tc / ma + 1.0f);
+
+    int nMaxMip = envMap.m_pVTF->MipCount() - 1;
+    flLod = clamp(flLod, 0.0f, (float)nMaxMip);
+    int nMip = (int)flLod;
+    float t = flLod - nMip;
+    Vector color = RefBilinear(envMap, nFace, nMip, u, v);
+    if (t > 0.0f)
+    {
+        color = color * (1.0f - t) + RefBilinear(envMap, nFace, MIN(nMip + 1, nMaxMip), u, v) * t;
+    }
+    return color;
+}
+
+// setupEnvMapAmbientCube, line for line
+static void RefEnvAmbientCube(const RefEnvMap_t& envMap, Vector vEnvAmbientCube[PBR_ENV_AMBIENT_CUBE_REGISTERS])
+{
+    const Vector directions[PBR_ENV_AMBIENT_CUBE_REGISTERS] =
+    {
+        Vector(1, 0, 0), Vector(-1, 0, 0), Vector(0, 1, 0), Vector(0, -1, 0), Vector(0, 0, 1), Vector(0, 0, -1)
+    };
+    for (int i = 0; i < PBR_ENV_AMBIENT_CUBE_REGISTERS; ++i)
+    {
+        vEnvAmbientCube[i] = RefEnvMapScale(envMap) * RefTexCUBElod(envMap, directions[i], 12.0f);
+    }
+}
+
+// Compares, then leaves envMap.m_pVTF converted by ComputeEnvAmbientCube
+static bool CheckEnvAmbientCube(const char* pName, RefEnvMap_t& envMap)
+{
+    Vector vReference[PBR_ENV_AMBIENT_CUBE_REGISTERS];
+    RefEnvAmbientCube(envMap, vReference);
+
+    EnvAmbientCube_t cube;
+    ComputeEnvAmbientCube(envMap.m_pVTF, envMap.m_bHDRFile, envMap.m_HDRType, cube);
+
+    // Relative to the color, or absolute below 1
+    float flMaxError = 0.0f;
+    for (int nFace = 0; nFace < PBR_ENV_AMBIENT_CUBE_REGISTERS; ++nFace)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            float flError = fabsf(cube.m_vColor[nFace][i] - vReference[nFace][i]) / MAX(1.0f, fabsf(vReference[nFace][i]));
+            flMaxError = MAX(flMaxError, flError);
+        }
+    }
+
+    bool bOk = (flMaxError < 1e-4f);
+    Msg("  %-52s max error %.2g%s\n", pName, flMaxError, bOk ? "" : "  FAILED");
+    return bOk;
+}
+
+// The same texels every run, whatever the CRT's rand does
+static uint32 NextRandomBits(uint32& nSeed)
+{
+    nSeed = nSeed * 1664525u + 1013904223u;
+    return nSeed >> 8;
+}
+
+static void FillRandomTexels(IVTFTexture* pVTF, uint32& nSeed)
+{
+    for (int nMip = 0; nMip < pVTF->MipCount(); ++nMip)
+    {
+        int nWidth, nHeight, nDepth;
+        pVTF->ComputeMipLevelDimensions(nMip, &nWidth, &nHeight, &nDepth);
+        int nComponents = nWidth * nHeight * 4;
+        for (int nFace = 0; nFace < pVTF->FaceCount(); ++nFace)
+        {
+            uint8* pData = pVTF->ImageData(0, nFace, nMip);
+            for (int i = 0; i < nComponents; ++i)
+            {
+                switch (pVTF->Format())
+                {
+                case IMAGE_FORMAT_RGBA16161616F:
+                    // Finite, from about 2^-10 to 8
+                    ((uint16*)pData)[i] = (uint16)(((5 + NextRandomBits(nSeed) % 13) << 10) | (NextRandomBits(nSeed) & 0x3FF));
+                    break;
+                case IMAGE_FORMAT_RGBA16161616:
+                    ((uint16*)pData)[i] = (uint16)NextRandomBits(nSeed);
+                    break;
+                case IMAGE_FORMAT_RGBA32323232F:
+                    ((float*)pData)[i] = (NextRandomBits(nSeed) & 0xFFFF) * (8.0f / 65536.0f);
+                    break;
+                default:
+                    pData[i] = (uint8)NextRandomBits(nSeed);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+static const struct
+{
+    ImageFormat m_Format;
+    bool m_bHDRFile;
+    HDRType_t m_HDRType;
+    const char* m_pName;
+}
+s_SelfTestEncodings[] =
+{
+    { IMAGE_FORMAT_RGBA8888, false, HDR_TYPE_NONE, "RGBA8888, sRGB reads" },
+    { IMAGE_FORMAT_BGRA8888, false, HDR_TYPE_NONE, "BGRA8888, sRGB reads" },
+    { IMAGE_FORMAT_BGRA8888, false, HDR_TYPE_INTEGER, "BGRA8888 .vtf, integer HDR" },
+    { IMAGE_FORMAT_BGRA8888, true, HDR_TYPE_INTEGER, "BGRA8888 .hdr.vtf, integer HDR" },
+    { IMAGE_FORMAT_ARGB8888, true, HDR_TYPE_INTEGER, "ARGB8888 .hdr.vtf, integer HDR" },
+    { IMAGE_FORMAT_RGBA8888, true, HDR_TYPE_FLOAT, "RGBA8888 .hdr.vtf, float HDR" },
+    { IMAGE_FORMAT_RGBA16161616, true, HDR_TYPE_INTEGER, "RGBA16161616 .hdr.vtf, integer HDR" },
+    { IMAGE_FORMAT_RGBA16161616F, true, HDR_TYPE_INTEGER, "RGBA16161616F .hdr.vtf, integer HDR" },
+    { IMAGE_FORMAT_RGBA16161616F, true, HDR_TYPE_FLOAT, "RGBA16161616F .hdr.vtf, float HDR" },
+    { IMAGE_FORMAT_RGBA32323232F, true, HDR_TYPE_FLOAT, "RGBA32323232F .hdr.vtf, float HDR" },
+};
+
+// Smallest mips of 1x1, 4x4 and 2x2
+static const struct
+{
+    int m_nSize;
+    int m_nMipCount;
+}
+s_SelfTestChains[] = { { 16, -1 }, { 16, 3 }, { 8, 3 } };
+
+static bool CheckGeneratedCubemaps()
+{
+    bool bOk = true;
+    uint32 nSeed = 1;
+    for (int nEncoding = 0; nEncoding < ARRAYSIZE(s_SelfTestEncodings); ++nEncoding)
+    {
+        for (int nChain = 0; nChain < ARRAYSIZE(s_SelfTestChains); ++nChain)
+        {
+            RefEnvMap_t envMap;
+            envMap.m_pVTF = CreateVTFTexture();
+            envMap.m_Format = s_SelfTestEncodings[nEncoding].m_Format;
+            envMap.m_bHDRFile = s_SelfTestEncodings[nEncoding].m_bHDRFile;
+            envMap.m_HDRType = s_SelfTestEncodings[nEncoding].m_HDRType;
+
+            int nSize = s_SelfTestChains[nChain].m_nSize;
+            if (envMap.m_pVTF->Init(nSize, nSize, 1, envMap.m_Format, TEXTUREFLAGS_ENVMAP, 1, s_SelfTestChains[nChain].m_nMipCount))
+            {
+                FillRandomTexels(envMap.m_pVTF, nSeed);
+
+                int nWidth, nHeight, nDepth;
+                envMap.m_pVTF->ComputeMipLevelDimensions(envMap.m_pVTF->MipCount() - 1, &nWidth, &nHeight, &nDepth);
+                char szName[128];
+                V_snprintf(szName, sizeof(szName), "%s, %dx%d last mip", s_SelfTestEncodings[nEncoding].m_pName, nWidth, nHeight);
+                bOk &= CheckEnvAmbientCube(szName, envMap);
+            }
+            else
+            {
+                Warning("  %s: can't create a %dx%d cubemap\n", s_SelfTestEncodings[nEncoding].m_pName, nSize, nSize);
+                bOk = false;
+            }
+            DestroyVTFTexture(envMap.m_pVTF);
+        }
+    }
+    return bOk;
+}
+
+//-----------------------------------------------------------------------------
+// Runs the checks on generated cubemaps and, given a texture name, on its
+// cubemap file as the current HDR mode reads it. True if they passed.
+//-----------------------------------------------------------------------------
+bool PBR_EnvAmbientSelfTest(const char* pTextureName)
+{
+    Msg("$useenvambient CPU ambient cube against the GPU lookups:\n");
+    bool bOk = CheckGeneratedCubemaps();
+
+    if (pTextureName)
+    {
+        RefEnvMap_t envMap;
+        envMap.m_HDRType = g_pHardwareConfig->GetHDRType();
+        envMap.m_pVTF = ReadEnvAmbientVTF(pTextureName, envMap.m_HDRType, envMap.m_bHDRFile);
+        if (!envMap.m_pVTF)
+        {
+            Warning("  can't read the cubemap %s\n", pTextureName);
+            bOk = false;
+        }
+        else
+        {
+            envMap.m_Format = envMap.m_pVTF->Format();
+            if (RefCanFetch(envMap.m_Format))
+            {
+                char szName[MAX_PATH];
+                V_snprintf(szName, sizeof(szName), "%s (%s)", pTextureName, ImageLoader::GetName(envMap.m_Format));
+                bOk &= CheckEnvAmbientCube(szName, envMap);
+            }
+            else
+            {
+                Msg("  %s: %s isn't a format the check decodes\n", pTextureName, ImageLoader::GetName(envMap.m_Format));
+            }
+            DestroyVTFTexture(envMap.m_pVTF);
+        }
+    }
+
+    Msg("$useenvambient self test: %s\n", bOk ? "passed" : "FAILED");
+    return bOk;
+}
+
+CON_COMMAND(mat_pbr_envambient_selftest, "Check the $useenvambient ambient cubes read on the CPU against the cubemap lookups of the shader. Optional argument: a cubemap texture to check as well, e.g. maps/<map>/c0_0_0.")
+{
+    PBR_EnvAmbientSelfTest((args.ArgC() > 1) ? args[1] : NULL);
+}
@@ -0,0 +1,58 @@
+//==================================================================================================
+//
+// $useenvambient's ambient cube, worked out once per cubemap on the CPU
+//
+// setupEnvMapAmbientCube in pbr_common_ps2_3_x.h reads the six face directions of the cubemap
+// at mip 12 in every pixel. That is the smallest mip, so the six colors only depend on the
+// cubemap: these read them from its VTF once, cache them by texture name and let pbr_dx9 upload
+// them to PSREG_AMBIENT_CUBE for the pixel shader to use like the engine's ambient cube.
+//
+//==================================================================================================
+
+#ifndef PBR_ENVAMBIENT_H
+#define PBR_ENVAMBIENT_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class ITexture;
+
+// Registers from PSREG_AMBIENT_CUBE: +X, -X, +Y, -Y, +Z and -Z
+#define PBR_ENV_AMBIENT_CUBE_REGISTERS 6
+
+// Is pEnvTexture the env_cubemap placeholder, which the engine binds as the local cubemap?
+// Compares names, so callers keep the answer with the texture rather than ask every draw.
+bool PBR_IsEnvCubemap(ITexture* pEnvTexture);
+
+// The cubemap a draw with pEnvTexture samples: for env_cubemap (bEnvCubemap, from
+// PBR_IsEnvCubemap) the local cubemap, like the engine binds it, else pEnvTexture itself.
+// Only env_cubemap queries the render context.
+ITexture* PBR_ResolveEnvAmbientTexture(ITexture* pEnvTexture, bool bEnvCubemap);
+
+// Reads pEnvTexture's ambient cube now, for cubemaps known before any draw (a material's
+// $envmap). Does nothing for env_cubemap, whose local cubemaps are queued by draws instead.
+void PBR_PrecacheEnvAmbientCube(ITexture* pEnvTexture);
+
+// The same for several cubemaps, read in parallel on g_pThreadPool. Returns once all are read.
+void PBR_PrecacheEnvAmbientCubes(ITexture** ppEnvTextures, int nTextures);
+
+// The ambient cube setupEnvMapAmbientCube builds from pEnvTexture, ENV_MAP_SCALE included.
+// Never reads files, so it's safe in a draw: a cubemap that isn't cached yet is queued for
+// PBR_UpdateEnvAmbientCubes and black until then. Also black when there is no texture, and
+// when its VTF can't be read (render targets, procedural textures, missing files), which is
+// reported once per texture.
+void PBR_GetEnvAmbientCube(ITexture* pEnvTexture, float vAmbientCube[PBR_ENV_AMBIENT_CUBE_REGISTERS][4]);
+
+// Reads the cubemaps draws have queued, in parallel like PBR_PrecacheEnvAmbientCubes. Runs at the
+// end of each frame and from mat_pbr_precache.
+void PBR_UpdateEnvAmbientCubes();
+
+// Bumped by mat_pbr_envambient_flush and whenever cubes are read. Ambient cubes copied before it
+// changed may be stale.
+int PBR_GetEnvAmbientCacheGeneration();
+
+// mat_pbr_envambient_selftest: checks the ambient cubes against a transliteration of the shader's
+// cubemap lookups, on generated cubemaps and on pTextureName's file if it isn't NULL
+bool PBR_EnvAmbientSelfTest(const char* pTextureName);
+
+#endif // PBR_ENVAMBIENT_H
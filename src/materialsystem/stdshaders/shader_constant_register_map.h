@@ -56,11 +56,15 @@
 #define PSREG_FLESH_LIGHTING_PARAMS				PSREG_CONSTANT_43
 #define PSREG_FLESH_SUBSURFACE_PARAMS			PSREG_CONSTANT_44
 #define PSREG_FLESH_SUBSURFACE_MODULATION		PSREG_CONSTANT_45
+//  --- PBR material constants, consecutive so they upload in one call ---
 #define PSREG_MRAO_FACTORS						PSREG_CONSTANT_46
 #define PSREG_EXTRA_FACTORS						PSREG_CONSTANT_47
 #define PSREG_CUSTOM_SSS_PARAMS					PSREG_CONSTANT_48
-#define PSREG_SSR_PARAMS_1                      PSREG_CONSTANT_49
-#define PSREG_SSR_PARAMS_2                      PSREG_CONSTANT_50
+#define PSREG_BASE_COLOR						PSREG_CONSTANT_49
+#define PSREG_PARALLAX_PARAMS					PSREG_CONSTANT_50
+//		.x parallax depth, .y parallax center, .z envmap roughness blend (0 with $envmapprefiltered)
+#define PSREG_SSR_PARAMS_1						PSREG_CONSTANT_51
+#define PSREG_SSR_PARAMS_2						PSREG_CONSTANT_52
 
 #ifndef C_CODE_HACK
 //for fxc code, map the constants to register names.
@@ -115,4 +119,6 @@
 #define PSREG_CONSTANT_48	c48
 #define PSREG_CONSTANT_49	c49
 #define PSREG_CONSTANT_50	c50
+#define PSREG_CONSTANT_51	c51
+#define PSREG_CONSTANT_52	c52
 #endif
\ No newline at end of file
@@ -497,7 +497,10 @@ private:
 	IMPLEMENT_OPERATOR_EQUAL( FlashlightState_t );
 };
 
+// Layout of the 32-bit engine
+#ifndef PLATFORM_64BITS
 static_assert( sizeof( FlashlightState_t ) == 348 );
+#endif
 
 //-----------------------------------------------------------------------------
 // Flags to be used with the Init call
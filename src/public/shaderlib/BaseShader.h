@@ -24,6 +24,7 @@
 //-----------------------------------------------------------------------------
 class IMaterialVar;
 class CPerInstanceContextData;
+struct ShaderDrawContext_t;
 
 
 //-----------------------------------------------------------------------------
@@ -183,6 +184,9 @@ public:
 	// Bind vertex texture
 	void BindVertexTexture( VertexTextureSampler_t vtSampler, int nTextureVar, int nFrame = 0 );
 
+	// Bind standard texture. Like BindTexture, this records the binding for mat_pbr_drawstream.
+	void BindStandardTexture( Sampler_t sampler, StandardTextureId_t nTextureId );
+
 	// Is the texture translucent?
 	bool TextureIsTranslucent( int textureVar, bool isBaseTexture );
 
@@ -219,6 +223,14 @@ public:
 
 	void ApplyColor2Factor( float *pColorOut ) const;		// (*pColorOut) *= COLOR2
 
+	// Groups this draw's timing under a shader-defined feature key (see mat_pbr_drawstats)
+	void SetDrawStatsKey( unsigned int nKey );
+
+	// Identifies this draw's passes in the mat_pbr_drawstream recording: the
+	// material sort key, the full vertex and pixel shader combo indices and
+	// a DrawStreamPass_t
+	void SetDrawStreamInfo( uint64 nSortKey, int nVertexShader, int nPixelShader, int nPass );
+
 private:
 	// This is a per-instance state which is handled completely by the system
 	void PI_SetSkinningMatrices();
@@ -227,15 +239,17 @@ private:
 	FORCEINLINE void SetFogMode( ShaderFogMode_t fogMode );
 
 protected:
-	static IMaterialVar **s_ppParams;
-	static const char *s_pTextureGroupName; // Current material's texture group name.
-	static IShaderShadow *s_pShaderShadow;
-	static IShaderDynamicAPI *s_pShaderAPI;
-	static IShaderInit *s_pShaderInit;
+	// The material being initialized or drawn on this thread. The engine
+	// snapshots materials on one thread while another draws, so each thread
+	// has its own.
+	static DECL_THREAD_LOCAL IMaterialVar **s_ppParams;
+	static DECL_THREAD_LOCAL const char *s_pTextureGroupName; // Current material's texture group name.
+	static DECL_THREAD_LOCAL IShaderShadow *s_pShaderShadow;
+	static DECL_THREAD_LOCAL IShaderDynamicAPI *s_pShaderAPI;
+	static DECL_THREAD_LOCAL IShaderInit *s_pShaderInit;
 private:
-	static int s_nPassCount;
-	static int s_nModulationFlags;
-	static CPerInstanceContextData** s_pInstanceDataPtr;
+	// The rest of this thread's DrawElements, which lives on its stack
+	static DECL_THREAD_LOCAL ShaderDrawContext_t *s_pDrawContext;
 
 	template <class T> friend class CBaseCommandBufferBuilder;
 };
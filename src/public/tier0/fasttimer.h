@@ -314,7 +314,7 @@ inline void CCycleCount::Sample()
 		"movl %%edx, 4(%0)\n\t"
 		: /* no output regs */
 	: "D" (pSample)
-		: "%eax", "%edx" );
+		: "%eax", "%edx", "memory" );
 #elif defined( _WIN32 )
 	unsigned long* pSample = (unsigned long *)&m_Int64;
 	__asm
@@ -337,7 +337,7 @@ inline void CCycleCount::Sample()
 		"movl %%edx, 4(%0)\n\t"
 		: /* no output regs */
 		: "D" (pSample)
-		: "%eax", "%edx" );
+		: "%eax", "%edx", "memory" );
 #endif
 }
 
@@ -0,0 +1,398 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Cubemap mip chains and the GGX prefilter.
+//
+// The prefilter follows the split sum approximation: the lobe is taken with
+// N = V = R, so every texel of a mip uses the same tangent space sample set,
+// built once per mip. Reading each sample from the source mip with texels of
+// the sample's solid angle (the pdf weighted lookups of GPU Gems 3, ch. 20)
+// keeps bright spots from turning into speckles at low sample counts.
+//
+//===========================================================================//
+
+#include "envprefilter.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/ssemath.h"
+#include "mathlib/halton.h"
+#include "bitmap/floatbitmap.h"
+#include "vstdlib/jobthread.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+#define ENV_PREFILTER_ROWS_PER_JOB	8
+
+static int ComputeEnvMapLOD( int nSize )
+{
+	int nLOD = 0;
+	while ( nSize >>= 1 )
+	{
+		++nLOD;
+	}
+	return clamp( nLOD, 4, 12 );
+}
+
+
+//-----------------------------------------------------------------------------
+// CCubeMapMipChain
+//-----------------------------------------------------------------------------
+CCubeMapMipChain::CCubeMapMipChain()
+{
+}
+
+CCubeMapMipChain::~CCubeMapMipChain()
+{
+	m_Mips.PurgeAndDeleteElements();
+}
+
+static FloatCubeMap_t *DownsampleCubeMap( const FloatCubeMap_t &src )
+{
+	int nSize = MAX( 1, src.face_maps[0].NumCols() / 2 );
+	FloatCubeMap_t *pDest = new FloatCubeMap_t( nSize, nSize );
+	for ( int f = 0; f < 6; ++f )
+	{
+		const FloatBitMap_t &srcFace = src.face_maps[f];
+		for ( int y = 0; y < nSize; ++y )
+		{
+			for ( int x = 0; x < nSize; ++x )
+			{
+				for ( int c = 0; c < 4; ++c )
+				{
+					pDest->face_maps[f].Pixel( x, y, 0, c ) = 0.25f * (
+						srcFace.PixelClamped( 2 * x, 2 * y, 0, c ) + srcFace.PixelClamped( 2 * x + 1, 2 * y, 0, c ) +
+						srcFace.PixelClamped( 2 * x, 2 * y + 1, 0, c ) + srcFace.PixelClamped( 2 * x + 1, 2 * y + 1, 0, c ) );
+				}
+			}
+		}
+	}
+	return pDest;
+}
+
+void CCubeMapMipChain::InitBoxFiltered( FloatCubeMap_t *pCubeMap )
+{
+	m_Mips.PurgeAndDeleteElements();
+	m_Mips.AddToTail( pCubeMap );
+	while ( pCubeMap->face_maps[0].NumCols() > 1 )
+	{
+		pCubeMap = DownsampleCubeMap( *pCubeMap );
+		m_Mips.AddToTail( pCubeMap );
+	}
+	InitFaceFrames();
+}
+
+void CCubeMapMipChain::InitFromMips( const CUtlVector< FloatCubeMap_t * > &mips )
+{
+	m_Mips.PurgeAndDeleteElements();
+	m_Mips.AddVectorToTail( mips );
+	InitFaceFrames();
+}
+
+void CCubeMapMipChain::InitFaceFrames()
+{
+	FloatCubeMap_t &top = *m_Mips[0];
+	for ( int f = 0; f < 6; ++f )
+	{
+		Vector normal = top.FaceNormal( f );
+		VectorNormalize( normal );
+		Vector corner = top.PixelDirection( f, 0, 0 );
+		Vector right = top.PixelDirection( f, 1, 0 );
+		Vector down = top.PixelDirection( f, 0, 1 );
+
+		m_FaceNormal[f] = normal;
+		m_FaceOrigin[f] = corner / DotProduct( corner, normal );
+		m_FaceX[f] = right / DotProduct( right, normal ) - m_FaceOrigin[f];
+		m_FaceY[f] = down / DotProduct( down, normal ) - m_FaceOrigin[f];
+	}
+}
+
+int CCubeMapMipChain::Size() const
+{
+	return m_Mips.Count() ? m_Mips[0]->face_maps[0].NumCols() : 0;
+}
+
+float CCubeMapMipChain::EnvMapLOD() const
+{
+	return (float)ComputeEnvMapLOD( Size() );
+}
+
+int CCubeMapMipChain::SelectFace( const Vector &direction, float &s, float &t ) const
+{
+	int nFace = 0;
+	float flBest = -FLT_MAX;
+	for ( int f = 0; f < 6; ++f )
+	{
+		float flDot = DotProduct( direction, m_FaceNormal[f] );
+		if ( flDot > flBest )
+		{
+			flBest = flDot;
+			nFace = f;
+		}
+	}
+
+	// To 0..1 across the face, with mip 0's pixel centers at ( x + 0.5 ) / size
+	Vector onFace = direction / MAX( flBest, 1e-6f ) - m_FaceOrigin[nFace];
+	float flSize = (float)Size();
+	s = ( DotProduct( onFace, m_FaceX[nFace] ) / m_FaceX[nFace].LengthSqr() + 0.5f ) / flSize;
+	t = ( DotProduct( onFace, m_FaceY[nFace] ) / m_FaceY[nFace].LengthSqr() + 0.5f ) / flSize;
+	return nFace;
+}
+
+// Bilinear, clamped at the face's edges
+static Vector SampleFace( const FloatBitMap_t &face, float s, float t )
+{
+	float x = s * face.NumCols() - 0.5f;
+	float y = t * face.NumRows() - 0.5f;
+	int x0 = (int)floorf( x );
+	int y0 = (int)floorf( y );
+	float fx = x - x0;
+	float fy = y - y0;
+
+	Vector result;
+	for ( int c = 0; c < 3; ++c )
+	{
+		float top = Lerp( fx, face.PixelClamped( x0, y0, 0, c ), face.PixelClamped( x0 + 1, y0, 0, c ) );
+		float bottom = Lerp( fx, face.PixelClamped( x0, y0 + 1, 0, c ), face.PixelClamped( x0 + 1, y0 + 1, 0, c ) );
+		result[c] = Lerp( fy, top, bottom );
+	}
+	return result;
+}
+
+Vector CCubeMapMipChain::SampleMip( const Vector &direction, int nMip ) const
+{
+	float s, t;
+	int nFace = SelectFace( direction, s, t );
+	return SampleFace( m_Mips[nMip]->face_maps[nFace], s, t );
+}
+
+Vector CCubeMapMipChain::Sample( const Vector &direction, float flLod ) const
+{
+	float s, t;
+	int nFace = SelectFace( direction, s, t );
+
+	flLod = clamp( flLod, 0.0f, (float)( m_Mips.Count() - 1 ) );
+	int nMip = (int)flLod;
+	Vector result = SampleFace( m_Mips[nMip]->face_maps[nFace], s, t );
+	float flFraction = flLod - nMip;
+	if ( flFraction > 0.0f && nMip + 1 < m_Mips.Count() )
+	{
+		result = Lerp( flFraction, result, SampleFace( m_Mips[nMip + 1]->face_maps[nFace], s, t ) );
+	}
+	return result;
+}
+
+void CCubeMapMipChain::ComputeFaceAverages( Vector *pAmbientCube ) const
+{
+	const FloatCubeMap_t &smallest = *m_Mips.Tail();
+	for ( int f = 0; f < 6; ++f )
+	{
+		const Vector &normal = m_FaceNormal[f];
+		int nAxis = ( fabsf( normal.x ) > 0.5f ) ? 0 : ( fabsf( normal.y ) > 0.5f ) ? 1 : 2;
+		pAmbientCube[nAxis * 2 + ( normal[nAxis] < 0.0f ? 1 : 0 )] = smallest.face_maps[f].AverageColor();
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// The sample set of one mip, in tangent space around +Z and padded to a
+// multiple of 4 with zero weights
+//-----------------------------------------------------------------------------
+struct PrefilterMipSamples_t
+{
+	CUtlVector< float > m_X;
+	CUtlVector< float > m_Y;
+	CUtlVector< float > m_Z;
+	CUtlVector< float > m_Weight;		// N.L
+	CUtlVector< int > m_nSourceMip;
+	float m_flWeightSum;
+};
+
+static void AddSample( PrefilterMipSamples_t &samples, const Vector &direction, float flWeight, int nSourceMip )
+{
+	samples.m_X.AddToTail( direction.x );
+	samples.m_Y.AddToTail( direction.y );
+	samples.m_Z.AddToTail( direction.z );
+	samples.m_Weight.AddToTail( flWeight );
+	samples.m_nSourceMip.AddToTail( nSourceMip );
+}
+
+static void BuildMipSamples( PrefilterMipSamples_t &samples, float flRoughness, int nSamples, const CCubeMapMipChain &source )
+{
+	// Same alpha as PBR_NdfGGX4
+	float flAlpha = flRoughness * flRoughness;
+	float flAlphaSq = flAlpha * flAlpha;
+	float flTexelSolidAngle = 4.0f * M_PI_F / ( 6.0f * source.Size() * source.Size() );
+
+	// Hammersley points: i / n against the base 2 radical inverse
+	HaltonSequenceGenerator_t radicalInverse( 2 );
+
+	samples.m_flWeightSum = 0.0f;
+	for ( int i = 0; i < nSamples; ++i )
+	{
+		float flPhi = 2.0f * M_PI_F * ( i + 0.5f ) / nSamples;
+		float u = radicalInverse.NextValue();
+		float flCosTheta = sqrtf( ( 1.0f - u ) / ( 1.0f + ( flAlphaSq - 1.0f ) * u ) );
+		float flSinTheta = sqrtf( MAX( 0.0f, 1.0f - flCosTheta * flCosTheta ) );
+		float flSinPhi, flCosPhi;
+		SinCos( flPhi, &flSinPhi, &flCosPhi );
+
+		// The half vector, and the view reflected about it with V = N = +Z
+		Vector halfVector( flSinTheta * flCosPhi, flSinTheta * flSinPhi, flCosTheta );
+		Vector lightIn = halfVector * ( 2.0f * flCosTheta ) - Vector( 0.0f, 0.0f, 1.0f );
+		if ( lightIn.z <= 0.0f )
+			continue;
+
+		// pdf( L ) = D * N.H / ( 4 * V.H ), which is D / 4 with V = N
+		float flDenom = flCosTheta * flCosTheta * ( flAlphaSq - 1.0f ) + 1.0f;
+		float flPdf = 0.25f * flAlphaSq / ( M_PI_F * flDenom * flDenom );
+		float flSampleSolidAngle = 1.0f / ( nSamples * flPdf + 1e-6f );
+
+		// One mip up from the matching one, which hides the sampling pattern
+		float flLod = 0.5f * log2f( flSampleSolidAngle / flTexelSolidAngle ) + 1.0f;
+		int nSourceMip = clamp( (int)( flLod + 0.5f ), 0, source.MipCount() - 1 );
+
+		AddSample( samples, lightIn, lightIn.z, nSourceMip );
+		samples.m_flWeightSum += lightIn.z;
+	}
+
+	while ( samples.m_Weight.Count() % 4 )
+	{
+		AddSample( samples, Vector( 0.0f, 0.0f, 1.0f ), 0.0f, 0 );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Jobs: a band of rows of one face of one mip
+//-----------------------------------------------------------------------------
+struct PrefilterContext_t
+{
+	const CCubeMapMipChain *m_pSource;
+	FloatCubeMap_t **m_ppDestMips;
+	const PrefilterMipSamples_t *m_pSamples;
+};
+
+struct PrefilterJob_t
+{
+	const PrefilterContext_t *m_pContext;
+	int m_nMip;
+	int m_nFace;
+	int m_nFirstRow;
+	int m_nRows;
+};
+
+static void PrefilterRows( PrefilterJob_t &job )
+{
+	const CCubeMapMipChain &source = *job.m_pContext->m_pSource;
+	FloatCubeMap_t &dest = *job.m_pContext->m_ppDestMips[job.m_nMip];
+	FloatBitMap_t &face = dest.face_maps[job.m_nFace];
+	const PrefilterMipSamples_t &samples = job.m_pContext->m_pSamples[job.m_nMip];
+	int nSamples = samples.m_Weight.Count();
+	float flInvWeightSum = 1.0f / MAX( samples.m_flWeightSum, 1e-6f );
+
+	for ( int y = job.m_nFirstRow; y < job.m_nFirstRow + job.m_nRows; ++y )
+	{
+		for ( int x = 0; x < face.NumCols(); ++x )
+		{
+			Vector normal = dest.PixelDirection( job.m_nFace, x, y );
+			VectorNormalize( normal );
+			Vector up = ( fabsf( normal.z ) < 0.999f ) ? Vector( 0.0f, 0.0f, 1.0f ) : Vector( 1.0f, 0.0f, 0.0f );
+			Vector tangent = CrossProduct( up, normal );
+			VectorNormalize( tangent );
+			Vector binormal = CrossProduct( normal, tangent );
+
+			FourVectors sum;
+			sum.x = sum.y = sum.z = Four_Zeros;
+			for ( int i = 0; i < nSamples; i += 4 )
+			{
+				fltx4 localX = LoadUnalignedSIMD( &samples.m_X[i] );
+				fltx4 localY = LoadUnalignedSIMD( &samples.m_Y[i] );
+				fltx4 localZ = LoadUnalignedSIMD( &samples.m_Z[i] );
+				fltx4 weight = LoadUnalignedSIMD( &samples.m_Weight[i] );
+
+				FourVectors lightIn;
+				lightIn.x = MaddSIMD( localX, ReplicateX4( tangent.x ), MaddSIMD( localY, ReplicateX4( binormal.x ), MulSIMD( localZ, ReplicateX4( normal.x ) ) ) );
+				lightIn.y = MaddSIMD( localX, ReplicateX4( tangent.y ), MaddSIMD( localY, ReplicateX4( binormal.y ), MulSIMD( localZ, ReplicateX4( normal.y ) ) ) );
+				lightIn.z = MaddSIMD( localX, ReplicateX4( tangent.z ), MaddSIMD( localY, ReplicateX4( binormal.z ), MulSIMD( localZ, ReplicateX4( normal.z ) ) ) );
+
+				FourVectors radiance;
+				for ( int nLane = 0; nLane < 4; ++nLane )
+				{
+					Vector color = ( samples.m_Weight[i + nLane] > 0.0f ) ? source.SampleMip( lightIn.Vec( nLane ), samples.m_nSourceMip[i + nLane] ) : vec3_origin;
+					radiance.X( nLane ) = color.x;
+					radiance.Y( nLane ) = color.y;
+					radiance.Z( nLane ) = color.z;
+				}
+
+				sum.x = MaddSIMD( radiance.x, weight, sum.x );
+				sum.y = MaddSIMD( radiance.y, weight, sum.y );
+				sum.z = MaddSIMD( radiance.z, weight, sum.z );
+			}
+
+			Vector result = sum.Vec( 0 ) + sum.Vec( 1 ) + sum.Vec( 2 ) + sum.Vec( 3 );
+			for ( int c = 0; c < 3; ++c )
+			{
+				face.Pixel( x, y, 0, c ) = result[c] * flInvWeightSum;
+			}
+			face.Pixel( x, y, 0, 3 ) = 1.0f;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Prefiltering
+//-----------------------------------------------------------------------------
+float EnvPrefilter_MipRoughness( int nMip, int nSize )
+{
+	return MIN( 1.0f, (float)nMip / ComputeEnvMapLOD( nSize ) );
+}
+
+void EnvPrefilter_GGX( const CCubeMapMipChain &source, CCubeMapMipChain &dest, int nSamples )
+{
+	int nSize = source.Size();
+	int nMips = source.MipCount();
+
+	// Mip 0 is a mirror, the source as it is
+	CUtlVector< FloatCubeMap_t * > mips;
+	mips.AddToTail( new FloatCubeMap_t( nSize, nSize ) );
+	for ( int f = 0; f < 6; ++f )
+	{
+		mips[0]->face_maps[f].LoadFromFloatBitmap( &source.Mip( 0 ).face_maps[f] );
+	}
+
+	PrefilterMipSamples_t *pSamples = new PrefilterMipSamples_t[nMips];
+	CUtlVector< PrefilterJob_t > jobs;
+	PrefilterContext_t context;
+	for ( int nMip = 1; nMip < nMips; ++nMip )
+	{
+		int nMipSize = MAX( 1, nSize >> nMip );
+		mips.AddToTail( new FloatCubeMap_t( nMipSize, nMipSize ) );
+		BuildMipSamples( pSamples[nMip], EnvPrefilter_MipRoughness( nMip, nSize ), nSamples, source );
+
+		// Largest mips first, so the small jobs fill in at the end
+		for ( int f = 0; f < 6; ++f )
+		{
+			for ( int y = 0; y < nMipSize; y += ENV_PREFILTER_ROWS_PER_JOB )
+			{
+				PrefilterJob_t &job = jobs[jobs.AddToTail()];
+				job.m_pContext = &context;
+				job.m_nMip = nMip;
+				job.m_nFace = f;
+				job.m_nFirstRow = y;
+				job.m_nRows = MIN( ENV_PREFILTER_ROWS_PER_JOB, nMipSize - y );
+			}
+		}
+	}
+
+	context.m_pSource = &source;
+	context.m_ppDestMips = mips.Base();
+	context.m_pSamples = pSamples;
+	if ( jobs.Count() )
+	{
+		ParallelProcess( jobs.Base(), jobs.Count(), PrefilterRows );
+	}
+
+	delete[] pSamples;
+	dest.InitFromMips( mips );
+}
@@ -0,0 +1,86 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Cubemap mip chains with lookups by direction, and the GGX
+//			prefilter that makes a chain match pbr_ps30's specular lookup.
+//
+//===========================================================================//
+
+#ifndef ENVPREFILTER_H
+#define ENVPREFILTER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "mathlib/vector.h"
+#include "tier1/utlvector.h"
+
+class FloatCubeMap_t;
+
+
+//-----------------------------------------------------------------------------
+// A cubemap and its mips, largest first
+//-----------------------------------------------------------------------------
+class CCubeMapMipChain
+{
+public:
+	CCubeMapMipChain();
+	~CCubeMapMipChain();
+
+	// Takes ownership of pCubeMap and box filters the mips down to 1x1
+	void InitBoxFiltered( FloatCubeMap_t *pCubeMap );
+
+	// Takes ownership of the mips, which must halve in size down the chain
+	void InitFromMips( const CUtlVector< FloatCubeMap_t * > &mips );
+
+	int MipCount() const { return m_Mips.Count(); }
+	int Size() const;
+	FloatCubeMap_t &Mip( int nMip ) const { return *m_Mips[nMip]; }
+
+	// The mip pbr_ps30 samples at roughness 1, as ComputeEnvMapLOD in
+	// pbr_dx9.cpp works it out for a cubemap of this size
+	float EnvMapLOD() const;
+
+	// Bilinear within the face the direction points into
+	Vector SampleMip( const Vector &direction, int nMip ) const;
+
+	// Trilinear, like texCUBElod
+	Vector Sample( const Vector &direction, float flLod ) const;
+
+	// The average of each face: +X, -X, +Y, -Y, +Z and -Z, the order of an
+	// ambient cube
+	void ComputeFaceAverages( Vector *pAmbientCube ) const;
+
+private:
+	void InitFaceFrames();
+	int SelectFace( const Vector &direction, float &s, float &t ) const;
+
+	CUtlVector< FloatCubeMap_t * > m_Mips;
+
+	// Each face's plane at distance 1: the mip 0 pixel ( x, y ) is in the
+	// direction m_FaceOrigin + x * m_FaceX + y * m_FaceY
+	Vector m_FaceNormal[6];
+	Vector m_FaceOrigin[6];
+	Vector m_FaceX[6];
+	Vector m_FaceY[6];
+};
+
+
+//-----------------------------------------------------------------------------
+// GGX prefiltering. pbr_ps30 reads the cubemap at mip roughness * ENVMAPLOD,
+// so mip n is convolved for roughness n / ENVMAPLOD, with mip 0 a copy of the
+// source. Each texel takes nSamples importance sampled directions (Hammersley
+// points, from a Halton sequence), each read from the source mip whose texels
+// match the sample's solid angle. The mips, faces and rows are spread over
+// g_pThreadPool, which the caller has started.
+//-----------------------------------------------------------------------------
+#define ENV_PREFILTER_DEFAULT_SAMPLES	128
+
+// The roughness mip nMip of a cubemap nSize texels wide is filtered for
+float EnvPrefilter_MipRoughness( int nMip, int nSize );
+
+// Fills dest with the prefiltered chain of source's mip 0, reading source's
+// mips for the filtered lookups
+void EnvPrefilter_GGX( const CCubeMapMipChain &source, CCubeMapMipChain &dest, int nSamples = ENV_PREFILTER_DEFAULT_SAMPLES );
+
+
+#endif // ENVPREFILTER_H
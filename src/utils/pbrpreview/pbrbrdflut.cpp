@@ -0,0 +1,404 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Bakes the split-sum environment BRDF table for pbr_ps30's
+//			ENVBRDFLUT combo, and measures EnvBRDFApprox against it.
+//
+//			pbrbrdflut [-o file.vtf] [-size n] [-samples n] [-format rg16f|rg8] [-threads n]
+//			pbrbrdflut -compare [-size n] [-samples n] [-threads n]
+//
+//			Texel ( x, y ) holds the scale (red) and bias (green) that F0
+//			gets in the GGX specular response integrated over the
+//			hemisphere, at N.V = ( x + 0.5 ) / size and roughness
+//			( y + 0.5 ) / size, which is where pbr_ps30 samples it. The
+//			default is a 128x128 RG16F envbrdflut.vtf. rg8 writes 8 bit RGB
+//			with blue unused, since D3D9 has no unsigned two channel 8 bit
+//			format. Set the texture as $envbrdflut.
+//
+//			-compare bakes the table in memory and prints the max and mean
+//			error of EnvBRDFApprox, as pbr_ps30 evaluates it, against the
+//			table over the whole ( N.V, roughness ) domain.
+//
+//===========================================================================//
+
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/halton.h"
+#include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utlvector.h"
+#include "vtf/vtf.h"
+#include "vstdlib/jobthread.h"
+#include "pbr_brdf_simd.h"
+#include <stdio.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+#define ENV_BRDF_DEFAULT_SIZE		128
+#define ENV_BRDF_DEFAULT_SAMPLES	1024
+
+//-----------------------------------------------------------------------------
+// The table, scale and bias in rows of increasing roughness
+//-----------------------------------------------------------------------------
+struct EnvBRDFTable_t
+{
+	int m_nSize;
+	int m_nSamples;
+	CUtlVector< float > m_Scale;
+	CUtlVector< float > m_Bias;
+};
+
+struct EnvBRDFRowJob_t
+{
+	EnvBRDFTable_t *m_pTable;
+	int m_nRow;
+};
+
+// Smith with Schlick-GGX, with k = alpha / 2 as for image based lighting
+static float SmithSchlickGGX( float flNoV, float flNoL, float flAlpha )
+{
+	float k = 0.5f * flAlpha;
+	float flG1V = flNoV / ( flNoV * ( 1.0f - k ) + k );
+	float flG1L = flNoL / ( flNoL * ( 1.0f - k ) + k );
+	return flG1V * flG1L;
+}
+
+static void IntegrateRow( EnvBRDFRowJob_t &job )
+{
+	EnvBRDFTable_t &table = *job.m_pTable;
+	int nSize = table.m_nSize;
+	int nSamples = table.m_nSamples;
+
+	// Same alpha as PBR_NdfGGX4
+	float flRoughness = ( job.m_nRow + 0.5f ) / nSize;
+	float flAlpha = flRoughness * flRoughness;
+	float flAlphaSq = flAlpha * flAlpha;
+
+	// The half vectors don't depend on N.V, so the row shares them.
+	// Hammersley points: i / n against the base 2 radical inverse.
+	CUtlVector< Vector > halfVectors;
+	halfVectors.EnsureCapacity( nSamples );
+	HaltonSequenceGenerator_t radicalInverse( 2 );
+	for ( int i = 0; i < nSamples; ++i )
+	{
+		float flPhi = 2.0f * M_PI_F * ( i + 0.5f ) / nSamples;
+		float u = radicalInverse.NextValue();
+		float flCosTheta = sqrtf( ( 1.0f - u ) / ( 1.0f + ( flAlphaSq - 1.0f ) * u ) );
+		float flSinTheta = sqrtf( MAX( 0.0f, 1.0f - flCosTheta * flCosTheta ) );
+		float flSinPhi, flCosPhi;
+		SinCos( flPhi, &flSinPhi, &flCosPhi );
+		halfVectors.AddToTail( Vector( flSinTheta * flCosPhi, flSinTheta * flSinPhi, flCosTheta ) );
+	}
+
+	for ( int x = 0; x < nSize; ++x )
+	{
+		float flNoV = ( x + 0.5f ) / nSize;
+		Vector view( sqrtf( 1.0f - flNoV * flNoV ), 0.0f, flNoV );
+
+		// With pdf( L ) = D * N.H / ( 4 * V.H ), each sample of
+		// F * D * G / ( 4 * N.L * N.V ) * N.L / pdf is F * G * V.H / ( N.H * N.V ),
+		// and F = F0 * ( 1 - Fc ) + Fc splits it into the scale and bias of F0
+		float flScale = 0.0f, flBias = 0.0f;
+		for ( int i = 0; i < nSamples; ++i )
+		{
+			const Vector &halfVector = halfVectors[i];
+			float flVoH = DotProduct( view, halfVector );
+			float flNoL = 2.0f * flVoH * halfVector.z - flNoV;
+			if ( flNoL <= 0.0f || flVoH <= 0.0f )
+				continue;
+
+			float flVisibility = SmithSchlickGGX( flNoV, flNoL, flAlpha ) * flVoH / ( halfVector.z * flNoV );
+			float flFc = powf( 1.0f - flVoH, 5.0f );
+			flScale += ( 1.0f - flFc ) * flVisibility;
+			flBias += flFc * flVisibility;
+		}
+
+		int nTexel = job.m_nRow * nSize + x;
+		table.m_Scale[nTexel] = flScale / nSamples;
+		table.m_Bias[nTexel] = flBias / nSamples;
+	}
+}
+
+static void BakeTable( EnvBRDFTable_t &table, int nSize, int nSamples )
+{
+	table.m_nSize = nSize;
+	table.m_nSamples = nSamples;
+	table.m_Scale.SetCount( nSize * nSize );
+	table.m_Bias.SetCount( nSize * nSize );
+
+	CUtlVector< EnvBRDFRowJob_t > jobs;
+	jobs.SetCount( nSize );
+	for ( int y = 0; y < nSize; ++y )
+	{
+		jobs[y].m_pTable = &table;
+		jobs[y].m_nRow = y;
+	}
+	ParallelProcess( jobs.Base(), jobs.Count(), IntegrateRow );
+}
+
+
+//-----------------------------------------------------------------------------
+// Writing the .vtf
+//-----------------------------------------------------------------------------
+
+// Rounds to nearest even. The table is in [0, 1], so there are no
+// infinities or NaNs to carry over.
+static uint16 FloatToHalf( float flValue )
+{
+	uint32 nBits = FloatBits( flValue );
+	uint32 nSign = ( nBits >> 16 ) & 0x8000;
+	int nExponent = (int)( ( nBits >> 23 ) & 0xff ) - 127 + 15;
+	uint32 nMantissa = nBits & 0x7fffff;
+
+	uint32 nHalf, nRemainder, nHalfway;
+	if ( nExponent > 0 )
+	{
+		nHalf = ( nExponent << 10 ) | ( nMantissa >> 13 );
+		nRemainder = nMantissa & 0x1fff;
+		nHalfway = 0x1000;
+	}
+	else
+	{
+		// Denormal, or zero below half the smallest one
+		if ( nExponent < -10 )
+			return (uint16)nSign;
+		nMantissa |= 0x800000;
+		int nShift = 14 - nExponent;
+		nHalf = nMantissa >> nShift;
+		nRemainder = nMantissa & ( ( 1 << nShift ) - 1 );
+		nHalfway = 1 << ( nShift - 1 );
+	}
+
+	// A carry out of the mantissa correctly bumps the exponent
+	if ( nRemainder > nHalfway || ( nRemainder == nHalfway && ( nHalf & 1 ) ) )
+	{
+		++nHalf;
+	}
+	return (uint16)( nSign | nHalf );
+}
+
+static bool WriteTable( const EnvBRDFTable_t &table, const char *pFileName, ImageFormat format )
+{
+	int nSize = table.m_nSize;
+	int nFlags = TEXTUREFLAGS_CLAMPS | TEXTUREFLAGS_CLAMPT | TEXTUREFLAGS_NOMIP | TEXTUREFLAGS_NOLOD;
+
+	IVTFTexture *pTexture = CreateVTFTexture();
+	if ( !pTexture->Init( nSize, nSize, 1, format, nFlags, 1, 1 ) )
+	{
+		Warning( "Unable to create a %dx%d texture\n", nSize, nSize );
+		DestroyVTFTexture( pTexture );
+		return false;
+	}
+
+	uint8 *pDest = pTexture->ImageData( 0, 0, 0 );
+	for ( int i = 0; i < nSize * nSize; ++i )
+	{
+		float flScale = clamp( table.m_Scale[i], 0.0f, 1.0f );
+		float flBias = clamp( table.m_Bias[i], 0.0f, 1.0f );
+		if ( format == IMAGE_FORMAT_RG1616F )
+		{
+			uint16 *pTexel = (uint16 *)pDest + 2 * i;
+			pTexel[0] = FloatToHalf( flScale );
+			pTexel[1] = FloatToHalf( flBias );
+		}
+		else
+		{
+			uint8 *pTexel = pDest + 3 * i;
+			pTexel[0] = (uint8)( flScale * 255.0f + 0.5f );
+			pTexel[1] = (uint8)( flBias * 255.0f + 0.5f );
+			pTexel[2] = 0;
+		}
+	}
+
+	CUtlBuffer buf;
+	bool bOk = pTexture->Serialize( buf );
+	DestroyVTFTexture( pTexture );
+
+	FILE *fp = bOk ? fopen( pFileName, "wb" ) : NULL;
+	if ( !fp )
+	{
+		Warning( "Unable to write %s\n", pFileName );
+		return false;
+	}
+	bOk = fwrite( buf.Base(), 1, buf.TellPut(), fp ) == (size_t)buf.TellPut();
+	fclose( fp );
+	return bOk;
+}
+
+
+//-----------------------------------------------------------------------------
+// EnvBRDFApprox against the table
+//-----------------------------------------------------------------------------
+struct EnvBRDFError_t
+{
+	const char *m_pName;
+	float m_flMax;
+	float m_flMaxNoV;
+	float m_flMaxRoughness;
+	double m_flSum;
+};
+
+static void AddError( EnvBRDFError_t &error, float flApprox, float flTable, float flNoV, float flRoughness )
+{
+	float flError = fabsf( flApprox - flTable );
+	error.m_flSum += flError;
+	if ( flError > error.m_flMax )
+	{
+		error.m_flMax = flError;
+		error.m_flMaxNoV = flNoV;
+		error.m_flMaxRoughness = flRoughness;
+	}
+}
+
+static void CompareWithApprox( const EnvBRDFTable_t &table )
+{
+	EnvBRDFError_t errors[4] =
+	{
+		{ "scale" }, { "bias" }, { "F0 0.04" }, { "F0 1.0" },
+	};
+
+	// One call gives the bias, F0 = 0, in x, scale + bias, F0 = 1, in y and
+	// a dielectric in z, for four N.V at once
+	int nSize = table.m_nSize;
+	FourVectors specularColor;
+	specularColor.x = Four_Zeros;
+	specularColor.y = Four_Ones;
+	specularColor.z = ReplicateX4( 0.04f );
+
+	for ( int y = 0; y < nSize; ++y )
+	{
+		float flRoughness = ( y + 0.5f ) / nSize;
+		for ( int x = 0; x < nSize; x += 4 )
+		{
+			ALIGN16 float flNoV[4] ALIGN16_POST;
+			for ( int i = 0; i < 4; ++i )
+			{
+				flNoV[i] = ( MIN( x + i, nSize - 1 ) + 0.5f ) / nSize;
+			}
+			FourVectors approx = PBR_EnvBRDFApprox4( specularColor, ReplicateX4( flRoughness ), LoadAlignedSIMD( flNoV ) );
+
+			for ( int i = 0; i < 4 && x + i < nSize; ++i )
+			{
+				int nTexel = y * nSize + x + i;
+				float flScale = table.m_Scale[nTexel];
+				float flBias = table.m_Bias[nTexel];
+				float flApproxBias = SubFloat( approx.x, i );
+				float flApproxOne = SubFloat( approx.y, i );
+
+				AddError( errors[0], flApproxOne - flApproxBias, flScale, flNoV[i], flRoughness );
+				AddError( errors[1], flApproxBias, flBias, flNoV[i], flRoughness );
+				AddError( errors[2], SubFloat( approx.z, i ), 0.04f * flScale + flBias, flNoV[i], flRoughness );
+				AddError( errors[3], flApproxOne, flScale + flBias, flNoV[i], flRoughness );
+			}
+		}
+	}
+
+	Msg( "EnvBRDFApprox against the %dx%d split-sum table, %d samples per texel:\n", nSize, nSize, table.m_nSamples );
+	for ( int i = 0; i < ARRAYSIZE( errors ); ++i )
+	{
+		const EnvBRDFError_t &error = errors[i];
+		Msg( "  %-8s max %.4f (N.V %.3f, roughness %.3f), mean %.4f\n", error.m_pName, error.m_flMax,
+			error.m_flMaxNoV, error.m_flMaxRoughness, error.m_flSum / ( nSize * nSize ) );
+	}
+}
+
+
+static void PrintUsage()
+{
+	Msg( "usage: pbrbrdflut [-o file.vtf] [-size n] [-samples n] [-format rg16f|rg8] [-threads n]\n"
+		 "       pbrbrdflut -compare [-size n] [-samples n] [-threads n]\n" );
+}
+
+int main( int argc, char **argv )
+{
+	const char *pOutFile = "envbrdflut.vtf";
+	int nSize = ENV_BRDF_DEFAULT_SIZE;
+	int nSamples = ENV_BRDF_DEFAULT_SAMPLES;
+	int nThreads = -1;
+	ImageFormat format = IMAGE_FORMAT_RG1616F;
+	bool bCompare = false;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		bool bHasValue = ( i + 1 < argc );
+		if ( !V_stricmp( argv[i], "-o" ) && bHasValue )
+		{
+			pOutFile = argv[++i];
+		}
+		else if ( !V_stricmp( argv[i], "-size" ) && bHasValue )
+		{
+			nSize = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-samples" ) && bHasValue )
+		{
+			nSamples = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-threads" ) && bHasValue )
+		{
+			nThreads = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-format" ) && bHasValue )
+		{
+			++i;
+			if ( !V_stricmp( argv[i], "rg16f" ) )
+			{
+				format = IMAGE_FORMAT_RG1616F;
+			}
+			else if ( !V_stricmp( argv[i], "rg8" ) )
+			{
+				format = IMAGE_FORMAT_RGB888;
+			}
+			else
+			{
+				PrintUsage();
+				return 2;
+			}
+		}
+		else if ( !V_stricmp( argv[i], "-compare" ) )
+		{
+			bCompare = true;
+		}
+		else
+		{
+			PrintUsage();
+			return 2;
+		}
+	}
+
+	if ( nSize <= 0 || nSamples <= 0 )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	MathLib_Init();
+
+	ThreadPoolStartParams_t startParams;
+	if ( nThreads > 0 )
+	{
+		startParams.nThreads = nThreads;
+	}
+	g_pThreadPool->Start( startParams );
+
+	double flStart = Plat_FloatTime();
+	EnvBRDFTable_t table;
+	BakeTable( table, nSize, nSamples );
+	double flSeconds = Plat_FloatTime() - flStart;
+	int nThreadCount = g_pThreadPool->NumThreads() + 1;
+	g_pThreadPool->Stop();
+
+	if ( bCompare )
+	{
+		CompareWithApprox( table );
+		return 0;
+	}
+
+	if ( !WriteTable( table, pOutFile, format ) )
+		return 1;
+
+	Msg( "%s: %dx%d %s, %d samples per texel, baked in %.2f s on %d threads\n", pOutFile, nSize, nSize,
+		( format == IMAGE_FORMAT_RG1616F ) ? "RG16F" : "RG8", nSamples, flSeconds, nThreadCount );
+	return 0;
+}
@@ -0,0 +1,216 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Writes GGX prefiltered mip chains for cubemaps.
+//
+//			pbrenvfilter [-o outbase] [-samples n] [-threads n] <basename> ...
+//			pbrenvfilter -benchmark [-size n] [-runs n] [-samples n] [-threads n]
+//
+//			Reads basename{bk,dn,ft,lf,rt,up}.pfm and writes every mip of
+//			the prefiltered chain as outbase_mNN{bk,dn,ft,lf,rt,up}.pfm,
+//			mip 0 first. outbase defaults to basename_ggx. Build the
+//			cubemap from those mips and set $envmapprefiltered on the
+//			materials that use it; mip n is filtered for roughness
+//			n / ENVMAPLOD, which is what pbr_ps30 reads at that mip.
+//
+//			-benchmark prefilters a generated cubemap (256 wide by default)
+//			-runs times and reports the seconds per cubemap.
+//
+//===========================================================================//
+
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "mathlib/mathlib.h"
+#include "bitmap/floatbitmap.h"
+#include "vstdlib/jobthread.h"
+#include "envprefilter.h"
+#include <stdio.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+static void WriteMips( const CCubeMapMipChain &chain, const char *pOutBase )
+{
+	for ( int nMip = 0; nMip < chain.MipCount(); ++nMip )
+	{
+		char szBaseName[MAX_PATH];
+		V_snprintf( szBaseName, sizeof( szBaseName ), "%s_m%02d", pOutBase, nMip );
+		chain.Mip( nMip ).WritePFMs( szBaseName );
+	}
+}
+
+static bool FilterCubeMap( const char *pBaseName, const char *pOutBase, int nSamples )
+{
+	FloatCubeMap_t *pCubeMap = new FloatCubeMap_t( pBaseName );
+	int nSize = pCubeMap->face_maps[0].NumCols();
+	if ( nSize == 0 )
+	{
+		Warning( "Unable to read the cubemap %s*.pfm\n", pBaseName );
+		delete pCubeMap;
+		return false;
+	}
+
+	double flStart = Plat_FloatTime();
+	CCubeMapMipChain source, filtered;
+	source.InitBoxFiltered( pCubeMap );
+	EnvPrefilter_GGX( source, filtered, nSamples );
+	double flSeconds = Plat_FloatTime() - flStart;
+
+	char szOutBase[MAX_PATH];
+	if ( pOutBase )
+	{
+		V_strncpy( szOutBase, pOutBase, sizeof( szOutBase ) );
+	}
+	else
+	{
+		V_snprintf( szOutBase, sizeof( szOutBase ), "%s_ggx", pBaseName );
+	}
+	WriteMips( filtered, szOutBase );
+
+	Msg( "%s: %dx%d, %d mips, ENVMAPLOD %.0f, prefiltered in %.2f s\n", pBaseName, nSize, nSize,
+		filtered.MipCount(), filtered.EnvMapLOD(), flSeconds );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Benchmark: a sky with small bright lights, so the filtered lookups matter
+//-----------------------------------------------------------------------------
+static uint32 HashTexel( int nFace, int x, int y )
+{
+	uint32 h = (uint32)( nFace * 73856093 ) ^ (uint32)( x * 19349663 ) ^ (uint32)( y * 83492791 );
+	h ^= h >> 13;
+	h *= 0x5bd1e995;
+	h ^= h >> 15;
+	return h;
+}
+
+static FloatCubeMap_t *MakeBenchmarkCubeMap( int nSize )
+{
+	FloatCubeMap_t *pCubeMap = new FloatCubeMap_t( nSize, nSize );
+	for ( int f = 0; f < 6; ++f )
+	{
+		for ( int y = 0; y < nSize; ++y )
+		{
+			for ( int x = 0; x < nSize; ++x )
+			{
+				Vector direction = pCubeMap->PixelDirection( f, x, y );
+				float flSky = 0.2f + 0.8f * MAX( 0.0f, direction.z );
+				float flLight = ( HashTexel( f, x, y ) % 997 == 0 ) ? 50.0f : 0.0f;
+				pCubeMap->face_maps[f].Pixel( x, y, 0, 0 ) = 0.6f * flSky + flLight;
+				pCubeMap->face_maps[f].Pixel( x, y, 0, 1 ) = 0.7f * flSky + flLight;
+				pCubeMap->face_maps[f].Pixel( x, y, 0, 2 ) = flSky + flLight;
+				pCubeMap->face_maps[f].Pixel( x, y, 0, 3 ) = 1.0f;
+			}
+		}
+	}
+	return pCubeMap;
+}
+
+static void RunBenchmark( int nSize, int nRuns, int nSamples )
+{
+	CCubeMapMipChain source;
+	source.InitBoxFiltered( MakeBenchmarkCubeMap( nSize ) );
+
+	double flBest = FLT_MAX, flTotal = 0.0;
+	for ( int i = 0; i < nRuns; ++i )
+	{
+		double flStart = Plat_FloatTime();
+		CCubeMapMipChain filtered;
+		EnvPrefilter_GGX( source, filtered, nSamples );
+		double flSeconds = Plat_FloatTime() - flStart;
+
+		flTotal += flSeconds;
+		flBest = MIN( flBest, flSeconds );
+	}
+
+	Msg( "%dx%d cubemap, %d samples per texel, %d threads: %.3f s per cubemap (best %.3f s over %d runs)\n",
+		nSize, nSize, nSamples, g_pThreadPool->NumThreads() + 1, flTotal / nRuns, flBest, nRuns );
+}
+
+static void PrintUsage()
+{
+	Msg( "usage: pbrenvfilter [-o outbase] [-samples n] [-threads n] <basename> ...\n"
+		 "       pbrenvfilter -benchmark [-size n] [-runs n] [-samples n] [-threads n]\n" );
+}
+
+int main( int argc, char **argv )
+{
+	const char *pOutBase = NULL;
+	int nSamples = ENV_PREFILTER_DEFAULT_SAMPLES;
+	int nThreads = -1;
+	bool bBenchmark = false;
+	int nBenchmarkSize = 256;
+	int nBenchmarkRuns = 3;
+	CUtlVector< const char * > files;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		bool bHasValue = ( i + 1 < argc );
+		if ( !V_stricmp( argv[i], "-o" ) && bHasValue )
+		{
+			pOutBase = argv[++i];
+		}
+		else if ( !V_stricmp( argv[i], "-samples" ) && bHasValue )
+		{
+			nSamples = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-threads" ) && bHasValue )
+		{
+			nThreads = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-benchmark" ) )
+		{
+			bBenchmark = true;
+		}
+		else if ( !V_stricmp( argv[i], "-size" ) && bHasValue )
+		{
+			nBenchmarkSize = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-runs" ) && bHasValue )
+		{
+			nBenchmarkRuns = atoi( argv[++i] );
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else
+		{
+			files.AddToTail( argv[i] );
+		}
+	}
+
+	// One output base can't name the mips of several cubemaps
+	if ( ( files.Count() == 0 && !bBenchmark ) || ( pOutBase && files.Count() > 1 ) ||
+		 nSamples <= 0 || nBenchmarkSize <= 0 || nBenchmarkRuns <= 0 )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	MathLib_Init();
+
+	ThreadPoolStartParams_t startParams;
+	if ( nThreads > 0 )
+	{
+		startParams.nThreads = nThreads;
+	}
+	g_pThreadPool->Start( startParams );
+
+	bool bOk = true;
+	if ( bBenchmark )
+	{
+		RunBenchmark( nBenchmarkSize, nBenchmarkRuns, nSamples );
+	}
+	for ( int i = 0; i < files.Count(); ++i )
+	{
+		bOk = FilterCubeMap( files[i], pOutBase, nSamples ) && bOk;
+	}
+
+	g_pThreadPool->Stop();
+	return bOk ? 0 : 1;
+}
@@ -0,0 +1,769 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Headless material previews with the CPU port of the PBR BRDF.
+//
+//			pbrpreview [-o dir] [-materials dir] [-size n] [-plane] [-tile n]
+//					   [-turntable n] [-env basename] [-prefilter] [-samples n]
+//					   [-exposure f] [-threads n] <material.vmt> ...
+//
+//			Each .vmt's $basetexture, $bumpmap (or $normaltexture) and
+//			$mraotexture are loaded as .pfm or .tga through FloatBitMap_t
+//			from the materials directory, which defaults to the part of the
+//			.vmt's path up to and including "materials". Textures that are
+//			missing fall back to the shader's defaults, as do $color and
+//			the MRAO factors. The base texture is sRGB when it's a .tga and
+//			linear when it's a .pfm.
+//
+//			A sphere (or with -plane, a square facing the camera) is shaded
+//			like pbr_ps30 without lightmaps: one key light through
+//			PBR_CalculateLight4 plus the image based ambient and specular
+//			from the cubemap and its face averages. -env loads the cubemap
+//			from basename{bk,dn,ft,lf,rt,up}.pfm; the default is a plain
+//			sky. Its mips are box filtered like the engine's, or with
+//			-prefilter GGX prefiltered (envprefilter.h) from -samples
+//			directions per texel, as a $envmapprefiltered material sees
+//			them. The image is split into tiles that CParallelProcessor
+//			spreads over the thread pool, four pixels per BRDF call.
+//
+//			Previews are written to <dir>/<material>.tga, or with
+//			-turntable n to <material>_00.tga ... as n frames of a turn
+//			about the vertical axis. Alpha is 0 outside the object.
+//
+//===========================================================================//
+
+#include "tier0/platform.h"
+#include "tier0/dbg.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+#include "tier1/KeyValues.h"
+#include "mathlib/mathlib.h"
+#include "bitmap/floatbitmap.h"
+#include "vstdlib/jobthread.h"
+#include "pbr_brdf_simd.h"
+#include "envprefilter.h"
+#include <stdio.h>
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+
+#define PREVIEW_TILE_SIZE			32
+#define PREVIEW_OBJECT_SIZE			0.9f		// sphere radius and plane half size; the view spans -1..1
+#define PREVIEW_DEFAULT_SKY_SIZE	64
+
+enum PreviewShape_t
+{
+	PREVIEW_SPHERE = 0,
+	PREVIEW_PLANE,
+};
+
+struct PreviewSettings_t
+{
+	int m_nSize;
+	PreviewShape_t m_nShape;
+	float m_flTile;				// texture repeats across the object
+	int m_nFrames;				// 0 for a single still
+	float m_flExposure;
+	Vector m_LightDirection;	// towards the light
+	Vector m_LightColor;
+};
+
+
+//-----------------------------------------------------------------------------
+// Textures: a bitmap, or the color the shader's default texture has
+//-----------------------------------------------------------------------------
+struct PreviewTexture_t
+{
+	PreviewTexture_t() : m_pBitmap( NULL ), m_Default( 1.0f, 1.0f, 1.0f ) {}
+	~PreviewTexture_t() { delete m_pBitmap; }
+
+	FloatBitMap_t *m_pBitmap;
+	Vector m_Default;
+};
+
+// Bilinear with wrap addressing, like the shader's samplers
+static Vector SampleTexture( const PreviewTexture_t &texture, float u, float v )
+{
+	const FloatBitMap_t *pBitmap = texture.m_pBitmap;
+	if ( !pBitmap )
+		return texture.m_Default;
+
+	float x = u * pBitmap->NumCols() - 0.5f;
+	float y = v * pBitmap->NumRows() - 0.5f;
+	int x0 = (int)floorf( x );
+	int y0 = (int)floorf( y );
+	float fx = x - x0;
+	float fy = y - y0;
+
+	Vector result;
+	for ( int c = 0; c < 3; ++c )
+	{
+		float top = Lerp( fx, pBitmap->PixelWrapped( x0, y0, 0, c ), pBitmap->PixelWrapped( x0 + 1, y0, 0, c ) );
+		float bottom = Lerp( fx, pBitmap->PixelWrapped( x0, y0 + 1, 0, c ), pBitmap->PixelWrapped( x0 + 1, y0 + 1, 0, c ) );
+		result[c] = Lerp( fy, top, bottom );
+	}
+	return result;
+}
+
+static bool FileExists( const char *pFileName )
+{
+	FILE *fp = fopen( pFileName, "rb" );
+	if ( !fp )
+		return false;
+	fclose( fp );
+	return true;
+}
+
+// FloatBitMap_t reads .tga bytes as 0..1 without any conversion, so an sRGB
+// texture is linearized here once rather than on every sample
+static void LoadPreviewTexture( PreviewTexture_t &texture, const char *pMaterialsDir, const char *pName, bool bSRGB )
+{
+	static const char *s_pExtensions[] = { ".pfm", ".tga" };
+
+	for ( int i = 0; i < ARRAYSIZE( s_pExtensions ); ++i )
+	{
+		char szPath[MAX_PATH];
+		V_snprintf( szPath, sizeof( szPath ), "%s%s%s", pMaterialsDir, pName, s_pExtensions[i] );
+		V_FixSlashes( szPath );
+		if ( !FileExists( szPath ) )
+			continue;
+
+		FloatBitMap_t *pBitmap = new FloatBitMap_t( szPath );
+		if ( pBitmap->NumCols() == 0 || pBitmap->NumRows() == 0 )
+		{
+			Warning( "Unable to read %s, using the default\n", szPath );
+			delete pBitmap;
+			return;
+		}
+
+		if ( bSRGB && i == 1 )
+		{
+			for ( int y = 0; y < pBitmap->NumRows(); ++y )
+			{
+				for ( int x = 0; x < pBitmap->NumCols(); ++x )
+				{
+					for ( int c = 0; c < 3; ++c )
+					{
+						float &texel = pBitmap->Pixel( x, y, 0, c );
+						texel = SrgbGammaToLinear( texel );
+					}
+				}
+			}
+		}
+
+		texture.m_pBitmap = pBitmap;
+		return;
+	}
+
+	Warning( "Unable to find %s%s.pfm or .tga, using the default\n", pMaterialsDir, pName );
+}
+
+
+//-----------------------------------------------------------------------------
+// Materials
+//-----------------------------------------------------------------------------
+struct PreviewMaterial_t
+{
+	PreviewTexture_t m_BaseTexture;
+	PreviewTexture_t m_BumpMap;
+	PreviewTexture_t m_MRAOTexture;
+	Vector m_BaseColor;
+	Vector m_MRAOFactors;
+};
+
+static bool ReadTextFile( const char *pFileName, CUtlVector< char > &text )
+{
+	FILE *fp = fopen( pFileName, "rb" );
+	if ( !fp )
+		return false;
+
+	fseek( fp, 0, SEEK_END );
+	long nSize = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	text.SetCount( nSize + 1 );
+	bool bOk = ( fread( text.Base(), 1, nSize, fp ) == (size_t)nSize );
+	text[nSize] = '\0';
+	fclose( fp );
+	return bOk;
+}
+
+// $color is "[r g b]" in 0..1 or "{r g b}" in 0..255
+static Vector ParseColor( const char *pValue )
+{
+	Vector color( 1.0f, 1.0f, 1.0f );
+	if ( sscanf( pValue, " [ %f %f %f", &color.x, &color.y, &color.z ) == 3 )
+		return color;
+	if ( sscanf( pValue, " { %f %f %f", &color.x, &color.y, &color.z ) == 3 )
+		return color * ( 1.0f / 255.0f );
+
+	return Vector( 1.0f, 1.0f, 1.0f );
+}
+
+// The materials directory: everything up to and including "materials/"
+static bool GuessMaterialsDir( const char *pVMTFileName, char *pDir, int nDirSize )
+{
+	char szPath[MAX_PATH];
+	V_strncpy( szPath, pVMTFileName, sizeof( szPath ) );
+	V_FixSlashes( szPath, '/' );
+
+	const char *pFound = NULL;
+	for ( const char *p = V_stristr( szPath, "materials/" ); p; p = V_stristr( p + 1, "materials/" ) )
+	{
+		if ( p == szPath || p[-1] == '/' )
+		{
+			pFound = p;
+		}
+	}
+	if ( !pFound )
+		return false;
+
+	int nLength = (int)( pFound - szPath ) + V_strlen( "materials/" );
+	V_strncpy( pDir, szPath, MIN( nLength + 1, nDirSize ) );
+	return true;
+}
+
+static bool LoadPreviewMaterial( const char *pVMTFileName, const char *pMaterialsDir, PreviewMaterial_t &material )
+{
+	CUtlVector< char > text;
+	if ( !ReadTextFile( pVMTFileName, text ) )
+	{
+		Warning( "Unable to read %s\n", pVMTFileName );
+		return false;
+	}
+
+	KeyValues *pVMT = new KeyValues( "vmt" );
+	if ( !pVMT->LoadFromBuffer( pVMTFileName, text.Base() ) )
+	{
+		Warning( "Unable to parse %s\n", pVMTFileName );
+		pVMT->deleteThis();
+		return false;
+	}
+
+	if ( V_stricmp( pVMT->GetName(), "pbr" ) )
+	{
+		Warning( "%s uses the %s shader, previewing it as PBR anyway\n", pVMTFileName, pVMT->GetName() );
+	}
+
+	char szMaterialsDir[MAX_PATH];
+	if ( pMaterialsDir )
+	{
+		V_strncpy( szMaterialsDir, pMaterialsDir, sizeof( szMaterialsDir ) );
+		V_AppendSlash( szMaterialsDir, sizeof( szMaterialsDir ) );
+	}
+	else if ( !GuessMaterialsDir( pVMTFileName, szMaterialsDir, sizeof( szMaterialsDir ) ) )
+	{
+		// Names are then relative to the current directory
+		szMaterialsDir[0] = '\0';
+	}
+
+	// The shader's defaults: grey base, flat normal, white MRAO
+	material.m_BaseTexture.m_Default.Init( SrgbGammaToLinear( 0.5f ), SrgbGammaToLinear( 0.5f ), SrgbGammaToLinear( 0.5f ) );
+	material.m_BumpMap.m_Default.Init( 0.5f, 0.5f, 1.0f );
+	material.m_MRAOTexture.m_Default.Init( 1.0f, 1.0f, 1.0f );
+
+	const char *pBaseTexture = pVMT->GetString( "$basetexture", NULL );
+	const char *pBumpMap = pVMT->GetString( "$bumpmap", NULL );
+	if ( !pBumpMap )
+	{
+		pBumpMap = pVMT->GetString( "$normaltexture", NULL );
+	}
+	const char *pMRAOTexture = pVMT->GetString( "$mraotexture", NULL );
+
+	if ( pBaseTexture )
+	{
+		LoadPreviewTexture( material.m_BaseTexture, szMaterialsDir, pBaseTexture, true );
+	}
+	if ( pBumpMap )
+	{
+		LoadPreviewTexture( material.m_BumpMap, szMaterialsDir, pBumpMap, false );
+	}
+	if ( pMRAOTexture )
+	{
+		LoadPreviewTexture( material.m_MRAOTexture, szMaterialsDir, pMRAOTexture, false );
+	}
+
+	material.m_BaseColor = ParseColor( pVMT->GetString( "$color", "[1 1 1]" ) );
+	material.m_MRAOFactors.Init( pVMT->GetFloat( "$metalnessfactor", 1.0f ),
+		pVMT->GetFloat( "$roughnessfactor", 1.0f ), pVMT->GetFloat( "$aofactor", 1.0f ) );
+
+	pVMT->deleteThis();
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// The environment: the cubemap's mips, box filtered like the engine's or GGX
+// prefiltered, and the ambient cube made from their face averages
+//-----------------------------------------------------------------------------
+struct PreviewEnvironment_t
+{
+	CCubeMapMipChain m_CubeMap;
+	float m_flEnvMapLOD;
+	float m_flAmbientBlend;		// ENVMAP_ROUGH_BLEND: 0 for prefiltered mips, as with $envmapprefiltered
+	Vector m_AmbientCube[6];
+};
+
+static void MakeDefaultSky( FloatCubeMap_t &sky )
+{
+	const Vector zenith( 0.25f, 0.45f, 0.9f );
+	const Vector horizon( 0.9f, 0.9f, 0.85f );
+	const Vector ground( 0.2f, 0.17f, 0.15f );
+
+	int nSize = sky.face_maps[0].NumCols();
+	for ( int f = 0; f < 6; ++f )
+	{
+		for ( int y = 0; y < nSize; ++y )
+		{
+			for ( int x = 0; x < nSize; ++x )
+			{
+				Vector direction = sky.PixelDirection( f, x, y );
+				Vector color = ( direction.z >= 0.0f ) ? Lerp( sqrtf( direction.z ), horizon, zenith ) : Lerp( sqrtf( -direction.z ), horizon, ground );
+				for ( int c = 0; c < 3; ++c )
+				{
+					sky.face_maps[f].Pixel( x, y, 0, c ) = color[c];
+				}
+				sky.face_maps[f].Pixel( x, y, 0, 3 ) = 1.0f;
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// The scene: an orthographic camera on +X looking down -X, with +Y to the
+// right and +Z up. The object turns about Z for turntables.
+//-----------------------------------------------------------------------------
+struct PreviewView_t
+{
+	const PreviewSettings_t *m_pSettings;
+	const PreviewMaterial_t *m_pMaterial;
+	const PreviewEnvironment_t *m_pEnv;
+	float m_flCos;				// of the object's turn
+	float m_flSin;
+	FloatBitMap_t *m_pImage;
+};
+
+struct PreviewTile_t
+{
+	const PreviewView_t *m_pView;
+	int m_nX;
+	int m_nY;
+};
+
+struct PreviewSurface_t
+{
+	Vector m_Normal;
+	Vector m_Tangent;			// along +u
+	Vector m_Binormal;			// along +v
+	float m_flU;
+	float m_flV;
+};
+
+static bool TraceObject( const PreviewView_t &view, int x, int y, PreviewSurface_t &surface )
+{
+	const PreviewSettings_t &settings = *view.m_pSettings;
+	float flScreenX = 2.0f * ( x + 0.5f ) / settings.m_nSize - 1.0f;
+	float flScreenY = 1.0f - 2.0f * ( y + 0.5f ) / settings.m_nSize;
+
+	// The ray in object space
+	float c = view.m_flCos, s = view.m_flSin;
+	Vector origin( 2.0f * c + flScreenX * s, -2.0f * s + flScreenX * c, flScreenY );
+	Vector direction( -c, s, 0.0f );
+
+	Vector normal, tangent, binormal;
+	if ( settings.m_nShape == PREVIEW_SPHERE )
+	{
+		float b = DotProduct( origin, direction );
+		float flDiscriminant = b * b - ( DotProduct( origin, origin ) - PREVIEW_OBJECT_SIZE * PREVIEW_OBJECT_SIZE );
+		if ( flDiscriminant < 0.0f )
+			return false;
+
+		normal = ( origin + direction * ( -b - sqrtf( flDiscriminant ) ) ) * ( 1.0f / PREVIEW_OBJECT_SIZE );
+		float flPhi = atan2f( normal.y, normal.x );
+		float flTheta = acosf( clamp( normal.z, -1.0f, 1.0f ) );
+		float flSinPhi, flCosPhi, flSinTheta, flCosTheta;
+		SinCos( flPhi, &flSinPhi, &flCosPhi );
+		SinCos( flTheta, &flSinTheta, &flCosTheta );
+
+		tangent.Init( -flSinPhi, flCosPhi, 0.0f );
+		binormal.Init( flCosTheta * flCosPhi, flCosTheta * flSinPhi, -flSinTheta );
+
+		// Twice as wide as high, so the texels come out square
+		surface.m_flU = ( 0.5f + flPhi / ( 2.0f * M_PI_F ) ) * 2.0f * settings.m_flTile;
+		surface.m_flV = flTheta / M_PI_F * settings.m_flTile;
+	}
+	else
+	{
+		// Edge on
+		if ( fabsf( direction.x ) < 1e-3f )
+			return false;
+
+		Vector hit = origin + direction * ( -origin.x / direction.x );
+		if ( fabsf( hit.y ) > PREVIEW_OBJECT_SIZE || fabsf( hit.z ) > PREVIEW_OBJECT_SIZE )
+			return false;
+
+		// Two sided, so turntables show the back with the texture mirrored
+		normal.Init( direction.x < 0.0f ? 1.0f : -1.0f, 0.0f, 0.0f );
+		tangent.Init( 0.0f, 1.0f, 0.0f );
+		binormal.Init( 0.0f, 0.0f, -1.0f );
+		surface.m_flU = 0.5f * ( hit.y / PREVIEW_OBJECT_SIZE + 1.0f ) * settings.m_flTile;
+		surface.m_flV = 0.5f * ( 1.0f - hit.z / PREVIEW_OBJECT_SIZE ) * settings.m_flTile;
+	}
+
+	// Back to world space
+	surface.m_Normal.Init( c * normal.x - s * normal.y, s * normal.x + c * normal.y, normal.z );
+	surface.m_Tangent.Init( c * tangent.x - s * tangent.y, s * tangent.x + c * tangent.y, tangent.z );
+	surface.m_Binormal.Init( c * binormal.x - s * binormal.y, s * binormal.x + c * binormal.y, binormal.z );
+	return true;
+}
+
+static void SetLane( FourVectors &v, int nLane, const Vector &value )
+{
+	SubFloat( v.x, nLane ) = value.x;
+	SubFloat( v.y, nLane ) = value.y;
+	SubFloat( v.z, nLane ) = value.z;
+}
+
+static Vector GetLane( const FourVectors &v, int nLane )
+{
+	return Vector( SubFloat( v.x, nLane ), SubFloat( v.y, nLane ), SubFloat( v.z, nLane ) );
+}
+
+// pbr_ps30's main without lightmaps for the four pixels from ( x, y )
+static void ShadePixels4( const PreviewView_t &view, int x, int y )
+{
+	const PreviewSettings_t &settings = *view.m_pSettings;
+	const PreviewMaterial_t &material = *view.m_pMaterial;
+	const PreviewEnvironment_t &env = *view.m_pEnv;
+
+	const Vector eyeDirection( 1.0f, 0.0f, 0.0f );
+
+	bool bHit[4];
+	FourVectors normal, albedo, outgoing, lightIn, lightColor;
+	fltx4 metalness, roughness, ambientOcclusion;
+	for ( int i = 0; i < 4; ++i )
+	{
+		SetLane( outgoing, i, eyeDirection );
+		SetLane( lightIn, i, settings.m_LightDirection );
+		SetLane( lightColor, i, settings.m_LightColor );
+
+		PreviewSurface_t surface;
+		bHit[i] = TraceObject( view, x + i, y, surface );
+		if ( !bHit[i] )
+		{
+			// Harmless values for the lanes that are thrown away
+			SetLane( normal, i, eyeDirection );
+			SetLane( albedo, i, vec3_origin );
+			SubFloat( metalness, i ) = 0.0f;
+			SubFloat( roughness, i ) = 1.0f;
+			SubFloat( ambientOcclusion, i ) = 0.0f;
+			continue;
+		}
+
+		Vector textureNormal = SampleTexture( material.m_BumpMap, surface.m_flU, surface.m_flV ) * 2.0f - Vector( 1.0f, 1.0f, 1.0f );
+		VectorNormalize( textureNormal );
+		Vector worldNormal = surface.m_Tangent * textureNormal.x + surface.m_Binormal * textureNormal.y + surface.m_Normal * textureNormal.z;
+		VectorNormalize( worldNormal );
+		SetLane( normal, i, worldNormal );
+
+		Vector baseColor = SampleTexture( material.m_BaseTexture, surface.m_flU, surface.m_flV );
+		SetLane( albedo, i, baseColor * material.m_BaseColor );
+
+		Vector mrao = SampleTexture( material.m_MRAOTexture, surface.m_flU, surface.m_flV ) * material.m_MRAOFactors;
+		SubFloat( metalness, i ) = mrao.x;
+		SubFloat( roughness, i ) = mrao.y;
+		SubFloat( ambientOcclusion, i ) = mrao.z;
+	}
+
+	fltx4 lightDirectionAngle = MaxSIMD( Four_Zeros, normal * outgoing );
+	FourVectors specularReflection = PBR_Scale4( normal, AddSIMD( lightDirectionAngle, lightDirectionAngle ) );
+	specularReflection -= outgoing;
+
+	FourVectors dielectric;
+	dielectric.DuplicateVector( Vector( 0.04f, 0.04f, 0.04f ) );
+	FourVectors fresnelReflectance;
+	fresnelReflectance.x = MaddSIMD( metalness, SubSIMD( albedo.x, dielectric.x ), dielectric.x );
+	fresnelReflectance.y = MaddSIMD( metalness, SubSIMD( albedo.y, dielectric.y ), dielectric.y );
+	fresnelReflectance.z = MaddSIMD( metalness, SubSIMD( albedo.z, dielectric.z ), dielectric.z );
+
+	// Diffuse ambient
+	FourVectors ambientFresnel = PBR_FresnelSchlickRoughness4( fresnelReflectance, lightDirectionAngle, roughness );
+	FourVectors diffuseContribution;
+	fltx4 dielectricFraction = SubSIMD( Four_Ones, metalness );
+	diffuseContribution.x = MulSIMD( SubSIMD( Four_Ones, ambientFresnel.x ), dielectricFraction );
+	diffuseContribution.y = MulSIMD( SubSIMD( Four_Ones, ambientFresnel.y ), dielectricFraction );
+	diffuseContribution.z = MulSIMD( SubSIMD( Four_Ones, ambientFresnel.z ), dielectricFraction );
+	FourVectors diffuseIBL = PBR_Mul4( PBR_Mul4( diffuseContribution, albedo ), PBR_AmbientLight4( normal, env.m_AmbientCube ) );
+
+	// Specular ambient
+	FourVectors lookupLow = PBR_AmbientLight4( specularReflection, env.m_AmbientCube );
+	FourVectors specularIrradiance;
+	for ( int i = 0; i < 4; ++i )
+	{
+		float flRoughness = SubFloat( roughness, i );
+		Vector lookupHigh = env.m_CubeMap.Sample( GetLane( specularReflection, i ), flRoughness * env.m_flEnvMapLOD );
+		SetLane( specularIrradiance, i, Lerp( flRoughness * flRoughness * env.m_flAmbientBlend, lookupHigh, GetLane( lookupLow, i ) ) );
+	}
+	FourVectors specularIBL = PBR_Mul4( specularIrradiance, PBR_EnvBRDFApprox4( fresnelReflectance, roughness, lightDirectionAngle ) );
+
+	FourVectors ambientLighting = PBR_Scale4( PBR_Add4( diffuseIBL, specularIBL ), ambientOcclusion );
+	FourVectors directLighting = PBR_CalculateLight4<0>( lightIn, lightColor, outgoing, normal, fresnelReflectance,
+		roughness, metalness, lightDirectionAngle, albedo, NULL );
+	FourVectors result = PBR_Scale4( PBR_Add4( directLighting, ambientLighting ), ReplicateX4( settings.m_flExposure ) );
+
+	FloatBitMap_t &image = *view.m_pImage;
+	for ( int i = 0; i < 4; ++i )
+	{
+		Vector color = bHit[i] ? GetLane( result, i ) : vec3_origin;
+		for ( int c = 0; c < 3; ++c )
+		{
+			image.Pixel( x + i, y, 0, c ) = SrgbLinearToGamma( clamp( color[c], 0.0f, 1.0f ) );
+		}
+		image.Pixel( x + i, y, 0, 3 ) = bHit[i] ? 1.0f : 0.0f;
+	}
+}
+
+static void ShadeTile( PreviewTile_t &tile )
+{
+	const PreviewView_t &view = *tile.m_pView;
+	int nSize = view.m_pSettings->m_nSize;
+	int nEndX = MIN( tile.m_nX + PREVIEW_TILE_SIZE, nSize );
+	int nEndY = MIN( tile.m_nY + PREVIEW_TILE_SIZE, nSize );
+	for ( int y = tile.m_nY; y < nEndY; ++y )
+	{
+		for ( int x = tile.m_nX; x < nEndX; x += 4 )
+		{
+			ShadePixels4( view, x, y );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Rendering a material's previews
+//-----------------------------------------------------------------------------
+static bool RenderPreviews( const char *pVMTFileName, const char *pMaterialsDir, const char *pOutputDir,
+	const PreviewSettings_t &settings, const PreviewEnvironment_t &env, CUtlVector< PreviewTile_t > &tiles, int &nImages )
+{
+	PreviewMaterial_t material;
+	if ( !LoadPreviewMaterial( pVMTFileName, pMaterialsDir, material ) )
+		return false;
+
+	FloatBitMap_t image( settings.m_nSize, settings.m_nSize );
+
+	PreviewView_t view;
+	view.m_pSettings = &settings;
+	view.m_pMaterial = &material;
+	view.m_pEnv = &env;
+	view.m_pImage = &image;
+	for ( int i = 0; i < tiles.Count(); ++i )
+	{
+		tiles[i].m_pView = &view;
+	}
+
+	char szBaseName[MAX_PATH];
+	V_FileBase( pVMTFileName, szBaseName, sizeof( szBaseName ) );
+
+	bool bOk = true;
+	int nFrames = MAX( settings.m_nFrames, 1 );
+	for ( int nFrame = 0; nFrame < nFrames; ++nFrame )
+	{
+		SinCos( 2.0f * M_PI_F * nFrame / nFrames, &view.m_flSin, &view.m_flCos );
+		ParallelProcess( tiles.Base(), tiles.Count(), ShadeTile );
+
+		char szFileName[MAX_PATH];
+		if ( settings.m_nFrames > 0 )
+		{
+			V_snprintf( szFileName, sizeof( szFileName ), "%s_%02d.tga", szBaseName, nFrame );
+		}
+		else
+		{
+			V_snprintf( szFileName, sizeof( szFileName ), "%s.tga", szBaseName );
+		}
+
+		char szPath[MAX_PATH];
+		V_ComposeFileName( pOutputDir, szFileName, szPath, sizeof( szPath ) );
+		if ( !image.WriteTGAFile( szPath ) )
+		{
+			Warning( "Unable to write %s\n", szPath );
+			bOk = false;
+			continue;
+		}
+		++nImages;
+	}
+
+	return bOk;
+}
+
+static void PrintUsage()
+{
+	Msg( "usage: pbrpreview [-o dir] [-materials dir] [-size n] [-plane] [-tile n] [-turntable n]\n"
+		 "                  [-env basename] [-prefilter] [-samples n] [-exposure f] [-threads n]\n"
+		 "                  <material.vmt> ...\n" );
+}
+
+int main( int argc, char **argv )
+{
+	PreviewSettings_t settings;
+	settings.m_nSize = 256;
+	settings.m_nShape = PREVIEW_SPHERE;
+	settings.m_flTile = 1.0f;
+	settings.m_nFrames = 0;
+	settings.m_flExposure = 1.0f;
+	settings.m_LightDirection.Init( 0.6f, -0.5f, 0.6f );
+	VectorNormalize( settings.m_LightDirection );
+	settings.m_LightColor.Init( 2.0f, 1.95f, 1.85f );
+
+	const char *pOutputDir = ".";
+	const char *pMaterialsDir = NULL;
+	const char *pEnvBaseName = NULL;
+	bool bPrefilter = false;
+	int nPrefilterSamples = ENV_PREFILTER_DEFAULT_SAMPLES;
+	int nThreads = -1;
+	CUtlVector< const char * > files;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		bool bHasValue = ( i + 1 < argc );
+		if ( !V_stricmp( argv[i], "-o" ) && bHasValue )
+		{
+			pOutputDir = argv[++i];
+		}
+		else if ( !V_stricmp( argv[i], "-materials" ) && bHasValue )
+		{
+			pMaterialsDir = argv[++i];
+		}
+		else if ( !V_stricmp( argv[i], "-size" ) && bHasValue )
+		{
+			settings.m_nSize = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-plane" ) )
+		{
+			settings.m_nShape = PREVIEW_PLANE;
+		}
+		else if ( !V_stricmp( argv[i], "-tile" ) && bHasValue )
+		{
+			settings.m_flTile = (float)atof( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-turntable" ) && bHasValue )
+		{
+			settings.m_nFrames = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-env" ) && bHasValue )
+		{
+			pEnvBaseName = argv[++i];
+		}
+		else if ( !V_stricmp( argv[i], "-prefilter" ) )
+		{
+			bPrefilter = true;
+		}
+		else if ( !V_stricmp( argv[i], "-samples" ) && bHasValue )
+		{
+			nPrefilterSamples = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-exposure" ) && bHasValue )
+		{
+			settings.m_flExposure = (float)atof( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-threads" ) && bHasValue )
+		{
+			nThreads = atoi( argv[++i] );
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else
+		{
+			files.AddToTail( argv[i] );
+		}
+	}
+
+	if ( files.Count() == 0 || settings.m_nSize <= 0 || nPrefilterSamples <= 0 )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	// Rows are shaded four pixels at a time
+	settings.m_nSize = ( settings.m_nSize + 3 ) & ~3;
+
+	MathLib_Init();
+
+	ThreadPoolStartParams_t startParams;
+	if ( nThreads > 0 )
+	{
+		startParams.nThreads = nThreads;
+	}
+	g_pThreadPool->Start( startParams );
+
+	PreviewEnvironment_t env;
+	FloatCubeMap_t *pCubeMap;
+	if ( pEnvBaseName )
+	{
+		pCubeMap = new FloatCubeMap_t( pEnvBaseName );
+		if ( pCubeMap->face_maps[0].NumCols() == 0 )
+		{
+			Warning( "Unable to read the cubemap %s*.pfm\n", pEnvBaseName );
+			delete pCubeMap;
+			g_pThreadPool->Stop();
+			return 1;
+		}
+	}
+	else
+	{
+		pCubeMap = new FloatCubeMap_t( PREVIEW_DEFAULT_SKY_SIZE, PREVIEW_DEFAULT_SKY_SIZE );
+		MakeDefaultSky( *pCubeMap );
+	}
+
+	if ( bPrefilter )
+	{
+		double flPrefilterStart = Plat_FloatTime();
+		CCubeMapMipChain source;
+		source.InitBoxFiltered( pCubeMap );
+		source.ComputeFaceAverages( env.m_AmbientCube );
+		EnvPrefilter_GGX( source, env.m_CubeMap, nPrefilterSamples );
+		env.m_flAmbientBlend = 0.0f;
+		Msg( "Prefiltered the cubemap in %.2f s\n", Plat_FloatTime() - flPrefilterStart );
+	}
+	else
+	{
+		env.m_CubeMap.InitBoxFiltered( pCubeMap );
+		env.m_CubeMap.ComputeFaceAverages( env.m_AmbientCube );
+		env.m_flAmbientBlend = 1.0f;
+	}
+	env.m_flEnvMapLOD = env.m_CubeMap.EnvMapLOD();
+
+	CUtlVector< PreviewTile_t > tiles;
+	for ( int y = 0; y < settings.m_nSize; y += PREVIEW_TILE_SIZE )
+	{
+		for ( int x = 0; x < settings.m_nSize; x += PREVIEW_TILE_SIZE )
+		{
+			PreviewTile_t &tile = tiles[tiles.AddToTail()];
+			tile.m_pView = NULL;
+			tile.m_nX = x;
+			tile.m_nY = y;
+		}
+	}
+
+	double flStart = Plat_FloatTime();
+	int nImages = 0;
+	bool bOk = true;
+	for ( int i = 0; i < files.Count(); ++i )
+	{
+		bOk = RenderPreviews( files[i], pMaterialsDir, pOutputDir, settings, env, tiles, nImages ) && bOk;
+	}
+	double flSeconds = Plat_FloatTime() - flStart;
+
+	// The main thread works on the tiles too
+	int nWorkers = g_pThreadPool->NumThreads() + 1;
+	g_pThreadPool->Stop();
+
+	Msg( "%d previews of %d materials at %dx%d on %d threads in %.2f s (%.0f per minute)\n",
+		nImages, files.Count(), settings.m_nSize, settings.m_nSize, nWorkers,
+		flSeconds, flSeconds > 0.0 ? 60.0 * nImages / flSeconds : 0.0 );
+
+	return bOk ? 0 : 1;
+}
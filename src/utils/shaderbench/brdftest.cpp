@@ -0,0 +1,37 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Runs PBR_BrdfSelfTest outside the engine: the CPU port of the
+//			PBR BRDF against its golden values and the scalar reference,
+//			then optionally its throughput.
+//
+//			brdftest [benchmark Msamples]
+//
+//			Without an argument only the checks run, so it can be used as a
+//			test. Exits with 1 if a check failed. mat_pbr_brdf_selftest runs
+//			the same code in game.
+//
+//			g++ -O2 -std=c++17 -w -include posix/posix_compat.h -I. -Iposix/public
+//				-Iposix/materialsystem/stdshaders -I../../common -I../../public
+//				-I../../public/tier0 -I../../public/tier1 -I../../materialsystem
+//				-I../../materialsystem/stdshaders -o brdftest brdftest.cpp sdkstubs.cpp
+//				../../materialsystem/stdshaders/pbr_brdf_simd.cpp
+//
+//===========================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pbr_brdf_simd.h"
+
+
+int main( int argc, char **argv )
+{
+	if ( argc > 2 || ( argc == 2 && argv[1][0] == '-' ) )
+	{
+		printf( "usage: brdftest [benchmark Msamples]\n" );
+		return 2;
+	}
+
+	float flMSamples = ( argc == 2 ) ? (float)atof( argv[1] ) : 0.0f;
+	return PBR_BrdfSelfTest( (int)( flMSamples * 1e6f ) ) ? 0 : 1;
+}
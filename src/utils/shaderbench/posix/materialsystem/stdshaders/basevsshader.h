@@ -0,0 +1 @@
+#include "../../../../../materialsystem/stdshaders/BaseVSShader.h"
@@ -0,0 +1,47 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Force included (g++ -include) ahead of every SDK source the
+//			benchmark builds. Fills in what the Windows-only parts of the
+//			stripped SDK headers expect from MSVC and the Win32 tier0.
+//
+//			The headers next to this one forward includes the SDK spells in
+//			a different case than the file on disk, which only matters off
+//			Windows.
+//
+//===========================================================================//
+
+#ifndef POSIX_COMPAT_H
+#define POSIX_COMPAT_H
+
+// What the SDK's Linux builds define on the command line. NDEBUG because
+// the tier0 asserts need the Win32 tier0.
+#define POSIX 1
+#define LINUX 1
+#define _LINUX 1
+#define GNUC 1
+#define COMPILER_GCC 1
+#define FAST_MATERIALVAR_ACCESS 1
+#ifndef NDEBUG
+#define NDEBUG 1
+#endif
+#if defined( __LP64__ )
+#define PLATFORM_64BITS 1
+#endif
+
+#include "tier0/platform.h"
+#include "tier0/win32consoleio.h"
+#include "tier0/threadtools.h"
+
+#define _strtoi64		strtoll
+#define __debugbreak()	DebuggerBreak()
+
+// utlmemory.h uses it from templates before mathlib.h defines it
+template <class T> FORCEINLINE void V_swap( T& x, T& y );
+
+// The SDK's AUTO_LOCK names the deduced mutex type without typename, which
+// only MSVC accepts inside templates (mempool.h)
+#undef AUTO_LOCK
+#define AUTO_LOCK( mutex ) \
+	AUTO_LOCK_( typename CAutoLockTypeDeducer<sizeof(mutex)>::Type_t, mutex )
+
+#endif // POSIX_COMPAT_H
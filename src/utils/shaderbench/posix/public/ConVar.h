@@ -0,0 +1 @@
+#include "../../../../public/tier1/convar.h"
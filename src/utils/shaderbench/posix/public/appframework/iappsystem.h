@@ -0,0 +1 @@
+#include "../../../../../public/appframework/IAppSystem.h"
@@ -0,0 +1 @@
+#include "../../../../public/Color.h"
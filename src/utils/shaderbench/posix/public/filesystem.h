@@ -0,0 +1,22 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Stand-in for the SDK's filesystem.h, which the stripped SDK
+//			doesn't ship. Only declares what the shader DLL calls. The
+//			benchmark leaves g_pFullFileSystem NULL, so no cubemap is read
+//			from disk and the layout needn't match the engine's.
+//
+//===========================================================================//
+
+#ifndef FILESYSTEM_H
+#define FILESYSTEM_H
+
+#include "tier1/utlbuffer.h"
+#include "interfaces/interfaces.h"
+
+abstract_class IFileSystem
+{
+public:
+	virtual bool ReadFile( const char *pFileName, const char *pPath, CUtlBuffer &buf, int nMaxBytes = 0, int nStartingByte = 0, void *pfnAlloc = NULL ) = 0;
+};
+
+#endif // FILESYSTEM_H
@@ -0,0 +1 @@
+#include "../../../../../public/shaderlib/BaseShader.h"
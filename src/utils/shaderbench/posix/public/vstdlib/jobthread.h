@@ -0,0 +1,104 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Stand-in for the SDK's vstdlib/jobthread.h, which only MSVC
+//			compiles: its IterRangeParallel names a parameter after a
+//			template parameter. Only declares what the shader DLL calls.
+//			ParallelProcess splits the items the way CParallelProcessor
+//			does, over the pool sdkstubs.cpp runs on std::thread.
+//
+//===========================================================================//
+
+#ifndef JOBTHREAD_H
+#define JOBTHREAD_H
+
+#include <limits.h>
+#include "tier0/threadtools.h"
+
+
+abstract_class IThreadPool
+{
+public:
+	virtual int NumThreads() = 0;
+
+	// Not in the SDK's interface: runs pfnJob( pContext ) on up to nJobs
+	// pool threads and on the calling thread. Returns when the calling
+	// thread's run does, after waiting for the pool's and dropping the jobs
+	// no pool thread got to, like CParallelProcessor aborting its jobs.
+	virtual void RunJobs( void (*pfnJob)( void * ), void *pContext, int nJobs ) = 0;
+};
+
+extern IThreadPool *g_pThreadPool;
+
+
+//-----------------------------------------------------------------------------
+// Every thread takes the next item until there are none left
+//-----------------------------------------------------------------------------
+template <typename ITEM_TYPE>
+class CParallelProcessor
+{
+public:
+	void Run( ITEM_TYPE *pItems, unsigned nItems, void (*pfnProcess)( ITEM_TYPE & ), void (*pfnBegin)(), void (*pfnEnd)(), int nMaxParallel )
+	{
+		if ( nItems == 0 )
+			return;
+
+		m_pItems = pItems;
+		m_nItems = nItems;
+		m_nNextItem = 0;
+		m_pfnProcess = pfnProcess;
+		m_pfnBegin = pfnBegin;
+		m_pfnEnd = pfnEnd;
+
+		int nJobs = MIN( (int)nItems - 1, nMaxParallel );
+		if ( !g_pThreadPool || nJobs <= 0 )
+		{
+			DoExecute( this );
+			return;
+		}
+
+		g_pThreadPool->RunJobs( &DoExecute, this, MIN( nJobs, g_pThreadPool->NumThreads() ) );
+	}
+
+private:
+	static void DoExecute( void *pContext )
+	{
+		CParallelProcessor *pThis = (CParallelProcessor *)pContext;
+		int nItem = ++pThis->m_nNextItem - 1;
+		if ( nItem >= (int)pThis->m_nItems )
+			return;
+
+		if ( pThis->m_pfnBegin )
+		{
+			pThis->m_pfnBegin();
+		}
+
+		do
+		{
+			pThis->m_pfnProcess( pThis->m_pItems[nItem] );
+			nItem = ++pThis->m_nNextItem - 1;
+		}
+		while ( nItem < (int)pThis->m_nItems );
+
+		if ( pThis->m_pfnEnd )
+		{
+			pThis->m_pfnEnd();
+		}
+	}
+
+	ITEM_TYPE *m_pItems;
+	unsigned m_nItems;
+	CInterlockedInt m_nNextItem;
+	void (*m_pfnProcess)( ITEM_TYPE & );
+	void (*m_pfnBegin)();
+	void (*m_pfnEnd)();
+};
+
+template <typename ITEM_TYPE>
+inline void ParallelProcess( ITEM_TYPE *pItems, unsigned nItems, void (*pfnProcess)( ITEM_TYPE & ), void (*pfnBegin)() = NULL, void (*pfnEnd)() = NULL, int nMaxParallel = INT_MAX )
+{
+	CParallelProcessor<ITEM_TYPE> processor;
+	processor.Run( pItems, nItems, pfnProcess, pfnBegin, pfnEnd, nMaxParallel );
+}
+
+
+#endif // JOBTHREAD_H
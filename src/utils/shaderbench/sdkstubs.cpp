@@ -0,0 +1,1193 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Stand-ins for the parts of tier0, tier1, vstdlib, mathlib and
+//			the bitmap and vtf libraries the shader DLL links with. The SDK
+//			only has them as Win32 .libs, so the benchmark gives each just
+//			the behaviour the shaders rely on:
+//
+//			- convars keep their values and run their change callbacks, and
+//			  commands dispatch, but nothing is registered with an ICvar
+//			- CFastTimer reads the TSC, calibrated against the monotonic clock
+//			- g_pThreadPool is NULL, so jobs run on the calling thread, until
+//			  ShaderBench_StartThreadPool starts std::threads for it
+//			- there is no file system, so no texture file is ever read
+//
+//===========================================================================//
+
+// The standard headers go first; mathlib's clamp macro breaks <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <x86intrin.h>
+
+#include "sdkstubs.h"
+#include "tier0/dbg.h"
+#include "tier0/icommandline.h"
+#include "tier0/fasttimer.h"
+#include "tier0/memalloc.h"
+#include "tier1/convar.h"
+#include "tier1/utlstring.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/mempool.h"
+#include "tier1/strtools.h"
+#include "tier1/generichash.h"
+#include "tier1/interface.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/vmatrix.h"
+#include "mathlib/ssemath.h"
+#include "bitmap/imageformat.h"
+#include "vtf/vtf.h"
+#include "vstdlib/jobthread.h"
+#include "filesystem.h"
+#include "icvar.h"
+
+
+//-----------------------------------------------------------------------------
+// Globals. Without an ICvar the shader DLL keeps its convars to itself, and
+// without a file system it never reads a cubemap.
+//-----------------------------------------------------------------------------
+ICvar *g_pCVar = NULL;
+IFileSystem *g_pFullFileSystem = NULL;
+const Vector vec3_origin( 0.0f, 0.0f, 0.0f );
+
+
+//-----------------------------------------------------------------------------
+// tier0: output
+//-----------------------------------------------------------------------------
+void Msg( const tchar* pMsg, ... )
+{
+	va_list args;
+	va_start( args, pMsg );
+	vprintf( pMsg, args );
+	va_end( args );
+}
+
+void Warning( const tchar *pMsg, ... )
+{
+	va_list args;
+	va_start( args, pMsg );
+	vfprintf( stderr, pMsg, args );
+	va_end( args );
+}
+
+void Error( const tchar *pMsg, ... )
+{
+	va_list args;
+	va_start( args, pMsg );
+	vfprintf( stderr, pMsg, args );
+	va_end( args );
+	exit( 1 );
+}
+
+void ConColorMsg( const Color& clr, const tchar* pMsg, ... )
+{
+	va_list args;
+	va_start( args, pMsg );
+	vprintf( pMsg, args );
+	va_end( args );
+}
+
+
+//-----------------------------------------------------------------------------
+// tier0: the command line, which the benchmark doesn't forward
+//-----------------------------------------------------------------------------
+class CEmptyCommandLine : public ICommandLine
+{
+public:
+	virtual void CreateCmdLine( const char *commandline ) {}
+	virtual void CreateCmdLine( int argc, char **argv ) {}
+	virtual const char *GetCmdLine( void ) const { return ""; }
+	virtual const char *CheckParm( const char *psz, const char **ppszValue = 0 ) const { return NULL; }
+	virtual void RemoveParm( const char *parm ) {}
+	virtual void AppendParm( const char *pszParm, const char *pszValues ) {}
+	virtual const char *ParmValue( const char *psz, const char *pDefaultVal = 0 ) const { return pDefaultVal; }
+	virtual int ParmValue( const char *psz, int nDefaultVal ) const { return nDefaultVal; }
+	virtual float ParmValue( const char *psz, float flDefaultVal ) const { return flDefaultVal; }
+	virtual int ParmCount() const { return 0; }
+	virtual int FindParm( const char *psz ) const { return 0; }
+	virtual const char* GetParm( int nIndex ) const { return ""; }
+	virtual void SetParm( int nIndex, char const *pNewParm ) {}
+};
+
+ICommandLine *CommandLine()
+{
+	static CEmptyCommandLine s_CommandLine;
+	return &s_CommandLine;
+}
+
+
+//-----------------------------------------------------------------------------
+// tier0: the clock. CFastTimer counts TSC ticks, so measure how many there
+// are to a second before any timer is read.
+//-----------------------------------------------------------------------------
+uint64 g_ClockSpeed;
+unsigned long g_dwClockSpeed;
+double g_ClockSpeedMicrosecondsMultiplier;
+double g_ClockSpeedMillisecondsMultiplier;
+double g_ClockSpeedSecondsMultiplier;
+
+static double MonotonicSeconds()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static class CTSCCalibration
+{
+public:
+	CTSCCalibration()
+	{
+		double flStart = MonotonicSeconds();
+		uint64 nStart = __rdtsc();
+		double flEnd;
+		do
+		{
+			flEnd = MonotonicSeconds();
+		} while ( flEnd - flStart < 0.05 );
+		uint64 nTicks = __rdtsc() - nStart;
+
+		double flClockSpeed = (double)nTicks / ( flEnd - flStart );
+		g_ClockSpeed = (uint64)flClockSpeed;
+		g_dwClockSpeed = (unsigned long)g_ClockSpeed;
+		g_ClockSpeedMicrosecondsMultiplier = 1000000.0 / flClockSpeed;
+		g_ClockSpeedMillisecondsMultiplier = 1000.0 / flClockSpeed;
+		g_ClockSpeedSecondsMultiplier = 1.0 / flClockSpeed;
+	}
+} s_TSCCalibration;
+
+
+//-----------------------------------------------------------------------------
+// tier0: threads
+//-----------------------------------------------------------------------------
+ThreadId_t ThreadGetCurrentId()
+{
+	return (ThreadId_t)syscall( SYS_gettid );
+}
+
+void CThreadFastMutex::Lock( const uint32 threadId, unsigned nSpinSleepTime ) volatile
+{
+	while ( !TryLockInline( threadId ) )
+	{
+		sched_yield();
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// tier0: the allocator, straight through to the CRT
+//-----------------------------------------------------------------------------
+class CCRTMemAlloc : public IMemAlloc
+{
+public:
+	virtual void *Alloc( size_t nSize ) { return malloc( nSize ); }
+	virtual void *Realloc( void *pMem, size_t nSize ) { return realloc( pMem, nSize ); }
+	virtual void Free( void *pMem ) { free( pMem ); }
+	virtual void *Expand_NoLongerSupported( void *pMem, size_t nSize ) { return NULL; }
+	virtual void *Alloc( size_t nSize, const char *pFileName, int nLine ) { return malloc( nSize ); }
+	virtual void *Realloc( void *pMem, size_t nSize, const char *pFileName, int nLine ) { return realloc( pMem, nSize ); }
+	virtual void Free( void *pMem, const char *pFileName, int nLine ) { free( pMem ); }
+	virtual void *Expand_NoLongerSupported( void *pMem, size_t nSize, const char *pFileName, int nLine ) { return NULL; }
+	virtual size_t GetSize( void *pMem ) { return 0; }
+	virtual void PushAllocDbgInfo( const char *pFileName, int nLine ) {}
+	virtual void PopAllocDbgInfo() {}
+	virtual int32 CrtSetBreakAlloc( int32 lNewBreakAlloc ) { return 0; }
+	virtual int CrtSetReportMode( int nReportType, int nReportMode ) { return 0; }
+	virtual int CrtIsValidHeapPointer( const void *pMem ) { return 1; }
+	virtual int CrtIsValidPointer( const void *pMem, unsigned int size, int access ) { return 1; }
+	virtual int CrtCheckMemory( void ) { return 1; }
+	virtual int CrtSetDbgFlag( int nNewFlag ) { return 0; }
+	virtual void CrtMemCheckpoint( _CrtMemState *pState ) {}
+	virtual void DumpStats() {}
+	virtual void DumpStatsFileBase( char const *pchFileBase ) {}
+	virtual size_t ComputeMemoryUsedBy( char const *pchSubStr ) { return 0; }
+	virtual void* CrtSetReportFile( int nRptType, void* hFile ) { return NULL; }
+	virtual void* CrtSetReportHook( void* pfnNewHook ) { return NULL; }
+	virtual int CrtDbgReport( int nRptType, const char * szFile, int nLine, const char * szModule, const char * pMsg ) { return 0; }
+	virtual int heapchk() { return 1; }
+	virtual bool IsDebugHeap() { return false; }
+	virtual void GetActualDbgInfo( const char *&pFileName, int &nLine ) {}
+	virtual void RegisterAllocation( const char *pFileName, int nLine, size_t nLogicalSize, size_t nActualSize, unsigned nTime ) {}
+	virtual void RegisterDeallocation( const char *pFileName, int nLine, size_t nLogicalSize, size_t nActualSize, unsigned nTime ) {}
+	virtual int GetVersion() { return 0; }
+	virtual void CompactHeap() {}
+	virtual MemAllocFailHandler_t SetAllocFailHandler( MemAllocFailHandler_t pfnMemAllocFailHandler ) { return NULL; }
+	virtual void DumpBlockStats( void * ) {}
+	virtual void SetStatsExtraInfo( const char *pMapName, const char *pComment ) {}
+	virtual size_t MemoryAllocFailed() { return 0; }
+	virtual void CompactIncremental() {}
+	virtual void OutOfMemory( size_t nBytesAttempted = 0 ) {}
+	virtual void *RegionAlloc( int region, size_t nSize ) { return malloc( nSize ); }
+	virtual void *RegionAlloc( int region, size_t nSize, const char *pFileName, int nLine ) { return malloc( nSize ); }
+	virtual void GlobalMemoryStatus( size_t *pUsedMemory, size_t *pFreeMemory ) { *pUsedMemory = *pFreeMemory = 0; }
+};
+
+static CCRTMemAlloc s_MemAlloc;
+IMemAlloc *g_pMemAlloc = &s_MemAlloc;
+
+
+//-----------------------------------------------------------------------------
+// tier1: strings
+//-----------------------------------------------------------------------------
+int _V_strlen( const char *str )
+{
+	return (int)strlen( str );
+}
+
+int _V_strcmp( const char *s1, const char *s2 )
+{
+	return strcmp( s1, s2 );
+}
+
+int _V_stricmp( const char *s1, const char *s2 )
+{
+	return strcasecmp( s1, s2 );
+}
+
+int V_strnicmp( const char *s1, const char *s2, int n )
+{
+	// Negative counts compare the whole strings
+	return ( n < 0 ) ? strcasecmp( s1, s2 ) : strncasecmp( s1, s2, n );
+}
+
+void _V_memmove( void *dest, const void *src, int count )
+{
+	memmove( dest, src, count );
+}
+
+void V_strncpy( char *pDest, char const *pSrc, int maxLen )
+{
+	if ( maxLen <= 0 )
+		return;
+	strncpy( pDest, pSrc, maxLen );
+	pDest[maxLen - 1] = 0;
+}
+
+char *V_strncat( char *pDest, const char *pSrc, size_t destBufferSize, int max_chars_to_copy )
+{
+	size_t nDestLen = strlen( pDest );
+	if ( nDestLen + 1 >= destBufferSize )
+		return pDest;
+
+	size_t nCopy = destBufferSize - nDestLen - 1;
+	if ( ( max_chars_to_copy >= 0 ) && ( (size_t)max_chars_to_copy < nCopy ) )
+	{
+		nCopy = max_chars_to_copy;
+	}
+	strncat( pDest, pSrc, nCopy );
+	return pDest;
+}
+
+int V_snprintf( char *pDest, int maxLen, char const *pFormat, ... )
+{
+	va_list args;
+	va_start( args, pFormat );
+	int nLen = vsnprintf( pDest, maxLen, pFormat, args );
+	va_end( args );
+
+	// Like the SDK's, returns -1 for output that didn't fit
+	return ( nLen < 0 || nLen >= maxLen ) ? -1 : nLen;
+}
+
+// FNV-1a over the lower cased string
+unsigned FASTCALL HashStringCaseless( const char *pszKey )
+{
+	unsigned nHash = 2166136261u;
+	for ( const unsigned char *p = (const unsigned char *)pszKey; *p; ++p )
+	{
+		nHash = ( nHash ^ tolower( *p ) ) * 16777619u;
+	}
+	return nHash;
+}
+
+
+//-----------------------------------------------------------------------------
+// tier1: containers
+//-----------------------------------------------------------------------------
+CUtlBinaryBlock::CUtlBinaryBlock( int growSize, int initSize ) : m_Memory( growSize, initSize )
+{
+	m_nActualLength = 0;
+}
+
+CUtlBinaryBlock::CUtlBinaryBlock( const CUtlBinaryBlock& src )
+{
+	m_nActualLength = 0;
+	Set( src.Get(), src.Length() );
+}
+
+void CUtlBinaryBlock::Set( const void *pValue, int nLen )
+{
+	SetLength( nLen );
+	if ( nLen > 0 )
+	{
+		memcpy( m_Memory.Base(), pValue, nLen );
+	}
+}
+
+void CUtlBinaryBlock::SetLength( int nLength )
+{
+	m_Memory.EnsureCapacity( nLength );
+	m_nActualLength = nLength;
+}
+
+CUtlString::CUtlString( const char *pString )
+{
+	Set( pString );
+}
+
+CUtlString::CUtlString( const CUtlString& string ) : m_Storage( string.m_Storage )
+{
+}
+
+void CUtlString::Set( const char *pValue )
+{
+	int nLen = pValue ? (int)strlen( pValue ) + 1 : 0;
+	m_Storage.Set( pValue, nLen );
+}
+
+const char *CUtlString::Get() const
+{
+	return m_Storage.Length() ? (const char *)m_Storage.Get() : "";
+}
+
+char *CUtlString::Get()
+{
+	static char s_Empty[1];
+	return m_Storage.Length() ? (char *)m_Storage.Get() : s_Empty;
+}
+
+// Only the file system fills buffers, and there is none
+CUtlBuffer::CUtlBuffer( int growSize, int initSize, int nFlags )
+{
+	Error( "CUtlBuffer isn't available in shaderbench\n" );
+}
+
+// Blocks come straight from the CRT; the pools only keep their counts
+CUtlMemoryPool::CUtlMemoryPool( int blockSize, int numElements, int growMode, const char *pszAllocOwner, int nAlignment )
+{
+	m_BlockSize = blockSize;
+	m_BlocksPerBlob = numElements;
+	m_GrowMode = growMode;
+	m_pHeadOfFreeList = NULL;
+	m_BlocksAllocated = 0;
+	m_PeakAlloc = 0;
+	m_nAlignment = nAlignment;
+	m_NumBlobs = 0;
+	m_pszAllocOwner = pszAllocOwner;
+}
+
+CUtlMemoryPool::~CUtlMemoryPool()
+{
+}
+
+void *CUtlMemoryPool::Alloc()
+{
+	m_PeakAlloc = MAX( m_PeakAlloc, ++m_BlocksAllocated );
+	return malloc( m_BlockSize );
+}
+
+void CUtlMemoryPool::Free( void *pMem )
+{
+	if ( pMem )
+	{
+		--m_BlocksAllocated;
+		free( pMem );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// tier1: interfaces
+//-----------------------------------------------------------------------------
+static InterfaceReg *s_pInterfaceRegs = NULL;
+
+InterfaceReg::InterfaceReg( InstantiateInterfaceFn fn, const char *pName ) : m_pName( pName )
+{
+	m_CreateFn = fn;
+	m_pNext = s_pInterfaceRegs;
+	s_pInterfaceRegs = this;
+}
+
+void ConnectTier1Libraries( CreateInterfaceFn *pFactoryList, int nFactoryCount )
+{
+}
+
+void DisconnectTier1Libraries()
+{
+}
+
+
+//-----------------------------------------------------------------------------
+// tier1: convars and commands. Each one links itself into
+// ConCommandBase::s_pConCommandBases as it is constructed.
+//-----------------------------------------------------------------------------
+ConCommandBase *ConCommandBase::s_pConCommandBases = NULL;
+IConCommandBaseAccessor *ConCommandBase::s_pAccessor = NULL;
+
+void ConVar_Register( int nCVarFlag, IConCommandBaseAccessor *pAccessor )
+{
+}
+
+void ConVar_Unregister( )
+{
+}
+
+ConCommandBase::ConCommandBase( void )
+{
+	m_bRegistered = false;
+	m_pszName = NULL;
+	m_pszHelpString = NULL;
+	m_nFlags = 0;
+	m_pNext = NULL;
+}
+
+ConCommandBase::ConCommandBase( const char *pName, const char *pHelpString, int flags )
+{
+	Create( pName, pHelpString, flags );
+}
+
+ConCommandBase::~ConCommandBase( void )
+{
+}
+
+void ConCommandBase::Create( const char *pName, const char *pHelpString, int flags )
+{
+	m_bRegistered = false;
+	m_pszName = pName;
+	m_pszHelpString = pHelpString ? pHelpString : "";
+	m_nFlags = flags;
+
+	m_pNext = s_pConCommandBases;
+	s_pConCommandBases = this;
+}
+
+bool ConCommandBase::IsCommand( void ) const
+{
+	return true;
+}
+
+bool ConCommandBase::IsFlagSet( int flag ) const
+{
+	return ( flag & m_nFlags ) != 0;
+}
+
+void ConCommandBase::AddFlags( int flags )
+{
+	m_nFlags |= flags;
+}
+
+void ConCommandBase::RemoveFlags( int flags )
+{
+	m_nFlags &= ~flags;
+}
+
+int ConCommandBase::GetFlags( void ) const
+{
+	return m_nFlags;
+}
+
+const char *ConCommandBase::GetName( void ) const
+{
+	return m_pszName;
+}
+
+const char *ConCommandBase::GetHelpText( void ) const
+{
+	return m_pszHelpString;
+}
+
+const ConCommandBase *ConCommandBase::GetNext( void ) const
+{
+	return m_pNext;
+}
+
+ConCommandBase *ConCommandBase::GetNext( void )
+{
+	return m_pNext;
+}
+
+bool ConCommandBase::IsRegistered( void ) const
+{
+	return m_bRegistered;
+}
+
+CVarDLLIdentifier_t ConCommandBase::GetDLLIdentifier() const
+{
+	return 0;
+}
+
+void ConCommandBase::Init()
+{
+}
+
+CCommand::CCommand( int nArgC, const char **ppArgV )
+{
+	Reset();
+
+	if ( nArgC > COMMAND_MAX_ARGC )
+	{
+		Error( "Too many arguments for a command\n" );
+	}
+
+	char *pBuf = m_pArgvBuffer;
+	char *pSBuf = m_pArgSBuffer;
+	m_nArgc = nArgC;
+	for ( int i = 0; i < nArgC; ++i )
+	{
+		int nLen = (int)strlen( ppArgV[i] );
+		if ( ( pBuf - m_pArgvBuffer ) + nLen + 1 > COMMAND_MAX_LENGTH ||
+			( pSBuf - m_pArgSBuffer ) + nLen + 2 > COMMAND_MAX_LENGTH )
+		{
+			Error( "Command is longer than %d characters\n", COMMAND_MAX_LENGTH );
+		}
+
+		m_ppArgv[i] = pBuf;
+		memcpy( pBuf, ppArgV[i], nLen + 1 );
+		pBuf += nLen + 1;
+
+		memcpy( pSBuf, ppArgV[i], nLen );
+		pSBuf += nLen;
+		if ( i != nArgC - 1 )
+		{
+			*pSBuf++ = ' ';
+		}
+		if ( i == 0 )
+		{
+			m_nArgv0Size = (int)( pSBuf - m_pArgSBuffer );
+		}
+	}
+	*pSBuf = 0;
+}
+
+void CCommand::Reset()
+{
+	m_nArgc = 0;
+	m_nArgv0Size = 0;
+	m_pArgSBuffer[0] = 0;
+}
+
+ConCommand::ConCommand( const char *pName, FnCommandCallback_t callback, const char *pHelpString, int flags, FnCommandCompletionCallback completionFunc )
+{
+	m_fnCommandCallback = callback;
+	m_bUsingNewCommandCallback = true;
+	m_bUsingCommandCallbackInterface = false;
+	m_fnCompletionCallback = completionFunc;
+	m_bHasCompletionCallback = ( completionFunc != 0 );
+
+	BaseClass::Create( pName, pHelpString, flags );
+}
+
+ConCommand::~ConCommand( void )
+{
+}
+
+bool ConCommand::IsCommand( void ) const
+{
+	return true;
+}
+
+int ConCommand::AutoCompleteSuggest( const char *partial, CUtlVector< CUtlString > &commands )
+{
+	return 0;
+}
+
+bool ConCommand::CanAutoComplete( void )
+{
+	return m_bHasCompletionCallback;
+}
+
+void ConCommand::Dispatch( const CCommand &command )
+{
+	if ( m_bUsingCommandCallbackInterface )
+	{
+		m_pCommandCallback->CommandCallback( command );
+	}
+	else if ( m_bUsingNewCommandCallback )
+	{
+		m_fnCommandCallback( command );
+	}
+	else
+	{
+		m_fnCommandCallbackV1();
+	}
+}
+
+ConVar::ConVar( const char *pName, const char *pDefaultValue, int flags )
+{
+	Create( pName, pDefaultValue, flags );
+}
+
+ConVar::ConVar( const char *pName, const char *pDefaultValue, int flags, const char *pHelpString )
+{
+	Create( pName, pDefaultValue, flags, pHelpString );
+}
+
+ConVar::~ConVar( void )
+{
+	delete[] m_Value.m_pszString;
+}
+
+void ConVar::Create( const char *pName, const char *pDefaultValue, int flags,
+	const char *pHelpString, bool bMin, float fMin, bool bMax, float fMax, FnChangeCallback_t callback )
+{
+	m_pParent = this;
+	m_pszDefaultValue = pDefaultValue ? pDefaultValue : "";
+
+	m_Value.m_StringLength = (int)strlen( m_pszDefaultValue ) + 1;
+	m_Value.m_pszString = new char[m_Value.m_StringLength];
+	memcpy( m_Value.m_pszString, m_pszDefaultValue, m_Value.m_StringLength );
+
+	m_bHasMin = bMin;
+	m_fMinVal = fMin;
+	m_bHasMax = bMax;
+	m_fMaxVal = fMax;
+
+	m_Value.m_fValue = (float)atof( m_Value.m_pszString );
+	m_Value.m_nValue = (int)m_Value.m_fValue;
+
+	if ( callback )
+	{
+		m_fnChangeCallbacks.AddToTail( callback );
+	}
+
+	BaseClass::Create( pName, pHelpString, flags );
+}
+
+void ConVar::Init()
+{
+	BaseClass::Init();
+}
+
+void ConVar::InstallChangeCallback( FnChangeCallback_t callback, bool bInvoke )
+{
+	if ( !callback )
+		return;
+
+	if ( m_pParent->m_fnChangeCallbacks.Find( callback ) == m_pParent->m_fnChangeCallbacks.InvalidIndex() )
+	{
+		m_pParent->m_fnChangeCallbacks.AddToTail( callback );
+		if ( bInvoke )
+		{
+			callback( this, m_Value.m_pszString, m_Value.m_fValue );
+		}
+	}
+}
+
+bool ConVar::IsFlagSet( int flag ) const
+{
+	return ( flag & m_pParent->m_nFlags ) != 0;
+}
+
+const char *ConVar::GetHelpText( void ) const
+{
+	return m_pParent->m_pszHelpString;
+}
+
+bool ConVar::IsRegistered( void ) const
+{
+	return m_pParent->m_bRegistered;
+}
+
+const char *ConVar::GetName( void ) const
+{
+	return m_pParent->m_pszName;
+}
+
+const char *ConVar::GetBaseName( void ) const
+{
+	return m_pParent->m_pszName;
+}
+
+int ConVar::GetSplitScreenPlayerSlot( void ) const
+{
+	return 0;
+}
+
+void ConVar::AddFlags( int flags )
+{
+	m_pParent->m_nFlags |= flags;
+}
+
+int ConVar::GetFlags( void ) const
+{
+	return m_pParent->m_nFlags;
+}
+
+bool ConVar::IsCommand( void ) const
+{
+	return false;
+}
+
+void ConVar::SetValue( const char *value )
+{
+	m_pParent->InternalSetValue( value );
+}
+
+void ConVar::SetValue( float value )
+{
+	m_pParent->InternalSetFloatValue( value );
+}
+
+void ConVar::SetValue( int value )
+{
+	m_pParent->InternalSetIntValue( value );
+}
+
+void ConVar::SetValue( Color value )
+{
+	m_pParent->InternalSetColorValue( value );
+}
+
+bool ConVar::ClampValue( float& value )
+{
+	if ( m_bHasMin && ( value < m_fMinVal ) )
+	{
+		value = m_fMinVal;
+		return true;
+	}
+
+	if ( m_bHasMax && ( value > m_fMaxVal ) )
+	{
+		value = m_fMaxVal;
+		return true;
+	}
+
+	return false;
+}
+
+void ConVar::ChangeStringValue( const char *tempVal, float flOldValue )
+{
+	char *pszOldValue = (char *)stackalloc( m_Value.m_StringLength );
+	memcpy( pszOldValue, m_Value.m_pszString, m_Value.m_StringLength );
+
+	int len = (int)strlen( tempVal ) + 1;
+	if ( len > m_Value.m_StringLength )
+	{
+		delete[] m_Value.m_pszString;
+		m_Value.m_pszString = new char[len];
+		m_Value.m_StringLength = len;
+	}
+	memcpy( m_Value.m_pszString, tempVal, len );
+
+	if ( strcmp( pszOldValue, m_Value.m_pszString ) != 0 )
+	{
+		for ( int i = 0; i < m_fnChangeCallbacks.Count(); ++i )
+		{
+			m_fnChangeCallbacks[i]( this, pszOldValue, flOldValue );
+		}
+	}
+}
+
+void ConVar::InternalSetValue( const char *value )
+{
+	float flOldValue = m_Value.m_fValue;
+	float fNewValue = (float)atof( value );
+
+	char tempVal[32];
+	const char *pVal = value;
+	if ( ClampValue( fNewValue ) )
+	{
+		V_snprintf( tempVal, sizeof( tempVal ), "%f", fNewValue );
+		pVal = tempVal;
+	}
+
+	m_Value.m_fValue = fNewValue;
+	m_Value.m_nValue = (int)fNewValue;
+
+	if ( !( m_nFlags & FCVAR_NEVER_AS_STRING ) )
+	{
+		ChangeStringValue( pVal, flOldValue );
+	}
+}
+
+void ConVar::InternalSetFloatValue( float fNewValue )
+{
+	if ( fNewValue == m_Value.m_fValue )
+		return;
+
+	ClampValue( fNewValue );
+
+	char tempVal[32];
+	V_snprintf( tempVal, sizeof( tempVal ), "%f", fNewValue );
+	InternalSetValue( tempVal );
+}
+
+void ConVar::InternalSetIntValue( int nValue )
+{
+	if ( nValue == m_Value.m_nValue )
+		return;
+
+	char tempVal[32];
+	V_snprintf( tempVal, sizeof( tempVal ), "%d", nValue );
+	InternalSetValue( tempVal );
+}
+
+void ConVar::InternalSetColorValue( Color value )
+{
+	int nValue;
+	memcpy( &nValue, &value, sizeof( nValue ) );
+	InternalSetIntValue( nValue );
+}
+
+// Reaches the list head ConCommandBase keeps for its derived classes
+class CConCommandList : public ConCommandBase
+{
+public:
+	static ConCommandBase *Head() { return s_pConCommandBases; }
+};
+
+static ConCommandBase *FindConCommandBase( const char *pName )
+{
+	for ( ConCommandBase *pBase = CConCommandList::Head(); pBase; pBase = pBase->GetNext() )
+	{
+		if ( !V_stricmp( pBase->GetName(), pName ) )
+			return pBase;
+	}
+	return NULL;
+}
+
+ConVar *ShaderBench_FindConVar( const char *pName )
+{
+	ConCommandBase *pBase = FindConCommandBase( pName );
+	return ( pBase && !pBase->IsCommand() ) ? static_cast< ConVar * >( pBase ) : NULL;
+}
+
+bool ShaderBench_Command( int nArgC, const char **ppArgV )
+{
+	ConCommandBase *pBase = ( nArgC > 0 ) ? FindConCommandBase( ppArgV[0] ) : NULL;
+	if ( !pBase )
+		return false;
+
+	if ( pBase->IsCommand() )
+	{
+		static_cast< ConCommand * >( pBase )->Dispatch( CCommand( nArgC, ppArgV ) );
+	}
+	else if ( nArgC > 1 )
+	{
+		static_cast< ConVar * >( pBase )->SetValue( ppArgV[1] );
+	}
+	else
+	{
+		ConVar *pVar = static_cast< ConVar * >( pBase );
+		Msg( "\"%s\" = \"%s\"\n", pVar->GetName(), pVar->GetString() );
+	}
+	return true;
+}
+
+void ShaderBench_ListCommands()
+{
+	for ( ConCommandBase *pBase = CConCommandList::Head(); pBase; pBase = pBase->GetNext() )
+	{
+		if ( pBase->IsCommand() )
+		{
+			Msg( "%-32s  %s\n", pBase->GetName(), pBase->GetHelpText() );
+		}
+		else
+		{
+			Msg( "%-32s  \"%s\"  %s\n", pBase->GetName(), static_cast< ConVar * >( pBase )->GetString(), pBase->GetHelpText() );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// vstdlib: the thread pool. Each RunJobs hands one job function to as many
+// idle threads as it asks for.
+//-----------------------------------------------------------------------------
+class CShaderBenchThreadPool : public IThreadPool
+{
+public:
+	CShaderBenchThreadPool( int nThreads ) : m_pfnJob( NULL ), m_pContext( NULL ), m_nJobsQueued( 0 ), m_nJobsRunning( 0 ), m_bExit( false )
+	{
+		for ( int i = 0; i < nThreads; ++i )
+		{
+			m_Threads.push_back( std::thread( &CShaderBenchThreadPool::ThreadMain, this ) );
+		}
+	}
+
+	~CShaderBenchThreadPool()
+	{
+		{
+			std::lock_guard< std::mutex > lock( m_Mutex );
+			m_bExit = true;
+		}
+		m_WorkQueued.notify_all();
+		for ( size_t i = 0; i < m_Threads.size(); ++i )
+		{
+			m_Threads[i].join();
+		}
+	}
+
+	virtual int NumThreads()
+	{
+		return (int)m_Threads.size();
+	}
+
+	virtual void RunJobs( void (*pfnJob)( void * ), void *pContext, int nJobs )
+	{
+		{
+			std::lock_guard< std::mutex > lock( m_Mutex );
+			m_pfnJob = pfnJob;
+			m_pContext = pContext;
+			m_nJobsQueued = nJobs;
+		}
+		m_WorkQueued.notify_all();
+
+		pfnJob( pContext );
+
+		std::unique_lock< std::mutex > lock( m_Mutex );
+		m_nJobsQueued = 0;
+		while ( m_nJobsRunning )
+		{
+			m_JobDone.wait( lock );
+		}
+	}
+
+private:
+	void ThreadMain()
+	{
+		std::unique_lock< std::mutex > lock( m_Mutex );
+		for ( ;; )
+		{
+			while ( !m_nJobsQueued && !m_bExit )
+			{
+				m_WorkQueued.wait( lock );
+			}
+			if ( m_bExit )
+				return;
+
+			--m_nJobsQueued;
+			++m_nJobsRunning;
+			void (*pfnJob)( void * ) = m_pfnJob;
+			void *pContext = m_pContext;
+
+			lock.unlock();
+			pfnJob( pContext );
+			lock.lock();
+
+			--m_nJobsRunning;
+			m_JobDone.notify_all();
+		}
+	}
+
+	std::vector< std::thread > m_Threads;
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkQueued;
+	std::condition_variable m_JobDone;
+	void (*m_pfnJob)( void * );
+	void *m_pContext;
+	int m_nJobsQueued;
+	int m_nJobsRunning;
+	bool m_bExit;
+};
+
+IThreadPool *g_pThreadPool = NULL;
+
+void ShaderBench_StartThreadPool( int nThreads )
+{
+	static CShaderBenchThreadPool s_ThreadPool( nThreads );
+	g_pThreadPool = &s_ThreadPool;
+}
+
+
+//-----------------------------------------------------------------------------
+// mathlib
+//-----------------------------------------------------------------------------
+const fltx4 Four_Zeros = { 0.0f, 0.0f, 0.0f, 0.0f };
+const fltx4 Four_Ones = { 1.0f, 1.0f, 1.0f, 1.0f };
+const fltx4 Four_PointFives = { 0.5f, 0.5f, 0.5f, 0.5f };
+const fltx4 Four_Threes = { 3.0f, 3.0f, 3.0f, 3.0f };
+
+void MathLib_Init( float gamma, float texGamma, float brightness, int overbright, bool bAllow3DNow, bool bAllowSSE, bool bAllowSSE2, bool bAllowMMX )
+{
+}
+
+float GammaToLinear( float gamma )
+{
+	return powf( clamp( gamma, 0.0f, 1.0f ), 2.2f );
+}
+
+float SrgbGammaToLinear( float flSrgbGammaValue )
+{
+	float x = clamp( flSrgbGammaValue, 0.0f, 1.0f );
+	return ( x <= 0.04045f ) ? ( x / 12.92f ) : powf( ( x + 0.055f ) / 1.055f, 2.4f );
+}
+
+float VectorNormalize( Vector& v )
+{
+	float flLength = sqrtf( v.x * v.x + v.y * v.y + v.z * v.z );
+	if ( flLength > 0.0f )
+	{
+		float flInvLength = 1.0f / flLength;
+		v.x *= flInvLength;
+		v.y *= flInvLength;
+		v.z *= flInvLength;
+	}
+	return flLength;
+}
+
+void AngleMatrix( const QAngle &angles, const Vector &position, matrix3x4_t &matrix )
+{
+	float sy, cy, sp, cp, sr, cr;
+	SinCos( DEG2RAD( angles[YAW] ), &sy, &cy );
+	SinCos( DEG2RAD( angles[PITCH] ), &sp, &cp );
+	SinCos( DEG2RAD( angles[ROLL] ), &sr, &cr );
+
+	matrix[0][0] = cp * cy;
+	matrix[1][0] = cp * sy;
+	matrix[2][0] = -sp;
+
+	float crcy = cr * cy;
+	float crsy = cr * sy;
+	float srcy = sr * cy;
+	float srsy = sr * sy;
+	matrix[0][1] = sp * srcy - crsy;
+	matrix[1][1] = sp * srsy + crcy;
+	matrix[2][1] = sr * cp;
+
+	matrix[0][2] = sp * crcy + srsy;
+	matrix[1][2] = sp * crsy - srcy;
+	matrix[2][2] = cr * cp;
+
+	matrix[0][3] = position.x;
+	matrix[1][3] = position.y;
+	matrix[2][3] = position.z;
+}
+
+// Inverts an orthonormal transform
+void MatrixInvert( const matrix3x4_t& in, matrix3x4_t& out )
+{
+	matrix3x4_t tmp = in;
+	for ( int i = 0; i < 3; ++i )
+	{
+		for ( int j = 0; j < 3; ++j )
+		{
+			out[i][j] = tmp[j][i];
+		}
+	}
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		out[i][3] = -( out[i][0] * tmp[0][3] + out[i][1] * tmp[1][3] + out[i][2] * tmp[2][3] );
+	}
+}
+
+void QuaternionAngles( const Quaternion &q, QAngle &angles )
+{
+	float forward[3], left[3], up2;
+	forward[0] = 1.0f - 2.0f * q.y * q.y - 2.0f * q.z * q.z;
+	forward[1] = 2.0f * q.x * q.y + 2.0f * q.w * q.z;
+	forward[2] = 2.0f * q.x * q.z - 2.0f * q.w * q.y;
+	left[0] = 2.0f * q.x * q.y - 2.0f * q.w * q.z;
+	left[1] = 1.0f - 2.0f * q.x * q.x - 2.0f * q.z * q.z;
+	left[2] = 2.0f * q.y * q.z + 2.0f * q.w * q.x;
+	up2 = 1.0f - 2.0f * q.x * q.x - 2.0f * q.y * q.y;
+
+	float xyDist = sqrtf( forward[0] * forward[0] + forward[1] * forward[1] );
+	if ( xyDist > 0.001f )
+	{
+		angles[YAW] = RAD2DEG( atan2f( forward[1], forward[0] ) );
+		angles[PITCH] = RAD2DEG( atan2f( -forward[2], xyDist ) );
+		angles[ROLL] = RAD2DEG( atan2f( left[2], up2 ) );
+	}
+	else
+	{
+		angles[YAW] = RAD2DEG( atan2f( -left[0], left[1] ) );
+		angles[PITCH] = RAD2DEG( atan2f( -forward[2], xyDist ) );
+		angles[ROLL] = 0.0f;
+	}
+}
+
+VMatrix& VMatrix::operator=( const VMatrix &mOther )
+{
+	memcpy( m, mOther.m, sizeof( m ) );
+	return *this;
+}
+
+void MatrixSetIdentity( VMatrix &dst )
+{
+	memset( dst.m, 0, sizeof( dst.m ) );
+	dst.m[0][0] = dst.m[1][1] = dst.m[2][2] = dst.m[3][3] = 1.0f;
+}
+
+void MatrixTranspose( const VMatrix& src, VMatrix& dst )
+{
+	VMatrix tmp = src;
+	for ( int i = 0; i < 4; ++i )
+	{
+		for ( int j = 0; j < 4; ++j )
+		{
+			dst.m[i][j] = tmp.m[j][i];
+		}
+	}
+}
+
+void MatrixMultiply( const VMatrix& src1, const VMatrix& src2, VMatrix& dst )
+{
+	VMatrix tmp;
+	for ( int i = 0; i < 4; ++i )
+	{
+		for ( int j = 0; j < 4; ++j )
+		{
+			tmp.m[i][j] = src1.m[i][0] * src2.m[0][j] + src1.m[i][1] * src2.m[1][j] +
+				src1.m[i][2] * src2.m[2][j] + src1.m[i][3] * src2.m[3][j];
+		}
+	}
+	dst = tmp;
+}
+
+
+//-----------------------------------------------------------------------------
+// bitmap and vtf. The formats the ambient cube code decodes; with no file
+// system it never gets a VTF to decode them from.
+//-----------------------------------------------------------------------------
+namespace ImageLoader
+{
+
+const ImageFormatInfo_t &ImageFormatInfo( ImageFormat fmt )
+{
+	static ImageFormatInfo_t s_Unknown = { "UNKNOWN", 0, 0, 0, 0, 0, 0, 0, false, false, false };
+	static ImageFormatInfo_t s_Formats[] =
+	{
+		{ "RGBA8888", 4, 8, 8, 8, 8, 0, 0, false, false, false },
+		{ "BGRA8888", 4, 8, 8, 8, 8, 0, 0, false, false, false },
+		{ "ABGR8888", 4, 8, 8, 8, 8, 0, 0, false, false, false },
+		{ "ARGB8888", 4, 8, 8, 8, 8, 0, 0, false, false, false },
+		{ "RGBA16161616", 8, 16, 16, 16, 16, 0, 0, false, false, false },
+		{ "RGBA16161616F", 8, 16, 16, 16, 16, 0, 0, false, true, false },
+		{ "RGBA32323232F", 16, 32, 32, 32, 32, 0, 0, false, true, false },
+	};
+
+	switch ( fmt )
+	{
+	case IMAGE_FORMAT_RGBA8888:			return s_Formats[0];
+	case IMAGE_FORMAT_BGRA8888:			return s_Formats[1];
+	case IMAGE_FORMAT_ABGR8888:			return s_Formats[2];
+	case IMAGE_FORMAT_ARGB8888:			return s_Formats[3];
+	case IMAGE_FORMAT_RGBA16161616:		return s_Formats[4];
+	case IMAGE_FORMAT_RGBA16161616F:	return s_Formats[5];
+	case IMAGE_FORMAT_RGBA32323232F:	return s_Formats[6];
+	default:							return s_Unknown;
+	}
+}
+
+} // namespace ImageLoader
+
+IVTFTexture *CreateVTFTexture()
+{
+	return NULL;
+}
+
+void DestroyVTFTexture( IVTFTexture *pTexture )
+{
+}
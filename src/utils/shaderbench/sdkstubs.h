@@ -0,0 +1,32 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Console access to the convars and commands the shader DLL
+//			defines, through the stand-ins sdkstubs.cpp gives for the tier0,
+//			tier1 and mathlib libraries the SDK only ships as Win32 .libs.
+//
+//===========================================================================//
+
+#ifndef SDKSTUBS_H
+#define SDKSTUBS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class ConVar;
+
+// Finds a convar the linked code defines, NULL if there is none
+ConVar *ShaderBench_FindConVar( const char *pName );
+
+// Sets a convar to ppArgV[1] or runs a command with the arguments given.
+// Returns false if ppArgV[0] names neither.
+bool ShaderBench_Command( int nArgC, const char **ppArgV );
+
+// Prints the convars and commands the linked code defines
+void ShaderBench_ListCommands();
+
+// Gives g_pThreadPool nThreads threads. Can be called once; until it is,
+// g_pThreadPool is NULL.
+void ShaderBench_StartThreadPool( int nThreads );
+
+
+#endif // SDKSTUBS_H
@@ -0,0 +1,342 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Times CBaseShader::DrawElements for the PBR shader against the
+//			mock shader API, and counts the API calls each draw makes.
+//
+//			shaderbench [-draws n] [-materials n] [-config name] [-list]
+//						[-cvar name value] [-drawstats] [-drawstream file]
+//						[-threads n] [-precache]
+//
+//			Each configuration creates a set of materials with the vars
+//			it names, snapshots them, then draws them round robin. A
+//			frame is one draw of every material; the material system's
+//			end frame callbacks run between frames, outside the timing.
+//			The report gives the snapshot cost per material, and per
+//			draw the CPU time and the calls made to the shader API,
+//			split by kind (see MockCallType_t).
+//
+//			-cvar sets a convar of the shader DLL before the run, and may
+//			be repeated. -drawstats dumps mat_pbr_drawstats afterwards,
+//			and -drawstream writes the passes drawn for drawsort.
+//
+//			-threads starts n threads for g_pThreadPool; without it jobs
+//			run on the main thread. -precache runs mat_pbr_envambient_flush
+//			and mat_pbr_precache over each configuration's materials once
+//			they are snapshotted. There is no file system, so the cubemap
+//			reads it times fail straight away.
+//
+//			Built from the SDK sources, without the engine or D3D:
+//
+//			g++ -O2 -std=c++17 -w -include posix/posix_compat.h -I. -Iposix/public
+//				-Iposix/materialsystem/stdshaders -I../../common -I../../public
+//				-I../../public/tier0 -I../../public/tier1 -I../../materialsystem
+//				-I../../materialsystem/stdshaders -I../../materialsystem/stdshaders/include
+//				-o shaderbench shaderbench.cpp shadermocks.cpp sdkstubs.cpp
+//				../../materialsystem/shaderlib/{BaseShader,ShaderDLL,shaderlib_cvar,
+//				shaderlib_drawstats,shaderlib_drawstream,shaderlib_statecache,
+//				shaderlib_combousage,shaderlib_startupstats}.cpp
+//				../../materialsystem/stdshaders/{BaseVSShader,pbr_dx9,pbr_envambient,
+//				pbr_brdf_simd}.cpp
+//
+//===========================================================================//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "shadermocks.h"
+#include "sdkstubs.h"
+#include "tier0/fasttimer.h"
+#include "tier1/convar.h"
+#include "shaderlib/shaderlib_drawstats.h"
+#include "shaderlib/shaderlib_drawstream.h"
+#include "shaderlib/shaderlib_statecache.h"
+#include "pbr_envambient.h"
+
+
+typedef std::vector< std::pair< std::string, std::string > > MaterialVars_t;
+
+struct BenchConfig_t
+{
+	const char *m_pName;
+	const char *m_pDescription;
+	int m_nFlags;						// MATERIAL_VAR_*
+	bool m_bFlashlight;					// draw the flashlight pass
+	const char *m_pVars[8][2];
+};
+
+// Every material gets a base texture, normal map and MRAO texture of its own
+static const BenchConfig_t s_Configs[] =
+{
+	{ "model", "model, ambient cube lighting", MATERIAL_VAR_MODEL, false,
+		{ { NULL, NULL } } },
+	{ "lightmapped", "brush, bumped lightmap", 0, false,
+		{ { NULL, NULL } } },
+	{ "envmap", "model, explicit cubemap", MATERIAL_VAR_MODEL, false,
+		{ { "$envmap", "maps/shaderbench/sky" }, { NULL, NULL } } },
+	{ "envambient", "model, env_cubemap with $useenvambient", MATERIAL_VAR_MODEL, false,
+		{ { "$envmap", "env_cubemap" }, { "$useenvambient", "1" }, { NULL, NULL } } },
+	{ "cubeambient", "model, explicit cubemap with $useenvambient", MATERIAL_VAR_MODEL, false,
+		{ { "$envmap", "maps/shaderbench/sky" }, { "$useenvambient", "1" }, { NULL, NULL } } },
+	{ "emissive", "model, emission and specular textures", MATERIAL_VAR_MODEL, false,
+		{ { "$emissiontexture", "%s_emit" }, { "$speculartexture", "%s_spec" }, { NULL, NULL } } },
+	{ "sss", "model, lightwarp and subsurface scattering", MATERIAL_VAR_MODEL, false,
+		{ { "$lightwarptexture", "shaderbench/lightwarp" }, { "$subsurfacescattering", "1" },
+		  { "$sssthickness", "%s_thick" }, { NULL, NULL } } },
+	{ "alphatest", "model, alpha tested", MATERIAL_VAR_MODEL | MATERIAL_VAR_ALPHATEST, false,
+		{ { "$alphatestreference", "0.5" }, { NULL, NULL } } },
+	{ "parallax", "brush, parallax occlusion mapping", 0, false,
+		{ { "$parallax", "1" }, { NULL, NULL } } },
+	{ "envbrdflut", "model, env_cubemap and the split-sum table", MATERIAL_VAR_MODEL, false,
+		{ { "$envmap", "env_cubemap" }, { "$envbrdflut", "shaderbench/envbrdflut" }, { NULL, NULL } } },
+	{ "flashlight", "model, flashlight pass with shadows", MATERIAL_VAR_MODEL, true,
+		{ { NULL, NULL } } },
+};
+
+
+static void PrintUsage()
+{
+	printf( "usage: shaderbench [-draws n] [-materials n] [-config name] [-list]\n"
+			"                   [-cvar name value] [-drawstats] [-drawstream file]\n"
+			"                   [-threads n] [-precache]\n" );
+}
+
+static void PrintConfigs()
+{
+	for ( int i = 0; i < (int)ARRAYSIZE( s_Configs ); ++i )
+	{
+		printf( "%-12s  %s\n", s_Configs[i].m_pName, s_Configs[i].m_pDescription );
+	}
+}
+
+// The material's own textures are named after it; "%s" in a var value is
+// replaced by the material name too
+static MaterialVars_t BuildMaterialVars( const BenchConfig_t &config, const char *pMaterialName )
+{
+	MaterialVars_t vars;
+	vars.push_back( std::make_pair( "$basetexture", std::string( pMaterialName ) + "_color" ) );
+	vars.push_back( std::make_pair( "$bumpmap", std::string( pMaterialName ) + "_normal" ) );
+	vars.push_back( std::make_pair( "$mraotexture", std::string( pMaterialName ) + "_mrao" ) );
+
+	for ( int i = 0; config.m_pVars[i][0]; ++i )
+	{
+		char value[256];
+		V_snprintf( value, sizeof( value ), config.m_pVars[i][1], pMaterialName );
+		vars.push_back( std::make_pair( config.m_pVars[i][0], value ) );
+	}
+	return vars;
+}
+
+static void PrintCallBreakdown( const MockCallCounts_t &calls, double flDivisor )
+{
+	for ( int i = 0; i < MOCK_CALL_TYPE_COUNT; ++i )
+	{
+		if ( calls.m_nCalls[i] )
+		{
+			printf( "  %s %.2f", MockCallTypeName( (MockCallType_t)i ), calls.m_nCalls[i] / flDivisor );
+		}
+	}
+	printf( "\n" );
+}
+
+static void RunCommand( const char *pCommand )
+{
+	const char *ppArgV[1] = { pCommand };
+	ShaderBench_Command( 1, ppArgV );
+}
+
+static void RunConfig( CMockMaterialSystem &materialSystem, const BenchConfig_t &config, int nMaterials, int nDraws, bool bPrecache )
+{
+	IShader *pShader = materialSystem.FindShader( "PBR" );
+	if ( !pShader )
+	{
+		Error( "The PBR shader isn't linked in\n" );
+	}
+
+	// Creation and snapshots
+	g_MockCalls.Reset();
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < nMaterials; ++i )
+	{
+		char name[64];
+		V_snprintf( name, sizeof( name ), "shaderbench/%s%03d", config.m_pName, i );
+		CMockMaterial *pMaterial = materialSystem.CreateMaterial( name, "PBR", BuildMaterialVars( config, name ), config.m_nFlags );
+		pMaterial->RecomputeStateSnapshots();
+	}
+	timer.End();
+	MockCallCounts_t snapshotCalls = g_MockCalls;
+	double flSnapshotUS = timer.GetDuration().GetMicrosecondsF();
+
+	if ( bPrecache )
+	{
+		RunCommand( "mat_pbr_envambient_flush" );
+		RunCommand( "mat_pbr_precache" );
+	}
+
+	const std::vector< CMockMaterial * > &materials = materialSystem.Materials();
+
+	// One frame to warm up the caches and the per-instance command buffers
+	for ( size_t i = 0; i < materials.size(); ++i )
+	{
+		materials[i]->Draw( config.m_bFlashlight );
+	}
+	ShaderDrawStream_EndFrame();
+	ShaderStateCache_EndFrame();
+	PBR_UpdateEnvAmbientCubes();
+
+	g_MockCalls.Reset();
+	CCycleCount drawTime;
+	int nDrawn = 0;
+	while ( nDrawn < nDraws )
+	{
+		int nFrameDraws = MIN( (int)materials.size(), nDraws - nDrawn );
+		timer.Start();
+		for ( int i = 0; i < nFrameDraws; ++i )
+		{
+			materials[i]->Draw( config.m_bFlashlight );
+		}
+		timer.End();
+		drawTime += timer.GetDuration();
+		nDrawn += nFrameDraws;
+
+		ShaderDrawStream_EndFrame();
+		ShaderStateCache_EndFrame();
+		PBR_UpdateEnvAmbientCubes();
+	}
+
+	double flDraws = (double)nDrawn;
+	double flStateCalls = (double)g_MockCalls.StateCalls();
+	printf( "%-12s  snapshot %8.2f us/material %6.1f calls/material\n", config.m_pName,
+		flSnapshotUS / nMaterials, (double)snapshotCalls.StateCalls() / nMaterials );
+	printf( "%-12s  draw     %8.1f ns/draw     %6.2f state calls/draw %5.2f queries/draw\n", "",
+		drawTime.GetMicrosecondsF() * 1000.0 / flDraws, flStateCalls / flDraws,
+		g_MockCalls.m_nCalls[MOCK_CALL_QUERY] / flDraws );
+	printf( "%-12s ", "" );
+	PrintCallBreakdown( g_MockCalls, flDraws );
+
+	materialSystem.DestroyMaterials();
+}
+
+int main( int argc, char **argv )
+{
+	int nDraws = 200000;
+	int nMaterials = 64;
+	int nThreads = 0;
+	bool bPrecache = false;
+	bool bDrawStats = false;
+	const char *pDrawStreamFile = NULL;
+	std::vector< const char * > configs;
+	std::vector< std::pair< const char *, const char * > > cvars;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !strcmp( argv[i], "-draws" ) && i + 1 < argc )
+		{
+			nDraws = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-materials" ) && i + 1 < argc )
+		{
+			nMaterials = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-config" ) && i + 1 < argc )
+		{
+			configs.push_back( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-cvar" ) && i + 2 < argc )
+		{
+			cvars.push_back( std::make_pair( argv[i + 1], argv[i + 2] ) );
+			i += 2;
+		}
+		else if ( !strcmp( argv[i], "-threads" ) && i + 1 < argc )
+		{
+			nThreads = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-precache" ) )
+		{
+			bPrecache = true;
+		}
+		else if ( !strcmp( argv[i], "-drawstats" ) )
+		{
+			bDrawStats = true;
+		}
+		else if ( !strcmp( argv[i], "-drawstream" ) && i + 1 < argc )
+		{
+			pDrawStreamFile = argv[++i];
+		}
+		else if ( !strcmp( argv[i], "-list" ) )
+		{
+			PrintConfigs();
+			return 0;
+		}
+		else
+		{
+			PrintUsage();
+			return 2;
+		}
+	}
+
+	if ( nDraws <= 0 || nMaterials <= 0 || nThreads < 0 )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	if ( nThreads > 0 )
+	{
+		ShaderBench_StartThreadPool( nThreads );
+	}
+
+	CMockMaterialSystem materialSystem;
+	if ( !materialSystem.Connect() )
+	{
+		Error( "Couldn't connect the shader DLL\n" );
+	}
+
+	for ( size_t i = 0; i < cvars.size(); ++i )
+	{
+		const char *ppArgV[2] = { cvars[i].first, cvars[i].second };
+		if ( !ShaderBench_Command( 2, ppArgV ) )
+		{
+			Warning( "Unknown convar %s\n", cvars[i].first );
+			return 2;
+		}
+	}
+
+	if ( bDrawStats )
+	{
+		ShaderBench_FindConVar( "mat_pbr_drawstats" )->SetValue( 1 );
+	}
+	if ( pDrawStreamFile )
+	{
+		ShaderBench_FindConVar( "mat_pbr_drawstream" )->SetValue( 1 );
+	}
+
+	printf( "%d materials, %d draws per configuration\n\n", nMaterials, nDraws );
+	for ( int i = 0; i < (int)ARRAYSIZE( s_Configs ); ++i )
+	{
+		bool bRun = configs.empty();
+		for ( size_t j = 0; j < configs.size(); ++j )
+		{
+			bRun = bRun || !V_stricmp( configs[j], s_Configs[i].m_pName );
+		}
+		if ( bRun )
+		{
+			RunConfig( materialSystem, s_Configs[i], nMaterials, nDraws, bPrecache );
+		}
+	}
+
+	if ( bDrawStats )
+	{
+		printf( "\n" );
+		ShaderDrawStats_Dump();
+	}
+	if ( pDrawStreamFile && !ShaderDrawStream_WriteFile( pDrawStreamFile ) )
+	{
+		Warning( "Couldn't write %s\n", pDrawStreamFile );
+		return 1;
+	}
+	return 0;
+}
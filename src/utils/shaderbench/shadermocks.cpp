@@ -0,0 +1,1059 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Recording stand-ins for the engine side of the shader DLL
+//			interfaces. See shadermocks.h.
+//
+//===========================================================================//
+
+#include <map>
+#include <algorithm>
+
+#include "shadermocks.h"
+#include "shaderapi/commandbuffer.h"
+#include "shaderlib/BaseShader.h"
+#include "renderparm.h"
+#include "tier1/strtools.h"
+#include "mathlib/mathlib.h"
+
+
+// The material system interface the shaders find through tier2
+IMaterialSystem *materials = NULL;
+
+
+//-----------------------------------------------------------------------------
+// Call counting
+//-----------------------------------------------------------------------------
+MockCallCounts_t g_MockCalls;
+
+static const char *s_pMockCallTypeNames[MOCK_CALL_TYPE_COUNT] =
+{
+	"shadow state",
+	"constants",
+	"texture binds",
+	"standard texture binds",
+	"shader indices",
+	"other state",
+	"queries",
+	"draws",
+};
+
+const char *MockCallTypeName( MockCallType_t nType )
+{
+	return s_pMockCallTypeNames[nType];
+}
+
+int64 MockCallCounts_t::StateCalls() const
+{
+	int64 nCalls = 0;
+	for ( int i = 0; i < MOCK_CALL_TYPE_COUNT; ++i )
+	{
+		if ( ( i != MOCK_CALL_QUERY ) && ( i != MOCK_CALL_DRAW ) )
+		{
+			nCalls += m_nCalls[i];
+		}
+	}
+	return nCalls;
+}
+
+
+//-----------------------------------------------------------------------------
+// Textures
+//-----------------------------------------------------------------------------
+static std::map< std::string, CMockTexture * > s_Textures;
+static ShaderAPITextureHandle_t s_hNextTexture = 1;
+
+CMockTexture::CMockTexture( const char *pName, int nFlags, int nSize ) :
+	m_Name( pName ), m_nFlags( nFlags ), m_nSize( nSize ), m_hTexture( s_hNextTexture++ )
+{
+}
+
+CMockTexture *CMockTexture::FindOrCreate( const char *pName, int nFlags, int nSize )
+{
+	// Texture names are case insensitive, like the file system they come from
+	std::string key( pName );
+	std::transform( key.begin(), key.end(), key.begin(), ::tolower );
+
+	std::map< std::string, CMockTexture * >::iterator i = s_Textures.find( key );
+	if ( i != s_Textures.end() )
+		return i->second;
+
+	CMockTexture *pTexture = new CMockTexture( pName, nFlags, nSize );
+	s_Textures[key] = pTexture;
+	return pTexture;
+}
+
+void CMockTexture::GetLowResColorSample( float s, float t, float *color ) const
+{
+	color[0] = color[1] = color[2] = 0.5f;
+}
+
+
+//-----------------------------------------------------------------------------
+// Material vars
+//-----------------------------------------------------------------------------
+CMockMaterialVar::CMockMaterialVar( IMaterial *pOwner, const char *pName ) :
+	m_pOwner( pOwner ), m_VarName( pName ), m_pTexture( NULL ), m_bDefined( false )
+{
+	m_pStringVal = NULL;
+	m_intVal = 0;
+	m_VecVal.Init( 0.0f, 0.0f, 0.0f, 0.0f );
+	m_Type = MATERIAL_VAR_TYPE_UNDEFINED;
+	m_nNumVectorComps = 4;
+	m_bFakeMaterialVar = 0;
+	m_nTempIndex = 0xFF;
+	m_Matrix.Identity();
+}
+
+CMockMaterialVar::~CMockMaterialVar()
+{
+}
+
+void CMockMaterialVar::SetType( MaterialVarType_t nType )
+{
+	m_Type = nType;
+	m_pStringVal = ( nType == MATERIAL_VAR_TYPE_STRING ) ? (char *)m_String.c_str() : NULL;
+	m_bDefined = true;
+}
+
+ITexture *CMockMaterialVar::GetTextureValue( void )
+{
+	return ( m_Type == MATERIAL_VAR_TYPE_TEXTURE ) ? m_pTexture : NULL;
+}
+
+void CMockMaterialVar::SetFloatValue( float val )
+{
+	m_VecVal.Init( val, val, val, val );
+	m_intVal = (int)val;
+	m_nNumVectorComps = 1;
+	char buf[64];
+	V_snprintf( buf, sizeof( buf ), "%f", val );
+	m_String = buf;
+	SetType( MATERIAL_VAR_TYPE_FLOAT );
+}
+
+void CMockMaterialVar::SetIntValue( int val )
+{
+	float flVal = (float)val;
+	m_VecVal.Init( flVal, flVal, flVal, flVal );
+	m_intVal = val;
+	m_nNumVectorComps = 1;
+	char buf[64];
+	V_snprintf( buf, sizeof( buf ), "%d", val );
+	m_String = buf;
+	SetType( MATERIAL_VAR_TYPE_INT );
+}
+
+void CMockMaterialVar::SetStringValue( char const *val )
+{
+	m_String = val;
+	m_intVal = atoi( val );
+	float flVal = (float)atof( val );
+	m_VecVal.Init( flVal, flVal, flVal, flVal );
+	SetType( MATERIAL_VAR_TYPE_STRING );
+}
+
+char const *CMockMaterialVar::GetStringValue( void ) const
+{
+	if ( ( m_Type == MATERIAL_VAR_TYPE_TEXTURE ) && m_pTexture )
+		return m_pTexture->GetName();
+	return m_String.c_str();
+}
+
+void CMockMaterialVar::SetFourCCValue( FourCC type, void *pData )
+{
+	m_intVal = (int)type;
+	m_String.clear();
+	SetType( MATERIAL_VAR_TYPE_FOURCC );
+}
+
+void CMockMaterialVar::GetFourCCValue( FourCC *type, void **ppData )
+{
+	*type = ( m_Type == MATERIAL_VAR_TYPE_FOURCC ) ? (FourCC)m_intVal : 0;
+	*ppData = NULL;
+}
+
+void CMockMaterialVar::SetVecValue( float const* val, int numcomps )
+{
+	m_VecVal.Init( 0.0f, 0.0f, 0.0f, 0.0f );
+	for ( int i = 0; i < numcomps; ++i )
+	{
+		m_VecVal[i] = val[i];
+	}
+	m_intVal = (int)val[0];
+	m_nNumVectorComps = numcomps;
+	SetType( MATERIAL_VAR_TYPE_VECTOR );
+}
+
+void CMockMaterialVar::SetVecValue( float x, float y )
+{
+	float v[2] = { x, y };
+	SetVecValue( v, 2 );
+}
+
+void CMockMaterialVar::SetVecValue( float x, float y, float z )
+{
+	float v[3] = { x, y, z };
+	SetVecValue( v, 3 );
+}
+
+void CMockMaterialVar::SetVecValue( float x, float y, float z, float w )
+{
+	float v[4] = { x, y, z, w };
+	SetVecValue( v, 4 );
+}
+
+void CMockMaterialVar::GetLinearVecValue( float *val, int numcomps ) const
+{
+	for ( int i = 0; i < numcomps; ++i )
+	{
+		val[i] = ( m_Type == MATERIAL_VAR_TYPE_VECTOR ) ? GammaToLinear( m_VecVal[i] ) : m_VecVal[i];
+	}
+}
+
+void CMockMaterialVar::SetTextureValue( ITexture *pTexture )
+{
+	m_pTexture = pTexture;
+	SetType( MATERIAL_VAR_TYPE_TEXTURE );
+}
+
+void CMockMaterialVar::SetMatrixValue( VMatrix const& matrix )
+{
+	m_Matrix = matrix;
+	SetType( MATERIAL_VAR_TYPE_MATRIX );
+}
+
+void CMockMaterialVar::CopyFrom( IMaterialVar *pMaterialVar )
+{
+	switch ( pMaterialVar->GetType() )
+	{
+	case MATERIAL_VAR_TYPE_FLOAT:
+		SetFloatValue( pMaterialVar->GetFloatValue() );
+		break;
+
+	case MATERIAL_VAR_TYPE_INT:
+		SetIntValue( pMaterialVar->GetIntValue() );
+		break;
+
+	case MATERIAL_VAR_TYPE_VECTOR:
+		SetVecValue( pMaterialVar->GetVecValue(), pMaterialVar->VectorSize() );
+		break;
+
+	case MATERIAL_VAR_TYPE_TEXTURE:
+		SetTextureValue( pMaterialVar->GetTextureValue() );
+		break;
+
+	case MATERIAL_VAR_TYPE_MATRIX:
+		SetMatrixValue( pMaterialVar->GetMatrixValue() );
+		break;
+
+	case MATERIAL_VAR_TYPE_UNDEFINED:
+		SetUndefined();
+		break;
+
+	default:
+		SetStringValue( pMaterialVar->GetStringValue() );
+		break;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Parses a value the way a .vmt gives it: "[x y z]" or "{r g b}" vectors,
+// ints, floats, and anything else as a string
+//-----------------------------------------------------------------------------
+void CMockMaterialVar::SetValueAutodetectType( char const *val )
+{
+	while ( *val == ' ' || *val == '\t' )
+	{
+		++val;
+	}
+
+	if ( *val == '[' || *val == '{' )
+	{
+		float flScale = ( *val == '{' ) ? ( 1.0f / 255.0f ) : 1.0f;
+		float v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		int nComps = 0;
+		const char *p = val + 1;
+		while ( nComps < 4 )
+		{
+			char *pEnd;
+			float f = strtof( p, &pEnd );
+			if ( pEnd == p )
+				break;
+			v[nComps++] = f * flScale;
+			p = pEnd;
+		}
+		SetVecValue( v, nComps ? nComps : 1 );
+		return;
+	}
+
+	char *pEnd;
+	long nVal = strtol( val, &pEnd, 10 );
+	if ( ( pEnd != val ) && ( *pEnd == 0 ) )
+	{
+		SetIntValue( (int)nVal );
+		return;
+	}
+
+	float flVal = strtof( val, &pEnd );
+	if ( ( pEnd != val ) && ( *pEnd == 0 ) )
+	{
+		SetFloatValue( flVal );
+		return;
+	}
+
+	SetStringValue( val );
+}
+
+void CMockMaterialVar::SetVecComponentValue( float fVal, int nComponent )
+{
+	if ( m_Type != MATERIAL_VAR_TYPE_VECTOR )
+	{
+		m_nNumVectorComps = 1;
+	}
+	m_VecVal[nComponent] = fVal;
+	if ( nComponent >= m_nNumVectorComps )
+	{
+		m_nNumVectorComps = nComponent + 1;
+	}
+	SetType( MATERIAL_VAR_TYPE_VECTOR );
+}
+
+void CMockMaterialVar::GetVecValueInternal( float *val, int numcomps ) const
+{
+	for ( int i = 0; i < numcomps; ++i )
+	{
+		val[i] = m_VecVal[i];
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Partial vtables. In the Itanium C++ ABI a pointer to a virtual member
+// function holds 1 + the byte offset of its vtable slot, where a pointer to
+// a non-virtual one holds the (even) function address.
+//-----------------------------------------------------------------------------
+template < int N >
+static void PartialMock_Trap( PartialMockVTable_t *pThis )
+{
+	Error( "%s: vtable slot %d is not mocked\n", pThis->m_pInterfaceName, N );
+}
+
+template < size_t... N >
+static void PartialMock_FillTraps( void **pTable, std::index_sequence< N... > )
+{
+	void *pTraps[] = { (void *)&PartialMock_Trap< N >... };
+	memcpy( pTable, pTraps, sizeof( pTraps ) );
+}
+
+void PartialMock_Init( PartialMockVTable_t *pMock, const char *pInterfaceName, void *pOwner )
+{
+	pMock->m_pVTable = pMock->m_Slots;
+	pMock->m_pInterfaceName = pInterfaceName;
+	pMock->m_pOwner = pOwner;
+	PartialMock_FillTraps( pMock->m_Slots, std::make_index_sequence< PARTIAL_MOCK_MAX_SLOTS >() );
+}
+
+int PartialMock_Slot( const void *pMember, size_t nMemberSize )
+{
+	struct MemberPointer_t
+	{
+		uintptr_t m_nPtr;
+		ptrdiff_t m_nAdj;
+	};
+
+	MemberPointer_t member;
+	if ( nMemberSize != sizeof( member ) )
+	{
+		Error( "Partial mocks need the Itanium C++ ABI\n" );
+	}
+	memcpy( &member, pMember, sizeof( member ) );
+
+	if ( !( member.m_nPtr & 1 ) || ( member.m_nAdj != 0 ) )
+	{
+		Error( "Partial mocks can only replace virtuals of the primary vtable\n" );
+	}
+
+	int nSlot = (int)( ( member.m_nPtr - 1 ) / sizeof( void * ) );
+	if ( nSlot >= PARTIAL_MOCK_MAX_SLOTS )
+	{
+		Error( "Vtable slot %d is past PARTIAL_MOCK_MAX_SLOTS\n", nSlot );
+	}
+	return nSlot;
+}
+
+
+//-----------------------------------------------------------------------------
+// The dynamic shader API
+//-----------------------------------------------------------------------------
+MockDynamicState_t::MockDynamicState_t()
+{
+	m_bFlashlight = false;
+	m_bFlashlightShadows = false;
+	m_nNumLights = 2;
+	m_nNumBones = 0;
+	m_FogMode = MATERIAL_FOG_LINEAR;
+	m_bWriteDepthToDestAlpha = false;
+	m_pAOTexture = NULL;
+	m_pFlashlightDepthTexture = NULL;
+	m_FlashlightState.m_pSpotlightTexture = CMockTexture::FindOrCreate( "effects/flashlight001" );
+	m_FlashlightState.m_nSpotlightTextureFrame = 0;
+}
+
+CMockShaderDynamicAPI::CMockShaderDynamicAPI() : m_vToneMappingScale( 1.0f, 1.0f, 1.0f )
+{
+	m_FlashlightWorldToTexture.Identity();
+}
+
+template < class T >
+static FORCEINLINE T ReadCommand( const uint8 *&pCmd )
+{
+	T value;
+	memcpy( &value, pCmd, sizeof( T ) );
+	pCmd += sizeof( T );
+	return value;
+}
+
+//-----------------------------------------------------------------------------
+// Walks a command buffer, counting each command as the call the shader API
+// makes for it
+//-----------------------------------------------------------------------------
+void CMockShaderDynamicAPI::CountCommandBuffer( const uint8 *pCmdBuffer, bool bInstance )
+{
+	const uint8 *pReturnStack[20];
+	int nReturnStack = 0;
+
+	const uint8 *pCmd = pCmdBuffer;
+	while ( pCmd )
+	{
+		int nCmd = ReadCommand< int >( pCmd );
+
+		// Both streams start with END, JUMP and JSR
+		if ( nCmd == CBCMD_END )
+		{
+			pCmd = nReturnStack ? pReturnStack[--nReturnStack] : NULL;
+			continue;
+		}
+		if ( nCmd == CBCMD_JUMP )
+		{
+			pCmd = ReadCommand< const uint8 * >( pCmd );
+			continue;
+		}
+		if ( nCmd == CBCMD_JSR )
+		{
+			const uint8 *pTarget = ReadCommand< const uint8 * >( pCmd );
+			if ( nReturnStack == ARRAYSIZE( pReturnStack ) )
+			{
+				Error( "Command buffer subroutines nest too deep\n" );
+			}
+			pReturnStack[nReturnStack++] = pCmd;
+			pCmd = pTarget;
+			continue;
+		}
+
+		if ( bInstance )
+		{
+			switch ( nCmd )
+			{
+			case CBICMD_SETSKINNINGMATRICES:
+			case CBICMD_SETVERTEXSHADERLOCALLIGHTING:
+			case CBICMD_SETVERTEXSHADERAMBIENTLIGHTCUBE:
+				MockCall( MOCK_CALL_CONSTANT );
+				break;
+
+			case CBICMD_SETPIXELSHADERLOCALLIGHTING:
+			case CBICMD_SETPIXELSHADERAMBIENTLIGHTCUBE:
+			case CBICMD_SETPIXELSHADERAMBIENTLIGHTCUBELUMINANCE:
+			case CBICMD_SETPIXELSHADERGLINTDAMPING:
+			case CBICMD_SETMODULATIONPIXELSHADERDYNAMICSTATE_IDENTITY:
+				ReadCommand< int >( pCmd );
+				MockCall( MOCK_CALL_CONSTANT );
+				break;
+
+			case CBICMD_BIND_ENV_CUBEMAP_TEXTURE:
+				ReadCommand< int >( pCmd );
+				MockCall( MOCK_CALL_TEXTURE );
+				break;
+
+			case CBICMD_SETMODULATIONPIXELSHADERDYNAMICSTATE:
+			case CBICMD_SETMODULATIONPIXELSHADERDYNAMICSTATE_LINEARCOLORSPACE:
+			case CBICMD_SETMODULATIONVERTEXSHADERDYNAMICSTATE:
+				ReadCommand< int >( pCmd );
+				pCmd += sizeof( Vector );
+				MockCall( MOCK_CALL_CONSTANT );
+				break;
+
+			case CBICMD_SETMODULATIONPIXELSHADERDYNAMICSTATE_LINEARCOLORSPACE_LINEARSCALE:
+			case CBICMD_SETMODULATIONPIXELSHADERDYNAMICSTATE_LINEARSCALE:
+			case CBICMD_SETMODULATIONPIXELSHADERDYNAMICSTATE_LINEARSCALE_SCALEINW:
+			case CBICMD_SETMODULATIONVERTEXSHADERDYNAMICSTATE_LINEARSCALE:
+				ReadCommand< int >( pCmd );
+				pCmd += sizeof( Vector );
+				ReadCommand< float >( pCmd );
+				MockCall( MOCK_CALL_CONSTANT );
+				break;
+
+			default:
+				Error( "Unknown instance command %d\n", nCmd );
+			}
+			continue;
+		}
+
+		switch ( nCmd )
+		{
+		case CBCMD_SET_PIXEL_SHADER_FLOAT_CONST:
+		case CBCMD_SET_VERTEX_SHADER_FLOAT_CONST:
+			{
+				ReadCommand< int >( pCmd );
+				int nRegs = ReadCommand< int >( pCmd );
+				pCmd += nRegs * 4 * sizeof( float );
+				MockCall( MOCK_CALL_CONSTANT );
+			}
+			break;
+
+		case CBCMD_SET_VERTEX_SHADER_FLOAT_CONST_REF:
+			ReadCommand< int >( pCmd );
+			ReadCommand< int >( pCmd );
+			ReadCommand< const float * >( pCmd );
+			MockCall( MOCK_CALL_CONSTANT );
+			break;
+
+		case CBCMD_SETPIXELSHADERFOGPARAMS:
+			ReadCommand< int >( pCmd );
+			MockCall( MOCK_CALL_OTHER_STATE );
+			break;
+
+		case CBCMD_STORE_EYE_POS_IN_PSCONST:
+		case CBCMD_SET_DEPTH_FEATHERING_CONST:
+			ReadCommand< int >( pCmd );
+			ReadCommand< float >( pCmd );
+			MockCall( MOCK_CALL_CONSTANT );
+			break;
+
+		case CBCMD_BIND_STANDARD_TEXTURE:
+			ReadCommand< int >( pCmd );
+			ReadCommand< int >( pCmd );
+			MockCall( MOCK_CALL_STANDARD_TEXTURE );
+			break;
+
+		case CBCMD_BIND_SHADERAPI_TEXTURE_HANDLE:
+			ReadCommand< int >( pCmd );
+			ReadCommand< int >( pCmd );
+			MockCall( MOCK_CALL_TEXTURE );
+			break;
+
+		case CBCMD_SET_PSHINDEX:
+		case CBCMD_SET_VSHINDEX:
+			ReadCommand< int >( pCmd );
+			MockCall( MOCK_CALL_SHADER_INDEX );
+			break;
+
+		case CBCMD_SET_VERTEX_SHADER_FLASHLIGHT_STATE:
+		case CBCMD_SET_VERTEX_SHADER_NEARZFARZ_STATE:
+			ReadCommand< int >( pCmd );
+			MockCall( MOCK_CALL_CONSTANT );
+			break;
+
+		case CBCMD_SET_PIXEL_SHADER_FLASHLIGHT_STATE:
+			pCmd += 11 * sizeof( int );
+			MockCall( MOCK_CALL_OTHER_STATE );
+			break;
+
+		case CBCMD_SET_PIXEL_SHADER_UBERLIGHT_STATE:
+			pCmd += 6 * sizeof( int );
+			MockCall( MOCK_CALL_OTHER_STATE );
+			break;
+
+		default:
+			Error( "Unknown command %d\n", nCmd );
+		}
+	}
+}
+
+void CMockShaderDynamicAPI::GetWorldSpaceCameraPosition( float* pPos ) const
+{
+	MockCall( MOCK_CALL_QUERY );
+	pPos[0] = 0.0f; pPos[1] = -128.0f; pPos[2] = 64.0f;
+}
+
+void CMockShaderDynamicAPI::GetWorldSpaceCameraDirection( float* pDir ) const
+{
+	MockCall( MOCK_CALL_QUERY );
+	pDir[0] = 0.0f; pDir[1] = 1.0f; pDir[2] = 0.0f;
+}
+
+void CMockShaderDynamicAPI::GetBackBufferDimensions( int& width, int& height ) const
+{
+	MockCall( MOCK_CALL_QUERY );
+	width = 1920;
+	height = 1080;
+}
+
+void CMockShaderDynamicAPI::GetCurrentRenderTargetDimensions( int& nWidth, int& nHeight ) const
+{
+	GetBackBufferDimensions( nWidth, nHeight );
+}
+
+void CMockShaderDynamicAPI::GetCurrentViewport( int& nX, int& nY, int& nWidth, int& nHeight ) const
+{
+	nX = nY = 0;
+	GetBackBufferDimensions( nWidth, nHeight );
+}
+
+const FlashlightState_t &CMockShaderDynamicAPI::GetFlashlightState( VMatrix &worldToTexture ) const
+{
+	MockCall( MOCK_CALL_QUERY );
+	worldToTexture = m_FlashlightWorldToTexture;
+	return m_State.m_FlashlightState;
+}
+
+const FlashlightState_t &CMockShaderDynamicAPI::GetFlashlightStateEx( VMatrix &worldToTexture, ITexture **pFlashlightDepthTexture ) const
+{
+	*pFlashlightDepthTexture = m_State.m_bFlashlightShadows ? m_State.m_pFlashlightDepthTexture : NULL;
+	return GetFlashlightState( worldToTexture );
+}
+
+void CMockShaderDynamicAPI::GetDX9LightState( LightState_t *state ) const
+{
+	MockCall( MOCK_CALL_QUERY );
+	state->m_nNumLights = m_State.m_nNumLights;
+	state->m_bAmbientLight = true;
+	state->m_bStaticLight = false;
+}
+
+void CMockShaderDynamicAPI::GetStandardTextureDimensions( int *pWidth, int *pHeight, StandardTextureId_t id )
+{
+	MockCall( MOCK_CALL_QUERY );
+	*pWidth = *pHeight = 256;
+}
+
+void CMockShaderDynamicAPI::GetMatrix( MaterialMatrixMode_t matrixMode, float *dst )
+{
+	MockCall( MOCK_CALL_QUERY );
+	VMatrix identity;
+	identity.Identity();
+	memcpy( dst, identity.Base(), 16 * sizeof( float ) );
+}
+
+int CMockShaderDynamicAPI::GetPackedDeformationInformation( int nMaskOfUnderstoodDeformations, float *pConstantValuesOut,
+	int nBufferSize, int nMaximumDeformations, int *pNumDefsOut ) const
+{
+	MockCall( MOCK_CALL_QUERY );
+	*pNumDefsOut = 0;
+	return 0;
+}
+
+void CMockShaderDynamicAPI::GetCurrentColorCorrection( ShaderColorCorrectionInfo_t* pInfo )
+{
+	MockCall( MOCK_CALL_QUERY );
+	memset( pInfo, 0, sizeof( *pInfo ) );
+}
+
+ITexture *CMockShaderDynamicAPI::GetTextureRenderingParameter( int parm_number ) const
+{
+	MockCall( MOCK_CALL_QUERY );
+	return ( parm_number == TEXTURE_RENDERPARM_AMBIENT_OCCLUSION ) ? m_State.m_pAOTexture : NULL;
+}
+
+void CMockShaderDynamicAPI::GetFlashlightShaderInfo( bool *pShadowsEnabled, bool *pUberLight ) const
+{
+	MockCall( MOCK_CALL_QUERY );
+	*pShadowsEnabled = m_State.m_bFlashlightShadows;
+	*pUberLight = false;
+}
+
+
+//-----------------------------------------------------------------------------
+// The shader system
+//-----------------------------------------------------------------------------
+ShaderAPITextureHandle_t CMockShaderSystem::GetShaderAPITextureBindHandle( ITexture *pTexture, int nFrameVar, int nTextureChannel )
+{
+	MockCall( MOCK_CALL_QUERY );
+	return pTexture ? static_cast< CMockTexture * >( pTexture )->GetHandle() : 0;
+}
+
+void CMockShaderSystem::BindTexture( Sampler_t sampler1, Sampler_t sampler2, ITexture *pTexture, int nFrameVar )
+{
+	MockCall( MOCK_CALL_TEXTURE );
+	MockCall( MOCK_CALL_TEXTURE );
+}
+
+void CMockShaderSystem::DrawSnapshot( const unsigned char *pInstanceCommandBuffer, bool bMakeActualDrawCall )
+{
+	if ( pInstanceCommandBuffer )
+	{
+		CMockShaderDynamicAPI::CountCommandBuffer( pInstanceCommandBuffer, true );
+	}
+	MockCall( MOCK_CALL_DRAW );
+}
+
+void CMockShaderInit::LoadTexture( IMaterialVar *pTextureVar, const char *pTextureGroupName, int nAdditionalCreationFlags )
+{
+	if ( pTextureVar->GetType() != MATERIAL_VAR_TYPE_TEXTURE )
+	{
+		pTextureVar->SetTextureValue( CMockTexture::FindOrCreate( pTextureVar->GetStringValue() ) );
+	}
+}
+
+void CMockShaderInit::LoadBumpMap( IMaterialVar *pTextureVar, const char *pTextureGroupName )
+{
+	if ( pTextureVar->GetType() != MATERIAL_VAR_TYPE_TEXTURE )
+	{
+		pTextureVar->SetTextureValue( CMockTexture::FindOrCreate( pTextureVar->GetStringValue(), MOCK_TEXTURE_NORMALMAP ) );
+	}
+}
+
+void CMockShaderInit::LoadCubeMap( IMaterialVar **ppParams, IMaterialVar *pTextureVar, int nAdditionalCreationFlags )
+{
+	if ( pTextureVar->GetType() != MATERIAL_VAR_TYPE_TEXTURE )
+	{
+		pTextureVar->SetTextureValue( CMockTexture::FindOrCreate( pTextureVar->GetStringValue(), MOCK_TEXTURE_CUBEMAP, 32 ) );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// IMaterialSystem, IMatRenderContext and IMaterial, as far as the shaders use
+// them. Material handles are indices into the material list.
+//-----------------------------------------------------------------------------
+static CMockMaterialSystem *MaterialSystemOf( IMaterialSystem *pThis )
+{
+	return (CMockMaterialSystem *)CPartialMock< IMaterialSystem >::Owner( pThis );
+}
+
+static IMatRenderContext *MaterialSystem_GetRenderContext( IMaterialSystem *pThis );
+
+static MaterialHandle_t MaterialSystem_FirstMaterial( IMaterialSystem *pThis )
+{
+	return MaterialSystemOf( pThis )->Materials().empty() ? (MaterialHandle_t)~0 : 0;
+}
+
+static MaterialHandle_t MaterialSystem_NextMaterial( IMaterialSystem *pThis, MaterialHandle_t h )
+{
+	++h;
+	return ( h < MaterialSystemOf( pThis )->Materials().size() ) ? h : (MaterialHandle_t)~0;
+}
+
+static MaterialHandle_t MaterialSystem_InvalidMaterial( IMaterialSystem *pThis )
+{
+	return (MaterialHandle_t)~0;
+}
+
+static IMaterial *MaterialSystem_GetMaterial( IMaterialSystem *pThis, MaterialHandle_t h )
+{
+	return MaterialSystemOf( pThis )->Materials()[h]->GetMaterial();
+}
+
+static int RenderContext_AddRef( IMatRenderContext *pThis )
+{
+	MockCall( MOCK_CALL_QUERY );
+	return 1;
+}
+
+static int RenderContext_Release( IMatRenderContext *pThis )
+{
+	MockCall( MOCK_CALL_QUERY );
+	return 1;
+}
+
+static void RenderContext_BeginRender( IMatRenderContext *pThis )
+{
+	MockCall( MOCK_CALL_QUERY );
+}
+
+static void RenderContext_EndRender( IMatRenderContext *pThis )
+{
+	MockCall( MOCK_CALL_QUERY );
+}
+
+static ITexture *RenderContext_GetLocalCubemap( IMatRenderContext *pThis )
+{
+	MockCall( MOCK_CALL_QUERY );
+	return ( (CMockMaterialSystem *)CPartialMock< IMatRenderContext >::Owner( pThis ) )->GetLocalCubemap();
+}
+
+static CMockMaterial *MaterialOf( IMaterial *pThis )
+{
+	return (CMockMaterial *)CPartialMock< IMaterial >::Owner( pThis );
+}
+
+static const char *Material_GetName( IMaterial *pThis )
+{
+	return MaterialOf( pThis )->GetName();
+}
+
+static const char *Material_GetShaderName( IMaterial *pThis )
+{
+	return MaterialOf( pThis )->GetShader()->GetName();
+}
+
+static IMaterialVar *Material_FindVar( IMaterial *pThis, const char *pVarName, bool *pFound, bool bComplain )
+{
+	IMaterialVar *pVar = MaterialOf( pThis )->FindVar( pVarName );
+	if ( pFound )
+	{
+		*pFound = ( pVar != NULL );
+	}
+	return pVar;
+}
+
+static void Material_RecomputeStateSnapshots( IMaterial *pThis )
+{
+	MaterialOf( pThis )->RecomputeStateSnapshots();
+}
+
+
+//-----------------------------------------------------------------------------
+// The material system
+//-----------------------------------------------------------------------------
+CMockMaterialSystem *CMockMaterialSystem::s_pMaterialSystem = NULL;
+
+CMockMaterialSystem::CMockMaterialSystem() :
+	m_MaterialSystem( "IMaterialSystem", this ), m_RenderContext( "IMatRenderContext", this )
+{
+	m_MaterialSystem.Set( &IMaterialSystem::GetRenderContext, (void *)MaterialSystem_GetRenderContext );
+	m_MaterialSystem.Set( &IMaterialSystem::FirstMaterial, (void *)MaterialSystem_FirstMaterial );
+	m_MaterialSystem.Set( &IMaterialSystem::NextMaterial, (void *)MaterialSystem_NextMaterial );
+	m_MaterialSystem.Set( &IMaterialSystem::InvalidMaterial, (void *)MaterialSystem_InvalidMaterial );
+	m_MaterialSystem.Set( &IMaterialSystem::GetMaterial, (void *)MaterialSystem_GetMaterial );
+
+	m_RenderContext.Set( &IMatRenderContext::AddRef, (void *)RenderContext_AddRef );
+	m_RenderContext.Set( &IMatRenderContext::Release, (void *)RenderContext_Release );
+	m_RenderContext.Set( &IMatRenderContext::BeginRender, (void *)RenderContext_BeginRender );
+	m_RenderContext.Set( &IMatRenderContext::EndRender, (void *)RenderContext_EndRender );
+	m_RenderContext.Set( &IMatRenderContext::GetLocalCubemap, (void *)RenderContext_GetLocalCubemap );
+
+	m_pLocalCubemap = CMockTexture::FindOrCreate( "maps/shaderbench/c0_0_0", MOCK_TEXTURE_CUBEMAP, 32 );
+}
+
+static IMatRenderContext *MaterialSystem_GetRenderContext( IMaterialSystem *pThis )
+{
+	MockCall( MOCK_CALL_QUERY );
+	return MaterialSystemOf( pThis )->GetRenderContext();
+}
+
+void *CMockMaterialSystem::Factory( const char *pName, int *pReturnCode )
+{
+	void *pInterface = NULL;
+	if ( !V_strcmp( pName, MATERIALSYSTEM_HARDWARECONFIG_INTERFACE_VERSION ) )
+	{
+		pInterface = &s_pMaterialSystem->m_HardwareConfig;
+	}
+	else if ( !V_strcmp( pName, MATERIALSYSTEM_CONFIG_VERSION ) )
+	{
+		pInterface = &s_pMaterialSystem->m_Config;
+	}
+	else if ( !V_strcmp( pName, SHADERSYSTEM_INTERFACE_VERSION ) )
+	{
+		pInterface = static_cast< IShaderSystem * >( &s_pMaterialSystem->m_ShaderSystem );
+	}
+
+	if ( pReturnCode )
+	{
+		*pReturnCode = pInterface ? IFACE_OK : IFACE_FAILED;
+	}
+	return pInterface;
+}
+
+bool CMockMaterialSystem::Connect()
+{
+	s_pMaterialSystem = this;
+	materials = m_MaterialSystem.Get();
+	return GetShaderDLLInternal()->Connect( Factory, false );
+}
+
+IShader *CMockMaterialSystem::FindShader( const char *pName )
+{
+	IShaderDLLInternal *pShaderDLL = GetShaderDLLInternal();
+	for ( int i = 0; i < pShaderDLL->ShaderCount(); ++i )
+	{
+		IShader *pShader = pShaderDLL->GetShader( i );
+		if ( !V_stricmp( pShader->GetName(), pName ) )
+			return pShader;
+	}
+	return NULL;
+}
+
+CMockMaterial *CMockMaterialSystem::CreateMaterial( const char *pName, const char *pShaderName,
+	const std::vector< std::pair< std::string, std::string > > &vars, int nFlags )
+{
+	IShader *pShader = FindShader( pShaderName );
+	if ( !pShader )
+		return NULL;
+
+	CMockMaterial *pMaterial = new CMockMaterial( pName, pShader );
+	IMaterialVar **ppParams = pMaterial->GetParams();
+	ppParams[FLAGS]->SetIntValue( nFlags );
+	ppParams[FLAGS_DEFINED]->SetIntValue( nFlags );
+
+	for ( size_t i = 0; i < vars.size(); ++i )
+	{
+		int nParam;
+		for ( nParam = 0; nParam < pShader->GetParamCount(); ++nParam )
+		{
+			if ( !V_stricmp( pShader->GetParamInfo( nParam ).m_pName, vars[i].first.c_str() ) )
+				break;
+		}
+
+		if ( nParam == pShader->GetParamCount() )
+		{
+			Warning( "%s: %s has no param %s\n", pName, pShaderName, vars[i].first.c_str() );
+			continue;
+		}
+		ppParams[nParam]->SetValueAutodetectType( vars[i].second.c_str() );
+	}
+
+	pMaterial->Init();
+	m_Materials.push_back( pMaterial );
+	return pMaterial;
+}
+
+void CMockMaterialSystem::DestroyMaterials()
+{
+	for ( size_t i = 0; i < m_Materials.size(); ++i )
+	{
+		delete m_Materials[i];
+	}
+	m_Materials.clear();
+}
+
+
+//-----------------------------------------------------------------------------
+// Materials
+//-----------------------------------------------------------------------------
+CMockMaterial::CMockMaterial( const char *pName, IShader *pShader ) :
+	m_Name( pName ), m_pShader( pShader ), m_IMaterial( "IMaterial", this )
+{
+	m_IMaterial.Set( &IMaterial::GetName, (void *)Material_GetName );
+	m_IMaterial.Set( &IMaterial::GetShaderName, (void *)Material_GetShaderName );
+	m_IMaterial.Set( &IMaterial::FindVar, (void *)Material_FindVar );
+	m_IMaterial.Set( &IMaterial::RecomputeStateSnapshots, (void *)Material_RecomputeStateSnapshots );
+
+	memset( m_RenderPasses, 0, sizeof( m_RenderPasses ) );
+
+	// Like the engine, vars the .vmt doesn't give hold the shader's default
+	// but stay undefined
+	int nParams = pShader->GetParamCount();
+	m_Params.resize( nParams );
+	for ( int i = 0; i < nParams; ++i )
+	{
+		const ShaderParamInfo_t &info = pShader->GetParamInfo( i );
+		m_Params[i] = new CMockMaterialVar( GetMaterial(), info.m_pName );
+		if ( i < NUM_SHADER_MATERIAL_VARS && i <= FLAGS_DEFINED2 )
+		{
+			m_Params[i]->SetIntValue( 0 );
+		}
+		else if ( info.m_pDefaultValue && info.m_pDefaultValue[0] )
+		{
+			m_Params[i]->SetValueAutodetectType( info.m_pDefaultValue );
+			m_Params[i]->SetUndefined();
+		}
+	}
+}
+
+CMockMaterial::~CMockMaterial()
+{
+	for ( int i = 0; i < MOCK_SNAPSHOT_COUNT; ++i )
+	{
+		FreeRenderPassList( m_RenderPasses[i] );
+	}
+	for ( size_t i = 0; i < m_Params.size(); ++i )
+	{
+		delete static_cast< CMockMaterialVar * >( m_Params[i] );
+	}
+}
+
+void CMockMaterial::FreeRenderPassList( RenderPassList_t &list )
+{
+	for ( int i = 0; i < MOCK_MAX_RENDER_PASSES; ++i )
+	{
+		delete list.m_pContextData[i];
+		delete list.m_pInstanceData[i];
+	}
+	memset( &list, 0, sizeof( list ) );
+}
+
+IMaterialVar *CMockMaterial::FindVar( const char *pVarName )
+{
+	for ( size_t i = 0; i < m_Params.size(); ++i )
+	{
+		if ( !V_stricmp( m_Params[i]->GetName(), pVarName ) )
+			return m_Params[i];
+	}
+	return NULL;
+}
+
+void CMockMaterial::Init()
+{
+	static CMockShaderInit s_ShaderInit;
+	m_pShader->InitShaderParams( GetParams(), GetName() );
+	m_pShader->InitShaderInstance( GetParams(), &s_ShaderInit, GetName(), TEXTURE_GROUP_MODEL );
+}
+
+void CMockMaterial::Snapshot( MockSnapshot_t nSnapshot )
+{
+	RenderPassList_t &list = m_RenderPasses[nSnapshot];
+	FreeRenderPassList( list );
+
+	IMaterialVar **ppParams = GetParams();
+	int nFlags2 = ppParams[FLAGS2]->GetIntValue();
+	int nModulation = 0;
+	if ( nSnapshot == MOCK_SNAPSHOT_FLASHLIGHT )
+	{
+		ppParams[FLAGS2]->SetIntValue( nFlags2 | MATERIAL_VAR2_USE_FLASHLIGHT );
+		nModulation |= SHADER_USING_FLASHLIGHT;
+	}
+	else
+	{
+		ppParams[FLAGS2]->SetIntValue( nFlags2 & ~MATERIAL_VAR2_USE_FLASHLIGHT );
+	}
+
+	CMockMaterialSystem *pMaterialSystem = CMockMaterialSystem::Get();
+	m_pShader->DrawElements( ppParams, nModulation, &pMaterialSystem->ShaderShadow(), NULL,
+		VERTEX_COMPRESSION_NONE, list.m_pContextData, list.m_pInstanceData );
+	list.m_bValid = true;
+
+	ppParams[FLAGS2]->SetIntValue( nFlags2 );
+}
+
+void CMockMaterial::RecomputeStateSnapshots()
+{
+	Snapshot( MOCK_SNAPSHOT_NORMAL );
+
+	if ( GetParams()[FLAGS2]->GetIntValue() & MATERIAL_VAR2_SUPPORTS_FLASHLIGHT )
+	{
+		Snapshot( MOCK_SNAPSHOT_FLASHLIGHT );
+	}
+	else
+	{
+		FreeRenderPassList( m_RenderPasses[MOCK_SNAPSHOT_FLASHLIGHT] );
+	}
+}
+
+void CMockMaterial::Draw( bool bFlashlight )
+{
+	CMockShaderDynamicAPI *pShaderAPI = &CMockMaterialSystem::Get()->ShaderAPI();
+	pShaderAPI->State().m_bFlashlight = bFlashlight;
+
+	IMaterialVar **ppParams = GetParams();
+	int nModulation = m_pShader->ComputeModulationFlags( ppParams, pShaderAPI );
+	RenderPassList_t &list = m_RenderPasses[ ( nModulation & SHADER_USING_FLASHLIGHT ) ? MOCK_SNAPSHOT_FLASHLIGHT : MOCK_SNAPSHOT_NORMAL ];
+	if ( !list.m_bValid )
+		return;
+
+	m_pShader->DrawElements( ppParams, nModulation, NULL, pShaderAPI,
+		VERTEX_COMPRESSION_NONE, list.m_pContextData, list.m_pInstanceData );
+}
+
+void CMockMaterial::MarkVarsChanged()
+{
+	for ( int i = 0; i < MOCK_SNAPSHOT_COUNT; ++i )
+	{
+		for ( int j = 0; j < MOCK_MAX_RENDER_PASSES; ++j )
+		{
+			if ( m_RenderPasses[i].m_pContextData[j] )
+			{
+				m_RenderPasses[i].m_pContextData[j]->m_bMaterialVarsChanged = true;
+			}
+		}
+	}
+}
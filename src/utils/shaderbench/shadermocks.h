@@ -0,0 +1,583 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Recording stand-ins for the engine side of the shader DLL
+//			interfaces, so shaders can be driven through their snapshot and
+//			dynamic passes without the material system or a D3D9 device.
+//
+//			Every call that would reach the shader API is counted by kind in
+//			g_MockCalls. Command buffers handed to ExecuteCommandBuffer and
+//			DrawSnapshot are walked, and each command in them counts as the
+//			call the shader API would make for it.
+//
+//===========================================================================//
+
+#ifndef SHADERMOCKS_H
+#define SHADERMOCKS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+// The standard headers go first; mathlib's clamp macro breaks <algorithm>
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "materialsystem/IShader.h"
+#include "materialsystem/imaterialvar.h"
+#include "materialsystem/imaterialsystemhardwareconfig.h"
+#include "materialsystem/imaterialsystem.h"
+#include "materialsystem/imaterial.h"
+#include "materialsystem/itexture.h"
+#include "materialsystem/ishaderapi.h"
+#include "materialsystem/materialsystem_config.h"
+#include "shaderapi/ishadershadow.h"
+#include "shaderapi/ishaderdynamic.h"
+#include "IShaderSystem.h"
+#include "mathlib/vmatrix.h"
+
+
+//-----------------------------------------------------------------------------
+// Call counting
+//-----------------------------------------------------------------------------
+enum MockCallType_t
+{
+	MOCK_CALL_SHADOW_STATE = 0,		// IShaderShadow, only made while snapshotting
+	MOCK_CALL_CONSTANT,				// shader constant uploads
+	MOCK_CALL_TEXTURE,				// texture binds through IShaderSystem or a texture handle
+	MOCK_CALL_STANDARD_TEXTURE,		// BindStandardTexture
+	MOCK_CALL_SHADER_INDEX,			// dynamic combo selection
+	MOCK_CALL_OTHER_STATE,			// fog, VPOS, lighting and modulation state
+	MOCK_CALL_QUERY,				// calls that only read engine state
+	MOCK_CALL_DRAW,					// TakeSnapshot and DrawSnapshot
+
+	MOCK_CALL_TYPE_COUNT
+};
+
+struct MockCallCounts_t
+{
+	int64 m_nCalls[MOCK_CALL_TYPE_COUNT];
+
+	void Reset() { memset( m_nCalls, 0, sizeof( m_nCalls ) ); }
+
+	// Everything that changes device state, draws excluded
+	int64 StateCalls() const;
+};
+
+extern MockCallCounts_t g_MockCalls;
+
+const char *MockCallTypeName( MockCallType_t nType );
+
+FORCEINLINE void MockCall( MockCallType_t nType )
+{
+	++g_MockCalls.m_nCalls[nType];
+}
+
+
+//-----------------------------------------------------------------------------
+// Textures. Created by name on first use and kept for the life of the process.
+//-----------------------------------------------------------------------------
+enum MockTextureFlags_t
+{
+	MOCK_TEXTURE_CUBEMAP		= 0x1,
+	MOCK_TEXTURE_TRANSLUCENT	= 0x2,
+	MOCK_TEXTURE_NORMALMAP		= 0x4,
+	MOCK_TEXTURE_RENDERTARGET	= 0x8,
+	MOCK_TEXTURE_ERROR			= 0x10,
+};
+
+class CMockTexture : public ITexture
+{
+public:
+	CMockTexture( const char *pName, int nFlags, int nSize );
+
+	static CMockTexture *FindOrCreate( const char *pName, int nFlags = 0, int nSize = 256 );
+
+	virtual const char *GetName( void ) const { return m_Name.c_str(); }
+	virtual int GetMappingWidth() const { return m_nSize; }
+	virtual int GetMappingHeight() const { return m_nSize; }
+	virtual int GetActualWidth() const { return m_nSize; }
+	virtual int GetActualHeight() const { return m_nSize; }
+	virtual int GetNumAnimationFrames() const { return 1; }
+	virtual bool IsTranslucent() const { return ( m_nFlags & MOCK_TEXTURE_TRANSLUCENT ) != 0; }
+	virtual bool IsMipmapped() const { return true; }
+	virtual void GetLowResColorSample( float s, float t, float *color ) const;
+	virtual void *GetResourceData( uint32 eDataType, size_t *pNumBytes ) const { return NULL; }
+	virtual void IncrementReferenceCount( void ) {}
+	virtual void DecrementReferenceCount( void ) {}
+	virtual void SetTextureRegenerator( ITextureRegenerator *pTextureRegen, bool releaseExisting = true ) {}
+	virtual void Download( Rect_t *pRect = 0 ) {}
+	virtual int GetApproximateVidMemBytes( void ) const { return m_nSize * m_nSize * 4; }
+	virtual bool IsError() const { return ( m_nFlags & MOCK_TEXTURE_ERROR ) != 0; }
+	virtual bool IsVolumeTexture() const { return false; }
+	virtual int GetMappingDepth() const { return 1; }
+	virtual int GetActualDepth() const { return 1; }
+	virtual ImageFormat GetImageFormat() const { return IMAGE_FORMAT_RGBA8888; }
+	virtual bool IsRenderTarget() const { return ( m_nFlags & MOCK_TEXTURE_RENDERTARGET ) != 0; }
+	virtual bool IsCubeMap() const { return ( m_nFlags & MOCK_TEXTURE_CUBEMAP ) != 0; }
+	virtual bool IsNormalMap() const { return ( m_nFlags & MOCK_TEXTURE_NORMALMAP ) != 0; }
+	virtual bool IsProcedural() const { return false; }
+	virtual void DeleteIfUnreferenced() {}
+	virtual void SwapContents( ITexture *pOther ) {}
+	virtual unsigned int GetFlags( void ) const { return 0; }
+	virtual void ForceLODOverride( int iNumLodsOverrideUpOrDown ) {}
+	virtual void ForceExcludeOverride( int iExcludeOverride ) {}
+
+	// The shader API handle a bind of this texture passes on
+	ShaderAPITextureHandle_t GetHandle() const { return m_hTexture; }
+
+private:
+	std::string m_Name;
+	int m_nFlags;
+	int m_nSize;
+	ShaderAPITextureHandle_t m_hTexture;
+};
+
+
+//-----------------------------------------------------------------------------
+// Material vars. Values are stored where IMaterialVar's inline accessors
+// read them (FAST_MATERIALVAR_ACCESS).
+//-----------------------------------------------------------------------------
+class CMockMaterialVar : public IMaterialVar
+{
+public:
+	CMockMaterialVar( IMaterial *pOwner, const char *pName );
+	virtual ~CMockMaterialVar();
+
+	virtual ITexture *GetTextureValue( void );
+	virtual char const *GetName( void ) const { return m_VarName.c_str(); }
+	virtual MaterialVarSym_t GetNameAsSymbol() const { return 0; }
+	virtual void SetFloatValue( float val );
+	virtual void SetIntValue( int val );
+	virtual void SetStringValue( char const *val );
+	virtual char const *GetStringValue( void ) const;
+	virtual void SetFourCCValue( FourCC type, void *pData );
+	virtual void GetFourCCValue( FourCC *type, void **ppData );
+	virtual void SetVecValue( float const* val, int numcomps );
+	virtual void SetVecValue( float x, float y );
+	virtual void SetVecValue( float x, float y, float z );
+	virtual void SetVecValue( float x, float y, float z, float w );
+	virtual void GetLinearVecValue( float *val, int numcomps ) const;
+	virtual void SetTextureValue( ITexture *pTexture );
+	virtual IMaterial *GetMaterialValue( void ) { return NULL; }
+	virtual void SetMaterialValue( IMaterial * ) {}
+	virtual bool IsDefined() const { return m_bDefined; }
+	virtual void SetUndefined() { m_bDefined = false; }
+	virtual void SetMatrixValue( VMatrix const& matrix );
+	virtual const VMatrix &GetMatrixValue( ) { return m_Matrix; }
+	virtual bool MatrixIsIdentity() const { return m_Matrix.IsIdentity(); }
+	virtual void CopyFrom( IMaterialVar *pMaterialVar );
+	virtual void SetValueAutodetectType( char const *val );
+	virtual IMaterial *GetOwningMaterial() { return m_pOwner; }
+	virtual void SetVecComponentValue( float fVal, int nComponent );
+
+protected:
+	virtual int GetIntValueInternal( void ) const { return m_intVal; }
+	virtual float GetFloatValueInternal( void ) const { return m_VecVal[0]; }
+	virtual float const *GetVecValueInternal( ) const { return m_VecVal.Base(); }
+	virtual void GetVecValueInternal( float *val, int numcomps ) const;
+	virtual int VectorSizeInternal() const { return m_nNumVectorComps; }
+
+private:
+	void SetType( MaterialVarType_t nType );
+
+	IMaterial *m_pOwner;
+	std::string m_VarName;
+	std::string m_String;
+	ITexture *m_pTexture;
+	VMatrix m_Matrix;
+	bool m_bDefined;
+};
+
+
+//-----------------------------------------------------------------------------
+// Vtables for interfaces too large to mock by hand. A CPartialMock's object
+// has an Itanium C++ ABI vtable whose slots all abort with the slot number,
+// except those filled with Set from a pointer to the interface's member.
+// Implementations take the object as their first argument.
+//-----------------------------------------------------------------------------
+#define PARTIAL_MOCK_MAX_SLOTS	256
+
+struct PartialMockVTable_t
+{
+	void **m_pVTable;				// what the interface's vptr would be
+	const char *m_pInterfaceName;
+	void *m_pOwner;
+	void *m_Slots[PARTIAL_MOCK_MAX_SLOTS];
+};
+
+void PartialMock_Init( PartialMockVTable_t *pMock, const char *pInterfaceName, void *pOwner );
+int PartialMock_Slot( const void *pMember, size_t nMemberSize );
+
+template < class I >
+class CPartialMock : private PartialMockVTable_t
+{
+public:
+	CPartialMock( const char *pInterfaceName, void *pOwner )
+	{
+		PartialMock_Init( this, pInterfaceName, pOwner );
+	}
+
+	template < class M >
+	void Set( M pMember, void *pImplementation )
+	{
+		m_Slots[ PartialMock_Slot( &pMember, sizeof( pMember ) ) ] = pImplementation;
+	}
+
+	I *Get() { return reinterpret_cast< I * >( static_cast< PartialMockVTable_t * >( this ) ); }
+
+	// The object that holds the mock, from the I * an implementation gets
+	static void *Owner( I *pThis ) { return reinterpret_cast< PartialMockVTable_t * >( pThis )->m_pOwner; }
+};
+
+
+//-----------------------------------------------------------------------------
+// The shader API
+//-----------------------------------------------------------------------------
+class CMockShaderShadow : public IShaderShadow
+{
+public:
+	virtual void SetDefaultState() { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void Unk1() { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void DepthFunc( ShaderDepthFunc_t depthFunc ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableDepthWrites( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableDepthTest( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnablePolyOffset( PolygonOffsetMode_t nOffsetMode ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableColorWrites( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableAlphaWrites( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableBlending( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void BlendFunc( ShaderBlendFactor_t srcFactor, ShaderBlendFactor_t dstFactor ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableBlendingSeparateAlpha( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void BlendFuncSeparateAlpha( ShaderBlendFactor_t srcFactor, ShaderBlendFactor_t dstFactor ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableAlphaTest( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void AlphaFunc( ShaderAlphaFunc_t alphaFunc, float alphaRef ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void PolyMode( ShaderPolyModeFace_t face, ShaderPolyMode_t polyMode ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableCulling( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void VertexShaderVertexFormat( unsigned int nFlags, int nTexCoordCount, int* pTexCoordDimensions, int nUserDataSize ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void SetVertexShader( const char* pFileName, int nStaticVshIndex ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void SetPixelShader( const char* pFileName, int nStaticPshIndex = 0 ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableSRGBWrite( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableSRGBRead( Sampler_t sampler, bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableTexture( Sampler_t sampler, bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void FogMode( ShaderFogMode_t fogMode, bool bVertexFog ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void DisableFogGammaCorrection( bool bDisable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableAlphaToCoverage( bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void SetShadowDepthFiltering( Sampler_t stage ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void EnableVertexTexture( VertexTextureSampler_t sampler, bool bEnable ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void BlendOp( ShaderBlendOp_t blendOp ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual void BlendOpSeparateAlpha( ShaderBlendOp_t blendOp ) { MockCall( MOCK_CALL_SHADOW_STATE ); }
+	virtual float GetLightMapScaleFactor( void ) const { MockCall( MOCK_CALL_QUERY ); return 1.0f; }
+};
+
+// What the dynamic state queries answer
+struct MockDynamicState_t
+{
+	MockDynamicState_t();
+
+	bool m_bFlashlight;
+	bool m_bFlashlightShadows;
+	int m_nNumLights;
+	int m_nNumBones;
+	MaterialFogMode_t m_FogMode;
+	bool m_bWriteDepthToDestAlpha;
+	ITexture *m_pAOTexture;
+	ITexture *m_pFlashlightDepthTexture;
+	FlashlightState_t m_FlashlightState;
+};
+
+class CMockShaderDynamicAPI : public IShaderDynamicAPI
+{
+public:
+	CMockShaderDynamicAPI();
+
+	MockDynamicState_t &State() { return m_State; }
+
+	// Counts the commands of a CCommandBufferBuilder or, with bInstance, a
+	// CInstanceCommandBufferBuilder stream
+	static void CountCommandBuffer( const uint8 *pCmdBuffer, bool bInstance );
+
+	virtual double CurrentTime() const { MockCall( MOCK_CALL_QUERY ); return 0.0; }
+	virtual void GetLightmapDimensions( int *w, int *h ) { MockCall( MOCK_CALL_QUERY ); *w = *h = 1024; }
+	virtual MaterialFogMode_t GetSceneFogMode( ) { MockCall( MOCK_CALL_QUERY ); return m_State.m_FogMode; }
+	virtual void GetSceneFogColor( unsigned char *rgb ) { MockCall( MOCK_CALL_QUERY ); rgb[0] = rgb[1] = rgb[2] = 0; }
+	virtual void SetVertexShaderConstant( int var, float const* pVec, int numConst = 1, bool bForce = false ) { MockCall( MOCK_CALL_CONSTANT ); }
+	virtual void SetPixelShaderConstant( int var, float const* pVec, int numConst = 1, bool bForce = false ) { MockCall( MOCK_CALL_CONSTANT ); }
+	virtual void SetDefaultState() { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void GetWorldSpaceCameraPosition( float* pPos ) const;
+	virtual void GetWorldSpaceCameraDirection( float* pDir ) const;
+	virtual int GetCurrentNumBones( void ) const { MockCall( MOCK_CALL_QUERY ); return m_State.m_nNumBones; }
+	virtual MaterialFogMode_t GetCurrentFogType( void ) const { MockCall( MOCK_CALL_QUERY ); return m_State.m_FogMode; }
+	virtual void SetVertexShaderIndex( int vshIndex = -1 ) { MockCall( MOCK_CALL_SHADER_INDEX ); }
+	virtual void SetPixelShaderIndex( int pshIndex = 0 ) { MockCall( MOCK_CALL_SHADER_INDEX ); }
+	virtual void GetBackBufferDimensions( int& width, int& height ) const;
+	virtual void GetCurrentRenderTargetDimensions( int& nWidth, int& nHeight ) const;
+	virtual void GetCurrentViewport( int& nX, int& nY, int& nWidth, int& nHeight ) const;
+	virtual void SetPixelShaderFogParams( int reg ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual bool InFlashlightMode() const { MockCall( MOCK_CALL_QUERY ); return m_State.m_bFlashlight; }
+	virtual const FlashlightState_t &GetFlashlightState( VMatrix &worldToTexture ) const;
+	virtual bool InEditorMode() const { MockCall( MOCK_CALL_QUERY ); return false; }
+	virtual void BindStandardTexture( Sampler_t sampler, StandardTextureId_t id ) { MockCall( MOCK_CALL_STANDARD_TEXTURE ); }
+	virtual ITexture *GetRenderTargetEx( int nRenderTargetID ) const { MockCall( MOCK_CALL_QUERY ); return NULL; }
+	virtual void SetToneMappingScaleLinear( const Vector &scale ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual const Vector &GetToneMappingScaleLinear( void ) const { MockCall( MOCK_CALL_QUERY ); return m_vToneMappingScale; }
+	virtual void SetAmbientLightColor( float r, float g, float b ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void SetFloatRenderingParameter( int parm_number, float value ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void SetIntRenderingParameter( int parm_number, int value ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void SetVectorRenderingParameter( int parm_number, Vector const &value ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual float GetFloatRenderingParameter( int parm_number ) const { MockCall( MOCK_CALL_QUERY ); return 0.0f; }
+	virtual int GetIntRenderingParameter( int parm_number ) const { MockCall( MOCK_CALL_QUERY ); return 0; }
+	virtual Vector GetVectorRenderingParameter( int parm_number ) const { MockCall( MOCK_CALL_QUERY ); return vec3_origin; }
+	virtual const FlashlightState_t &GetFlashlightStateEx( VMatrix &worldToTexture, ITexture **pFlashlightDepthTexture ) const;
+	virtual void Unk32() { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void Unk33() { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void Unk34() { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void Unk35() { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void GetDX9LightState( LightState_t *state ) const;
+	virtual int GetPixelFogCombo( ) { MockCall( MOCK_CALL_QUERY ); return 0; }
+	virtual void BindStandardVertexTexture( VertexTextureSampler_t sampler, StandardTextureId_t id ) { MockCall( MOCK_CALL_STANDARD_TEXTURE ); }
+	virtual bool IsHWMorphingEnabled( ) const { MockCall( MOCK_CALL_QUERY ); return false; }
+	virtual void GetStandardTextureDimensions( int *pWidth, int *pHeight, StandardTextureId_t id );
+	virtual void SetBooleanVertexShaderConstant( int var, BOOL const* pVec, int numBools = 1, bool bForce = false ) { MockCall( MOCK_CALL_CONSTANT ); }
+	virtual void SetIntegerVertexShaderConstant( int var, int const* pVec, int numIntVecs = 1, bool bForce = false ) { MockCall( MOCK_CALL_CONSTANT ); }
+	virtual void SetBooleanPixelShaderConstant( int var, BOOL const* pVec, int numBools = 1, bool bForce = false ) { MockCall( MOCK_CALL_CONSTANT ); }
+	virtual void SetIntegerPixelShaderConstant( int var, int const* pVec, int numIntVecs = 1, bool bForce = false ) { MockCall( MOCK_CALL_CONSTANT ); }
+	virtual bool ShouldWriteDepthToDestAlpha( void ) const { MockCall( MOCK_CALL_QUERY ); return m_State.m_bWriteDepthToDestAlpha; }
+	virtual void GetMatrix( MaterialMatrixMode_t matrixMode, float *dst );
+	virtual void PushDeformation( DeformationBase_t const *Deformation ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void PopDeformation( ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual int GetNumActiveDeformations() const { MockCall( MOCK_CALL_QUERY ); return 0; }
+	virtual int GetPackedDeformationInformation( int nMaskOfUnderstoodDeformations, float *pConstantValuesOut,
+		int nBufferSize, int nMaximumDeformations, int *pNumDefsOut ) const;
+	virtual void MarkUnusedVertexFields( unsigned int nFlags, int nTexCoordCount, bool *pUnusedTexCoords ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void ExecuteCommandBuffer( uint8 *pCmdBuffer ) { CountCommandBuffer( pCmdBuffer, false ); }
+	virtual void GetCurrentColorCorrection( ShaderColorCorrectionInfo_t* pInfo );
+	virtual ITexture *GetTextureRenderingParameter( int parm_number ) const;
+	virtual void SetScreenSizeForVPOS( int pshReg = 32 ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void SetVSNearAndFarZ( int vshReg ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual void Unk57() { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual float GetFarZ() { MockCall( MOCK_CALL_QUERY ); return 4096.0f; }
+	virtual void SetDepthFeatheringPixelShaderConstant( int iConstant, float fDepthBlendScale ) { MockCall( MOCK_CALL_CONSTANT ); }
+	virtual void GetFlashlightShaderInfo( bool *pShadowsEnabled, bool *pUberLight ) const;
+	virtual float GetFlashlightAmbientOcclusion( ) const { MockCall( MOCK_CALL_QUERY ); return m_State.m_FlashlightState.m_flAmbientOcclusion; }
+	virtual void SetTextureFilterMode( Sampler_t sampler, TextureFilterMode_t nMode ) { MockCall( MOCK_CALL_OTHER_STATE ); }
+	virtual TessellationMode_t GetTessellationMode() const { MockCall( MOCK_CALL_QUERY ); return TESSELLATION_MODE_DISABLED; }
+	virtual float GetSubDHeight() { MockCall( MOCK_CALL_QUERY ); return 0.0f; }
+
+private:
+	MockDynamicState_t m_State;
+	Vector m_vToneMappingScale;
+	VMatrix m_FlashlightWorldToTexture;
+};
+
+class CMockHardwareConfig : public IMaterialSystemHardwareConfig
+{
+public:
+	CMockHardwareConfig() : m_nHDRType( HDR_TYPE_INTEGER ), m_nShadowFilterMode( 0 ) {}
+
+	HDRType_t m_nHDRType;
+	int m_nShadowFilterMode;
+
+	virtual int GetFrameBufferColorDepth() const { return 4; }
+	virtual int GetSamplerCount() const { return 16; }
+	virtual bool HasSetDeviceGammaRamp() const { return true; }
+	virtual bool SupportsStaticControlFlow() const { return true; }
+	virtual VertexCompressionType_t SupportsCompressedVertices() const { return VERTEX_COMPRESSION_ON; }
+	virtual int MaximumAnisotropicLevel() const { return 16; }
+	virtual int MaxTextureWidth() const { return 4096; }
+	virtual int MaxTextureHeight() const { return 4096; }
+	virtual int TextureMemorySize() const { return 512 * 1024 * 1024; }
+	virtual bool SupportsMipmappedCubemaps() const { return true; }
+	virtual int NumVertexShaderConstants() const { return 256; }
+	virtual int NumPixelShaderConstants() const { return 224; }
+	virtual int MaxNumLights() const { return 4; }
+	virtual int MaxTextureAspectRatio() const { return 4096; }
+	virtual int MaxVertexShaderBlendMatrices() const { return 53; }
+	virtual int MaxUserClipPlanes() const { return 6; }
+	virtual bool UseFastClipping() const { return false; }
+	virtual int GetDXSupportLevel() const { return 95; }
+	virtual const char *GetShaderDLLName() const { return "DEFAULT"; }
+	virtual bool ReadPixelsFromFrontBuffer() const { return false; }
+	virtual bool PreferDynamicTextures() const { return false; }
+	virtual bool SupportsHDR() const { return true; }
+	virtual bool NeedsAAClamp() const { return false; }
+	virtual bool NeedsATICentroidHack() const { return false; }
+	virtual int GetMaxDXSupportLevel() const { return 95; }
+	virtual bool SpecifiesFogColorInLinearSpace() const { return true; }
+	virtual bool SupportsSRGB() const { return true; }
+	virtual bool FakeSRGBWrite() const { return false; }
+	virtual bool CanDoSRGBReadFromRTs() const { return true; }
+	virtual bool SupportsGLMixedSizeTargets() const { return false; }
+	virtual bool IsAAEnabled() const { return false; }
+	virtual int GetVertexSamplerCount() const { return 4; }
+	virtual int GetMaxVertexTextureDimension() const { return 4096; }
+	virtual int MaxTextureDepth() const { return 256; }
+	virtual HDRType_t GetHDRType() const { return m_nHDRType; }
+	virtual HDRType_t GetHardwareHDRType() const { return m_nHDRType; }
+	virtual bool SupportsStreamOffset() const { return true; }
+	virtual int StencilBufferBits() const { return 8; }
+	virtual int MaxViewports() const { return 4; }
+	virtual void OverrideStreamOffsetSupport( bool bOverrideEnabled, bool bEnableSupport ) {}
+	virtual int GetShadowFilterMode() const { return m_nShadowFilterMode; }
+	virtual int NeedsShaderSRGBConversion() const { return 0; }
+	virtual bool UsesSRGBCorrectBlending() const { return true; }
+	virtual bool HasFastVertexTextures() const { return false; }
+	virtual int MaxHWMorphBatchCount() const { return 0; }
+	virtual bool SupportsHDRMode( HDRType_t nHDRMode ) const { return nHDRMode != HDR_TYPE_FLOAT; }
+	virtual bool GetHDREnabled( void ) const { return m_nHDRType != HDR_TYPE_NONE; }
+	virtual void SetHDREnabled( bool bEnable ) {}
+	virtual bool SupportsBorderColor( void ) const { return true; }
+	virtual bool SupportsFetch4( void ) const { return false; }
+	virtual float GetShadowDepthBias() const { return 0.0005f; }
+	virtual float GetShadowSlopeScaleDepthBias() const { return 2.0f; }
+	virtual bool PreferZPrepass() const { return false; }
+	virtual bool SuppressPixelShaderCentroidHackFixup() const { return false; }
+	virtual bool PreferTexturesInHWMemory() const { return false; }
+	virtual bool PreferHardwareSync() const { return false; }
+	virtual bool ActualHasFastVertexTextures() const { return false; }
+	virtual bool SupportsShadowDepthTextures( void ) const { return true; }
+	virtual ImageFormat GetShadowDepthTextureFormat( void ) const { return IMAGE_FORMAT_D24X8; }
+	virtual ImageFormat GetNullTextureFormat( void ) const { return IMAGE_FORMAT_NULL; }
+	virtual int GetMinDXSupportLevel() const { return 90; }
+	virtual bool IsUnsupported() const { return false; }
+};
+
+class CMockShaderSystem : public IShaderSystem
+{
+public:
+	virtual ShaderAPITextureHandle_t GetShaderAPITextureBindHandle( ITexture *pTexture, int nFrameVar, int nTextureChannel = 0 );
+	virtual void BindTexture( Sampler_t sampler1, ITexture *pTexture, int nFrameVar = 0 ) { MockCall( MOCK_CALL_TEXTURE ); }
+	virtual void BindTexture( Sampler_t sampler1, Sampler_t sampler2, ITexture *pTexture, int nFrameVar = 0 );
+	virtual void TakeSnapshot( ) { MockCall( MOCK_CALL_DRAW ); }
+	virtual void DrawSnapshot( const unsigned char *pInstanceCommandBuffer, bool bMakeActualDrawCall = true );
+	virtual bool IsUsingGraphics() const { return true; }
+	virtual bool CanUseEditorMaterials() const { return false; }
+	virtual void BindVertexTexture( VertexTextureSampler_t vtSampler, ITexture *pTexture, int nFrameVar = 0 ) { MockCall( MOCK_CALL_TEXTURE ); }
+};
+
+// Loads textures by creating CMockTextures named after the vars
+class CMockShaderInit : public IShaderInit
+{
+public:
+	virtual void LoadTexture( IMaterialVar *pTextureVar, const char *pTextureGroupName, int nAdditionalCreationFlags );
+	virtual void LoadBumpMap( IMaterialVar *pTextureVar, const char *pTextureGroupName );
+	virtual void LoadCubeMap( IMaterialVar **ppParams, IMaterialVar *pTextureVar, int nAdditionalCreationFlags );
+};
+
+
+//-----------------------------------------------------------------------------
+// The material system side. Connects the shader DLL to the mocks and plays
+// the part of CMaterial and the engine's shader system for each material.
+//-----------------------------------------------------------------------------
+class CMockMaterial;
+
+class CMockMaterialSystem
+{
+public:
+	CMockMaterialSystem();
+
+	// Connects the shader DLL the harness is linked with, and points the
+	// material system globals the shaders use at the mocks
+	bool Connect();
+
+	IShader *FindShader( const char *pName );
+
+	// Var values are given the way a .vmt gives them, as name / value pairs.
+	// Shader params that aren't given keep their default value, undefined.
+	CMockMaterial *CreateMaterial( const char *pName, const char *pShaderName,
+		const std::vector< std::pair< std::string, std::string > > &vars, int nFlags = 0 );
+	void DestroyMaterials();
+	const std::vector< CMockMaterial * > &Materials() const { return m_Materials; }
+
+	// The local cubemap env_cubemap resolves to
+	void SetLocalCubemap( ITexture *pTexture ) { m_pLocalCubemap = pTexture; }
+	ITexture *GetLocalCubemap() const { return m_pLocalCubemap; }
+
+	IMatRenderContext *GetRenderContext() { return m_RenderContext.Get(); }
+
+	CMockShaderShadow &ShaderShadow() { return m_ShaderShadow; }
+	CMockShaderDynamicAPI &ShaderAPI() { return m_ShaderAPI; }
+	CMockHardwareConfig &HardwareConfig() { return m_HardwareConfig; }
+	MaterialSystem_Config_t &Config() { return m_Config; }
+
+	static CMockMaterialSystem *Get() { return s_pMaterialSystem; }
+
+private:
+	static void *Factory( const char *pName, int *pReturnCode );
+
+	static CMockMaterialSystem *s_pMaterialSystem;
+
+	CMockShaderShadow m_ShaderShadow;
+	CMockShaderDynamicAPI m_ShaderAPI;
+	CMockHardwareConfig m_HardwareConfig;
+	CMockShaderSystem m_ShaderSystem;
+	MaterialSystem_Config_t m_Config;
+
+	// IMaterialSystem and IMatRenderContext, as far as the shaders use them
+	CPartialMock< IMaterialSystem > m_MaterialSystem;
+	CPartialMock< IMatRenderContext > m_RenderContext;
+	ITexture *m_pLocalCubemap;
+
+	std::vector< CMockMaterial * > m_Materials;
+};
+
+#define MOCK_MAX_RENDER_PASSES	4
+
+// One per modulation; like the engine's render pass lists they keep the
+// shader's context and instance data for the passes of a snapshot
+enum MockSnapshot_t
+{
+	MOCK_SNAPSHOT_NORMAL = 0,
+	MOCK_SNAPSHOT_FLASHLIGHT,
+
+	MOCK_SNAPSHOT_COUNT
+};
+
+class CMockMaterial
+{
+public:
+	CMockMaterial( const char *pName, IShader *pShader );
+	~CMockMaterial();
+
+	const char *GetName() const { return m_Name.c_str(); }
+	IShader *GetShader() const { return m_pShader; }
+	IMaterialVar **GetParams() { return &m_Params[0]; }
+	IMaterial *GetMaterial() { return m_IMaterial.Get(); }
+
+	// The var named pVarName, NULL if the shader has none
+	IMaterialVar *FindVar( const char *pVarName );
+
+	// InitShaderParams and InitShaderInstance
+	void Init();
+
+	// Takes the normal snapshot, and the flashlight one if the shader asks for it
+	void RecomputeStateSnapshots();
+
+	// A dynamic pass with the shader API in or out of flashlight mode
+	void Draw( bool bFlashlight );
+
+	// Flags the vars changed, as setting a var through the material does
+	void MarkVarsChanged();
+
+private:
+	friend class CMockMaterialSystem;
+
+	struct RenderPassList_t
+	{
+		bool m_bValid;
+		CBasePerMaterialContextData *m_pContextData[MOCK_MAX_RENDER_PASSES];
+		CBasePerInstanceContextData *m_pInstanceData[MOCK_MAX_RENDER_PASSES];
+	};
+
+	void Snapshot( MockSnapshot_t nSnapshot );
+	void FreeRenderPassList( RenderPassList_t &list );
+
+	std::string m_Name;
+	IShader *m_pShader;
+	std::vector< IMaterialVar * > m_Params;
+	RenderPassList_t m_RenderPasses[MOCK_SNAPSHOT_COUNT];
+
+	// IMaterial, as far as mat_pbr_precache uses it
+	CPartialMock< IMaterial > m_IMaterial;
+};
+
+
+#endif // SHADERMOCKS_H
@@ -0,0 +1,589 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Parallel, cached replacement for the process_shaders.ps1 loop.
+//
+//			combobuild [-ver 30] [-threads N] [-cache dir] [-out dir] [-force]
+//					   (-compiler "<command>" | -stubcompiler) <file.fxc | list.txt> ...
+//
+//			Every static combo that survives the SKIP rules is one job. A
+//			job's key hashes the source the compiler would see for that
+//			static combo (see fxcpreprocess.h), the combo values, the dynamic
+//			combos it compiles and the compiler command. Jobs whose key is in
+//			the cache directory are not compiled again, so editing a header
+//			only recompiles the static combos whose compiled source changed.
+//			The rest run on a work-stealing thread pool, and each shader is
+//			written as a .vcs with identical static combos aliased.
+//
+//			A shader whose .vcs already carries the fingerprint of its
+//			.fxc and headers (see fxcdeps.h) is skipped without looking
+//			at its combos. -force rebuilds everything, e.g. after changing
+//			the compiler.
+//
+//			The compiler command is run once per dynamic combo with these
+//			substitutions:
+//				{source}	the .fxc
+//				{output}	file the compiled shader must be written to
+//				{target}	ps_3_0, vs_3_0, ...
+//				{defines}	-DNAME=value for every combo and the shader model
+//			e.g. -compiler "fxc /nologo /T {target} /E main /Fo {output} {defines} {source}"
+//			-defineflag changes the -D prefix.
+//
+//			-stubcompiler uses a built in stand-in that writes a few bytes
+//			derived from the job key, to exercise the scheduler and cache on
+//			machines without the compiler.
+//
+//			g++ -O2 -pthread -I../../public -o combobuild combobuild.cpp fxccombos.cpp fxcdeps.cpp
+//				fxcpreprocess.cpp shaderhash.cpp vcsreader.cpp vcswriter.cpp
+//
+//===========================================================================//
+
+#include "fxccombos.h"
+#include "fxcpreprocess.h"
+#include "fxcdeps.h"
+#include "shaderhash.h"
+#include "vcswriter.h"
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir( path, mode )	_mkdir( path )
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Work-stealing pool. Every job is queued up front, spread over the workers;
+// a worker takes from the back of its own queue and steals from the front of
+// the others when it runs dry.
+//-----------------------------------------------------------------------------
+class CWorkStealingPool
+{
+public:
+	void Run( int nThreads, int nJobs, const std::function< void( int ) > &fnJob )
+	{
+		if ( nThreads < 1 )
+		{
+			nThreads = 1;
+		}
+
+		m_Queues.clear();
+		for ( int i = 0; i < nThreads; ++i )
+		{
+			m_Queues.push_back( std::unique_ptr< WorkerQueue_t >( new WorkerQueue_t ) );
+		}
+
+		// Contiguous runs keep neighbouring combos on one worker
+		for ( int i = 0; i < nJobs; ++i )
+		{
+			m_Queues[(int)( (int64_t)i * nThreads / nJobs )]->m_Jobs.push_back( i );
+		}
+
+		std::vector< std::thread > threads;
+		for ( int i = 0; i < nThreads; ++i )
+		{
+			threads.push_back( std::thread( [this, i, &fnJob]() { WorkerMain( i, fnJob ); } ) );
+		}
+		for ( size_t i = 0; i < threads.size(); ++i )
+		{
+			threads[i].join();
+		}
+	}
+
+private:
+	struct WorkerQueue_t
+	{
+		std::mutex m_Mutex;
+		std::deque< int > m_Jobs;
+	};
+
+	bool TakeJob( int nWorker, int &nJob )
+	{
+		{
+			WorkerQueue_t &own = *m_Queues[nWorker];
+			std::lock_guard< std::mutex > lock( own.m_Mutex );
+			if ( !own.m_Jobs.empty() )
+			{
+				nJob = own.m_Jobs.back();
+				own.m_Jobs.pop_back();
+				return true;
+			}
+		}
+
+		for ( size_t i = 1; i < m_Queues.size(); ++i )
+		{
+			WorkerQueue_t &victim = *m_Queues[( nWorker + i ) % m_Queues.size()];
+			std::lock_guard< std::mutex > lock( victim.m_Mutex );
+			if ( !victim.m_Jobs.empty() )
+			{
+				nJob = victim.m_Jobs.front();
+				victim.m_Jobs.pop_front();
+				return true;
+			}
+		}
+
+		// Nothing queues new jobs, so once every queue is empty we're done
+		return false;
+	}
+
+	void WorkerMain( int nWorker, const std::function< void( int ) > &fnJob )
+	{
+		int nJob;
+		while ( TakeJob( nWorker, nJob ) )
+		{
+			fnJob( nJob );
+		}
+	}
+
+	std::vector< std::unique_ptr< WorkerQueue_t > > m_Queues;
+};
+
+
+//-----------------------------------------------------------------------------
+// Build settings and state
+//-----------------------------------------------------------------------------
+struct BuildOptions_t
+{
+	int m_nShaderModel;
+	int m_nThreads;
+	std::string m_CacheDirectory;
+	std::string m_OutputDirectory;
+	std::string m_Compiler;
+	std::string m_DefineFlag;
+	bool m_bStubCompiler;
+	bool m_bForce;
+};
+
+struct ShaderBuild_t
+{
+	std::string m_FileName;
+	CFxcComboSpace m_Space;
+	std::string m_Target;				// ps_3_0
+	std::string m_ShaderModelDefine;	// SHADER_MODEL_PS_3_0
+	uint32_t m_nFingerprint;			// of the .fxc and everything it includes
+	bool m_bUpToDate;					// the .vcs was built from the same sources
+};
+
+struct ComboJob_t
+{
+	int m_nShader;
+	uint32 m_nStaticCombo;			// static index / dynamic combo count, as in the .vcs
+
+	// Results
+	bool m_bOk;
+	bool m_bCacheHit;
+	int m_nCompiled;
+	std::vector< uint8_t > m_Data;	// the static combo as stored in the .vcs
+	std::string m_Error;
+};
+
+static bool ReadWholeFile( const std::string &fileName, std::vector< uint8_t > &data )
+{
+	FILE *fp = fopen( fileName.c_str(), "rb" );
+	if ( !fp )
+		return false;
+
+	data.clear();
+	uint8_t buf[16384];
+	size_t nRead;
+	while ( ( nRead = fread( buf, 1, sizeof( buf ), fp ) ) > 0 )
+	{
+		data.insert( data.end(), buf, buf + nRead );
+	}
+	fclose( fp );
+	return true;
+}
+
+// Writes next to the destination and renames, so a crash never leaves a half written cache entry
+static bool WriteFileAtomic( const std::string &fileName, const std::vector< uint8_t > &data )
+{
+	char szTemp[64];
+	snprintf( szTemp, sizeof( szTemp ), ".tmp%llu", (unsigned long long)std::hash< std::thread::id >()( std::this_thread::get_id() ) );
+	std::string tempName = fileName + szTemp;
+
+	FILE *fp = fopen( tempName.c_str(), "wb" );
+	if ( !fp )
+		return false;
+
+	bool bOk = data.empty() || fwrite( data.data(), 1, data.size(), fp ) == data.size();
+	bOk = ( fclose( fp ) == 0 ) && bOk;
+#ifdef _WIN32
+	remove( fileName.c_str() );
+#endif
+	bOk = bOk && rename( tempName.c_str(), fileName.c_str() ) == 0;
+	if ( !bOk )
+	{
+		remove( tempName.c_str() );
+	}
+	return bOk;
+}
+
+static void ReplaceAll( std::string &text, const char *pFind, const std::string &replacement )
+{
+	size_t nFindLength = strlen( pFind );
+	for ( size_t nPos = text.find( pFind ); nPos != std::string::npos; nPos = text.find( pFind, nPos + replacement.size() ) )
+	{
+		text.replace( nPos, nFindLength, replacement );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// One static combo
+//-----------------------------------------------------------------------------
+static void RunJob( ComboJob_t &job, const ShaderBuild_t &shader, const BuildOptions_t &options, CFxcSourceCache &sourceCache )
+{
+	const CFxcComboSpace &space = shader.m_Space;
+	const std::vector< FxcComboVar_t > &vars = space.GetVars();
+	int nDynamicVars = space.GetDynamicVarCount();
+	uint64_t nDynamicCombos = space.GetDynamicComboCount();
+
+	job.m_bOk = false;
+	job.m_bCacheHit = false;
+	job.m_nCompiled = 0;
+
+	// Dynamic combos of this static combo that survive the SKIP rules
+	std::vector< int > values( vars.size() );
+	std::vector< uint32 > dynamicCombos;
+	for ( uint64_t nDynamic = 0; nDynamic < nDynamicCombos; ++nDynamic )
+	{
+		space.DecodeCombo( (uint64_t)job.m_nStaticCombo * nDynamicCombos + nDynamic, values.data() );
+		if ( !space.IsSkipped( values.data() ) )
+		{
+			dynamicCombos.push_back( (uint32)nDynamic );
+		}
+	}
+
+	if ( dynamicCombos.empty() )
+	{
+		job.m_bOk = true;
+		return;
+	}
+
+	// Key: the source the compiler sees, with the dynamic combos left varying
+	CFxcPreprocessor preprocessor( sourceCache );
+	preprocessor.Define( shader.m_ShaderModelDefine.c_str(), 1 );
+	std::string comboValues;
+	for ( size_t i = 0; i < vars.size(); ++i )
+	{
+		if ( (int)i < nDynamicVars )
+		{
+			preprocessor.DefineVarying( vars[i].m_Name.c_str() );
+		}
+		else
+		{
+			preprocessor.Define( vars[i].m_Name.c_str(), values[i] );
+			comboValues += vars[i].m_Name + "=" + std::to_string( values[i] ) + ";";
+		}
+	}
+
+	ShaderContentHash_t sourceHash;
+	if ( !preprocessor.Run( shader.m_FileName.c_str(), &sourceHash, job.m_Error ) )
+		return;
+
+	std::string compiler = options.m_bStubCompiler ? std::string( "<stub>" ) : options.m_Compiler + "|" + options.m_DefineFlag;
+	ShaderContentHash_t key;
+	ShaderContentHash_Init( &key );
+	ShaderContentHash_ProcessBuffer( &key, &sourceHash, sizeof( sourceHash.m_nCRC ) );
+	ShaderContentHash_ProcessBuffer( &key, &sourceHash.m_nHash, sizeof( sourceHash.m_nHash ) );
+	ShaderContentHash_ProcessBuffer( &key, shader.m_Target.data(), shader.m_Target.size() + 1 );
+	ShaderContentHash_ProcessBuffer( &key, comboValues.data(), comboValues.size() + 1 );
+	ShaderContentHash_ProcessBuffer( &key, compiler.data(), compiler.size() + 1 );
+	ShaderContentHash_ProcessBuffer( &key, dynamicCombos.data(), dynamicCombos.size() * sizeof( uint32 ) );
+	ShaderContentHash_Final( &key );
+
+	char szKey[32];
+	ShaderContentHash_ToString( key, szKey, sizeof( szKey ) );
+	std::string cacheDirectory = options.m_CacheDirectory + "/" + std::string( szKey, 2 );
+	std::string cacheFile = cacheDirectory + "/" + szKey + ".combo";
+
+	if ( !options.m_bForce && ReadWholeFile( cacheFile, job.m_Data ) )
+	{
+		job.m_bCacheHit = true;
+		job.m_bOk = true;
+		return;
+	}
+
+	// Compile every dynamic combo
+	std::vector< std::vector< uint8_t > > shaders( dynamicCombos.size() );
+	std::vector< VcsDynamicCombo_t > combos( dynamicCombos.size() );
+	for ( size_t i = 0; i < dynamicCombos.size(); ++i )
+	{
+		space.DecodeCombo( (uint64_t)job.m_nStaticCombo * nDynamicCombos + dynamicCombos[i], values.data() );
+
+		if ( options.m_bStubCompiler )
+		{
+			char szStub[64];
+			int nLength = snprintf( szStub, sizeof( szStub ), "stub %s %u", szKey, dynamicCombos[i] );
+			shaders[i].assign( szStub, szStub + nLength );
+		}
+		else
+		{
+			std::string defines = options.m_DefineFlag + shader.m_ShaderModelDefine + "=1";
+			for ( size_t j = 0; j < vars.size(); ++j )
+			{
+				defines += " " + options.m_DefineFlag + vars[j].m_Name + "=" + std::to_string( values[j] );
+			}
+
+			std::string output = options.m_CacheDirectory + "/tmp/" + szKey + "_" + std::to_string( dynamicCombos[i] ) + ".o";
+			std::string command = options.m_Compiler;
+			ReplaceAll( command, "{source}", shader.m_FileName );
+			ReplaceAll( command, "{output}", output );
+			ReplaceAll( command, "{target}", shader.m_Target );
+			ReplaceAll( command, "{defines}", defines );
+
+			int nResult = system( command.c_str() );
+			bool bRead = ( nResult == 0 ) && ReadWholeFile( output, shaders[i] );
+			remove( output.c_str() );
+			if ( !bRead )
+			{
+				job.m_Error = "compile failed: " + command;
+				return;
+			}
+		}
+
+		combos[i].m_nDynamicComboID = dynamicCombos[i];
+		combos[i].m_nSize = (uint32)shaders[i].size();
+		combos[i].m_pData = shaders[i].data();
+		++job.m_nCompiled;
+	}
+
+	CVcsWriter::PackStoredBlocks( combos.data(), (int)combos.size(), job.m_Data );
+
+	mkdir( cacheDirectory.c_str(), 0755 );
+	if ( !WriteFileAtomic( cacheFile, job.m_Data ) )
+	{
+		// Not fatal, it just gets compiled again next time
+		fprintf( stderr, "warning: unable to write %s\n", cacheFile.c_str() );
+	}
+
+	job.m_bOk = true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Shader setup
+//-----------------------------------------------------------------------------
+static void SetShaderTarget( ShaderBuild_t &shader, int nShaderModel )
+{
+	// Shader names end in _ps30, _vs20, ...
+	bool bVertexShader = shader.m_Space.GetShaderName().find( "_vs" ) != std::string::npos;
+	const char *pVersion = ( nShaderModel >= 30 ) ? "3_0" : ( bVertexShader ? "2_0" : "2_b" );
+
+	shader.m_Target = std::string( bVertexShader ? "vs_" : "ps_" ) + pVersion;
+	shader.m_ShaderModelDefine = std::string( bVertexShader ? "SHADER_MODEL_VS_" : "SHADER_MODEL_PS_" ) + pVersion;
+	for ( size_t i = 0; i < shader.m_ShaderModelDefine.size(); ++i )
+	{
+		shader.m_ShaderModelDefine[i] = (char)toupper( (unsigned char)shader.m_ShaderModelDefine[i] );
+	}
+}
+
+static void PrintUsage()
+{
+	printf( "usage: combobuild [-ver 30] [-threads N] [-cache dir] [-out dir] [-force] [-defineflag -D]\n"
+			"                  (-compiler \"<command>\" | -stubcompiler) <file.fxc | list.txt> ...\n" );
+}
+
+int main( int argc, char **argv )
+{
+	BuildOptions_t options;
+	options.m_nShaderModel = 30;
+	options.m_nThreads = (int)std::thread::hardware_concurrency();
+	options.m_CacheDirectory = "shadercache";
+	options.m_OutputDirectory = ".";
+	options.m_DefineFlag = "-D";
+	options.m_bStubCompiler = false;
+	options.m_bForce = false;
+
+	std::vector< std::string > files;
+	for ( int i = 1; i < argc; ++i )
+	{
+		bool bHasValue = ( i + 1 < argc );
+		if ( !strcmp( argv[i], "-ver" ) && bHasValue )
+		{
+			options.m_nShaderModel = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-threads" ) && bHasValue )
+		{
+			options.m_nThreads = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-cache" ) && bHasValue )
+		{
+			options.m_CacheDirectory = argv[++i];
+		}
+		else if ( !strcmp( argv[i], "-out" ) && bHasValue )
+		{
+			options.m_OutputDirectory = argv[++i];
+		}
+		else if ( !strcmp( argv[i], "-compiler" ) && bHasValue )
+		{
+			options.m_Compiler = argv[++i];
+		}
+		else if ( !strcmp( argv[i], "-defineflag" ) && bHasValue )
+		{
+			options.m_DefineFlag = argv[++i];
+		}
+		else if ( !strcmp( argv[i], "-stubcompiler" ) )
+		{
+			options.m_bStubCompiler = true;
+		}
+		else if ( !strcmp( argv[i], "-force" ) )
+		{
+			options.m_bForce = true;
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else if ( !FxcAddShaderArgument( argv[i], files ) )
+		{
+			fprintf( stderr, "unable to open %s\n", argv[i] );
+			return 1;
+		}
+	}
+
+	if ( files.empty() || ( options.m_Compiler.empty() && !options.m_bStubCompiler ) )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	mkdir( options.m_CacheDirectory.c_str(), 0755 );
+	mkdir( ( options.m_CacheDirectory + "/tmp" ).c_str(), 0755 );
+	mkdir( options.m_OutputDirectory.c_str(), 0755 );
+
+	// Expand every shader that changed into static combo jobs
+	CFxcSourceCache sourceCache;
+	CShaderDependencyGraph dependencies( sourceCache );
+	std::vector< std::unique_ptr< ShaderBuild_t > > shaders;
+	std::vector< ComboJob_t > jobs;
+	for ( size_t i = 0; i < files.size(); ++i )
+	{
+		ShaderBuild_t *pShader = new ShaderBuild_t;
+		shaders.push_back( std::unique_ptr< ShaderBuild_t >( pShader ) );
+		pShader->m_FileName = files[i];
+
+		std::string error;
+		if ( !pShader->m_Space.Load( files[i].c_str(), options.m_nShaderModel, error ) )
+		{
+			fprintf( stderr, "%s\n", error.c_str() );
+			return 1;
+		}
+		SetShaderTarget( *pShader, options.m_nShaderModel );
+
+		pShader->m_nFingerprint = dependencies.GetFingerprint( dependencies.AddShader( files[i] ) );
+		pShader->m_bUpToDate = false;
+		if ( !options.m_bForce )
+		{
+			CVcsReader existing;
+			std::string outputName = options.m_OutputDirectory + "/" + pShader->m_Space.GetShaderName() + ".vcs";
+			if ( existing.Open( outputName.c_str(), error ) )
+			{
+				const ShaderHeader_t &header = existing.GetHeader();
+				pShader->m_bUpToDate = ( header.m_nSourceCRC32 == pShader->m_nFingerprint ) &&
+					( (uint64_t)header.m_nTotalCombos == pShader->m_Space.GetTotalComboCount() ) &&
+					( (uint64_t)header.m_nDynamicCombos == pShader->m_Space.GetDynamicComboCount() );
+			}
+		}
+		if ( pShader->m_bUpToDate )
+			continue;
+
+		for ( uint64_t nStatic = 0; nStatic < pShader->m_Space.GetStaticComboCount(); ++nStatic )
+		{
+			ComboJob_t job;
+			job.m_nShader = (int)i;
+			job.m_nStaticCombo = (uint32)nStatic;
+			jobs.push_back( job );
+		}
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	CWorkStealingPool pool;
+	pool.Run( options.m_nThreads, (int)jobs.size(), [&]( int nJob )
+	{
+		ComboJob_t &job = jobs[nJob];
+		RunJob( job, *shaders[job.m_nShader], options, sourceCache );
+	} );
+
+	double flSeconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count();
+
+	// Assemble the .vcs files
+	bool bOk = true;
+	for ( size_t i = 0; i < shaders.size(); ++i )
+	{
+		const ShaderBuild_t &shader = *shaders[i];
+		if ( shader.m_bUpToDate )
+		{
+			printf( "%s: up to date (sources 0x%08x)\n", shader.m_Space.GetShaderName().c_str(), shader.m_nFingerprint );
+			continue;
+		}
+
+		int nJobs = 0, nCacheHits = 0, nCompiledJobs = 0, nCompiledShaders = 0, nFailed = 0;
+
+		CVcsWriter writer;
+		for ( size_t j = 0; j < jobs.size(); ++j )
+		{
+			const ComboJob_t &job = jobs[j];
+			if ( job.m_nShader != (int)i || ( job.m_bOk && job.m_Data.empty() ) )
+				continue;
+
+			++nJobs;
+			if ( !job.m_bOk )
+			{
+				if ( nFailed++ < 10 )
+				{
+					fprintf( stderr, "%s static combo %u: %s\n", shader.m_Space.GetShaderName().c_str(), job.m_nStaticCombo, job.m_Error.c_str() );
+				}
+				continue;
+			}
+
+			nCacheHits += job.m_bCacheHit ? 1 : 0;
+			nCompiledJobs += job.m_bCacheHit ? 0 : 1;
+			nCompiledShaders += job.m_nCompiled;
+			writer.AddStaticCombo( job.m_nStaticCombo, job.m_Data.data(), (uint32)job.m_Data.size() );
+		}
+
+		printf( "%s: %d jobs, %d cached, %d compiled (%d shaders), %d failed\n", shader.m_Space.GetShaderName().c_str(),
+			nJobs, nCacheHits, nCompiledJobs, nCompiledShaders, nFailed );
+
+		if ( nFailed )
+		{
+			bOk = false;
+			continue;
+		}
+
+		ShaderHeader_t header;
+		memset( &header, 0, sizeof( header ) );
+		header.m_nTotalCombos = (int32)shader.m_Space.GetTotalComboCount();
+		header.m_nDynamicCombos = (int32)shader.m_Space.GetDynamicComboCount();
+		header.m_nSourceCRC32 = shader.m_nFingerprint;
+		writer.SetHeader( header );
+
+		std::string outputName = options.m_OutputDirectory + "/" + shader.m_Space.GetShaderName() + ".vcs";
+		VcsWriteStats_t stats;
+		std::string error;
+		if ( !writer.Write( outputName.c_str(), &stats, error ) )
+		{
+			fprintf( stderr, "%s\n", error.c_str() );
+			bOk = false;
+			continue;
+		}
+
+		printf( "  wrote %s, %d static combos, %d aliased, %llu bytes\n", outputName.c_str(), stats.m_nStaticCombos,
+			stats.m_nAliasedCombos, (unsigned long long)stats.m_nFileBytes );
+	}
+
+	printf( "%.1f seconds on %d threads\n", flSeconds, options.m_nThreads );
+	return bOk ? 0 : 1;
+}
@@ -0,0 +1,418 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Writes the combo index .inc of a shader from its .fxc.
+//
+//			comboinc [-ver 30] [-out dir] <file.fxc | list.txt> ...
+//
+//			The .inc has the _Static_Index and _Dynamic_Index classes the
+//			SET_*_SHADER macros in cshader.h use, with constant strides and
+//			plain int members, so GetIndex is a few multiply-adds. It also
+//			has a compile time descriptor:
+//
+//			<shader>_Combos			enums with each axis's range, stride and bit
+//			<shader>_Combo_Builder	constexpr builder. Each Set returns a builder
+//									with that axis marked, and GetStaticIndex,
+//									GetDynamicIndex and IsSkipped static_assert
+//									that every axis they read is set.
+//
+//			static_assert( pbr_vs30_Combo_Builder<>().SetWORLD_NORMAL( 0 ).SetLIGHTMAPPED( 1 ).GetStaticIndex() == 80, "" );
+//
+//			The .inc goes to -out, by default the include directory next to
+//			the .fxc.
+//
+//			g++ -O2 -o comboinc comboinc.cpp fxccombos.cpp
+//
+//===========================================================================//
+
+#include "fxccombos.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//-----------------------------------------------------------------------------
+// Writing the .inc
+//-----------------------------------------------------------------------------
+class CComboIncWriter
+{
+public:
+	CComboIncWriter( const CFxcComboSpace &space, FILE *fp ) :
+		m_Space( space ), m_Vars( space.GetVars() ), m_pName( space.GetShaderName().c_str() ), m_fp( fp )
+	{
+		m_pPrefix = ( space.GetShaderName().find( "_vs" ) != std::string::npos ) ? "vsh" : "psh";
+		CollectSkipRules();
+	}
+
+	void Write()
+	{
+		fprintf( m_fp, "// ALL SKIP STATEMENTS THAT AFFECT THIS SHADER!!!\n" );
+		for ( size_t i = 0; i < m_Space.GetSkipRules().size(); ++i )
+		{
+			fprintf( m_fp, "// %s\n", m_Space.GetSkipRules()[i].m_Text.c_str() );
+		}
+		fprintf( m_fp, "\n// Written by comboinc, don't edit.\n" );
+		fprintf( m_fp, "#pragma once\n#include \"shaderlib/cshader.h\"\n\n" );
+
+		WriteDescriptor();
+		WriteBuilder();
+		WriteIndexClass( true );
+		WriteIndexClass( false );
+	}
+
+private:
+	bool IsStatic( size_t nSlot ) const { return (int)nSlot >= m_Space.GetDynamicVarCount(); }
+
+	unsigned int AxisMask( bool bStatic ) const
+	{
+		unsigned int nMask = 0;
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			nMask |= ( IsStatic( i ) == bStatic ) ? ( 1u << i ) : 0;
+		}
+		return nMask;
+	}
+
+	// Each distinct SKIP rule once. Rules that never match, like the
+	// LIGHTING_PREVIEW ones on shaders without that combo, are left out.
+	void CollectSkipRules()
+	{
+		std::vector< int > slots;
+		for ( size_t i = 0; i < m_Space.GetSkipRules().size(); ++i )
+		{
+			const CFxcExpression &expr = m_Space.GetSkipRules()[i].m_Expr;
+			if ( !CanMatch( expr ) )
+				continue;
+
+			SkipRule_t rule;
+			rule.m_Cpp = expr.ToCpp( m_Vars, "m_n" );
+			rule.m_Text = expr.ToCpp( m_Vars, "" );
+			rule.m_nAxes = 0;
+			expr.GetReferencedSlots( slots );
+			for ( size_t j = 0; j < slots.size(); ++j )
+			{
+				rule.m_nAxes |= 1u << slots[j];
+			}
+
+			bool bDuplicate = false;
+			for ( size_t j = 0; j < m_SkipRules.size(); ++j )
+			{
+				bDuplicate = bDuplicate || ( m_SkipRules[j].m_Cpp == rule.m_Cpp );
+			}
+			if ( !bDuplicate )
+			{
+				m_SkipRules.push_back( rule );
+			}
+		}
+	}
+
+	unsigned int SkipAxisMask() const
+	{
+		unsigned int nMask = 0;
+		for ( size_t i = 0; i < m_SkipRules.size(); ++i )
+		{
+			nMask |= m_SkipRules[i].m_nAxes;
+		}
+		return nMask;
+	}
+
+	// Does the rule match any combo? Too large a space is assumed to.
+	bool CanMatch( const CFxcExpression &expr ) const
+	{
+		const uint64_t nMaxCombos = 1 << 24;
+		if ( m_Space.GetTotalComboCount() > nMaxCombos )
+			return true;
+
+		std::vector< int > values( m_Vars.size() );
+		for ( uint64_t nCombo = 0; nCombo < m_Space.GetTotalComboCount(); ++nCombo )
+		{
+			m_Space.DecodeCombo( nCombo, values.data() );
+			if ( expr.Evaluate( values.data() ) )
+				return true;
+		}
+		return false;
+	}
+
+	// The stride-weighted sum of one side's axes
+	std::string IndexExpression( bool bStatic, const char *pMemberPrefix ) const
+	{
+		std::string expression;
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			if ( IsStatic( i ) != bStatic )
+				continue;
+
+			const std::string &name = m_Vars[i].m_Name;
+			std::string value = pMemberPrefix + name;
+			if ( m_Vars[i].m_nMin != 0 )
+			{
+				value = "( " + value + " - " + name + "_MIN )";
+			}
+			expression += ( expression.empty() ? "" : " + " ) + std::string( "( " ) + name + "_STRIDE * " + value + " )";
+		}
+		return expression.empty() ? std::string( "0" ) : expression;
+	}
+
+	void WriteDescriptor()
+	{
+		fprintf( m_fp,
+			"//-----------------------------------------------------------------------------\n"
+			"// Combo axes. Strides are into the combined index; the static axes start\n"
+			"// at the dynamic combo count.\n"
+			"//-----------------------------------------------------------------------------\n" );
+		fprintf( m_fp, "struct %s_Combos\n{\n\tenum\n\t{\n", m_pName );
+		fprintf( m_fp, "\t\tNUM_DYNAMIC_COMBOS = %llu,\n", (unsigned long long)m_Space.GetDynamicComboCount() );
+		fprintf( m_fp, "\t\tNUM_STATIC_COMBOS = %llu,\n", (unsigned long long)m_Space.GetStaticComboCount() );
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			const FxcComboVar_t &var = m_Vars[i];
+			fprintf( m_fp, "\n\t\t%s_MIN = %d,\n\t\t%s_MAX = %d,\n\t\t%s_STRIDE = %llu,\n\t\t%s_BIT = 0x%x,\n",
+				var.m_Name.c_str(), var.m_nMin, var.m_Name.c_str(), var.m_nMax,
+				var.m_Name.c_str(), (unsigned long long)m_Space.GetStride( (int)i ), var.m_Name.c_str(), 1u << i );
+		}
+		fprintf( m_fp, "\n\t\tDYNAMIC_AXES = 0x%x,\n", AxisMask( false ) );
+		fprintf( m_fp, "\t\tSTATIC_AXES = 0x%x,\n", AxisMask( true ) );
+		fprintf( m_fp, "\t\tSKIP_AXES = 0x%x,\t// read by the SKIP rules\n", SkipAxisMask() );
+		fprintf( m_fp, "\t};\n};\n\n\n" );
+	}
+
+	// The constructor arguments, with slot nReplace passed as pReplacement
+	std::string MemberList( int nReplace, const char *pReplacement ) const
+	{
+		std::string list;
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			list += ( i ? ", " : "" ) + ( (int)i == nReplace ? std::string( pReplacement ) : "m_n" + m_Vars[i].m_Name );
+		}
+		return list;
+	}
+
+	void WriteBuilder()
+	{
+		fprintf( m_fp,
+			"//-----------------------------------------------------------------------------\n"
+			"// Compile time combo builder. nSetMask has a bit per axis that was set.\n"
+			"//-----------------------------------------------------------------------------\n" );
+		fprintf( m_fp, "template < unsigned int nSetMask = 0 >\nclass %s_Combo_Builder : public %s_Combos\n{\npublic:\n", m_pName, m_pName );
+
+		// Constructors
+		fprintf( m_fp, "\tconstexpr %s_Combo_Builder() :", m_pName );
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			fprintf( m_fp, "%s m_n%s( 0 )", i ? "," : "", m_Vars[i].m_Name.c_str() );
+		}
+		fprintf( m_fp, "\n\t{\n\t}\n\n\tconstexpr %s_Combo_Builder(", m_pName );
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			fprintf( m_fp, "%s int n%s", i ? "," : "", m_Vars[i].m_Name.c_str() );
+		}
+		fprintf( m_fp, " ) :" );
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			fprintf( m_fp, "%s m_n%s( n%s )", i ? "," : "", m_Vars[i].m_Name.c_str(), m_Vars[i].m_Name.c_str() );
+		}
+		fprintf( m_fp, "\n\t{\n\t}\n" );
+
+		// Setters
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			const char *pVar = m_Vars[i].m_Name.c_str();
+			fprintf( m_fp, "\n\tconstexpr %s_Combo_Builder< nSetMask | %s_BIT > Set%s( int i ) const\n\t{\n", m_pName, pVar, pVar );
+			fprintf( m_fp, "\t\tstatic_assert( !( nSetMask & %s_BIT ), \"%s: %s is set twice\" );\n", pVar, m_pName, pVar );
+			fprintf( m_fp, "\t\treturn %s_Combo_Builder< nSetMask | %s_BIT >( %s );\n\t}\n", m_pName, pVar, MemberList( (int)i, "i" ).c_str() );
+		}
+
+		// Index getters
+		for ( int nStatic = 1; nStatic >= 0; --nStatic )
+		{
+			const char *pSide = nStatic ? "Static" : "Dynamic";
+			const char *pAxes = nStatic ? "STATIC_AXES" : "DYNAMIC_AXES";
+			fprintf( m_fp, "\n\tconstexpr int Get%sIndex() const\n\t{\n", pSide );
+			fprintf( m_fp, "\t\tstatic_assert( ( nSetMask & %s ) == %s, \"%s: a %s combo isn't set\" );\n", pAxes, pAxes, m_pName, nStatic ? "static" : "dynamic" );
+			fprintf( m_fp, "\t\treturn %s;\n\t}\n", IndexExpression( nStatic != 0, "m_n" ).c_str() );
+		}
+
+		fprintf( m_fp, "\n\t// True if a SKIP rule leaves the combo out of the .vcs\n" );
+		fprintf( m_fp, "\tconstexpr bool IsSkipped() const\n\t{\n" );
+		fprintf( m_fp, "\t\tstatic_assert( ( nSetMask & SKIP_AXES ) == SKIP_AXES, \"%s: a combo read by the SKIP rules isn't set\" );\n", m_pName );
+		if ( m_SkipRules.empty() )
+		{
+			fprintf( m_fp, "\t\treturn false;\n\t}\n" );
+		}
+		else
+		{
+			for ( size_t i = 0; i < m_SkipRules.size(); ++i )
+			{
+				fprintf( m_fp, "%s%s", i ? "\n\t\t\t|| " : "\t\treturn ", m_SkipRules[i].m_Cpp.c_str() );
+			}
+			fprintf( m_fp, ";\n\t}\n" );
+		}
+
+		fprintf( m_fp, "\nprivate:\n" );
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			fprintf( m_fp, "\tint m_n%s;\n", m_Vars[i].m_Name.c_str() );
+		}
+		fprintf( m_fp, "};\n\n\n" );
+	}
+
+	// The classes DECLARE_*_SHADER declares
+	void WriteIndexClass( bool bStatic )
+	{
+		const char *pSide = bStatic ? "Static" : "Dynamic";
+		const char *pLowerSide = bStatic ? "static" : "dynamic";
+		fprintf( m_fp, "class %s_%s_Index : public %s_Combos\n{\n", m_pName, pSide, m_pName );
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			if ( IsStatic( i ) == bStatic )
+			{
+				fprintf( m_fp, "\tint m_n%s;\n", m_Vars[i].m_Name.c_str() );
+			}
+		}
+		fprintf( m_fp, "public:\n" );
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			if ( IsStatic( i ) != bStatic )
+				continue;
+
+			const char *pVar = m_Vars[i].m_Name.c_str();
+			fprintf( m_fp, "\tvoid Set%s( int i )\n\t{\n\t\tAssert( i >= %s_MIN && i <= %s_MAX );\n\t\tm_n%s = i;\n\t}\n\n", pVar, pVar, pVar, pVar );
+		}
+
+		fprintf( m_fp, "\t%s_%s_Index()\n\t{\n", m_pName, pSide );
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			if ( IsStatic( i ) == bStatic )
+			{
+				fprintf( m_fp, "\t\tm_n%s = %s_MIN;\n", m_Vars[i].m_Name.c_str(), m_Vars[i].m_Name.c_str() );
+			}
+		}
+		fprintf( m_fp, "\t}\n\n" );
+
+		// Combos a SKIP rule on this side alone removes are asserted against
+		fprintf( m_fp, "\tint GetIndex() const\n\t{\n" );
+		unsigned int nSideAxes = AxisMask( bStatic );
+		for ( size_t i = 0; i < m_SkipRules.size(); ++i )
+		{
+			const SkipRule_t &rule = m_SkipRules[i];
+			if ( rule.m_nAxes && ( rule.m_nAxes & ~nSideAxes ) == 0 )
+			{
+				fprintf( m_fp, "\t\tAssertMsg( !%s, \"Invalid combo combination %s\" );\n", rule.m_Cpp.c_str(), rule.m_Text.c_str() );
+			}
+		}
+		fprintf( m_fp, "\t\treturn %s;\n\t}\n};\n\n", IndexExpression( bStatic, "m_n" ).c_str() );
+
+		// Every combo left unset is an undeclared variable in SET_*_SHADER
+		std::string test;
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			if ( IsStatic( i ) == bStatic )
+			{
+				test += ( test.empty() ? "" : " + " ) + std::string( m_pPrefix ) + "_forgot_to_set_" + pLowerSide + "_" + m_Vars[i].m_Name;
+			}
+		}
+		fprintf( m_fp, "#define shader%sTest_%s %s\n\n\n", pSide, m_pName, test.empty() ? "0" : test.c_str() );
+	}
+
+	struct SkipRule_t
+	{
+		std::string m_Cpp;		// reading the m_n members
+		std::string m_Text;		// for messages
+		unsigned int m_nAxes;
+	};
+
+	const CFxcComboSpace &m_Space;
+	const std::vector< FxcComboVar_t > &m_Vars;
+	std::vector< SkipRule_t > m_SkipRules;
+	const char *m_pName;
+	const char *m_pPrefix;
+	FILE *m_fp;
+};
+
+
+static void PrintUsage()
+{
+	printf( "usage: comboinc [-ver 30] [-out dir] <file.fxc | list.txt> ...\n" );
+}
+
+int main( int argc, char **argv )
+{
+	int nShaderModel = 30;
+	const char *pOutputDirectory = NULL;
+	std::vector< std::string > files;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !strcmp( argv[i], "-ver" ) && i + 1 < argc )
+		{
+			nShaderModel = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-out" ) && i + 1 < argc )
+		{
+			pOutputDirectory = argv[++i];
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else if ( !FxcAddShaderArgument( argv[i], files ) )
+		{
+			fprintf( stderr, "unable to open %s\n", argv[i] );
+			return 1;
+		}
+	}
+
+	if ( files.empty() )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	for ( size_t i = 0; i < files.size(); ++i )
+	{
+		CFxcComboSpace space;
+		std::string error;
+		if ( !space.Load( files[i].c_str(), nShaderModel, error ) )
+		{
+			fprintf( stderr, "%s\n", error.c_str() );
+			return 1;
+		}
+
+		if ( space.GetVars().size() > 32 )
+		{
+			fprintf( stderr, "%s: more than 32 combos\n", files[i].c_str() );
+			return 1;
+		}
+
+		std::string directory;
+		if ( pOutputDirectory )
+		{
+			directory = std::string( pOutputDirectory ) + "/";
+		}
+		else
+		{
+			size_t nSlash = files[i].find_last_of( "/\\" );
+			directory = ( ( nSlash == std::string::npos ) ? std::string() : files[i].substr( 0, nSlash + 1 ) ) + "include/";
+		}
+
+		std::string outputName = directory + space.GetShaderName() + ".inc";
+		FILE *fp = fopen( outputName.c_str(), "wt" );
+		if ( !fp )
+		{
+			fprintf( stderr, "unable to write %s\n", outputName.c_str() );
+			return 1;
+		}
+
+		CComboIncWriter writer( space, fp );
+		writer.Write();
+		if ( fclose( fp ) != 0 )
+		{
+			fprintf( stderr, "unable to write %s\n", outputName.c_str() );
+			return 1;
+		}
+
+		printf( "%s\n", outputName.c_str() );
+	}
+
+	return 0;
+}
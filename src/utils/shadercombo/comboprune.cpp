@@ -0,0 +1,546 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Suggests SKIP rules from recorded combo usage.
+//
+//			comboprune [-ver 30] [-terms 3] [-rules 10] [-rare N] [-vcs dir]
+//					   [-compiletime seconds] -usage <file> [-usage <file> ...]
+//					   <file.fxc | list.txt> ...
+//
+//			The usage files are mat_pbr_combousage dumps (see
+//			shaderlib_combousage.cpp); several sessions can be merged. For
+//			each shader with usage data, regions of up to -terms static
+//			combo values (LIGHTWARPTEXTURE=1 && SUBSURFACESCATTERING=1) are
+//			ranked by the compiles they cost:
+//
+//			- never hit regions become candidate SKIP lines, picked greedily
+//			  by the compiles they save over the rules picked before them
+//			- regions hit at most -rare times are listed, but not suggested
+//
+//			Every candidate is parsed back and evaluated against every combo
+//			in the profiles, and the run fails if one of them would skip a
+//			used combo. Savings are in shaders compiled; -vcs reads the
+//			current .vcs files for the bytes, and -compiletime (average
+//			seconds per compiled shader) turns compiles into time.
+//
+//			Profiles only cover what the sessions did. Merge several before
+//			trusting a rule.
+//
+//			g++ -O2 -I../../public -o comboprune comboprune.cpp fxccombos.cpp vcsreader.cpp
+//
+//===========================================================================//
+
+#include "fxccombos.h"
+#include "vcsreader.h"
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//-----------------------------------------------------------------------------
+// Usage dumps
+//-----------------------------------------------------------------------------
+struct ShaderUsage_t
+{
+	std::map< int, uint64_t > m_StaticHits;				// .inc static index -> snapshots + draws
+	std::map< uint64_t, uint64_t > m_ComboHits;			// static + dynamic index -> draws
+};
+
+typedef std::map< std::string, ShaderUsage_t > Usage_t;
+
+static bool ReadUsage( const char *pFileName, Usage_t &usage )
+{
+	FILE *fp = fopen( pFileName, "rt" );
+	if ( !fp )
+		return false;
+
+	char szLine[512];
+	while ( fgets( szLine, sizeof( szLine ), fp ) )
+	{
+		char szShader[256], szPass[32];
+		int nStatic, nDynamic;
+		unsigned long long nCount;
+		if ( sscanf( szLine, "%255[^\t]\t%31[^\t]\t%d\t%d\t%llu", szShader, szPass, &nStatic, &nDynamic, &nCount ) != 5 )
+			continue;	// the header
+
+		ShaderUsage_t &shader = usage[szShader];
+		shader.m_StaticHits[nStatic] += nCount;
+		if ( nDynamic >= 0 )
+		{
+			shader.m_ComboHits[(uint64_t)nStatic + nDynamic] += nCount;
+		}
+	}
+
+	fclose( fp );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Per static combo costs and hits
+//-----------------------------------------------------------------------------
+struct StaticCombo_t
+{
+	std::vector< int > m_Values;	// every slot; dynamic slots at their minimum
+	int m_nCompiles;				// dynamic combos that survive the SKIP rules
+	uint64_t m_nBytes;				// in the .vcs, if known
+	uint64_t m_nHits;
+};
+
+// A conjunction of static var == value terms
+struct Region_t
+{
+	std::vector< std::pair< int, int > > m_Terms;	// slot, value
+	int m_nStaticCombos;
+	uint64_t m_nCompiles;
+	uint64_t m_nBytes;
+	uint64_t m_nHits;
+};
+
+static bool RegionContains( const Region_t &region, const StaticCombo_t &combo )
+{
+	for ( size_t i = 0; i < region.m_Terms.size(); ++i )
+	{
+		if ( combo.m_Values[region.m_Terms[i].first] != region.m_Terms[i].second )
+			return false;
+	}
+	return true;
+}
+
+static std::string DescribeRegion( const Region_t &region, const std::vector< FxcComboVar_t > &vars )
+{
+	std::string text;
+	for ( size_t i = 0; i < region.m_Terms.size(); ++i )
+	{
+		text += ( i ? " && " : "" ) + vars[region.m_Terms[i].first].m_Name + "=" + std::to_string( region.m_Terms[i].second );
+	}
+	return text;
+}
+
+static std::string RegionSkipLine( const Region_t &region, const std::vector< FxcComboVar_t > &vars )
+{
+	std::string text;
+	for ( size_t i = 0; i < region.m_Terms.size(); ++i )
+	{
+		text += ( i ? " && " : "" ) + std::string( "( $" ) + vars[region.m_Terms[i].first].m_Name + " == " + std::to_string( region.m_Terms[i].second ) + " )";
+	}
+	return text;
+}
+
+// Every region of up to nMaxTerms terms over the static slots, in slot order
+static void EnumerateRegions( const CFxcComboSpace &space, int nFirstSlot, int nMaxTerms, Region_t &region, std::vector< Region_t > &regions )
+{
+	const std::vector< FxcComboVar_t > &vars = space.GetVars();
+	for ( int nSlot = nFirstSlot; nSlot < (int)vars.size(); ++nSlot )
+	{
+		for ( int nValue = vars[nSlot].m_nMin; nValue <= vars[nSlot].m_nMax; ++nValue )
+		{
+			region.m_Terms.push_back( std::make_pair( nSlot, nValue ) );
+			regions.push_back( region );
+			if ( (int)region.m_Terms.size() < nMaxTerms )
+			{
+				EnumerateRegions( space, nSlot + 1, nMaxTerms, region, regions );
+			}
+			region.m_Terms.pop_back();
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// One shader
+//-----------------------------------------------------------------------------
+struct PruneOptions_t
+{
+	int m_nMaxTerms;
+	int m_nMaxRules;
+	uint64_t m_nRareHits;
+	const char *m_pVcsDirectory;
+	double m_flCompileTime;		// seconds per compile
+};
+
+static void PrintRegion( const char *pPrefix, const Region_t &region, const std::vector< FxcComboVar_t > &vars,
+						 const PruneOptions_t &options, bool bHaveBytes )
+{
+	printf( "%s%-60s %5d static, %7llu compiles", pPrefix, DescribeRegion( region, vars ).c_str(),
+		region.m_nStaticCombos, (unsigned long long)region.m_nCompiles );
+	if ( options.m_flCompileTime > 0 )
+	{
+		printf( ", %.0fs", options.m_flCompileTime * region.m_nCompiles );
+	}
+	if ( bHaveBytes )
+	{
+		printf( ", %llu bytes", (unsigned long long)region.m_nBytes );
+	}
+	if ( region.m_nHits )
+	{
+		printf( ", %llu hits", (unsigned long long)region.m_nHits );
+	}
+	printf( "\n" );
+}
+
+static bool PruneShader( const char *pFileName, int nShaderModel, const Usage_t &usage, const PruneOptions_t &options )
+{
+	CFxcComboSpace space;
+	std::string error;
+	if ( !space.Load( pFileName, nShaderModel, error ) )
+	{
+		fprintf( stderr, "%s\n", error.c_str() );
+		return false;
+	}
+
+	const std::string &name = space.GetShaderName();
+	Usage_t::const_iterator itUsage = usage.find( name );
+	if ( itUsage == usage.end() )
+	{
+		// Without a profile every combo looks unused
+		printf( "%s: no usage data, skipped\n\n", name.c_str() );
+		return true;
+	}
+	const ShaderUsage_t &shaderUsage = itUsage->second;
+
+	const std::vector< FxcComboVar_t > &vars = space.GetVars();
+	uint64_t nDynamicCombos = space.GetDynamicComboCount();
+	uint64_t nStaticCombos = space.GetStaticComboCount();
+
+	// Bytes per static combo from the current .vcs: the record and its data.
+	// Aliased combos only cost their alias record.
+	std::vector< uint64_t > bytes( nStaticCombos, 0 );
+	bool bHaveBytes = false;
+	if ( options.m_pVcsDirectory )
+	{
+		CVcsReader reader;
+		std::string vcsName = std::string( options.m_pVcsDirectory ) + "/" + name + ".vcs";
+		if ( reader.Open( vcsName.c_str(), error ) )
+		{
+			bHaveBytes = true;
+			for ( int i = 0; i < reader.GetStaticComboCount(); ++i )
+			{
+				const uint8_t *pData;
+				uint32 nSize;
+				reader.GetStaticComboData( i, &pData, &nSize );
+				uint32 nID = reader.GetStaticComboRecord( i ).m_nStaticComboID;
+				if ( nID < nStaticCombos )
+				{
+					bytes[nID] = sizeof( StaticComboRecord_t ) + nSize;
+				}
+			}
+			for ( int i = 0; i < reader.GetAliasCount(); ++i )
+			{
+				uint32 nID = reader.GetAliasRecord( i ).m_nStaticComboID;
+				if ( nID < nStaticCombos )
+				{
+					bytes[nID] = sizeof( StaticComboAliasRecord_t );
+				}
+			}
+		}
+		else
+		{
+			fprintf( stderr, "%s\n", error.c_str() );
+		}
+	}
+
+	// Static combos, what they cost and how often they were used
+	std::vector< StaticCombo_t > combos( nStaticCombos );
+	std::vector< int > values( vars.size() );
+	uint64_t nTotalCompiles = 0;
+	for ( uint64_t nStatic = 0; nStatic < nStaticCombos; ++nStatic )
+	{
+		StaticCombo_t &combo = combos[nStatic];
+		combo.m_nCompiles = 0;
+		combo.m_nBytes = bytes[nStatic];
+		combo.m_nHits = 0;
+		for ( uint64_t nDynamic = 0; nDynamic < nDynamicCombos; ++nDynamic )
+		{
+			space.DecodeCombo( nStatic * nDynamicCombos + nDynamic, values.data() );
+			combo.m_nCompiles += space.IsSkipped( values.data() ) ? 0 : 1;
+		}
+		space.DecodeCombo( nStatic * nDynamicCombos, values.data() );
+		combo.m_Values = values;
+		nTotalCompiles += combo.m_nCompiles;
+	}
+
+	int nBadIndices = 0;
+	for ( std::map< int, uint64_t >::const_iterator it = shaderUsage.m_StaticHits.begin(); it != shaderUsage.m_StaticHits.end(); ++it )
+	{
+		uint64_t nStatic = (uint64_t)it->first / nDynamicCombos;
+		if ( it->first < 0 || it->first % nDynamicCombos || nStatic >= nStaticCombos )
+		{
+			++nBadIndices;
+			continue;
+		}
+		combos[nStatic].m_nHits += it->second;
+	}
+	if ( nBadIndices )
+	{
+		// Recorded with a different .inc; the profile can't be trusted
+		fprintf( stderr, "%s: %d static indices in the usage data don't fit %s, was it recorded with another version?\n",
+			name.c_str(), nBadIndices, pFileName );
+		return false;
+	}
+
+	int nUsedStatics = 0;
+	for ( size_t i = 0; i < combos.size(); ++i )
+	{
+		nUsedStatics += combos[i].m_nHits ? 1 : 0;
+	}
+	printf( "%s: %llu static combos, %d used in the profiles, %llu compiles\n", name.c_str(),
+		(unsigned long long)nStaticCombos, nUsedStatics, (unsigned long long)nTotalCompiles );
+
+	// Cost and hits of every region
+	std::vector< Region_t > regions;
+	{
+		Region_t region;
+		EnumerateRegions( space, space.GetDynamicVarCount(), options.m_nMaxTerms, region, regions );
+	}
+	for ( size_t i = 0; i < regions.size(); ++i )
+	{
+		Region_t &region = regions[i];
+		region.m_nStaticCombos = 0;
+		region.m_nCompiles = region.m_nBytes = region.m_nHits = 0;
+		for ( size_t j = 0; j < combos.size(); ++j )
+		{
+			if ( !combos[j].m_nCompiles || !RegionContains( region, combos[j] ) )
+				continue;
+
+			++region.m_nStaticCombos;
+			region.m_nCompiles += combos[j].m_nCompiles;
+			region.m_nBytes += combos[j].m_nBytes;
+			region.m_nHits += combos[j].m_nHits;
+		}
+	}
+
+	// Greedy cover of the unused combos: each pick is the never hit region
+	// saving the most compiles that earlier picks don't already save.
+	// Ties go to the shorter rule.
+	std::vector< bool > covered( combos.size(), false );
+	std::vector< int > picked;
+	std::vector< uint64_t > gains;
+	while ( (int)picked.size() < options.m_nMaxRules )
+	{
+		int nBest = -1;
+		uint64_t nBestGain = 0;
+		for ( size_t i = 0; i < regions.size(); ++i )
+		{
+			if ( regions[i].m_nHits || !regions[i].m_nCompiles )
+				continue;
+
+			uint64_t nGain = 0;
+			for ( size_t j = 0; j < combos.size(); ++j )
+			{
+				nGain += ( !covered[j] && RegionContains( regions[i], combos[j] ) ) ? combos[j].m_nCompiles : 0;
+			}
+			if ( nGain > nBestGain || ( nGain == nBestGain && nBest >= 0 && nGain && regions[i].m_Terms.size() < regions[nBest].m_Terms.size() ) )
+			{
+				nBest = (int)i;
+				nBestGain = nGain;
+			}
+		}
+		if ( nBest < 0 )
+			break;
+
+		picked.push_back( nBest );
+		gains.push_back( nBestGain );
+		for ( size_t j = 0; j < combos.size(); ++j )
+		{
+			covered[j] = covered[j] || RegionContains( regions[nBest], combos[j] );
+		}
+	}
+
+	if ( picked.empty() )
+	{
+		printf( "  every region of up to %d terms was used\n", options.m_nMaxTerms );
+	}
+	else
+	{
+		printf( "  never hit, in the order picked:\n" );
+		for ( size_t i = 0; i < picked.size(); ++i )
+		{
+			PrintRegion( "    ", regions[picked[i]], vars, options, bHaveBytes );
+			if ( gains[i] != regions[picked[i]].m_nCompiles )
+			{
+				printf( "      %llu compiles not already saved by the rules above\n", (unsigned long long)gains[i] );
+			}
+		}
+	}
+
+	// Rarely hit regions, for a human to judge
+	std::vector< int > rare;
+	for ( size_t i = 0; i < regions.size() && options.m_nRareHits; ++i )
+	{
+		if ( regions[i].m_nHits && regions[i].m_nHits <= options.m_nRareHits )
+		{
+			rare.push_back( (int)i );
+		}
+	}
+	std::sort( rare.begin(), rare.end(), [&regions]( int a, int b )
+	{
+		if ( regions[a].m_nCompiles != regions[b].m_nCompiles )
+			return regions[a].m_nCompiles > regions[b].m_nCompiles;
+		return regions[a].m_Terms.size() < regions[b].m_Terms.size();
+	} );
+	if ( !rare.empty() )
+	{
+		printf( "  hit at most %llu times (not suggested):\n", (unsigned long long)options.m_nRareHits );
+		for ( size_t i = 0; i < rare.size() && (int)i < options.m_nMaxRules; ++i )
+		{
+			PrintRegion( "    ", regions[rare[i]], vars, options, bHaveBytes );
+		}
+	}
+
+	if ( picked.empty() )
+	{
+		printf( "\n" );
+		return true;
+	}
+
+	// Check the candidates the way the build will read them: parsed from
+	// text and evaluated against every profiled combo
+	std::vector< CFxcExpression > candidates( picked.size() );
+	for ( size_t i = 0; i < picked.size(); ++i )
+	{
+		if ( !candidates[i].Parse( RegionSkipLine( regions[picked[i]], vars ).c_str(), vars, error ) )
+		{
+			fprintf( stderr, "%s: %s\n", name.c_str(), error.c_str() );
+			return false;
+		}
+	}
+
+	int nViolations = 0;
+	uint64_t nChecked = 0;
+	for ( std::map< int, uint64_t >::const_iterator it = shaderUsage.m_StaticHits.begin(); it != shaderUsage.m_StaticHits.end(); ++it, ++nChecked )
+	{
+		space.DecodeCombo( (uint64_t)it->first, values.data() );
+		for ( size_t i = 0; i < candidates.size(); ++i )
+		{
+			nViolations += candidates[i].Evaluate( values.data() ) ? 1 : 0;
+		}
+	}
+	for ( std::map< uint64_t, uint64_t >::const_iterator it = shaderUsage.m_ComboHits.begin(); it != shaderUsage.m_ComboHits.end(); ++it, ++nChecked )
+	{
+		if ( it->first >= space.GetTotalComboCount() )
+		{
+			++nViolations;
+			continue;
+		}
+		space.DecodeCombo( it->first, values.data() );
+		for ( size_t i = 0; i < candidates.size(); ++i )
+		{
+			nViolations += candidates[i].Evaluate( values.data() ) ? 1 : 0;
+		}
+	}
+
+	uint64_t nSavedCompiles = 0, nSavedBytes = 0;
+	for ( size_t j = 0; j < combos.size(); ++j )
+	{
+		nSavedCompiles += covered[j] ? combos[j].m_nCompiles : 0;
+		nSavedBytes += covered[j] ? combos[j].m_nBytes : 0;
+	}
+
+	if ( nViolations )
+	{
+		fprintf( stderr, "%s: the candidate rules skip %d profiled combos\n", name.c_str(), nViolations );
+		return false;
+	}
+
+	printf( "  candidate rules, checked against %llu profiled combos:\n", (unsigned long long)nChecked );
+	for ( size_t i = 0; i < picked.size(); ++i )
+	{
+		printf( "// SKIP: %s\n", RegionSkipLine( regions[picked[i]], vars ).c_str() );
+	}
+	printf( "  together they save %llu of %llu compiles (%.1f%%)", (unsigned long long)nSavedCompiles,
+		(unsigned long long)nTotalCompiles, nTotalCompiles ? 100.0 * nSavedCompiles / nTotalCompiles : 0.0 );
+	if ( options.m_flCompileTime > 0 )
+	{
+		printf( ", %.0fs", options.m_flCompileTime * nSavedCompiles );
+	}
+	if ( bHaveBytes )
+	{
+		printf( ", %llu bytes of .vcs", (unsigned long long)nSavedBytes );
+	}
+	printf( "\n\n" );
+	return true;
+}
+
+
+static void PrintUsage()
+{
+	printf( "usage: comboprune [-ver 30] [-terms 3] [-rules 10] [-rare N] [-vcs dir] [-compiletime seconds]\n"
+			"                  -usage <file> [-usage <file> ...] <file.fxc | list.txt> ...\n" );
+}
+
+int main( int argc, char **argv )
+{
+	int nShaderModel = 30;
+	PruneOptions_t options;
+	options.m_nMaxTerms = 3;
+	options.m_nMaxRules = 10;
+	options.m_nRareHits = 0;
+	options.m_pVcsDirectory = NULL;
+	options.m_flCompileTime = 0;
+
+	Usage_t usage;
+	int nUsageFiles = 0;
+	std::vector< std::string > files;
+	for ( int i = 1; i < argc; ++i )
+	{
+		bool bHasValue = ( i + 1 < argc );
+		if ( !strcmp( argv[i], "-ver" ) && bHasValue )
+		{
+			nShaderModel = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-terms" ) && bHasValue )
+		{
+			options.m_nMaxTerms = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-rules" ) && bHasValue )
+		{
+			options.m_nMaxRules = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-rare" ) && bHasValue )
+		{
+			options.m_nRareHits = strtoull( argv[++i], NULL, 10 );
+		}
+		else if ( !strcmp( argv[i], "-vcs" ) && bHasValue )
+		{
+			options.m_pVcsDirectory = argv[++i];
+		}
+		else if ( !strcmp( argv[i], "-compiletime" ) && bHasValue )
+		{
+			options.m_flCompileTime = atof( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-usage" ) && bHasValue )
+		{
+			if ( !ReadUsage( argv[++i], usage ) )
+			{
+				fprintf( stderr, "unable to open %s\n", argv[i] );
+				return 1;
+			}
+			++nUsageFiles;
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else if ( !FxcAddShaderArgument( argv[i], files ) )
+		{
+			fprintf( stderr, "unable to open %s\n", argv[i] );
+			return 1;
+		}
+	}
+
+	if ( files.empty() || !nUsageFiles || options.m_nMaxTerms < 1 )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	bool bOk = true;
+	for ( size_t i = 0; i < files.size(); ++i )
+	{
+		bOk = PruneShader( files[i].c_str(), nShaderModel, usage, options ) && bOk;
+	}
+	return bOk ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Reports the combo space of .fxc shaders without compiling them:
+//			total, skipped and surviving combos, the compile jobs that leaves,
+//			and SKIP rules that never match or only repeat other rules.
+//
+//			combospace [-ver 30] [-maxcombos N] <file.fxc | list.txt> ...
+//
+//			A .txt argument is a shader list like sfmshaders_dx9_30.txt.
+//			With -maxcombos the exit code is 1 if any shader compiles more
+//			than N combos, so combo growth can be caught before a build.
+//
+//			Builds with any C++11 compiler, e.g.
+//			g++ -O2 -o combospace combospace.cpp fxccombos.cpp
+//
+//===========================================================================//
+
+#include "fxccombos.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+
+struct SkipRuleStats_t
+{
+	uint64_t m_nHits;		// combos the rule matches
+	uint64_t m_nUnique;		// combos no other rule matches
+	int m_nDuplicateOf;		// earlier rule with the same text, or -1
+};
+
+static void PrintUsage()
+{
+	printf( "usage: combospace [-ver 30] [-maxcombos N] <file.fxc | list.txt> ...\n" );
+}
+
+static std::string FileNameOnly( const std::string &path )
+{
+	size_t nSlash = path.find_last_of( "/\\" );
+	return ( nSlash == std::string::npos ) ? path : path.substr( nSlash + 1 );
+}
+
+static std::string StripSpaces( const std::string &text )
+{
+	std::string out;
+	for ( size_t i = 0; i < text.size(); ++i )
+	{
+		if ( text[i] != ' ' && text[i] != '\t' )
+		{
+			out += text[i];
+		}
+	}
+	return out;
+}
+
+
+//-----------------------------------------------------------------------------
+// Walks every combo of one shader and prints the report
+//-----------------------------------------------------------------------------
+static bool AnalyzeShader( const char *pFileName, int nShaderModel, uint64_t nMaxCombos )
+{
+	CFxcComboSpace space;
+	std::string error;
+	if ( !space.Load( pFileName, nShaderModel, error ) )
+	{
+		fprintf( stderr, "%s\n", error.c_str() );
+		return false;
+	}
+
+	const std::vector< FxcComboVar_t > &vars = space.GetVars();
+	const std::vector< FxcSkipRule_t > &rules = space.GetSkipRules();
+
+	std::vector< SkipRuleStats_t > stats( rules.size() );
+	for ( size_t i = 0; i < rules.size(); ++i )
+	{
+		stats[i].m_nHits = 0;
+		stats[i].m_nUnique = 0;
+		stats[i].m_nDuplicateOf = -1;
+
+		std::string text = StripSpaces( rules[i].m_Text );
+		for ( size_t j = 0; j < i && stats[i].m_nDuplicateOf < 0; ++j )
+		{
+			if ( StripSpaces( rules[j].m_Text ) == text )
+			{
+				stats[i].m_nDuplicateOf = (int)j;
+			}
+		}
+	}
+
+	uint64_t nDynamicCombos = space.GetDynamicComboCount();
+	uint64_t nTotal = space.GetTotalComboCount();
+	uint64_t nSkipped = 0;
+	uint64_t nLiveStatics = 0;
+	bool bStaticHasWork = false;
+
+	std::vector< int > values( vars.size() );
+	std::vector< int > matches;
+	matches.reserve( rules.size() );
+
+	for ( uint64_t nCombo = 0; nCombo < nTotal; ++nCombo )
+	{
+		space.DecodeCombo( nCombo, values.data() );
+
+		matches.clear();
+		for ( size_t i = 0; i < rules.size(); ++i )
+		{
+			if ( rules[i].m_Expr.Evaluate( values.data() ) )
+			{
+				matches.push_back( (int)i );
+				++stats[i].m_nHits;
+			}
+		}
+
+		if ( matches.size() == 1 )
+		{
+			++stats[matches[0]].m_nUnique;
+		}
+
+		if ( matches.empty() )
+		{
+			bStaticHasWork = true;
+		}
+		else
+		{
+			++nSkipped;
+		}
+
+		// Last dynamic combo of a static combo
+		if ( ( nCombo + 1 ) % nDynamicCombos == 0 )
+		{
+			nLiveStatics += bStaticHasWork ? 1 : 0;
+			bStaticHasWork = false;
+		}
+	}
+
+	uint64_t nSurviving = nTotal - nSkipped;
+
+	printf( "%s (%d static, %d dynamic axes)\n", space.GetShaderName().c_str(),
+		(int)vars.size() - space.GetDynamicVarCount(), space.GetDynamicVarCount() );
+	for ( size_t i = 0; i < vars.size(); ++i )
+	{
+		printf( "    %-8s %-28s %d..%d\n", vars[i].m_bStatic ? "STATIC" : "DYNAMIC", vars[i].m_Name.c_str(), vars[i].m_nMin, vars[i].m_nMax );
+	}
+	printf( "  combos       %12llu  (%llu static x %llu dynamic)\n", (unsigned long long)nTotal,
+		(unsigned long long)space.GetStaticComboCount(), (unsigned long long)nDynamicCombos );
+	printf( "  skipped      %12llu  (%.1f%%)\n", (unsigned long long)nSkipped, nTotal ? 100.0 * nSkipped / nTotal : 0.0 );
+	printf( "  surviving    %12llu\n", (unsigned long long)nSurviving );
+	printf( "  compile jobs %12llu  (one per surviving combo, in %llu static combos)\n",
+		(unsigned long long)nSurviving, (unsigned long long)nLiveStatics );
+
+	printf( "  SKIP rules\n" );
+	for ( size_t i = 0; i < rules.size(); ++i )
+	{
+		const SkipRuleStats_t &rule = stats[i];
+
+		char szStatus[64];
+		if ( rule.m_nDuplicateOf >= 0 )
+		{
+			snprintf( szStatus, sizeof( szStatus ), "duplicate of #%d", rule.m_nDuplicateOf );
+		}
+		else if ( rule.m_nHits == 0 )
+		{
+			snprintf( szStatus, sizeof( szStatus ), rules[i].m_Expr.ReferencesUndefinedVar() ? "dead (undefined var)" : "dead" );
+		}
+		else if ( rule.m_nUnique == 0 )
+		{
+			snprintf( szStatus, sizeof( szStatus ), "redundant" );
+		}
+		else
+		{
+			snprintf( szStatus, sizeof( szStatus ), "ok" );
+		}
+
+		printf( "    #%-3d %-20s %10llu hits %10llu unique  %s:%d\n", (int)i, szStatus,
+			(unsigned long long)rule.m_nHits, (unsigned long long)rule.m_nUnique,
+			FileNameOnly( rules[i].m_File ).c_str(), rules[i].m_nLine );
+		printf( "         %s\n", rules[i].m_Text.c_str() );
+	}
+	printf( "\n" );
+
+	if ( nMaxCombos && nSurviving > nMaxCombos )
+	{
+		fprintf( stderr, "%s: %llu surviving combos exceeds -maxcombos %llu\n", space.GetShaderName().c_str(),
+			(unsigned long long)nSurviving, (unsigned long long)nMaxCombos );
+		return false;
+	}
+
+	return true;
+}
+
+
+int main( int argc, char **argv )
+{
+	int nShaderModel = 30;
+	uint64_t nMaxCombos = 0;
+	std::vector< std::string > files;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !strcmp( argv[i], "-ver" ) && i + 1 < argc )
+		{
+			nShaderModel = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-maxcombos" ) && i + 1 < argc )
+		{
+			nMaxCombos = strtoull( argv[++i], NULL, 10 );
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else if ( !FxcAddShaderArgument( argv[i], files ) )
+		{
+			fprintf( stderr, "unable to open %s\n", argv[i] );
+			return 1;
+		}
+	}
+
+	if ( files.empty() )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	bool bOk = true;
+	for ( size_t i = 0; i < files.size(); ++i )
+	{
+		bOk = AnalyzeShader( files[i].c_str(), nShaderModel, nMaxCombos ) && bOk;
+	}
+
+	return bOk ? 0 : 1;
+}
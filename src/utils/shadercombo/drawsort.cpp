@@ -0,0 +1,351 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Replays recorded draw streams to measure what sorting by the
+//			material sort key saves.
+//
+//			drawsort [-v] [-keepstate] <stream.txt> ...
+//
+//			The streams are mat_pbr_drawstream dumps (see
+//			shaderlib_drawstream.cpp). Each one is replayed twice against a
+//			simple device model, in the recorded order and sorted by the
+//			sort key, counting vertex and pixel shader switches and texture
+//			binds. A bind counts when a sampler gets a different texture
+//			than the one it holds; samplers a pass leaves alone keep theirs.
+//
+//			Only neighbouring passes of the same kind are sorted: a run of
+//			opaque passes, or of flashlight passes, within one frame. The
+//			sort is stable, and translucent passes are never moved.
+//
+//			The device state is forgotten at the start of every frame, since
+//			the engine and other shaders draw in between and the stream
+//			doesn't see them; -keepstate carries it over instead. -v adds
+//			the binds per sampler.
+//
+//			g++ -O2 -o drawsort drawsort.cpp
+//
+//===========================================================================//
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+
+#define SAMPLER_COUNT	16
+
+enum PassType_t
+{
+	PASS_OPAQUE = 0,
+	PASS_FLASHLIGHT,
+	PASS_TRANSLUCENT,
+};
+
+struct StreamPass_t
+{
+	unsigned int m_nFrame;
+	int m_nShader;				// index into the shader names
+	PassType_t m_nPass;
+	int m_nVertexShader;
+	int m_nPixelShader;
+	uint64_t m_nSortKey;
+	uint32_t m_Samplers[SAMPLER_COUNT];
+};
+
+struct Stream_t
+{
+	std::vector< std::string > m_ShaderNames;
+	std::vector< StreamPass_t > m_Passes;
+};
+
+
+//-----------------------------------------------------------------------------
+// Reading
+//-----------------------------------------------------------------------------
+static int FindOrAddShader( Stream_t &stream, const char *pName )
+{
+	for ( size_t i = 0; i < stream.m_ShaderNames.size(); ++i )
+	{
+		if ( stream.m_ShaderNames[i] == pName )
+			return (int)i;
+	}
+	stream.m_ShaderNames.push_back( pName );
+	return (int)stream.m_ShaderNames.size() - 1;
+}
+
+static bool ParsePassType( const char *pName, PassType_t *pPass )
+{
+	if ( !strcmp( pName, "opaque" ) )
+		*pPass = PASS_OPAQUE;
+	else if ( !strcmp( pName, "flashlight" ) )
+		*pPass = PASS_FLASHLIGHT;
+	else if ( !strcmp( pName, "translucent" ) )
+		*pPass = PASS_TRANSLUCENT;
+	else
+		return false;
+	return true;
+}
+
+static bool ReadStream( const char *pFileName, Stream_t &stream, std::string &error )
+{
+	FILE *fp = fopen( pFileName, "rt" );
+	if ( !fp )
+	{
+		error = "unable to open file";
+		return false;
+	}
+
+	char szLine[1024];
+	int nLine = 0;
+	while ( fgets( szLine, sizeof( szLine ), fp ) )
+	{
+		++nLine;
+		if ( nLine == 1 && !strncmp( szLine, "frame\t", 6 ) )
+			continue;	// the header
+
+		char szShader[256], szPass[32];
+		unsigned int nFrame;
+		unsigned long long nSortKey;
+		int nVertexShader, nPixelShader, nRead;
+		if ( sscanf( szLine, "%u\t%255[^\t]\t%31[^\t]\t%d\t%d\t%llx%n", &nFrame, szShader, szPass,
+					 &nVertexShader, &nPixelShader, &nSortKey, &nRead ) != 6 )
+		{
+			if ( szLine[strspn( szLine, " \t\r\n" )] == '\0' )
+				continue;
+
+			char szError[64];
+			snprintf( szError, sizeof( szError ), "line %d: bad pass", nLine );
+			error = szError;
+			fclose( fp );
+			return false;
+		}
+
+		StreamPass_t pass;
+		pass.m_nFrame = nFrame;
+		pass.m_nShader = FindOrAddShader( stream, szShader );
+		pass.m_nVertexShader = nVertexShader;
+		pass.m_nPixelShader = nPixelShader;
+		pass.m_nSortKey = nSortKey;
+
+		bool bOk = ParsePassType( szPass, &pass.m_nPass );
+		const char *pText = szLine + nRead;
+		for ( int s = 0; bOk && s < SAMPLER_COUNT; ++s )
+		{
+			char *pEnd;
+			pass.m_Samplers[s] = (uint32_t)strtoul( pText, &pEnd, 16 );
+			bOk = ( pEnd != pText );
+			pText = pEnd;
+		}
+
+		if ( !bOk )
+		{
+			char szError[64];
+			snprintf( szError, sizeof( szError ), "line %d: bad pass", nLine );
+			error = szError;
+			fclose( fp );
+			return false;
+		}
+
+		stream.m_Passes.push_back( pass );
+	}
+
+	fclose( fp );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Sorting: stable, within runs of opaque or flashlight passes of one frame
+//-----------------------------------------------------------------------------
+static bool SortKeyLess( const StreamPass_t &lhs, const StreamPass_t &rhs )
+{
+	return lhs.m_nSortKey < rhs.m_nSortKey;
+}
+
+static int SortStream( std::vector< StreamPass_t > &passes )
+{
+	int nSortable = 0;
+	size_t nStart = 0;
+	while ( nStart < passes.size() )
+	{
+		size_t nEnd = nStart + 1;
+		if ( passes[nStart].m_nPass != PASS_TRANSLUCENT )
+		{
+			while ( nEnd < passes.size() && passes[nEnd].m_nFrame == passes[nStart].m_nFrame &&
+					passes[nEnd].m_nPass == passes[nStart].m_nPass )
+			{
+				++nEnd;
+			}
+			std::stable_sort( passes.begin() + nStart, passes.begin() + nEnd, SortKeyLess );
+			nSortable += (int)( nEnd - nStart );
+		}
+		nStart = nEnd;
+	}
+	return nSortable;
+}
+
+
+//-----------------------------------------------------------------------------
+// Replay against the device model
+//-----------------------------------------------------------------------------
+struct ReplayCounts_t
+{
+	uint64_t m_nVertexShaderSwitches;
+	uint64_t m_nPixelShaderSwitches;
+	uint64_t m_nTextureBinds;
+	uint64_t m_SamplerBinds[SAMPLER_COUNT];
+};
+
+static void Replay( const std::vector< StreamPass_t > &passes, bool bKeepState, ReplayCounts_t &counts )
+{
+	memset( &counts, 0, sizeof( counts ) );
+
+	// -1 shader/0 texture: unknown, so the first pass always sets it
+	int nVertexShader = -1, nPixelShader = -1, nShader = -1;
+	uint32_t samplers[SAMPLER_COUNT];
+	memset( samplers, 0, sizeof( samplers ) );
+
+	for ( size_t i = 0; i < passes.size(); ++i )
+	{
+		const StreamPass_t &pass = passes[i];
+		if ( !bKeepState && i > 0 && pass.m_nFrame != passes[i - 1].m_nFrame )
+		{
+			nVertexShader = nPixelShader = nShader = -1;
+			memset( samplers, 0, sizeof( samplers ) );
+		}
+
+		if ( pass.m_nShader != nShader || pass.m_nVertexShader != nVertexShader )
+		{
+			++counts.m_nVertexShaderSwitches;
+		}
+		if ( pass.m_nShader != nShader || pass.m_nPixelShader != nPixelShader )
+		{
+			++counts.m_nPixelShaderSwitches;
+		}
+		nShader = pass.m_nShader;
+		nVertexShader = pass.m_nVertexShader;
+		nPixelShader = pass.m_nPixelShader;
+
+		for ( int s = 0; s < SAMPLER_COUNT; ++s )
+		{
+			if ( pass.m_Samplers[s] && pass.m_Samplers[s] != samplers[s] )
+			{
+				samplers[s] = pass.m_Samplers[s];
+				++counts.m_SamplerBinds[s];
+				++counts.m_nTextureBinds;
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Reporting
+//-----------------------------------------------------------------------------
+static void PrintRow( const char *pName, uint64_t nBefore, uint64_t nAfter, unsigned int nFrames )
+{
+	double flSaved = nBefore ? 100.0 * ( (double)nBefore - (double)nAfter ) / (double)nBefore : 0.0;
+	printf( "  %-18s %10llu %10llu %7.1f%%   %10.1f %10.1f\n", pName, (unsigned long long)nBefore, (unsigned long long)nAfter,
+			flSaved, (double)nBefore / nFrames, (double)nAfter / nFrames );
+}
+
+static bool SimulateStream( const char *pFileName, bool bKeepState, bool bVerbose )
+{
+	Stream_t stream;
+	std::string error;
+	if ( !ReadStream( pFileName, stream, error ) )
+	{
+		fprintf( stderr, "%s: %s\n", pFileName, error.c_str() );
+		return false;
+	}
+
+	if ( stream.m_Passes.empty() )
+	{
+		printf( "%s: no passes\n", pFileName );
+		return true;
+	}
+
+	unsigned int nFrames = 1;
+	for ( size_t i = 1; i < stream.m_Passes.size(); ++i )
+	{
+		if ( stream.m_Passes[i].m_nFrame != stream.m_Passes[i - 1].m_nFrame )
+		{
+			++nFrames;
+		}
+	}
+
+	ReplayCounts_t recorded, sorted;
+	Replay( stream.m_Passes, bKeepState, recorded );
+
+	std::vector< StreamPass_t > sortedPasses = stream.m_Passes;
+	int nSortable = SortStream( sortedPasses );
+	Replay( sortedPasses, bKeepState, sorted );
+
+	printf( "%s: %d passes in %u frames, %d sortable\n", pFileName, (int)stream.m_Passes.size(), nFrames, nSortable );
+	printf( "  %-18s %10s %10s %8s   %10s %10s\n", "", "recorded", "sorted", "saved", "rec/frame", "sort/frame" );
+	PrintRow( "vs switches", recorded.m_nVertexShaderSwitches, sorted.m_nVertexShaderSwitches, nFrames );
+	PrintRow( "ps switches", recorded.m_nPixelShaderSwitches, sorted.m_nPixelShaderSwitches, nFrames );
+	PrintRow( "texture binds", recorded.m_nTextureBinds, sorted.m_nTextureBinds, nFrames );
+
+	if ( bVerbose )
+	{
+		for ( int s = 0; s < SAMPLER_COUNT; ++s )
+		{
+			if ( recorded.m_SamplerBinds[s] || sorted.m_SamplerBinds[s] )
+			{
+				char szName[32];
+				snprintf( szName, sizeof( szName ), "  sampler %d", s );
+				PrintRow( szName, recorded.m_SamplerBinds[s], sorted.m_SamplerBinds[s], nFrames );
+			}
+		}
+	}
+
+	return true;
+}
+
+static void PrintUsage()
+{
+	fprintf( stderr, "usage: drawsort [-v] [-keepstate] <stream.txt> ...\n" );
+}
+
+int main( int argc, char **argv )
+{
+	bool bVerbose = false;
+	bool bKeepState = false;
+	std::vector< const char * > files;
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !strcmp( argv[i], "-v" ) )
+		{
+			bVerbose = true;
+		}
+		else if ( !strcmp( argv[i], "-keepstate" ) )
+		{
+			bKeepState = true;
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else
+		{
+			files.push_back( argv[i] );
+		}
+	}
+
+	if ( files.empty() )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	bool bOk = true;
+	for ( size_t i = 0; i < files.size(); ++i )
+	{
+		bOk = SimulateStream( files[i], bKeepState, bVerbose ) && bOk;
+	}
+	return bOk ? 0 : 1;
+}
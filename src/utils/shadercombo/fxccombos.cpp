@@ -0,0 +1,771 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Portable reader for .fxc combo declarations and SKIP expressions.
+//
+//===========================================================================//
+
+#include "fxccombos.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//-----------------------------------------------------------------------------
+// Expression tokens. SKIP expressions are perl, but only this subset is used.
+//-----------------------------------------------------------------------------
+enum ExprToken_t
+{
+	TOK_END,
+	TOK_NUMBER,
+	TOK_VAR,
+	TOK_DEFINED,
+	TOK_LPAREN,
+	TOK_RPAREN,
+	TOK_NOT,
+	TOK_OR,
+	TOK_AND,
+	TOK_EQ,
+	TOK_NE,
+	TOK_LT,
+	TOK_GT,
+	TOK_LE,
+	TOK_GE,
+	TOK_ADD,
+	TOK_SUB,
+	TOK_MUL,
+	TOK_DIV,
+	TOK_MOD,
+	TOK_ERROR,
+};
+
+class CFxcExpressionParser
+{
+public:
+	CFxcExpressionParser( CFxcExpression &expr, const char *pText, const std::vector< FxcComboVar_t > &vars ) :
+		m_Expr( expr ), m_pText( pText ), m_Vars( vars )
+	{
+		Advance();
+	}
+
+	bool Parse( std::string &error )
+	{
+		m_Expr.m_Nodes.clear();
+		m_Expr.m_nRoot = ParseBinary( 0 );
+		if ( m_Error.empty() && m_nToken != TOK_END )
+		{
+			m_Error = "unexpected text at \"" + std::string( m_pTokenStart ) + "\"";
+		}
+		error = m_Error;
+		return m_Error.empty();
+	}
+
+private:
+	// Binary operators from loosest to tightest
+	static int Precedence( int nToken )
+	{
+		switch ( nToken )
+		{
+		case TOK_OR:	return 1;
+		case TOK_AND:	return 2;
+		case TOK_EQ:
+		case TOK_NE:	return 3;
+		case TOK_LT:
+		case TOK_GT:
+		case TOK_LE:
+		case TOK_GE:	return 4;
+		case TOK_ADD:
+		case TOK_SUB:	return 5;
+		case TOK_MUL:
+		case TOK_DIV:
+		case TOK_MOD:	return 6;
+		default:		return 0;
+		}
+	}
+
+	void Advance()
+	{
+		while ( isspace( (unsigned char)*m_pText ) )
+		{
+			++m_pText;
+		}
+
+		m_pTokenStart = m_pText;
+		char c = *m_pText;
+		if ( c == '\0' )
+		{
+			m_nToken = TOK_END;
+			return;
+		}
+
+		if ( isdigit( (unsigned char)c ) )
+		{
+			m_nTokenValue = (int)strtol( m_pText, (char **)&m_pText, 10 );
+			m_nToken = TOK_NUMBER;
+			return;
+		}
+
+		if ( c == '$' || isalpha( (unsigned char)c ) || c == '_' )
+		{
+			const char *pStart = ( c == '$' ) ? m_pText + 1 : m_pText;
+			const char *pEnd = pStart;
+			while ( isalnum( (unsigned char)*pEnd ) || *pEnd == '_' )
+			{
+				++pEnd;
+			}
+			m_TokenName.assign( pStart, pEnd - pStart );
+			m_pText = pEnd;
+
+			if ( c == '$' )
+			{
+				m_nToken = TOK_VAR;
+			}
+			else if ( m_TokenName == "defined" )
+			{
+				m_nToken = TOK_DEFINED;
+			}
+			else
+			{
+				m_nToken = TOK_ERROR;
+			}
+			return;
+		}
+
+		struct Operator_t { const char *m_pText; int m_nToken; };
+		static const Operator_t s_Operators[] =
+		{
+			{ "&&", TOK_AND }, { "||", TOK_OR }, { "==", TOK_EQ }, { "!=", TOK_NE }, { "<=", TOK_LE }, { ">=", TOK_GE },
+			{ "<", TOK_LT }, { ">", TOK_GT }, { "!", TOK_NOT }, { "(", TOK_LPAREN }, { ")", TOK_RPAREN },
+			{ "+", TOK_ADD }, { "-", TOK_SUB }, { "*", TOK_MUL }, { "/", TOK_DIV }, { "%", TOK_MOD },
+		};
+		for ( size_t i = 0; i < sizeof( s_Operators ) / sizeof( s_Operators[0] ); ++i )
+		{
+			size_t nLen = strlen( s_Operators[i].m_pText );
+			if ( !strncmp( m_pText, s_Operators[i].m_pText, nLen ) )
+			{
+				m_pText += nLen;
+				m_nToken = s_Operators[i].m_nToken;
+				return;
+			}
+		}
+
+		m_nToken = TOK_ERROR;
+	}
+
+	int AddNode( CFxcExpression::NodeType_t type, int nValue, int nOp = 0, int nLeft = -1, int nRight = -1 )
+	{
+		CFxcExpression::Node_t node;
+		node.m_Type = type;
+		node.m_nValue = nValue;
+		node.m_nOp = nOp;
+		node.m_nLeft = nLeft;
+		node.m_nRight = nRight;
+		m_Expr.m_Nodes.push_back( node );
+		return (int)m_Expr.m_Nodes.size() - 1;
+	}
+
+	int FindSlot( const std::string &name ) const
+	{
+		for ( size_t i = 0; i < m_Vars.size(); ++i )
+		{
+			if ( m_Vars[i].m_Name == name )
+				return (int)i;
+		}
+		return -1;
+	}
+
+	int ParseUnary()
+	{
+		if ( !m_Error.empty() )
+			return -1;
+
+		switch ( m_nToken )
+		{
+		case TOK_NUMBER:
+			{
+				int nNode = AddNode( CFxcExpression::NODE_CONST, m_nTokenValue );
+				Advance();
+				return nNode;
+			}
+
+		case TOK_VAR:
+			{
+				int nNode = AddNode( CFxcExpression::NODE_VAR, FindSlot( m_TokenName ) );
+				Advance();
+				return nNode;
+			}
+
+		case TOK_DEFINED:
+			Advance();
+			if ( m_nToken != TOK_VAR )
+			{
+				m_Error = "expected $var after defined";
+				return -1;
+			}
+			else
+			{
+				int nNode = AddNode( CFxcExpression::NODE_DEFINED, FindSlot( m_TokenName ) );
+				Advance();
+				return nNode;
+			}
+
+		case TOK_NOT:
+			Advance();
+			return AddNode( CFxcExpression::NODE_NOT, 0, 0, ParseUnary() );
+
+		case TOK_SUB:
+			Advance();
+			return AddNode( CFxcExpression::NODE_NEGATE, 0, 0, ParseUnary() );
+
+		case TOK_LPAREN:
+			{
+				Advance();
+				int nNode = ParseBinary( 0 );
+				if ( m_Error.empty() && m_nToken != TOK_RPAREN )
+				{
+					m_Error = "missing )";
+					return -1;
+				}
+				Advance();
+				return nNode;
+			}
+
+		default:
+			m_Error = "unexpected text at \"" + std::string( m_pTokenStart ) + "\"";
+			return -1;
+		}
+	}
+
+	int ParseBinary( int nMinPrecedence )
+	{
+		int nLeft = ParseUnary();
+		while ( m_Error.empty() )
+		{
+			int nPrecedence = Precedence( m_nToken );
+			if ( nPrecedence == 0 || nPrecedence <= nMinPrecedence )
+				break;
+
+			int nOp = m_nToken;
+			Advance();
+			int nRight = ParseBinary( nPrecedence );
+			nLeft = AddNode( CFxcExpression::NODE_BINARY, 0, nOp, nLeft, nRight );
+		}
+		return nLeft;
+	}
+
+	CFxcExpression &m_Expr;
+	const char *m_pText;
+	const char *m_pTokenStart;
+	const std::vector< FxcComboVar_t > &m_Vars;
+	int m_nToken;
+	int m_nTokenValue;
+	std::string m_TokenName;
+	std::string m_Error;
+};
+
+
+//-----------------------------------------------------------------------------
+// Expression evaluation
+//-----------------------------------------------------------------------------
+bool CFxcExpression::Parse( const char *pText, const std::vector< FxcComboVar_t > &vars, std::string &error )
+{
+	CFxcExpressionParser parser( *this, pText, vars );
+	return parser.Parse( error );
+}
+
+int CFxcExpression::Evaluate( const int *pValues ) const
+{
+	return Eval( m_nRoot, pValues );
+}
+
+int CFxcExpression::Eval( int nNode, const int *pValues ) const
+{
+	const Node_t &node = m_Nodes[nNode];
+	switch ( node.m_Type )
+	{
+	case NODE_CONST:
+		return node.m_nValue;
+
+	case NODE_VAR:
+		return ( node.m_nValue >= 0 ) ? pValues[node.m_nValue] : 0;
+
+	case NODE_DEFINED:
+		return node.m_nValue >= 0;
+
+	case NODE_NOT:
+		return !Eval( node.m_nLeft, pValues );
+
+	case NODE_NEGATE:
+		return -Eval( node.m_nLeft, pValues );
+
+	case NODE_BINARY:
+		break;
+	}
+
+	// Short circuit like perl does
+	int a = Eval( node.m_nLeft, pValues );
+	if ( node.m_nOp == TOK_AND && !a )
+		return 0;
+	if ( node.m_nOp == TOK_OR && a )
+		return 1;
+
+	int b = Eval( node.m_nRight, pValues );
+	switch ( node.m_nOp )
+	{
+	case TOK_AND:	return b != 0;
+	case TOK_OR:	return b != 0;
+	case TOK_EQ:	return a == b;
+	case TOK_NE:	return a != b;
+	case TOK_LT:	return a < b;
+	case TOK_GT:	return a > b;
+	case TOK_LE:	return a <= b;
+	case TOK_GE:	return a >= b;
+	case TOK_ADD:	return a + b;
+	case TOK_SUB:	return a - b;
+	case TOK_MUL:	return a * b;
+	case TOK_DIV:	return b ? a / b : 0;
+	case TOK_MOD:	return b ? a % b : 0;
+	}
+	return 0;
+}
+
+std::string CFxcExpression::ToCpp( const std::vector< FxcComboVar_t > &vars, const char *pVarPrefix ) const
+{
+	return NodeToCpp( m_nRoot, vars, pVarPrefix );
+}
+
+std::string CFxcExpression::NodeToCpp( int nNode, const std::vector< FxcComboVar_t > &vars, const char *pVarPrefix ) const
+{
+	const Node_t &node = m_Nodes[nNode];
+	switch ( node.m_Type )
+	{
+	case NODE_CONST:
+		return std::to_string( node.m_nValue );
+
+	case NODE_VAR:
+		return ( node.m_nValue >= 0 ) ? pVarPrefix + vars[node.m_nValue].m_Name : std::string( "0" );
+
+	case NODE_DEFINED:
+		return ( node.m_nValue >= 0 ) ? "1" : "0";
+
+	case NODE_NOT:
+		return "!" + NodeToCpp( node.m_nLeft, vars, pVarPrefix );
+
+	case NODE_NEGATE:
+		return "-" + NodeToCpp( node.m_nLeft, vars, pVarPrefix );
+
+	case NODE_BINARY:
+		break;
+	}
+
+	std::string a = NodeToCpp( node.m_nLeft, vars, pVarPrefix );
+	std::string b = NodeToCpp( node.m_nRight, vars, pVarPrefix );
+
+	// Division by zero is 0, as in Eval
+	if ( node.m_nOp == TOK_DIV || node.m_nOp == TOK_MOD )
+		return "( " + b + " ? " + a + ( node.m_nOp == TOK_DIV ? " / " : " % " ) + b + " : 0 )";
+
+	const char *pOp = "";
+	switch ( node.m_nOp )
+	{
+	case TOK_AND:	pOp = " && "; break;
+	case TOK_OR:	pOp = " || "; break;
+	case TOK_EQ:	pOp = " == "; break;
+	case TOK_NE:	pOp = " != "; break;
+	case TOK_LT:	pOp = " < "; break;
+	case TOK_GT:	pOp = " > "; break;
+	case TOK_LE:	pOp = " <= "; break;
+	case TOK_GE:	pOp = " >= "; break;
+	case TOK_ADD:	pOp = " + "; break;
+	case TOK_SUB:	pOp = " - "; break;
+	case TOK_MUL:	pOp = " * "; break;
+	}
+	return "( " + a + pOp + b + " )";
+}
+
+bool CFxcExpression::ReferencesUndefinedVar() const
+{
+	for ( size_t i = 0; i < m_Nodes.size(); ++i )
+	{
+		if ( ( m_Nodes[i].m_Type == NODE_VAR || m_Nodes[i].m_Type == NODE_DEFINED ) && m_Nodes[i].m_nValue < 0 )
+			return true;
+	}
+	return false;
+}
+
+void CFxcExpression::GetReferencedSlots( std::vector< int > &slots ) const
+{
+	slots.clear();
+	for ( size_t i = 0; i < m_Nodes.size(); ++i )
+	{
+		const Node_t &node = m_Nodes[i];
+		if ( node.m_Type != NODE_VAR || node.m_nValue < 0 )
+			continue;
+
+		bool bFound = false;
+		for ( size_t j = 0; j < slots.size(); ++j )
+		{
+			bFound = bFound || ( slots[j] == node.m_nValue );
+		}
+		if ( !bFound )
+		{
+			slots.push_back( node.m_nValue );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Helpers for reading the .fxc
+//-----------------------------------------------------------------------------
+static bool ReadTextFile( const std::string &fileName, std::vector< std::string > &lines )
+{
+	FILE *fp = fopen( fileName.c_str(), "rb" );
+	if ( !fp )
+		return false;
+
+	lines.clear();
+	std::string line;
+	int c;
+	while ( ( c = fgetc( fp ) ) != EOF )
+	{
+		if ( c == '\n' )
+		{
+			lines.push_back( line );
+			line.clear();
+		}
+		else if ( c != '\r' )
+		{
+			line += (char)c;
+		}
+	}
+	if ( !line.empty() )
+	{
+		lines.push_back( line );
+	}
+
+	fclose( fp );
+	return true;
+}
+
+static std::string DirectoryOf( const std::string &fileName )
+{
+	size_t nSlash = fileName.find_last_of( "/\\" );
+	return ( nSlash == std::string::npos ) ? std::string() : fileName.substr( 0, nSlash + 1 );
+}
+
+static std::string BaseNameOf( const std::string &fileName )
+{
+	size_t nSlash = fileName.find_last_of( "/\\" );
+	std::string name = ( nSlash == std::string::npos ) ? fileName : fileName.substr( nSlash + 1 );
+	size_t nDot = name.find_last_of( '.' );
+	return ( nDot == std::string::npos ) ? name : name.substr( 0, nDot );
+}
+
+// Returns the text after "// <pKeyword>:" or NULL
+static const char *MatchCommentKeyword( const char *pLine, const char *pKeyword )
+{
+	while ( isspace( (unsigned char)*pLine ) )
+	{
+		++pLine;
+	}
+	if ( pLine[0] != '/' || pLine[1] != '/' )
+		return NULL;
+
+	pLine += 2;
+	while ( isspace( (unsigned char)*pLine ) )
+	{
+		++pLine;
+	}
+
+	size_t nLen = strlen( pKeyword );
+	if ( strncmp( pLine, pKeyword, nLen ) || pLine[nLen] != ':' )
+		return NULL;
+
+	return pLine + nLen + 1;
+}
+
+// Strips the trailing [tags] and whitespace
+static std::string StripTags( const char *pText )
+{
+	std::string text( pText );
+	size_t nBracket = text.find( '[' );
+	if ( nBracket != std::string::npos )
+	{
+		text.erase( nBracket );
+	}
+
+	size_t nFirst = text.find_first_not_of( " \t" );
+	size_t nLast = text.find_last_not_of( " \t" );
+	return ( nFirst == std::string::npos ) ? std::string() : text.substr( nFirst, nLast - nFirst + 1 );
+}
+
+bool CFxcComboSpace::LineAppliesToShaderModel( const char *pLine ) const
+{
+	bool bHasModelTag = false;
+	bool bMatchesModel = false;
+
+	for ( const char *pTag = strchr( pLine, '[' ); pTag; pTag = strchr( pTag + 1, '[' ) )
+	{
+		const char *pEnd = strchr( pTag, ']' );
+		if ( !pEnd )
+			break;
+
+		std::string tag( pTag + 1, pEnd - pTag - 1 );
+		if ( tag == "XBOX" || tag == "CONSOLE" || tag == "SONYPS3" )
+			return false;
+
+		if ( tag.size() >= 4 && ( tag[0] == 'p' || tag[0] == 'v' ) && tag[1] == 's' && isdigit( (unsigned char)tag[2] ) )
+		{
+			bHasModelTag = true;
+			bMatchesModel = bMatchesModel || ( atoi( tag.c_str() + 2 ) == m_nShaderModel );
+		}
+	}
+
+	return !bHasModelTag || bMatchesModel;
+}
+
+
+//-----------------------------------------------------------------------------
+// Loading
+//-----------------------------------------------------------------------------
+bool CFxcComboSpace::ParseFile( const std::string &fileName, bool bRoot, std::vector< std::string > &skipLines,
+								std::vector< std::string > &skipFiles, std::vector< int > &skipLineNumbers, std::string &error )
+{
+	// Each file is read once, however many headers include it
+	for ( size_t i = 0; i < m_SourceFiles.size(); ++i )
+	{
+		if ( m_SourceFiles[i] == fileName )
+			return true;
+	}
+
+	std::vector< std::string > lines;
+	if ( !ReadTextFile( fileName, lines ) )
+	{
+		if ( bRoot )
+		{
+			error = "unable to open " + fileName;
+			return false;
+		}
+
+		// Includes that aren't next to the .fxc are system headers without combos
+		return true;
+	}
+	m_SourceFiles.push_back( fileName );
+
+	std::vector< FxcComboVar_t > dynamicVars;
+	for ( size_t i = 0; i < lines.size(); ++i )
+	{
+		const char *pLine = lines[i].c_str();
+		int nLine = (int)i + 1;
+
+		const char *pInclude = strstr( pLine, "#include" );
+		if ( pInclude && !MatchCommentKeyword( pLine, "SKIP" ) )
+		{
+			const char *pOpen = strchr( pInclude, '"' );
+			const char *pClose = pOpen ? strchr( pOpen + 1, '"' ) : NULL;
+			if ( pClose )
+			{
+				std::string includeName = DirectoryOf( fileName ) + std::string( pOpen + 1, pClose - pOpen - 1 );
+				if ( !ParseFile( includeName, false, skipLines, skipFiles, skipLineNumbers, error ) )
+					return false;
+			}
+			continue;
+		}
+
+		const char *pSkip = MatchCommentKeyword( pLine, "SKIP" );
+		if ( pSkip )
+		{
+			if ( LineAppliesToShaderModel( pSkip ) )
+			{
+				skipLines.push_back( StripTags( pSkip ) );
+				skipFiles.push_back( fileName );
+				skipLineNumbers.push_back( nLine );
+			}
+			continue;
+		}
+
+		// Only the .fxc itself declares combos
+		if ( !bRoot )
+			continue;
+
+		bool bStatic = true;
+		const char *pDecl = MatchCommentKeyword( pLine, "STATIC" );
+		if ( !pDecl )
+		{
+			bStatic = false;
+			pDecl = MatchCommentKeyword( pLine, "DYNAMIC" );
+		}
+		if ( !pDecl || !LineAppliesToShaderModel( pDecl ) )
+			continue;
+
+		char szName[128];
+		int nMin, nMax;
+		if ( sscanf( pDecl, " \"%127[^\"]\" \"%d..%d\"", szName, &nMin, &nMax ) != 3 || nMax < nMin )
+		{
+			char szLine[32];
+			snprintf( szLine, sizeof( szLine ), "%d", nLine );
+			error = fileName + "(" + szLine + "): bad combo declaration";
+			return false;
+		}
+
+		FxcComboVar_t var;
+		var.m_Name = szName;
+		var.m_nMin = nMin;
+		var.m_nMax = nMax;
+		var.m_bStatic = bStatic;
+		var.m_File = fileName;
+		var.m_nLine = nLine;
+
+		if ( bStatic )
+		{
+			m_Vars.push_back( var );
+		}
+		else
+		{
+			dynamicVars.push_back( var );
+		}
+	}
+
+	if ( bRoot )
+	{
+		// Dynamic vars take the low digits of the index
+		m_Vars.insert( m_Vars.begin(), dynamicVars.begin(), dynamicVars.end() );
+		m_nDynamicVars = (int)dynamicVars.size();
+	}
+
+	return true;
+}
+
+bool CFxcComboSpace::Load( const char *pFxcFileName, int nShaderModel, std::string &error )
+{
+	m_ShaderName = BaseNameOf( pFxcFileName );
+	m_Vars.clear();
+	m_SkipRules.clear();
+	m_SourceFiles.clear();
+	m_nDynamicVars = 0;
+	m_nShaderModel = nShaderModel;
+
+	std::vector< std::string > skipLines, skipFiles;
+	std::vector< int > skipLineNumbers;
+	if ( !ParseFile( pFxcFileName, true, skipLines, skipFiles, skipLineNumbers, error ) )
+		return false;
+
+	m_Strides.resize( m_Vars.size() );
+	m_nDynamicCombos = 1;
+	m_nStaticCombos = 1;
+	uint64_t nStride = 1;
+	for ( size_t i = 0; i < m_Vars.size(); ++i )
+	{
+		m_Strides[i] = nStride;
+		nStride *= m_Vars[i].Count();
+		if ( m_Vars[i].m_bStatic )
+		{
+			m_nStaticCombos *= m_Vars[i].Count();
+		}
+		else
+		{
+			m_nDynamicCombos *= m_Vars[i].Count();
+		}
+	}
+
+	m_SkipRules.resize( skipLines.size() );
+	for ( size_t i = 0; i < skipLines.size(); ++i )
+	{
+		FxcSkipRule_t &rule = m_SkipRules[i];
+		rule.m_Text = skipLines[i];
+		rule.m_File = skipFiles[i];
+		rule.m_nLine = skipLineNumbers[i];
+
+		std::string exprError;
+		if ( !rule.m_Expr.Parse( rule.m_Text.c_str(), m_Vars, exprError ) )
+		{
+			char szLine[32];
+			snprintf( szLine, sizeof( szLine ), "%d", rule.m_nLine );
+			error = rule.m_File + "(" + szLine + "): bad SKIP expression: " + exprError;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int CFxcComboSpace::FindVar( const char *pName ) const
+{
+	for ( size_t i = 0; i < m_Vars.size(); ++i )
+	{
+		if ( m_Vars[i].m_Name == pName )
+			return (int)i;
+	}
+	return -1;
+}
+
+void CFxcComboSpace::DecodeCombo( uint64_t nCombo, int *pValues ) const
+{
+	for ( size_t i = 0; i < m_Vars.size(); ++i )
+	{
+		uint64_t nCount = m_Vars[i].Count();
+		pValues[i] = m_Vars[i].m_nMin + (int)( nCombo % nCount );
+		nCombo /= nCount;
+	}
+}
+
+uint64_t CFxcComboSpace::EncodeCombo( const int *pValues ) const
+{
+	uint64_t nCombo = 0;
+	for ( size_t i = 0; i < m_Vars.size(); ++i )
+	{
+		nCombo += m_Strides[i] * ( pValues[i] - m_Vars[i].m_nMin );
+	}
+	return nCombo;
+}
+
+int CFxcComboSpace::FindSkipRule( const int *pValues ) const
+{
+	for ( size_t i = 0; i < m_SkipRules.size(); ++i )
+	{
+		if ( m_SkipRules[i].m_Expr.Evaluate( pValues ) )
+			return (int)i;
+	}
+	return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Shader lists
+//-----------------------------------------------------------------------------
+bool FxcReadShaderList( const char *pListName, std::vector< std::string > &files )
+{
+	FILE *fp = fopen( pListName, "rt" );
+	if ( !fp )
+		return false;
+
+	std::string dir( pListName );
+	size_t nSlash = dir.find_last_of( "/\\" );
+	dir = ( nSlash == std::string::npos ) ? std::string() : dir.substr( 0, nSlash + 1 );
+
+	char szLine[1024];
+	while ( fgets( szLine, sizeof( szLine ), fp ) )
+	{
+		std::string line( szLine );
+		size_t nFirst = line.find_first_not_of( " \t\r\n" );
+		if ( nFirst == std::string::npos || line.compare( nFirst, 2, "//" ) == 0 )
+			continue;
+
+		size_t nLast = line.find_last_not_of( " \t\r\n" );
+		files.push_back( dir + line.substr( nFirst, nLast - nFirst + 1 ) );
+	}
+
+	fclose( fp );
+	return true;
+}
+
+bool FxcAddShaderArgument( const char *pArgument, std::vector< std::string > &files )
+{
+	size_t nLen = strlen( pArgument );
+	if ( nLen > 4 && !strcmp( pArgument + nLen - 4, ".txt" ) )
+		return FxcReadShaderList( pArgument, files );
+
+	files.push_back( pArgument );
+	return true;
+}
@@ -0,0 +1,162 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Portable reader for the combo declarations at the top of an .fxc
+//			file ("// STATIC:", "// DYNAMIC:" and "// SKIP:"), including the
+//			SKIP lines pulled in through #include, and an evaluator for the
+//			SKIP expressions.
+//
+//			Combo indices follow the generated .inc files: dynamic combos
+//			take the low digits in declaration order, then the static combos.
+//
+//===========================================================================//
+
+#ifndef FXCCOMBOS_H
+#define FXCCOMBOS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+//-----------------------------------------------------------------------------
+// One combo axis
+//-----------------------------------------------------------------------------
+struct FxcComboVar_t
+{
+	std::string m_Name;
+	int m_nMin;
+	int m_nMax;
+	bool m_bStatic;
+	std::string m_File;
+	int m_nLine;
+
+	int Count() const { return m_nMax - m_nMin + 1; }
+};
+
+
+//-----------------------------------------------------------------------------
+// A parsed SKIP expression. Variables are resolved to combo slots; variables
+// that aren't combos of this shader are undefined and evaluate to 0.
+//-----------------------------------------------------------------------------
+class CFxcExpression
+{
+public:
+	bool Parse( const char *pText, const std::vector< FxcComboVar_t > &vars, std::string &error );
+	int Evaluate( const int *pValues ) const;
+
+	// Does the expression reference a variable that isn't a combo of this shader?
+	bool ReferencesUndefinedVar() const;
+
+	// Slots of the combo vars the expression reads
+	void GetReferencedSlots( std::vector< int > &slots ) const;
+
+	// The expression as C++, fully parenthesized. Combo vars are written as
+	// pVarPrefix followed by the var name; undefined vars become 0.
+	std::string ToCpp( const std::vector< FxcComboVar_t > &vars, const char *pVarPrefix ) const;
+
+private:
+	enum NodeType_t
+	{
+		NODE_CONST,
+		NODE_VAR,
+		NODE_DEFINED,
+		NODE_NOT,
+		NODE_NEGATE,
+		NODE_BINARY,
+	};
+
+	struct Node_t
+	{
+		NodeType_t m_Type;
+		int m_nValue;		// constant, or var slot (-1 for undefined vars)
+		int m_nOp;			// binary operator token
+		int m_nLeft;
+		int m_nRight;
+	};
+
+	int Eval( int nNode, const int *pValues ) const;
+	std::string NodeToCpp( int nNode, const std::vector< FxcComboVar_t > &vars, const char *pVarPrefix ) const;
+
+	std::vector< Node_t > m_Nodes;
+	int m_nRoot;
+
+	friend class CFxcExpressionParser;
+};
+
+
+struct FxcSkipRule_t
+{
+	std::string m_Text;
+	std::string m_File;
+	int m_nLine;
+	CFxcExpression m_Expr;
+};
+
+
+//-----------------------------------------------------------------------------
+// The combo space of one shader
+//-----------------------------------------------------------------------------
+class CFxcComboSpace
+{
+public:
+	// nShaderModel is the -ver value the shader is compiled with (20b counts as 20).
+	// Lines tagged for other shader models or for consoles are ignored.
+	bool Load( const char *pFxcFileName, int nShaderModel, std::string &error );
+
+	const std::string &GetShaderName() const { return m_ShaderName; }
+
+	// Slots [0, GetDynamicVarCount()) are the dynamic vars, the rest are static
+	const std::vector< FxcComboVar_t > &GetVars() const { return m_Vars; }
+	int GetDynamicVarCount() const { return m_nDynamicVars; }
+	int FindVar( const char *pName ) const;
+
+	const std::vector< FxcSkipRule_t > &GetSkipRules() const { return m_SkipRules; }
+
+	uint64_t GetDynamicComboCount() const { return m_nDynamicCombos; }
+	uint64_t GetStaticComboCount() const { return m_nStaticCombos; }
+	uint64_t GetTotalComboCount() const { return m_nDynamicCombos * m_nStaticCombos; }
+
+	// Step of a slot in the combined index
+	uint64_t GetStride( int nSlot ) const { return m_Strides[nSlot]; }
+
+	// Combined index (static index as returned by the .inc plus dynamic index)
+	// to one value per slot, and back
+	void DecodeCombo( uint64_t nCombo, int *pValues ) const;
+	uint64_t EncodeCombo( const int *pValues ) const;
+
+	// Index of the first SKIP rule that matches, or -1 if the combo is compiled
+	int FindSkipRule( const int *pValues ) const;
+	bool IsSkipped( const int *pValues ) const { return FindSkipRule( pValues ) >= 0; }
+
+	// Input files the combo declarations came from, the .fxc first
+	const std::vector< std::string > &GetSourceFiles() const { return m_SourceFiles; }
+
+private:
+	bool ParseFile( const std::string &fileName, bool bRoot, std::vector< std::string > &skipLines,
+					std::vector< std::string > &skipFiles, std::vector< int > &skipLineNumbers, std::string &error );
+	bool LineAppliesToShaderModel( const char *pLine ) const;
+
+	std::string m_ShaderName;
+	std::vector< FxcComboVar_t > m_Vars;
+	int m_nDynamicVars;
+	std::vector< FxcSkipRule_t > m_SkipRules;
+	std::vector< std::string > m_SourceFiles;
+	std::vector< uint64_t > m_Strides;
+	uint64_t m_nDynamicCombos;
+	uint64_t m_nStaticCombos;
+	int m_nShaderModel;
+};
+
+
+// Shader lists like sfmshaders_dx9_30.txt name one .fxc per line, relative to
+// the list. Appends them to files.
+bool FxcReadShaderList( const char *pListName, std::vector< std::string > &files );
+
+// Expands command line arguments: .txt files are shader lists, anything else a .fxc
+bool FxcAddShaderArgument( const char *pArgument, std::vector< std::string > &files );
+
+
+#endif // FXCCOMBOS_H
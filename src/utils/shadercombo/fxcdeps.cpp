@@ -0,0 +1,152 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: #include graph of a set of .fxc files.
+//
+//===========================================================================//
+
+#include "fxcdeps.h"
+#include <algorithm>
+
+
+static std::string DirectoryOf( const std::string &fileName )
+{
+	size_t nSlash = fileName.find_last_of( "/\\" );
+	return ( nSlash == std::string::npos ) ? std::string() : fileName.substr( 0, nSlash + 1 );
+}
+
+CShaderDependencyGraph::CShaderDependencyGraph( CFxcSourceCache &sourceCache ) :
+	m_SourceCache( sourceCache )
+{
+}
+
+int CShaderDependencyGraph::FindFile( const std::string &fileName ) const
+{
+	std::map< std::string, int >::const_iterator it = m_FileIndex.find( fileName );
+	return ( it == m_FileIndex.end() ) ? -1 : it->second;
+}
+
+int CShaderDependencyGraph::AddShader( const std::string &fileName )
+{
+	if ( m_Shaders.empty() )
+	{
+		m_BaseDirectory = DirectoryOf( fileName );
+	}
+
+	int nFile = AddFile( fileName, DirectoryOf( fileName ) );
+	for ( size_t i = 0; i < m_Shaders.size(); ++i )
+	{
+		if ( m_Shaders[i] == nFile )
+			return (int)i;
+	}
+
+	m_Shaders.push_back( nFile );
+	return (int)m_Shaders.size() - 1;
+}
+
+int CShaderDependencyGraph::AddFile( const std::string &fileName, const std::string &rootDirectory )
+{
+	int nFile = FindFile( fileName );
+	if ( nFile >= 0 )
+		return nFile;
+
+	nFile = (int)m_Files.size();
+	m_FileIndex[fileName] = nFile;
+	m_Files.push_back( ShaderDependencyFile_t() );
+	{
+		ShaderDependencyFile_t &file = m_Files.back();
+		file.m_FileName = fileName;
+		bool bUnderBase = !m_BaseDirectory.empty() && fileName.compare( 0, m_BaseDirectory.size(), m_BaseDirectory ) == 0;
+		file.m_RelativeName = bUnderBase ? fileName.substr( m_BaseDirectory.size() ) : fileName;
+		file.m_bMissing = true;
+		file.m_nContentCRC = 0;
+	}
+
+	const FxcSourceFile_t *pSource = m_SourceCache.GetFile( fileName );
+	if ( !pSource )
+		return nFile;
+
+	m_Files[nFile].m_bMissing = false;
+	m_Files[nFile].m_nContentCRC = pSource->m_RawHash.m_nCRC;
+
+	// m_Files grows while recursing, so only hold indices across the calls
+	std::vector< int > includes;
+	for ( size_t i = 0; i < pSource->m_Lines.size(); ++i )
+	{
+		const FxcSourceLine_t &line = pSource->m_Lines[i];
+		if ( line.m_nDirective != FXC_DIRECTIVE_INCLUDE )
+			continue;
+
+		std::string resolved;
+		FxcResolveInclude( fileName, rootDirectory, line.m_Argument, resolved );
+		if ( resolved.empty() )
+			continue;	// <system> includes
+
+		int nInclude = AddFile( resolved, rootDirectory );
+		if ( std::find( includes.begin(), includes.end(), nInclude ) == includes.end() )
+		{
+			includes.push_back( nInclude );
+		}
+	}
+
+	m_Files[nFile].m_Includes = includes;
+	return nFile;
+}
+
+void CShaderDependencyGraph::GetInputs( int nShader, std::vector< int > &files ) const
+{
+	files.clear();
+
+	std::vector< bool > visited( m_Files.size(), false );
+	std::vector< int > stack( 1, m_Shaders[nShader] );
+	while ( !stack.empty() )
+	{
+		int nFile = stack.back();
+		stack.pop_back();
+		if ( visited[nFile] )
+			continue;
+
+		visited[nFile] = true;
+		files.push_back( nFile );
+		stack.insert( stack.end(), m_Files[nFile].m_Includes.begin(), m_Files[nFile].m_Includes.end() );
+	}
+
+	std::sort( files.begin(), files.end(), [this]( int a, int b ) { return m_Files[a].m_RelativeName < m_Files[b].m_RelativeName; } );
+}
+
+uint32_t CShaderDependencyGraph::GetFingerprint( int nShader ) const
+{
+	std::vector< int > files;
+	GetInputs( nShader, files );
+
+	uint32_t nCRC;
+	ShaderCRC32_Init( &nCRC );
+	for ( size_t i = 0; i < files.size(); ++i )
+	{
+		const ShaderDependencyFile_t &file = m_Files[files[i]];
+		uint8_t content[5] =
+		{
+			(uint8_t)( file.m_bMissing ? 0 : 1 ),
+			(uint8_t)( file.m_nContentCRC ), (uint8_t)( file.m_nContentCRC >> 8 ),
+			(uint8_t)( file.m_nContentCRC >> 16 ), (uint8_t)( file.m_nContentCRC >> 24 ),
+		};
+		ShaderCRC32_ProcessBuffer( &nCRC, file.m_RelativeName.c_str(), file.m_RelativeName.size() + 1 );
+		ShaderCRC32_ProcessBuffer( &nCRC, content, sizeof( content ) );
+	}
+	ShaderCRC32_Final( &nCRC );
+	return nCRC;
+}
+
+void CShaderDependencyGraph::GetDependents( int nFile, std::vector< int > &shaders ) const
+{
+	shaders.clear();
+
+	std::vector< int > files;
+	for ( size_t i = 0; i < m_Shaders.size(); ++i )
+	{
+		GetInputs( (int)i, files );
+		if ( std::find( files.begin(), files.end(), nFile ) != files.end() )
+		{
+			shaders.push_back( (int)i );
+		}
+	}
+}
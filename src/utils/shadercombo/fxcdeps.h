@@ -0,0 +1,72 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: #include graph of a set of .fxc files, and a fingerprint of each
+//			shader's transitive inputs.
+//
+//			Every quoted #include is followed, whatever #if it sits in, so a
+//			shader depends on each header any of its combos could read.
+//
+//===========================================================================//
+
+#ifndef FXCDEPS_H
+#define FXCDEPS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "fxcpreprocess.h"
+#include <map>
+#include <string>
+#include <vector>
+
+
+struct ShaderDependencyFile_t
+{
+	std::string m_FileName;
+	std::string m_RelativeName;		// relative to the first shader's directory, used in fingerprints
+	bool m_bMissing;
+	uint32_t m_nContentCRC;			// of the file bytes, 0 if missing
+	std::vector< int > m_Includes;	// files this one includes
+};
+
+
+class CShaderDependencyGraph
+{
+public:
+	explicit CShaderDependencyGraph( CFxcSourceCache &sourceCache );
+
+	// Adds a shader and scans everything it includes. Missing includes are
+	// kept as nodes (creating the file later changes the fingerprint).
+	// Returns the shader index.
+	int AddShader( const std::string &fileName );
+
+	int GetShaderCount() const { return (int)m_Shaders.size(); }
+	int GetShaderFile( int nShader ) const { return m_Shaders[nShader]; }
+
+	int GetFileCount() const { return (int)m_Files.size(); }
+	const ShaderDependencyFile_t &GetFile( int nFile ) const { return m_Files[nFile]; }
+	int FindFile( const std::string &fileName ) const;
+
+	// The shader's .fxc and everything it includes, directly or not, sorted by
+	// relative name
+	void GetInputs( int nShader, std::vector< int > &files ) const;
+
+	// CRC of the relative names and contents of the shader's inputs, for
+	// ShaderHeader_t::m_nSourceCRC32
+	uint32_t GetFingerprint( int nShader ) const;
+
+	// Shaders with nFile among their inputs
+	void GetDependents( int nFile, std::vector< int > &shaders ) const;
+
+private:
+	int AddFile( const std::string &fileName, const std::string &rootDirectory );
+
+	CFxcSourceCache &m_SourceCache;
+	std::string m_BaseDirectory;
+	std::vector< ShaderDependencyFile_t > m_Files;
+	std::map< std::string, int > m_FileIndex;
+	std::vector< int > m_Shaders;
+};
+
+
+#endif // FXCDEPS_H
@@ -0,0 +1,850 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Conditional-only preprocessor for .fxc files.
+//
+// Conditions are three valued: a block is compiled, not compiled, or maybe
+// compiled (its condition reads a varying macro). Compiled and maybe blocks
+// are hashed, each line tagged with which it was, along with the directive
+// lines that decide them.
+//
+//===========================================================================//
+
+#include "fxcpreprocess.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PP_FALSE		0
+#define PP_MAYBE		1
+#define PP_TRUE			2
+
+#define MAX_INCLUDE_DEPTH		32
+#define MAX_MACRO_DEPTH			32
+
+
+//-----------------------------------------------------------------------------
+// Splitting files into logical lines
+//-----------------------------------------------------------------------------
+static bool ReadFileBytes( const std::string &fileName, std::string &contents )
+{
+	FILE *fp = fopen( fileName.c_str(), "rb" );
+	if ( !fp )
+		return false;
+
+	char buf[4096];
+	size_t nRead;
+	contents.clear();
+	while ( ( nRead = fread( buf, 1, sizeof( buf ), fp ) ) > 0 )
+	{
+		contents.append( buf, nRead );
+	}
+	fclose( fp );
+	return true;
+}
+
+static FxcDirective_t ParseDirective( const std::string &text, std::string &argument )
+{
+	if ( text.empty() || text[0] != '#' )
+		return FXC_DIRECTIVE_NONE;
+
+	size_t nStart = 1;
+	while ( nStart < text.size() && text[nStart] == ' ' )
+	{
+		++nStart;
+	}
+	size_t nEnd = nStart;
+	while ( nEnd < text.size() && isalpha( (unsigned char)text[nEnd] ) )
+	{
+		++nEnd;
+	}
+
+	std::string name = text.substr( nStart, nEnd - nStart );
+	argument = ( nEnd < text.size() ) ? text.substr( nEnd + ( text[nEnd] == ' ' ? 1 : 0 ) ) : std::string();
+
+	static const struct { const char *m_pName; FxcDirective_t m_nDirective; } s_Directives[] =
+	{
+		{ "if", FXC_DIRECTIVE_IF }, { "ifdef", FXC_DIRECTIVE_IFDEF }, { "ifndef", FXC_DIRECTIVE_IFNDEF },
+		{ "elif", FXC_DIRECTIVE_ELIF }, { "else", FXC_DIRECTIVE_ELSE }, { "endif", FXC_DIRECTIVE_ENDIF },
+		{ "define", FXC_DIRECTIVE_DEFINE }, { "undef", FXC_DIRECTIVE_UNDEF }, { "include", FXC_DIRECTIVE_INCLUDE },
+	};
+	for ( size_t i = 0; i < sizeof( s_Directives ) / sizeof( s_Directives[0] ); ++i )
+	{
+		if ( name == s_Directives[i].m_pName )
+			return s_Directives[i].m_nDirective;
+	}
+	return FXC_DIRECTIVE_OTHER;
+}
+
+static void SplitLogicalLines( const std::string &contents, FxcSourceFile_t &file )
+{
+	// Join continuation lines first, remembering where each logical line starts
+	std::string text;
+	std::vector< int > lineOfChar;
+	int nLine = 1;
+	for ( size_t i = 0; i < contents.size(); ++i )
+	{
+		char c = contents[i];
+		if ( c == '\r' )
+			continue;
+
+		if ( c == '\\' && ( i + 1 < contents.size() ) && ( contents[i + 1] == '\n' || contents[i + 1] == '\r' ) )
+		{
+			while ( i + 1 < contents.size() && contents[i + 1] != '\n' )
+			{
+				++i;
+			}
+			++i;
+			++nLine;
+			continue;
+		}
+
+		text += c;
+		lineOfChar.push_back( nLine );
+		if ( c == '\n' )
+		{
+			++nLine;
+		}
+	}
+
+	// Then drop comments and collapse whitespace
+	std::string line;
+	int nLineStart = 1;
+	bool bInBlockComment = false;
+	bool bInString = false;
+	for ( size_t i = 0; i <= text.size(); ++i )
+	{
+		char c = ( i < text.size() ) ? text[i] : '\n';
+		if ( line.empty() && i < text.size() )
+		{
+			nLineStart = lineOfChar[i];
+		}
+
+		if ( bInBlockComment )
+		{
+			if ( c == '*' && i + 1 < text.size() && text[i + 1] == '/' )
+			{
+				bInBlockComment = false;
+				++i;
+				c = ' ';
+			}
+			else if ( c != '\n' )
+			{
+				continue;
+			}
+		}
+		else if ( !bInString && c == '/' && i + 1 < text.size() && text[i + 1] == '/' )
+		{
+			while ( i + 1 < text.size() && text[i + 1] != '\n' )
+			{
+				++i;
+			}
+			continue;
+		}
+		else if ( !bInString && c == '/' && i + 1 < text.size() && text[i + 1] == '*' )
+		{
+			bInBlockComment = true;
+			++i;
+			continue;
+		}
+		else if ( c == '"' )
+		{
+			bInString = !bInString;
+		}
+
+		if ( c == '\n' )
+		{
+			bInString = false;
+			while ( !line.empty() && line[line.size() - 1] == ' ' )
+			{
+				line.erase( line.size() - 1 );
+			}
+
+			if ( !line.empty() )
+			{
+				FxcSourceLine_t logical;
+				logical.m_Text = line;
+				logical.m_nLine = nLineStart;
+				logical.m_nDirective = ParseDirective( line, logical.m_Argument );
+				file.m_Lines.push_back( logical );
+			}
+			line.clear();
+			continue;
+		}
+
+		if ( c == ' ' || c == '\t' )
+		{
+			if ( !line.empty() && line[line.size() - 1] != ' ' )
+			{
+				line += ' ';
+			}
+			continue;
+		}
+
+		line += c;
+	}
+}
+
+const FxcSourceFile_t *CFxcSourceCache::GetFile( const std::string &fileName )
+{
+	std::lock_guard< std::mutex > lock( m_Mutex );
+
+	std::map< std::string, std::unique_ptr< FxcSourceFile_t > >::iterator it = m_Files.find( fileName );
+	if ( it != m_Files.end() )
+		return it->second.get();
+
+	std::string contents;
+	FxcSourceFile_t *pFile = NULL;
+	if ( ReadFileBytes( fileName, contents ) )
+	{
+		pFile = new FxcSourceFile_t;
+		pFile->m_FileName = fileName;
+		ShaderContentHash_Init( &pFile->m_RawHash );
+		ShaderContentHash_ProcessBuffer( &pFile->m_RawHash, contents.data(), contents.size() );
+		ShaderContentHash_Final( &pFile->m_RawHash );
+		SplitLogicalLines( contents, *pFile );
+	}
+
+	// Missing files are remembered too
+	m_Files[fileName].reset( pFile );
+	return pFile;
+}
+
+
+//-----------------------------------------------------------------------------
+// #if expressions, with unknown values
+//-----------------------------------------------------------------------------
+struct PPValue_t
+{
+	bool m_bKnown;
+	long long m_nValue;
+};
+
+static PPValue_t KnownValue( long long nValue )
+{
+	PPValue_t value;
+	value.m_bKnown = true;
+	value.m_nValue = nValue;
+	return value;
+}
+
+static PPValue_t UnknownValue()
+{
+	PPValue_t value;
+	value.m_bKnown = false;
+	value.m_nValue = 0;
+	return value;
+}
+
+class CFxcConditionParser
+{
+public:
+	CFxcConditionParser( const CFxcPreprocessor &pp, const std::string &text, int nDepth ) :
+		m_Preprocessor( pp ), m_Text( text ), m_nPos( 0 ), m_nDepth( nDepth ), m_bError( false )
+	{
+	}
+
+	PPValue_t Evaluate()
+	{
+		PPValue_t value = ParseTernary();
+		SkipSpaces();
+		if ( m_bError || m_nPos != m_Text.size() )
+			return UnknownValue();
+		return value;
+	}
+
+private:
+	void SkipSpaces()
+	{
+		while ( m_nPos < m_Text.size() && isspace( (unsigned char)m_Text[m_nPos] ) )
+		{
+			++m_nPos;
+		}
+	}
+
+	bool Accept( const char *pOp )
+	{
+		SkipSpaces();
+		size_t nLen = strlen( pOp );
+		if ( m_Text.compare( m_nPos, nLen, pOp ) != 0 )
+			return false;
+
+		// Don't take the first char of a longer operator
+		if ( nLen == 1 && m_nPos + 1 < m_Text.size() )
+		{
+			char c = pOp[0];
+			char next = m_Text[m_nPos + 1];
+			if ( ( c == '&' && next == '&' ) || ( c == '|' && next == '|' ) || ( ( c == '<' || c == '>' ) && ( next == '=' || next == c ) ) ||
+				 ( ( c == '!' || c == '=' ) && next == '=' ) )
+				return false;
+		}
+		if ( nLen == 2 && ( pOp[0] == '<' || pOp[0] == '>' ) && pOp[1] == pOp[0] && m_nPos + 2 < m_Text.size() && m_Text[m_nPos + 2] == '=' )
+			return false;
+
+		m_nPos += nLen;
+		return true;
+	}
+
+	std::string ParseIdentifier()
+	{
+		SkipSpaces();
+		size_t nStart = m_nPos;
+		while ( m_nPos < m_Text.size() && ( isalnum( (unsigned char)m_Text[m_nPos] ) || m_Text[m_nPos] == '_' ) )
+		{
+			++m_nPos;
+		}
+		return m_Text.substr( nStart, m_nPos - nStart );
+	}
+
+	PPValue_t ParsePrimary()
+	{
+		SkipSpaces();
+		if ( m_nPos >= m_Text.size() )
+		{
+			m_bError = true;
+			return UnknownValue();
+		}
+
+		char c = m_Text[m_nPos];
+		if ( Accept( "(" ) )
+		{
+			PPValue_t value = ParseTernary();
+			if ( !Accept( ")" ) )
+			{
+				m_bError = true;
+			}
+			return value;
+		}
+
+		if ( isdigit( (unsigned char)c ) )
+		{
+			char *pEnd;
+			long long nValue = strtoll( m_Text.c_str() + m_nPos, &pEnd, 0 );
+			m_nPos = pEnd - m_Text.c_str();
+			while ( m_nPos < m_Text.size() && strchr( "uUlL", m_Text[m_nPos] ) )
+			{
+				++m_nPos;
+			}
+			return KnownValue( nValue );
+		}
+
+		if ( !isalpha( (unsigned char)c ) && c != '_' )
+		{
+			m_bError = true;
+			return UnknownValue();
+		}
+
+		std::string name = ParseIdentifier();
+		if ( name == "defined" )
+		{
+			bool bParen = Accept( "(" );
+			std::string macroName = ParseIdentifier();
+			if ( macroName.empty() || ( bParen && !Accept( ")" ) ) )
+			{
+				m_bError = true;
+				return UnknownValue();
+			}
+
+			std::unordered_map< std::string, CFxcPreprocessor::Macro_t >::const_iterator it = m_Preprocessor.m_Macros.find( macroName );
+			if ( it == m_Preprocessor.m_Macros.end() )
+				return KnownValue( 0 );
+			return ( it->second.m_nState == CFxcPreprocessor::MACRO_MAYBE ) ? UnknownValue() : KnownValue( 1 );
+		}
+
+		std::unordered_map< std::string, CFxcPreprocessor::Macro_t >::const_iterator it = m_Preprocessor.m_Macros.find( name );
+		if ( it == m_Preprocessor.m_Macros.end() )
+			return KnownValue( 0 );
+
+		const CFxcPreprocessor::Macro_t &macro = it->second;
+		if ( macro.m_bFunction )
+		{
+			// Not expanded; skip the arguments
+			SkipSpaces();
+			if ( m_nPos < m_Text.size() && m_Text[m_nPos] == '(' )
+			{
+				int nParens = 0;
+				do
+				{
+					nParens += ( m_Text[m_nPos] == '(' ) - ( m_Text[m_nPos] == ')' );
+					++m_nPos;
+				} while ( nParens > 0 && m_nPos < m_Text.size() );
+			}
+			return UnknownValue();
+		}
+
+		if ( macro.m_nState != CFxcPreprocessor::MACRO_DEFINED || m_nDepth >= MAX_MACRO_DEPTH )
+			return UnknownValue();
+
+		if ( macro.m_Body.empty() )
+			return KnownValue( 0 );
+
+		CFxcConditionParser body( m_Preprocessor, macro.m_Body, m_nDepth + 1 );
+		return body.Evaluate();
+	}
+
+	PPValue_t ParseUnary()
+	{
+		if ( Accept( "!" ) )
+		{
+			PPValue_t value = ParseUnary();
+			return value.m_bKnown ? KnownValue( !value.m_nValue ) : value;
+		}
+		if ( Accept( "~" ) )
+		{
+			PPValue_t value = ParseUnary();
+			return value.m_bKnown ? KnownValue( ~value.m_nValue ) : value;
+		}
+		if ( Accept( "-" ) )
+		{
+			PPValue_t value = ParseUnary();
+			return value.m_bKnown ? KnownValue( -value.m_nValue ) : value;
+		}
+		if ( Accept( "+" ) )
+			return ParseUnary();
+
+		return ParsePrimary();
+	}
+
+	// Binary operators from tightest to loosest
+	PPValue_t ParseBinary( int nLevel )
+	{
+		static const char *s_Levels[][5] =
+		{
+			{ "*", "/", "%", NULL },
+			{ "+", "-", NULL },
+			{ "<<", ">>", NULL },
+			{ "<=", ">=", "<", ">", NULL },
+			{ "==", "!=", NULL },
+			{ "&", NULL },
+			{ "^", NULL },
+			{ "|", NULL },
+			{ "&&", NULL },
+			{ "||", NULL },
+		};
+
+		if ( nLevel < 0 )
+			return ParseUnary();
+
+		PPValue_t left = ParseBinary( nLevel - 1 );
+		for ( ;; )
+		{
+			const char *pOp = NULL;
+			for ( int i = 0; s_Levels[nLevel][i] && !pOp; ++i )
+			{
+				if ( Accept( s_Levels[nLevel][i] ) )
+				{
+					pOp = s_Levels[nLevel][i];
+				}
+			}
+			if ( !pOp )
+				return left;
+
+			PPValue_t right = ParseBinary( nLevel - 1 );
+			left = Apply( pOp, left, right );
+		}
+	}
+
+	static PPValue_t Apply( const char *pOp, PPValue_t a, PPValue_t b )
+	{
+		// A known side can decide && and || on its own
+		if ( !strcmp( pOp, "&&" ) )
+		{
+			if ( ( a.m_bKnown && !a.m_nValue ) || ( b.m_bKnown && !b.m_nValue ) )
+				return KnownValue( 0 );
+			return ( a.m_bKnown && b.m_bKnown ) ? KnownValue( 1 ) : UnknownValue();
+		}
+		if ( !strcmp( pOp, "||" ) )
+		{
+			if ( ( a.m_bKnown && a.m_nValue ) || ( b.m_bKnown && b.m_nValue ) )
+				return KnownValue( 1 );
+			return ( a.m_bKnown && b.m_bKnown ) ? KnownValue( 0 ) : UnknownValue();
+		}
+
+		if ( !a.m_bKnown || !b.m_bKnown )
+			return UnknownValue();
+
+		long long x = a.m_nValue;
+		long long y = b.m_nValue;
+		switch ( pOp[0] )
+		{
+		case '*':	return KnownValue( x * y );
+		case '/':	return y ? KnownValue( x / y ) : UnknownValue();
+		case '%':	return y ? KnownValue( x % y ) : UnknownValue();
+		case '+':	return KnownValue( x + y );
+		case '-':	return KnownValue( x - y );
+		case '^':	return KnownValue( x ^ y );
+		case '&':	return KnownValue( x & y );
+		case '|':	return KnownValue( x | y );
+		case '=':	return KnownValue( x == y );
+		case '!':	return KnownValue( x != y );
+		case '<':
+			if ( pOp[1] == '<' )
+				return KnownValue( x << y );
+			return KnownValue( pOp[1] == '=' ? x <= y : x < y );
+		case '>':
+			if ( pOp[1] == '>' )
+				return KnownValue( x >> y );
+			return KnownValue( pOp[1] == '=' ? x >= y : x > y );
+		}
+		return UnknownValue();
+	}
+
+	PPValue_t ParseTernary()
+	{
+		PPValue_t condition = ParseBinary( 9 );
+		if ( !Accept( "?" ) )
+			return condition;
+
+		PPValue_t a = ParseTernary();
+		if ( !Accept( ":" ) )
+		{
+			m_bError = true;
+			return UnknownValue();
+		}
+		PPValue_t b = ParseTernary();
+
+		if ( condition.m_bKnown )
+			return condition.m_nValue ? a : b;
+		return ( a.m_bKnown && b.m_bKnown && a.m_nValue == b.m_nValue ) ? a : UnknownValue();
+	}
+
+	const CFxcPreprocessor &m_Preprocessor;
+	const std::string &m_Text;
+	size_t m_nPos;
+	int m_nDepth;
+	bool m_bError;
+};
+
+
+//-----------------------------------------------------------------------------
+// Preprocessing
+//-----------------------------------------------------------------------------
+CFxcPreprocessor::CFxcPreprocessor( CFxcSourceCache &sourceCache ) :
+	m_SourceCache( sourceCache ), m_bKeepLines( false )
+{
+}
+
+void CFxcPreprocessor::Define( const char *pName, int nValue )
+{
+	char szValue[32];
+	snprintf( szValue, sizeof( szValue ), "%d", nValue );
+
+	Macro_t &macro = m_InitialMacros[pName];
+	macro.m_nState = MACRO_DEFINED;
+	macro.m_bFunction = false;
+	macro.m_Body = szValue;
+}
+
+void CFxcPreprocessor::DefineVarying( const char *pName )
+{
+	Macro_t &macro = m_InitialMacros[pName];
+	macro.m_nState = MACRO_VARYING;
+	macro.m_bFunction = false;
+	macro.m_Body.clear();
+}
+
+// Compiled, not compiled, or maybe
+int CFxcPreprocessor::EvaluateCondition( const FxcSourceLine_t &line )
+{
+	if ( line.m_nDirective == FXC_DIRECTIVE_IFDEF || line.m_nDirective == FXC_DIRECTIVE_IFNDEF )
+	{
+		std::string name = line.m_Argument.substr( 0, line.m_Argument.find( ' ' ) );
+		std::unordered_map< std::string, Macro_t >::const_iterator it = m_Macros.find( name );
+		if ( it != m_Macros.end() && it->second.m_nState == MACRO_MAYBE )
+			return PP_MAYBE;
+
+		bool bDefined = ( it != m_Macros.end() );
+		return ( bDefined == ( line.m_nDirective == FXC_DIRECTIVE_IFDEF ) ) ? PP_TRUE : PP_FALSE;
+	}
+
+	CFxcConditionParser parser( *this, line.m_Argument, 0 );
+	PPValue_t value = parser.Evaluate();
+	if ( !value.m_bKnown )
+		return PP_MAYBE;
+	return value.m_nValue ? PP_TRUE : PP_FALSE;
+}
+
+static int CombineStates( int nParent, int nCondition )
+{
+	if ( nParent == PP_FALSE || nCondition == PP_FALSE )
+		return PP_FALSE;
+	return ( nParent == PP_MAYBE || nCondition == PP_MAYBE ) ? PP_MAYBE : PP_TRUE;
+}
+
+static void HashLine( ShaderContentHash_t *pHash, int nState, const std::string &text )
+{
+	char marker = ( nState == PP_TRUE ) ? '+' : '?';
+	ShaderContentHash_ProcessBuffer( pHash, &marker, 1 );
+	ShaderContentHash_ProcessBuffer( pHash, text.data(), text.size() );
+	ShaderContentHash_ProcessBuffer( pHash, "\n", 1 );
+}
+
+bool FxcResolveInclude( const std::string &fromFile, const std::string &rootDirectory, const std::string &includeArgument, std::string &resolved )
+{
+	size_t nOpen = includeArgument.find( '"' );
+	size_t nClose = ( nOpen == std::string::npos ) ? std::string::npos : includeArgument.find( '"', nOpen + 1 );
+	if ( nClose == std::string::npos )
+	{
+		resolved.clear();
+		return false;
+	}
+
+	std::string name = includeArgument.substr( nOpen + 1, nClose - nOpen - 1 );
+	size_t nSlash = fromFile.find_last_of( "/\\" );
+	std::string fromDirectory = ( nSlash == std::string::npos ) ? std::string() : fromFile.substr( 0, nSlash + 1 );
+
+	// Next to the including file, then next to the .fxc
+	resolved = fromDirectory + name;
+	FILE *fp = fopen( resolved.c_str(), "rb" );
+	if ( !fp && rootDirectory != fromDirectory )
+	{
+		fp = fopen( ( rootDirectory + name ).c_str(), "rb" );
+		if ( fp )
+		{
+			resolved = rootDirectory + name;
+		}
+	}
+	if ( fp )
+	{
+		fclose( fp );
+	}
+	return fp != NULL;
+}
+
+bool CFxcPreprocessor::ProcessFile( const FxcSourceFile_t &file, int nState, int nDepth, ShaderContentHash_t *pHash, std::string &error )
+{
+	struct Conditional_t
+	{
+		int m_nParent;
+		bool m_bHadTrue;	// an earlier branch is certainly compiled
+		bool m_bHadMaybe;
+	};
+	std::vector< Conditional_t > conditionals;
+
+	bool bListed = false;
+	for ( size_t i = 0; i < m_IncludedFiles.size() && !bListed; ++i )
+	{
+		bListed = ( m_IncludedFiles[i] == file.m_FileName );
+	}
+	if ( !bListed )
+	{
+		m_IncludedFiles.push_back( file.m_FileName );
+	}
+
+	char szLocation[32];
+	for ( size_t i = 0; i < file.m_Lines.size(); ++i )
+	{
+		const FxcSourceLine_t &line = file.m_Lines[i];
+		snprintf( szLocation, sizeof( szLocation ), "(%d): ", line.m_nLine );
+
+		switch ( line.m_nDirective )
+		{
+		case FXC_DIRECTIVE_IF:
+		case FXC_DIRECTIVE_IFDEF:
+		case FXC_DIRECTIVE_IFNDEF:
+			{
+				Conditional_t conditional;
+				conditional.m_nParent = nState;
+				conditional.m_bHadTrue = false;
+				conditional.m_bHadMaybe = false;
+				if ( nState != PP_FALSE )
+				{
+					HashLine( pHash, nState, line.m_Text );
+					int nCondition = EvaluateCondition( line );
+					conditional.m_bHadTrue = ( nCondition == PP_TRUE );
+					conditional.m_bHadMaybe = ( nCondition == PP_MAYBE );
+					nState = CombineStates( nState, nCondition );
+				}
+				conditionals.push_back( conditional );
+			}
+			continue;
+
+		case FXC_DIRECTIVE_ELIF:
+		case FXC_DIRECTIVE_ELSE:
+			{
+				if ( conditionals.empty() )
+				{
+					error = file.m_FileName + szLocation + "#" + ( line.m_nDirective == FXC_DIRECTIVE_ELSE ? "else" : "elif" ) + " without #if";
+					return false;
+				}
+
+				Conditional_t &conditional = conditionals.back();
+				if ( conditional.m_nParent == PP_FALSE )
+					continue;
+
+				HashLine( pHash, conditional.m_nParent, line.m_Text );
+				if ( conditional.m_bHadTrue )
+				{
+					nState = PP_FALSE;
+					continue;
+				}
+
+				int nCondition = ( line.m_nDirective == FXC_DIRECTIVE_ELSE ) ? PP_TRUE : EvaluateCondition( line );
+				int nEffective = ( conditional.m_bHadMaybe && nCondition == PP_TRUE ) ? PP_MAYBE : nCondition;
+				nState = CombineStates( conditional.m_nParent, nEffective );
+				conditional.m_bHadTrue = conditional.m_bHadTrue || ( nCondition == PP_TRUE );
+				conditional.m_bHadMaybe = conditional.m_bHadMaybe || ( nCondition == PP_MAYBE );
+			}
+			continue;
+
+		case FXC_DIRECTIVE_ENDIF:
+			if ( conditionals.empty() )
+			{
+				error = file.m_FileName + szLocation + "#endif without #if";
+				return false;
+			}
+			nState = conditionals.back().m_nParent;
+			conditionals.pop_back();
+			if ( nState != PP_FALSE )
+			{
+				HashLine( pHash, nState, line.m_Text );
+			}
+			continue;
+
+		default:
+			break;
+		}
+
+		if ( nState == PP_FALSE )
+			continue;
+
+		HashLine( pHash, nState, line.m_Text );
+
+		if ( m_bKeepLines && line.m_nDirective == FXC_DIRECTIVE_NONE )
+		{
+			FxcVisibleLine_t visible;
+			visible.m_pFile = &file;
+			visible.m_pLine = &line;
+			visible.m_bMaybe = ( nState == PP_MAYBE );
+			m_Lines.push_back( visible );
+		}
+
+		if ( line.m_nDirective == FXC_DIRECTIVE_DEFINE || line.m_nDirective == FXC_DIRECTIVE_UNDEF )
+		{
+			const std::string &arg = line.m_Argument;
+			size_t nNameEnd = 0;
+			while ( nNameEnd < arg.size() && ( isalnum( (unsigned char)arg[nNameEnd] ) || arg[nNameEnd] == '_' ) )
+			{
+				++nNameEnd;
+			}
+			std::string name = arg.substr( 0, nNameEnd );
+
+			if ( line.m_nDirective == FXC_DIRECTIVE_UNDEF && nState == PP_TRUE )
+			{
+				m_Macros.erase( name );
+				continue;
+			}
+
+			Macro_t &macro = m_Macros[name];
+			macro.m_nState = ( nState == PP_TRUE ) ? MACRO_DEFINED : MACRO_MAYBE;
+			macro.m_bFunction = ( nNameEnd < arg.size() && arg[nNameEnd] == '(' );
+			macro.m_Body = ( nNameEnd < arg.size() ) ? arg.substr( nNameEnd + ( arg[nNameEnd] == ' ' ? 1 : 0 ) ) : std::string();
+		}
+		else if ( line.m_nDirective == FXC_DIRECTIVE_INCLUDE && line.m_Argument.find( '"' ) != std::string::npos )
+		{
+			std::string resolved;
+			const FxcSourceFile_t *pInclude = FxcResolveInclude( file.m_FileName, m_RootDirectory, line.m_Argument, resolved ) ? m_SourceCache.GetFile( resolved ) : NULL;
+			if ( !pInclude )
+			{
+				// The compiler only fails if the include is really compiled
+				if ( nState == PP_TRUE )
+				{
+					error = file.m_FileName + szLocation + "can't open " + line.m_Argument;
+					return false;
+				}
+				continue;
+			}
+
+			if ( nDepth >= MAX_INCLUDE_DEPTH )
+			{
+				error = file.m_FileName + szLocation + "#include nested too deeply";
+				return false;
+			}
+
+			if ( !ProcessFile( *pInclude, nState, nDepth + 1, pHash, error ) )
+				return false;
+		}
+	}
+
+	if ( !conditionals.empty() )
+	{
+		error = file.m_FileName + ": unterminated #if";
+		return false;
+	}
+
+	return true;
+}
+
+bool CFxcPreprocessor::Run( const char *pFileName, ShaderContentHash_t *pHash, std::string &error )
+{
+	m_Macros = m_InitialMacros;
+	m_IncludedFiles.clear();
+	m_Lines.clear();
+
+	std::string fileName( pFileName );
+	size_t nSlash = fileName.find_last_of( "/\\" );
+	m_RootDirectory = ( nSlash == std::string::npos ) ? std::string() : fileName.substr( 0, nSlash + 1 );
+
+	const FxcSourceFile_t *pFile = m_SourceCache.GetFile( fileName );
+	if ( !pFile )
+	{
+		error = "unable to open " + fileName;
+		return false;
+	}
+
+	ShaderContentHash_Init( pHash );
+	bool bOk = ProcessFile( *pFile, PP_TRUE, 0, pHash, error );
+	ShaderContentHash_Final( pHash );
+	return bOk;
+}
+
+std::string CFxcPreprocessor::ExpandMacros( const std::string &text ) const
+{
+	std::string result = text;
+	for ( int nDepth = 0; nDepth < MAX_MACRO_DEPTH; ++nDepth )
+	{
+		std::string expanded;
+		bool bChanged = false;
+		size_t i = 0;
+		while ( i < result.size() )
+		{
+			char c = result[i];
+			if ( !isalpha( (unsigned char)c ) && c != '_' )
+			{
+				// Don't split numbers like 1e5 into identifiers
+				size_t nStart = i++;
+				if ( isdigit( (unsigned char)c ) )
+				{
+					while ( i < result.size() && ( isalnum( (unsigned char)result[i] ) || result[i] == '_' || result[i] == '.' ) )
+					{
+						++i;
+					}
+				}
+				expanded.append( result, nStart, i - nStart );
+				continue;
+			}
+
+			size_t nStart = i;
+			while ( i < result.size() && ( isalnum( (unsigned char)result[i] ) || result[i] == '_' ) )
+			{
+				++i;
+			}
+			std::string name = result.substr( nStart, i - nStart );
+			std::unordered_map< std::string, Macro_t >::const_iterator it = m_Macros.find( name );
+			if ( it != m_Macros.end() && it->second.m_nState == MACRO_DEFINED && !it->second.m_bFunction )
+			{
+				expanded += it->second.m_Body;
+				bChanged = true;
+			}
+			else
+			{
+				expanded += name;
+			}
+		}
+
+		result.swap( expanded );
+		if ( !bChanged )
+			break;
+	}
+	return result;
+}
@@ -0,0 +1,151 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Conditional-only preprocessor for .fxc files. It follows
+//			#include, #define and #if the way the shader compiler does, but
+//			only to find which lines the compiler would see. Those lines are
+//			hashed, not expanded.
+//
+//			Macros can be left varying (the dynamic combos of a static combo
+//			job). Blocks whose #if depends on them are kept and hashed with
+//			their conditions, so one hash covers every value they can take.
+//
+//===========================================================================//
+
+#ifndef FXCPREPROCESS_H
+#define FXCPREPROCESS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "shaderhash.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+enum FxcDirective_t
+{
+	FXC_DIRECTIVE_NONE,
+	FXC_DIRECTIVE_IF,
+	FXC_DIRECTIVE_IFDEF,
+	FXC_DIRECTIVE_IFNDEF,
+	FXC_DIRECTIVE_ELIF,
+	FXC_DIRECTIVE_ELSE,
+	FXC_DIRECTIVE_ENDIF,
+	FXC_DIRECTIVE_DEFINE,
+	FXC_DIRECTIVE_UNDEF,
+	FXC_DIRECTIVE_INCLUDE,
+	FXC_DIRECTIVE_OTHER,
+};
+
+// One logical line: continuations joined, comments removed, whitespace
+// collapsed. Blank lines are dropped, so comment and spacing edits don't
+// change the hash.
+struct FxcSourceLine_t
+{
+	std::string m_Text;
+	int m_nLine;
+	FxcDirective_t m_nDirective;
+	std::string m_Argument;		// text after the directive name
+};
+
+struct FxcSourceFile_t
+{
+	std::string m_FileName;
+	std::vector< FxcSourceLine_t > m_Lines;
+	ShaderContentHash_t m_RawHash;	// of the file bytes
+};
+
+
+//-----------------------------------------------------------------------------
+// Source files are read and split into lines once, then shared by every
+// preprocessor run. Thread safe.
+//-----------------------------------------------------------------------------
+class CFxcSourceCache
+{
+public:
+	// NULL if the file can't be read
+	const FxcSourceFile_t *GetFile( const std::string &fileName );
+
+private:
+	std::mutex m_Mutex;
+	std::map< std::string, std::unique_ptr< FxcSourceFile_t > > m_Files;
+};
+
+
+// A line the last Run kept, with the file it came from
+struct FxcVisibleLine_t
+{
+	const FxcSourceFile_t *m_pFile;
+	const FxcSourceLine_t *m_pLine;
+	bool m_bMaybe;		// in a block that depends on a varying macro
+};
+
+
+// Finds the file named by an #include argument: next to the including file,
+// then in rootDirectory (the .fxc's directory, with a trailing slash). If the
+// file isn't found, resolved is where it was first looked for.
+bool FxcResolveInclude( const std::string &fromFile, const std::string &rootDirectory, const std::string &includeArgument, std::string &resolved );
+
+
+class CFxcPreprocessor
+{
+public:
+	explicit CFxcPreprocessor( CFxcSourceCache &sourceCache );
+
+	void Define( const char *pName, int nValue );
+
+	// Defined, but with a value that isn't known
+	void DefineVarying( const char *pName );
+
+	// Hashes the lines the compiler would see. Can be called again after
+	// changing the defines.
+	bool Run( const char *pFileName, ShaderContentHash_t *pHash, std::string &error );
+
+	// Files read by the last Run, the root file first
+	const std::vector< std::string > &GetIncludedFiles() const { return m_IncludedFiles; }
+
+	// With KeepLines( true ), Run also records the lines that aren't directives
+	// in the blocks the compiler sees or may see. They point into the source
+	// cache.
+	void KeepLines( bool bKeep ) { m_bKeepLines = bKeep; }
+	const std::vector< FxcVisibleLine_t > &GetLines() const { return m_Lines; }
+
+	// Replaces the object-like macros in text with their bodies, as defined at
+	// the end of the last Run. Varying and function-like macros are left alone.
+	std::string ExpandMacros( const std::string &text ) const;
+
+private:
+	enum MacroState_t
+	{
+		MACRO_DEFINED,
+		MACRO_VARYING,	// defined, unknown value
+		MACRO_MAYBE,	// defined or #undef'd in a block that may not be compiled
+	};
+
+	struct Macro_t
+	{
+		MacroState_t m_nState;
+		bool m_bFunction;
+		std::string m_Body;
+	};
+
+	bool ProcessFile( const FxcSourceFile_t &file, int nState, int nDepth, ShaderContentHash_t *pHash, std::string &error );
+	int EvaluateCondition( const FxcSourceLine_t &line );
+
+	CFxcSourceCache &m_SourceCache;
+	std::unordered_map< std::string, Macro_t > m_InitialMacros;
+	std::unordered_map< std::string, Macro_t > m_Macros;
+	std::string m_RootDirectory;
+	std::vector< std::string > m_IncludedFiles;
+	bool m_bKeepLines;
+	std::vector< FxcVisibleLine_t > m_Lines;
+
+	friend class CFxcConditionParser;
+};
+
+
+#endif // FXCPREPROCESS_H
@@ -0,0 +1,275 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Prints the #include graph of a shader list and finds the shaders
+//			whose sources changed since the last build.
+//
+//			shaderdeps [-manifest file] [-update] [-stale] [-graph] <file.fxc | list.txt> ...
+//
+//			The manifest records each shader's fingerprint and the CRC of
+//			every file it reads. Shaders are stale when their fingerprint
+//			differs or they aren't in the manifest; the report names the
+//			inputs that changed. -update rewrites the manifest, -stale only
+//			prints the stale .fxc paths (for build scripts), -graph prints
+//			each shader's include tree.
+//
+//			g++ -O2 -o shaderdeps shaderdeps.cpp fxcdeps.cpp fxcpreprocess.cpp fxccombos.cpp shaderhash.cpp
+//
+//===========================================================================//
+
+#include "fxccombos.h"
+#include "fxcdeps.h"
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//-----------------------------------------------------------------------------
+// Manifest: a shader line, then one indented line per input
+//
+//		pbr_vs30.fxc	0x1a2b3c4d
+//			common_vs_fxc.h	0x01234567
+//-----------------------------------------------------------------------------
+struct ManifestShader_t
+{
+	uint32_t m_nFingerprint;
+	std::map< std::string, uint32_t > m_Inputs;
+};
+
+typedef std::map< std::string, ManifestShader_t > Manifest_t;
+
+static bool ReadManifest( const char *pFileName, Manifest_t &manifest )
+{
+	FILE *fp = fopen( pFileName, "rt" );
+	if ( !fp )
+		return false;
+
+	ManifestShader_t *pShader = NULL;
+	char szLine[1024];
+	while ( fgets( szLine, sizeof( szLine ), fp ) )
+	{
+		if ( szLine[0] == '/' || szLine[0] == '\n' || szLine[0] == '\r' )
+			continue;
+
+		bool bInput = ( szLine[0] == '\t' );
+		char *pName = szLine + ( bInput ? 1 : 0 );
+		char *pTab = strchr( pName, '\t' );
+		if ( !pTab )
+			continue;
+
+		*pTab = 0;
+		uint32_t nValue = (uint32_t)strtoul( pTab + 1, NULL, 16 );
+		if ( !bInput )
+		{
+			pShader = &manifest[pName];
+			pShader->m_nFingerprint = nValue;
+		}
+		else if ( pShader )
+		{
+			pShader->m_Inputs[pName] = nValue;
+		}
+	}
+
+	fclose( fp );
+	return true;
+}
+
+static bool WriteManifest( const char *pFileName, const CShaderDependencyGraph &graph )
+{
+	FILE *fp = fopen( pFileName, "wt" );
+	if ( !fp )
+		return false;
+
+	fprintf( fp, "// Written by shaderdeps. Shader fingerprint, then the CRC of each input.\n" );
+	std::vector< int > inputs;
+	for ( int i = 0; i < graph.GetShaderCount(); ++i )
+	{
+		fprintf( fp, "%s\t0x%08x\n", graph.GetFile( graph.GetShaderFile( i ) ).m_RelativeName.c_str(), graph.GetFingerprint( i ) );
+
+		graph.GetInputs( i, inputs );
+		for ( size_t j = 0; j < inputs.size(); ++j )
+		{
+			const ShaderDependencyFile_t &file = graph.GetFile( inputs[j] );
+			fprintf( fp, "\t%s\t0x%08x%s\n", file.m_RelativeName.c_str(), file.m_nContentCRC, file.m_bMissing ? "\tmissing" : "" );
+		}
+	}
+
+	return fclose( fp ) == 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Reporting
+//-----------------------------------------------------------------------------
+static void PrintIncludeTree( const CShaderDependencyGraph &graph, int nFile, int nDepth, std::vector< bool > &printed )
+{
+	const ShaderDependencyFile_t &file = graph.GetFile( nFile );
+	printf( "%*s%s%s%s\n", 2 + nDepth * 2, "", file.m_RelativeName.c_str(), file.m_bMissing ? " (missing)" : "",
+		( printed[nFile] && !file.m_Includes.empty() ) ? " ..." : "" );
+	if ( printed[nFile] )
+		return;
+
+	printed[nFile] = true;
+	for ( size_t i = 0; i < file.m_Includes.size(); ++i )
+	{
+		PrintIncludeTree( graph, file.m_Includes[i], nDepth + 1, printed );
+	}
+}
+
+// Names the inputs that differ from the manifest
+static std::string DescribeChanges( const CShaderDependencyGraph &graph, int nShader, const ManifestShader_t &previous )
+{
+	std::vector< int > inputs;
+	graph.GetInputs( nShader, inputs );
+
+	std::string changes;
+	std::map< std::string, uint32_t > removed = previous.m_Inputs;
+	for ( size_t i = 0; i < inputs.size(); ++i )
+	{
+		const ShaderDependencyFile_t &file = graph.GetFile( inputs[i] );
+		std::map< std::string, uint32_t >::iterator it = removed.find( file.m_RelativeName );
+		const char *pChange = NULL;
+		if ( it == removed.end() )
+		{
+			pChange = "added";
+		}
+		else
+		{
+			pChange = ( it->second != file.m_nContentCRC ) ? "changed" : NULL;
+			removed.erase( it );
+		}
+
+		if ( pChange )
+		{
+			changes += ( changes.empty() ? "" : ", " ) + file.m_RelativeName + " " + pChange;
+		}
+	}
+
+	for ( std::map< std::string, uint32_t >::iterator it = removed.begin(); it != removed.end(); ++it )
+	{
+		changes += ( changes.empty() ? "" : ", " ) + it->first + " no longer included";
+	}
+
+	return changes;
+}
+
+static void PrintUsage()
+{
+	printf( "usage: shaderdeps [-manifest file] [-update] [-stale] [-graph] <file.fxc | list.txt> ...\n" );
+}
+
+int main( int argc, char **argv )
+{
+	const char *pManifestName = NULL;
+	bool bUpdate = false;
+	bool bStaleOnly = false;
+	bool bGraph = false;
+	std::vector< std::string > files;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !strcmp( argv[i], "-manifest" ) && i + 1 < argc )
+		{
+			pManifestName = argv[++i];
+		}
+		else if ( !strcmp( argv[i], "-update" ) )
+		{
+			bUpdate = true;
+		}
+		else if ( !strcmp( argv[i], "-stale" ) )
+		{
+			bStaleOnly = true;
+		}
+		else if ( !strcmp( argv[i], "-graph" ) )
+		{
+			bGraph = true;
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else if ( !FxcAddShaderArgument( argv[i], files ) )
+		{
+			fprintf( stderr, "unable to open %s\n", argv[i] );
+			return 1;
+		}
+	}
+
+	if ( files.empty() || ( bUpdate && !pManifestName ) )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	CFxcSourceCache sourceCache;
+	CShaderDependencyGraph graph( sourceCache );
+	for ( size_t i = 0; i < files.size(); ++i )
+	{
+		graph.AddShader( files[i] );
+	}
+
+	Manifest_t manifest;
+	bool bHaveManifest = pManifestName && ReadManifest( pManifestName, manifest );
+
+	int nStale = 0;
+	for ( int i = 0; i < graph.GetShaderCount(); ++i )
+	{
+		const ShaderDependencyFile_t &shaderFile = graph.GetFile( graph.GetShaderFile( i ) );
+		uint32_t nFingerprint = graph.GetFingerprint( i );
+
+		Manifest_t::const_iterator it = manifest.find( shaderFile.m_RelativeName );
+		bool bStale = ( it == manifest.end() ) || ( it->second.m_nFingerprint != nFingerprint );
+		nStale += bStale ? 1 : 0;
+
+		if ( bStaleOnly )
+		{
+			if ( bStale )
+			{
+				printf( "%s\n", shaderFile.m_FileName.c_str() );
+			}
+			continue;
+		}
+
+		if ( shaderFile.m_bMissing )
+		{
+			printf( "%s: missing\n", shaderFile.m_FileName.c_str() );
+		}
+		else if ( !bHaveManifest )
+		{
+			printf( "%s: sources 0x%08x\n", shaderFile.m_FileName.c_str(), nFingerprint );
+		}
+		else if ( it == manifest.end() )
+		{
+			printf( "%s: stale, not in the manifest\n", shaderFile.m_FileName.c_str() );
+		}
+		else if ( bStale )
+		{
+			std::string changes = DescribeChanges( graph, i, it->second );
+			printf( "%s: stale, %s\n", shaderFile.m_FileName.c_str(), changes.empty() ? "renamed inputs" : changes.c_str() );
+		}
+		else
+		{
+			printf( "%s: up to date\n", shaderFile.m_FileName.c_str() );
+		}
+
+		if ( bGraph )
+		{
+			std::vector< bool > printed( graph.GetFileCount(), false );
+			PrintIncludeTree( graph, graph.GetShaderFile( i ), 0, printed );
+		}
+	}
+
+	if ( !bStaleOnly && bHaveManifest )
+	{
+		printf( "%d of %d shaders need rebuilding\n", nStale, graph.GetShaderCount() );
+	}
+
+	if ( bUpdate && !WriteManifest( pManifestName, graph ) )
+	{
+		fprintf( stderr, "unable to write %s\n", pManifestName );
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,95 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Portable hashes for the shader tools.
+//
+//===========================================================================//
+
+#include "shaderhash.h"
+#include <stdio.h>
+
+
+// Built on first use; function statics are thread safe to initialize
+struct CRCTable_t
+{
+	CRCTable_t()
+	{
+		for ( uint32_t i = 0; i < 256; ++i )
+		{
+			uint32_t nValue = i;
+			for ( int j = 0; j < 8; ++j )
+			{
+				nValue = ( nValue & 1 ) ? ( 0xEDB88320 ^ ( nValue >> 1 ) ) : ( nValue >> 1 );
+			}
+			m_Entries[i] = nValue;
+		}
+	}
+
+	uint32_t m_Entries[256];
+};
+
+static const uint32_t *GetCRCTable()
+{
+	static CRCTable_t s_Table;
+	return s_Table.m_Entries;
+}
+
+void ShaderCRC32_Init( uint32_t *pCRC )
+{
+	*pCRC = 0xFFFFFFFF;
+}
+
+void ShaderCRC32_ProcessBuffer( uint32_t *pCRC, const void *pData, size_t nLength )
+{
+	const uint32_t *pTable = GetCRCTable();
+	const uint8_t *p = (const uint8_t *)pData;
+	uint32_t nCRC = *pCRC;
+	for ( size_t i = 0; i < nLength; ++i )
+	{
+		nCRC = pTable[( nCRC ^ p[i] ) & 0xFF] ^ ( nCRC >> 8 );
+	}
+	*pCRC = nCRC;
+}
+
+void ShaderCRC32_Final( uint32_t *pCRC )
+{
+	*pCRC ^= 0xFFFFFFFF;
+}
+
+void ShaderHash64_Init( uint64_t *pHash )
+{
+	*pHash = 14695981039346656037ULL;
+}
+
+void ShaderHash64_ProcessBuffer( uint64_t *pHash, const void *pData, size_t nLength )
+{
+	const uint8_t *p = (const uint8_t *)pData;
+	uint64_t nHash = *pHash;
+	for ( size_t i = 0; i < nLength; ++i )
+	{
+		nHash ^= p[i];
+		nHash *= 1099511628211ULL;
+	}
+	*pHash = nHash;
+}
+
+void ShaderContentHash_Init( ShaderContentHash_t *pHash )
+{
+	ShaderCRC32_Init( &pHash->m_nCRC );
+	ShaderHash64_Init( &pHash->m_nHash );
+}
+
+void ShaderContentHash_ProcessBuffer( ShaderContentHash_t *pHash, const void *pData, size_t nLength )
+{
+	ShaderCRC32_ProcessBuffer( &pHash->m_nCRC, pData, nLength );
+	ShaderHash64_ProcessBuffer( &pHash->m_nHash, pData, nLength );
+}
+
+void ShaderContentHash_Final( ShaderContentHash_t *pHash )
+{
+	ShaderCRC32_Final( &pHash->m_nCRC );
+}
+
+void ShaderContentHash_ToString( const ShaderContentHash_t &hash, char *pBuf, size_t nBufSize )
+{
+	snprintf( pBuf, nBufSize, "%08x%016llx", hash.m_nCRC, (unsigned long long)hash.m_nHash );
+}
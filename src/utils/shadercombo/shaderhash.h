@@ -0,0 +1,61 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Portable hashes for the shader tools. The CRC32 is the same
+//			checksum as tier1's checksum_crc.h (reflected 0xEDB88320), so its
+//			values can be compared with m_nSourceCRC32 in .vcs headers.
+//
+//===========================================================================//
+
+#ifndef SHADERHASH_H
+#define SHADERHASH_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+void ShaderCRC32_Init( uint32_t *pCRC );
+void ShaderCRC32_ProcessBuffer( uint32_t *pCRC, const void *pData, size_t nLength );
+void ShaderCRC32_Final( uint32_t *pCRC );
+
+inline uint32_t ShaderCRC32_ProcessSingleBuffer( const void *pData, size_t nLength )
+{
+	uint32_t nCRC;
+	ShaderCRC32_Init( &nCRC );
+	ShaderCRC32_ProcessBuffer( &nCRC, pData, nLength );
+	ShaderCRC32_Final( &nCRC );
+	return nCRC;
+}
+
+// 64-bit FNV-1a, used next to the CRC so two different blocks practically
+// never share a key
+void ShaderHash64_Init( uint64_t *pHash );
+void ShaderHash64_ProcessBuffer( uint64_t *pHash, const void *pData, size_t nLength );
+
+inline uint64_t ShaderHash64( const void *pData, size_t nLength )
+{
+	uint64_t nHash;
+	ShaderHash64_Init( &nHash );
+	ShaderHash64_ProcessBuffer( &nHash, pData, nLength );
+	return nHash;
+}
+
+
+// Both hashes of the same data, used as a content address
+struct ShaderContentHash_t
+{
+	uint32_t m_nCRC;
+	uint64_t m_nHash;
+};
+
+void ShaderContentHash_Init( ShaderContentHash_t *pHash );
+void ShaderContentHash_ProcessBuffer( ShaderContentHash_t *pHash, const void *pData, size_t nLength );
+void ShaderContentHash_Final( ShaderContentHash_t *pHash );
+
+// 24 hex digits; pBuf needs room for 25 chars
+void ShaderContentHash_ToString( const ShaderContentHash_t &hash, char *pBuf, size_t nBufSize );
+
+
+#endif // SHADERHASH_H
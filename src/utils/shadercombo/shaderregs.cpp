@@ -0,0 +1,1151 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Checks the constant registers of .fxc shaders against each other
+//			and against shader_constant_register_map.h.
+//
+//			shaderregs [-ver 30] [-cpp file.cpp ...] [-pack NAME,NAME,...]
+//					   <file.fxc | list.txt> ...
+//
+//			Each shader is preprocessed the way fxc sees it, with the combos
+//			left varying, and every "x : register( ... )" declaration is
+//			sized from its type (structs included). The report lists:
+//
+//			- declarations whose registers overlap in a combo that is
+//			  compiled; declarations in different #if branches don't clash
+//			- declarations that hard-code a register instead of using a
+//			  register map name, or need more registers than their map entry
+//			- map entries that overlap each other
+//			- free registers below the highest one a shader uses
+//			- SetPixelShaderConstant calls in the -cpp files that pass a
+//			  register number instead of a map name
+//
+//			-pack takes register map names in upload order and prints the
+//			lowest block of free registers that holds all of them, as
+//			#define lines for the map, so the C++ side can upload them with
+//			one SetPixelShaderConstant( first, pData, count ). Names that
+//			aren't in the map yet are added with one register each.
+//
+//			The exit code is 1 if declarations overlap, a declaration is
+//			bigger than its map entry, or map entries overlap.
+//
+//			g++ -O2 -o shaderregs shaderregs.cpp fxcpreprocess.cpp fxccombos.cpp shaderhash.cpp
+//
+//===========================================================================//
+
+#include "fxccombos.h"
+#include "fxcpreprocess.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Float constant registers of each target
+#define PS_2_X_CONSTANTS	32
+#define PS_3_0_CONSTANTS	224
+#define VS_CONSTANTS		256
+
+// Largest number of value combinations tried for one pair of declarations
+#define MAX_OVERLAP_ASSIGNMENTS		4096
+
+
+//-----------------------------------------------------------------------------
+// One "name : register( ... )" declaration
+//-----------------------------------------------------------------------------
+struct RegisterDecl_t
+{
+	std::string m_Name;
+	std::string m_FileName;
+	int m_nLine;
+	std::string m_RegisterArg;	// as written, e.g. PSREG_MRAO_FACTORS or c50
+	char m_cClass;				// c, b, i or s
+	int m_nFirst;
+	int m_nCount;
+	bool m_bMaybe;				// only compiled in some combos
+	std::vector< int > m_DependsOn;	// combo slots that can drop it
+};
+
+struct RegisterMapEntry_t
+{
+	std::string m_Name;
+	int m_nFirst;
+	int m_nCount;				// the #define plus the commented lines after it
+	int m_nLine;
+};
+
+struct ShaderRegisters_t
+{
+	std::string m_Name;
+	std::string m_FileName;
+	bool m_bPixelShader;
+	int m_nMaxConstants;
+	std::vector< FxcComboVar_t > m_Vars;
+	std::vector< RegisterDecl_t > m_Decls;
+};
+
+struct RegisterReport_t
+{
+	int m_nErrors;
+	int m_nWarnings;
+};
+
+
+static void PrintUsage()
+{
+	printf( "usage: shaderregs [-ver 30] [-cpp file.cpp ...] [-pack NAME,NAME,...] <file.fxc | list.txt> ...\n" );
+}
+
+static std::string FileNameOnly( const std::string &path )
+{
+	size_t nSlash = path.find_last_of( "/\\" );
+	return ( nSlash == std::string::npos ) ? path : path.substr( nSlash + 1 );
+}
+
+static std::string Trim( const std::string &text )
+{
+	size_t nStart = 0;
+	size_t nEnd = text.size();
+	while ( nStart < nEnd && isspace( (unsigned char)text[nStart] ) )
+	{
+		++nStart;
+	}
+	while ( nEnd > nStart && isspace( (unsigned char)text[nEnd - 1] ) )
+	{
+		--nEnd;
+	}
+	return text.substr( nStart, nEnd - nStart );
+}
+
+static void SplitTokens( const std::string &text, std::vector< std::string > &tokens )
+{
+	// Brackets are tokens of their own, "x[ 2 ]" and "x [2]" split the same way
+	tokens.clear();
+	std::string token;
+	for ( size_t i = 0; i <= text.size(); ++i )
+	{
+		char c = ( i < text.size() ) ? text[i] : ' ';
+		if ( isspace( (unsigned char)c ) || c == '[' || c == ']' )
+		{
+			if ( !token.empty() )
+			{
+				tokens.push_back( token );
+				token.clear();
+			}
+			if ( c == '[' || c == ']' )
+			{
+				tokens.push_back( std::string( 1, c ) );
+			}
+		}
+		else
+		{
+			token += c;
+		}
+	}
+}
+
+static std::string RangeText( char cClass, int nFirst, int nCount )
+{
+	char szText[32];
+	if ( nCount <= 1 )
+	{
+		snprintf( szText, sizeof( szText ), "%c%d", cClass, nFirst );
+	}
+	else
+	{
+		snprintf( szText, sizeof( szText ), "%c%d-%c%d", cClass, nFirst, cClass, nFirst + nCount - 1 );
+	}
+	return szText;
+}
+
+
+//-----------------------------------------------------------------------------
+// Register map. Entries look like
+//
+//	#define PSREG_AMBIENT_CUBE		PSREG_CONSTANT_04
+//	//		PSREG_AMBIENT_CUBE		PSREG_CONSTANT_05
+//
+// where the commented lines mark the further registers of the entry above.
+//-----------------------------------------------------------------------------
+static bool ParseRegisterMapLine( const char *pLine, std::string &name, int &nRegister )
+{
+	std::vector< std::string > tokens;
+	SplitTokens( pLine, tokens );
+	if ( tokens.size() < 2 || tokens[0].compare( 0, 6, "PSREG_" ) != 0 || tokens[1].compare( 0, 15, "PSREG_CONSTANT_" ) != 0 )
+		return false;
+
+	name = tokens[0];
+	nRegister = atoi( tokens[1].c_str() + 15 );
+	return true;
+}
+
+static bool LoadRegisterMap( const std::string &fileName, std::vector< RegisterMapEntry_t > &entries, RegisterReport_t &report )
+{
+	FILE *fp = fopen( fileName.c_str(), "rt" );
+	if ( !fp )
+		return false;
+
+	char szLine[1024];
+	int nLine = 0;
+	while ( fgets( szLine, sizeof( szLine ), fp ) )
+	{
+		++nLine;
+		const char *pText = szLine;
+		while ( isspace( (unsigned char)*pText ) )
+		{
+			++pText;
+		}
+
+		std::string name;
+		int nRegister;
+		if ( !strncmp( pText, "#define", 7 ) && ParseRegisterMapLine( pText + 7, name, nRegister ) )
+		{
+			RegisterMapEntry_t entry;
+			entry.m_Name = name;
+			entry.m_nFirst = nRegister;
+			entry.m_nCount = 1;
+			entry.m_nLine = nLine;
+			entries.push_back( entry );
+		}
+		else if ( !strncmp( pText, "//", 2 ) && ParseRegisterMapLine( pText + 2, name, nRegister ) )
+		{
+			if ( entries.empty() || entries.back().m_Name != name ||
+				 entries.back().m_nFirst + entries.back().m_nCount != nRegister )
+			{
+				printf( "%s(%d): warning: %s c%d doesn't continue the entry above it\n", FileNameOnly( fileName ).c_str(),
+					nLine, name.c_str(), nRegister );
+				++report.m_nWarnings;
+				continue;
+			}
+			++entries.back().m_nCount;
+		}
+	}
+	fclose( fp );
+
+	for ( size_t i = 0; i < entries.size(); ++i )
+	{
+		for ( size_t j = 0; j < i; ++j )
+		{
+			const RegisterMapEntry_t &a = entries[j];
+			const RegisterMapEntry_t &b = entries[i];
+			if ( a.m_nFirst < b.m_nFirst + b.m_nCount && b.m_nFirst < a.m_nFirst + a.m_nCount )
+			{
+				printf( "%s(%d): error: %s (%s) overlaps %s (%s) from line %d\n", FileNameOnly( fileName ).c_str(), b.m_nLine,
+					b.m_Name.c_str(), RangeText( 'c', b.m_nFirst, b.m_nCount ).c_str(), a.m_Name.c_str(),
+					RangeText( 'c', a.m_nFirst, a.m_nCount ).c_str(), a.m_nLine );
+				++report.m_nErrors;
+			}
+		}
+	}
+	return true;
+}
+
+static const RegisterMapEntry_t *FindMapEntry( const std::vector< RegisterMapEntry_t > &entries, const std::string &name )
+{
+	for ( size_t i = 0; i < entries.size(); ++i )
+	{
+		if ( entries[i].m_Name == name )
+			return &entries[i];
+	}
+	return NULL;
+}
+
+static const RegisterMapEntry_t *FindMapEntry( const std::vector< RegisterMapEntry_t > &entries, int nRegister )
+{
+	for ( size_t i = 0; i < entries.size(); ++i )
+	{
+		if ( nRegister >= entries[i].m_nFirst && nRegister < entries[i].m_nFirst + entries[i].m_nCount )
+			return &entries[i];
+	}
+	return NULL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Declarations
+//-----------------------------------------------------------------------------
+static bool IsQualifier( const std::string &token )
+{
+	static const char *s_Qualifiers[] = { "const", "static", "uniform", "extern", "volatile", "shared", "row_major", "column_major" };
+	for ( size_t i = 0; i < sizeof( s_Qualifiers ) / sizeof( s_Qualifiers[0] ); ++i )
+	{
+		if ( token == s_Qualifiers[i] )
+			return true;
+	}
+	return false;
+}
+
+// Float registers one value of the type takes, or 0 if the type isn't known
+static int TypeRegisterCount( const std::string &type, bool bRowMajor, const std::map< std::string, int > &structs )
+{
+	static const char *s_Scalars[] = { "float", "half", "double", "int", "uint", "bool" };
+	for ( size_t i = 0; i < sizeof( s_Scalars ) / sizeof( s_Scalars[0] ); ++i )
+	{
+		size_t nLen = strlen( s_Scalars[i] );
+		if ( type.compare( 0, nLen, s_Scalars[i] ) != 0 )
+			continue;
+
+		const char *pDims = type.c_str() + nLen;
+		if ( !*pDims || ( pDims[0] >= '1' && pDims[0] <= '4' && !pDims[1] ) )
+			return 1;
+
+		// floatRxC is column major unless declared row_major: one register per column
+		if ( pDims[0] >= '1' && pDims[0] <= '4' && pDims[1] == 'x' && pDims[2] >= '1' && pDims[2] <= '4' && !pDims[3] )
+			return bRowMajor ? pDims[0] - '0' : pDims[2] - '0';
+	}
+
+	if ( type == "vector" || type.compare( 0, 7, "sampler" ) == 0 || type.compare( 0, 7, "texture" ) == 0 )
+		return 1;
+	if ( type == "matrix" )
+		return 4;
+
+	std::map< std::string, int >::const_iterator it = structs.find( type );
+	return ( it != structs.end() ) ? it->second : 0;
+}
+
+// Parses "qualifiers type name[N]" (already macro expanded) into the type,
+// name and element count
+static bool ParseDeclarator( const std::string &text, std::string &type, std::string &name, bool &bRowMajor, int &nElements )
+{
+	std::vector< std::string > tokens;
+	SplitTokens( text, tokens );
+
+	size_t nName = 0;
+	while ( nName < tokens.size() && tokens[nName] != "[" )
+	{
+		++nName;
+	}
+	if ( nName < 2 )
+		return false;
+	--nName;
+
+	name = tokens[nName];
+	type = tokens[nName - 1];
+	bRowMajor = false;
+	for ( size_t i = 0; i + 1 < nName; ++i )
+	{
+		if ( tokens[i] == "row_major" )
+		{
+			bRowMajor = true;
+		}
+		else if ( !IsQualifier( tokens[i] ) )
+		{
+			return false;
+		}
+	}
+
+	nElements = 1;
+	for ( size_t i = nName + 1; i < tokens.size(); i += 3 )
+	{
+		if ( tokens[i] != "[" || i + 2 >= tokens.size() || tokens[i + 2] != "]" )
+			return false;
+		char *pEnd;
+		long nCount = strtol( tokens[i + 1].c_str(), &pEnd, 0 );
+		if ( *pEnd || nCount <= 0 )
+			return false;
+		nElements *= (int)nCount;
+	}
+	return true;
+}
+
+// Struct sizes, from the struct definitions among the lines
+static void CollectStructs( const CFxcPreprocessor &pp, std::map< std::string, int > &structs )
+{
+	const std::vector< FxcVisibleLine_t > &lines = pp.GetLines();
+	for ( size_t i = 0; i < lines.size(); ++i )
+	{
+		std::vector< std::string > tokens;
+		SplitTokens( lines[i].m_pLine->m_Text, tokens );
+		if ( tokens.size() < 2 || tokens[0] != "struct" )
+			continue;
+
+		// Everything up to the closing brace
+		std::string name = tokens[1].substr( 0, tokens[1].find( '{' ) );
+		std::string body = lines[i].m_pLine->m_Text;
+		size_t j = i;
+		while ( body.find( '}' ) == std::string::npos && ++j < lines.size() )
+		{
+			body += " " + lines[j].m_pLine->m_Text;
+		}
+
+		size_t nOpen = body.find( '{' );
+		size_t nClose = body.find( '}' );
+		if ( nOpen == std::string::npos || nClose == std::string::npos )
+			continue;
+
+		int nSize = 0;
+		std::string members = pp.ExpandMacros( body.substr( nOpen + 1, nClose - nOpen - 1 ) );
+		size_t nStart = 0;
+		while ( nStart < members.size() )
+		{
+			size_t nEnd = members.find( ';', nStart );
+			if ( nEnd == std::string::npos )
+			{
+				nEnd = members.size();
+			}
+
+			// Drop semantics like ": COLOR0"
+			std::string member = members.substr( nStart, nEnd - nStart );
+			member = Trim( member.substr( 0, member.find( ':' ) ) );
+			nStart = nEnd + 1;
+			if ( member.empty() )
+				continue;
+
+			std::string memberType, memberName;
+			bool bRowMajor;
+			int nElements;
+			int nMemberSize = ParseDeclarator( member, memberType, memberName, bRowMajor, nElements ) ?
+				TypeRegisterCount( memberType, bRowMajor, structs ) : 0;
+			if ( !nMemberSize )
+			{
+				nSize = 0;
+				break;
+			}
+			nSize += nMemberSize * nElements;
+		}
+
+		if ( nSize )
+		{
+			structs[name] = nSize;
+		}
+	}
+}
+
+static void CollectDecls( const CFxcPreprocessor &pp, const std::map< std::string, int > &structs,
+						  std::vector< RegisterDecl_t > &decls, RegisterReport_t *pReport )
+{
+	const std::vector< FxcVisibleLine_t > &lines = pp.GetLines();
+	for ( size_t i = 0; i < lines.size(); ++i )
+	{
+		const std::string &text = lines[i].m_pLine->m_Text;
+		size_t nStatementStart = 0;
+		while ( nStatementStart < text.size() )
+		{
+			size_t nStatementEnd = text.find( ';', nStatementStart );
+			if ( nStatementEnd == std::string::npos )
+			{
+				nStatementEnd = text.size();
+			}
+			std::string statement = text.substr( nStatementStart, nStatementEnd - nStatementStart );
+			nStatementStart = nStatementEnd + 1;
+
+			size_t nColon = statement.find( ':' );
+			if ( nColon == std::string::npos )
+				continue;
+
+			std::string semantic = Trim( statement.substr( nColon + 1 ) );
+			if ( semantic.compare( 0, 8, "register" ) != 0 )
+				continue;
+			size_t nOpen = semantic.find( '(' );
+			size_t nClose = semantic.rfind( ')' );
+			if ( nOpen == std::string::npos || nClose == std::string::npos || nClose < nOpen )
+				continue;
+
+			RegisterDecl_t decl;
+			decl.m_FileName = lines[i].m_pFile->m_FileName;
+			decl.m_nLine = lines[i].m_pLine->m_nLine;
+			decl.m_bMaybe = lines[i].m_bMaybe;
+
+			// register( ps_3_0, c5 ) names the profile first
+			decl.m_RegisterArg = Trim( semantic.substr( nOpen + 1, nClose - nOpen - 1 ) );
+			decl.m_RegisterArg = Trim( decl.m_RegisterArg.substr( decl.m_RegisterArg.rfind( ',' ) + 1 ) );
+
+			std::string reg = Trim( pp.ExpandMacros( decl.m_RegisterArg ) );
+			std::string type;
+			bool bRowMajor;
+			int nElements;
+			bool bParsed = ParseDeclarator( pp.ExpandMacros( statement.substr( 0, nColon ) ), type, decl.m_Name, bRowMajor, nElements );
+			if ( !bParsed || reg.size() < 2 || !strchr( "cbis", reg[0] ) || !isdigit( (unsigned char)reg[1] ) )
+			{
+				if ( pReport )
+				{
+					printf( "%s(%d): warning: can't read the register declaration \"%s\"\n", FileNameOnly( decl.m_FileName ).c_str(),
+						decl.m_nLine, Trim( statement ).c_str() );
+					++pReport->m_nWarnings;
+				}
+				continue;
+			}
+
+			decl.m_cClass = reg[0];
+			decl.m_nFirst = atoi( reg.c_str() + 1 );
+
+			// Only float registers hold several per value
+			int nSize = ( decl.m_cClass == 'c' ) ? TypeRegisterCount( type, bRowMajor, structs ) : 1;
+			if ( !nSize )
+			{
+				if ( pReport )
+				{
+					printf( "%s(%d): warning: unknown type %s, %s counted as one register per element\n",
+						FileNameOnly( decl.m_FileName ).c_str(), decl.m_nLine, type.c_str(), decl.m_Name.c_str() );
+					++pReport->m_nWarnings;
+				}
+				nSize = 1;
+			}
+			decl.m_nCount = nSize * nElements;
+			decls.push_back( decl );
+		}
+	}
+}
+
+static bool SameDecl( const RegisterDecl_t &a, const RegisterDecl_t &b )
+{
+	return a.m_nLine == b.m_nLine && a.m_Name == b.m_Name && a.m_FileName == b.m_FileName;
+}
+
+static bool HasDecl( const std::vector< RegisterDecl_t > &decls, const RegisterDecl_t &decl )
+{
+	for ( size_t i = 0; i < decls.size(); ++i )
+	{
+		if ( SameDecl( decls[i], decl ) )
+			return true;
+	}
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// Preprocesses a shader with some combos fixed (pValues[slot] >= 0) and the
+// rest varying, and collects its declarations
+//-----------------------------------------------------------------------------
+class CShaderScanner
+{
+public:
+	CShaderScanner( CFxcSourceCache &sourceCache, const CFxcComboSpace &space, const std::string &fileName,
+					const std::string &shaderModelDefine ) :
+		m_SourceCache( sourceCache ), m_Space( space ), m_FileName( fileName ), m_ShaderModelDefine( shaderModelDefine )
+	{
+	}
+
+	bool Scan( const int *pValues, std::vector< RegisterDecl_t > &decls, RegisterReport_t *pReport,
+			   std::vector< std::string > *pIncludedFiles, std::string &error )
+	{
+		CFxcPreprocessor pp( m_SourceCache );
+		pp.KeepLines( true );
+		pp.Define( m_ShaderModelDefine.c_str(), 1 );
+
+		const std::vector< FxcComboVar_t > &vars = m_Space.GetVars();
+		for ( size_t i = 0; i < vars.size(); ++i )
+		{
+			if ( pValues[i] >= 0 )
+			{
+				pp.Define( vars[i].m_Name.c_str(), pValues[i] );
+			}
+			else
+			{
+				pp.DefineVarying( vars[i].m_Name.c_str() );
+			}
+		}
+
+		ShaderContentHash_t hash;
+		if ( !pp.Run( m_FileName.c_str(), &hash, error ) )
+			return false;
+
+		std::map< std::string, int > structs;
+		CollectStructs( pp, structs );
+		CollectDecls( pp, structs, decls, pReport );
+		if ( pIncludedFiles )
+		{
+			*pIncludedFiles = pp.GetIncludedFiles();
+		}
+		return true;
+	}
+
+private:
+	CFxcSourceCache &m_SourceCache;
+	const CFxcComboSpace &m_Space;
+	std::string m_FileName;
+	std::string m_ShaderModelDefine;
+};
+
+// Is some combo with the given values (-1 = any) compiled?
+static bool HasCompiledCombo( const CFxcComboSpace &space, const std::vector< int > &fixed )
+{
+	const std::vector< FxcComboVar_t > &vars = space.GetVars();
+	std::vector< int > values( vars.size() );
+	for ( size_t i = 0; i < vars.size(); ++i )
+	{
+		values[i] = ( fixed[i] >= 0 ) ? fixed[i] : vars[i].m_nMin;
+	}
+
+	for ( ;; )
+	{
+		if ( !space.IsSkipped( values.data() ) )
+			return true;
+
+		size_t i = 0;
+		for ( ; i < vars.size(); ++i )
+		{
+			if ( fixed[i] >= 0 )
+				continue;
+			if ( ++values[i] <= vars[i].m_nMax )
+				break;
+			values[i] = vars[i].m_nMin;
+		}
+		if ( i == vars.size() )
+			return false;
+	}
+}
+
+static std::string ValuesText( const std::vector< FxcComboVar_t > &vars, const std::vector< int > &values )
+{
+	std::string text;
+	for ( size_t i = 0; i < vars.size(); ++i )
+	{
+		if ( values[i] < 0 )
+			continue;
+		if ( !text.empty() )
+		{
+			text += " ";
+		}
+		text += vars[i].m_Name + "=" + std::to_string( values[i] );
+	}
+	return text;
+}
+
+
+//-----------------------------------------------------------------------------
+// One shader
+//-----------------------------------------------------------------------------
+static bool ScanShader( CFxcSourceCache &sourceCache, const std::string &fileName, int nShaderModel, ShaderRegisters_t &shader,
+						std::string &registerMapFile, RegisterReport_t &report )
+{
+	CFxcComboSpace space;
+	std::string error;
+	if ( !space.Load( fileName.c_str(), nShaderModel, error ) )
+	{
+		fprintf( stderr, "%s\n", error.c_str() );
+		return false;
+	}
+
+	// Shader names end in _ps30, _vs20, ...
+	shader.m_Name = space.GetShaderName();
+	shader.m_FileName = fileName;
+	shader.m_bPixelShader = shader.m_Name.find( "_vs" ) == std::string::npos;
+	const char *pVersion = ( nShaderModel >= 30 ) ? "3_0" : ( shader.m_bPixelShader ? "2_B" : "2_0" );
+	std::string shaderModelDefine = std::string( shader.m_bPixelShader ? "SHADER_MODEL_PS_" : "SHADER_MODEL_VS_" ) + pVersion;
+	shader.m_nMaxConstants = !shader.m_bPixelShader ? VS_CONSTANTS : ( nShaderModel >= 30 ? PS_3_0_CONSTANTS : PS_2_X_CONSTANTS );
+
+	shader.m_Vars = space.GetVars();
+	const std::vector< FxcComboVar_t > &vars = shader.m_Vars;
+	CShaderScanner scanner( sourceCache, space, fileName, shaderModelDefine );
+
+	// Everything any combo may compile
+	std::vector< int > values( vars.size(), -1 );
+	std::vector< std::string > includedFiles;
+	if ( !scanner.Scan( values.data(), shader.m_Decls, &report, &includedFiles, error ) )
+	{
+		fprintf( stderr, "%s\n", error.c_str() );
+		return false;
+	}
+
+	for ( size_t i = 0; i < includedFiles.size(); ++i )
+	{
+		if ( FileNameOnly( includedFiles[i] ) == "shader_constant_register_map.h" && registerMapFile.empty() )
+		{
+			registerMapFile = includedFiles[i];
+		}
+	}
+
+	// Which combos each conditional declaration depends on: the ones with a
+	// value that drops it
+	bool bAnyMaybe = false;
+	for ( size_t i = 0; i < shader.m_Decls.size(); ++i )
+	{
+		bAnyMaybe = bAnyMaybe || shader.m_Decls[i].m_bMaybe;
+	}
+	for ( size_t nSlot = 0; nSlot < vars.size() && bAnyMaybe; ++nSlot )
+	{
+		for ( int nValue = vars[nSlot].m_nMin; nValue <= vars[nSlot].m_nMax; ++nValue )
+		{
+			values.assign( vars.size(), -1 );
+			values[nSlot] = nValue;
+			std::vector< RegisterDecl_t > decls;
+			if ( !scanner.Scan( values.data(), decls, NULL, NULL, error ) )
+			{
+				fprintf( stderr, "%s\n", error.c_str() );
+				return false;
+			}
+
+			for ( size_t i = 0; i < shader.m_Decls.size(); ++i )
+			{
+				RegisterDecl_t &decl = shader.m_Decls[i];
+				if ( decl.m_bMaybe && !HasDecl( decls, decl ) &&
+					 std::find( decl.m_DependsOn.begin(), decl.m_DependsOn.end(), (int)nSlot ) == decl.m_DependsOn.end() )
+				{
+					decl.m_DependsOn.push_back( (int)nSlot );
+				}
+			}
+		}
+	}
+
+	// Overlapping pairs: try every value of the combos they depend on
+	for ( size_t i = 0; i < shader.m_Decls.size(); ++i )
+	{
+		for ( size_t j = 0; j < i; ++j )
+		{
+			const RegisterDecl_t &a = shader.m_Decls[j];
+			const RegisterDecl_t &b = shader.m_Decls[i];
+			if ( a.m_cClass != b.m_cClass || a.m_nFirst >= b.m_nFirst + b.m_nCount || b.m_nFirst >= a.m_nFirst + a.m_nCount )
+				continue;
+
+			std::vector< int > slots = a.m_DependsOn;
+			for ( size_t k = 0; k < b.m_DependsOn.size(); ++k )
+			{
+				if ( std::find( slots.begin(), slots.end(), b.m_DependsOn[k] ) == slots.end() )
+				{
+					slots.push_back( b.m_DependsOn[k] );
+				}
+			}
+
+			uint64_t nAssignments = 1;
+			for ( size_t k = 0; k < slots.size(); ++k )
+			{
+				nAssignments *= vars[slots[k]].Count();
+			}
+
+			bool bClash = false;
+			std::vector< int > fixed( vars.size(), -1 );
+			for ( uint64_t nAssignment = 0; nAssignment < nAssignments && !bClash; ++nAssignment )
+			{
+				uint64_t nRest = nAssignment;
+				for ( size_t k = 0; k < slots.size(); ++k )
+				{
+					fixed[slots[k]] = vars[slots[k]].m_nMin + (int)( nRest % vars[slots[k]].Count() );
+					nRest /= vars[slots[k]].Count();
+				}
+				if ( !HasCompiledCombo( space, fixed ) )
+					continue;
+
+				std::vector< RegisterDecl_t > decls;
+				if ( !slots.empty() && !scanner.Scan( fixed.data(), decls, NULL, NULL, error ) )
+				{
+					fprintf( stderr, "%s\n", error.c_str() );
+					return false;
+				}
+				bClash = slots.empty() || ( HasDecl( decls, a ) && HasDecl( decls, b ) );
+			}
+
+			if ( nAssignments > MAX_OVERLAP_ASSIGNMENTS && !bClash )
+			{
+				printf( "%s: warning: %s and %s overlap, checked only the first %d of %llu combo values\n", shader.m_Name.c_str(),
+					a.m_Name.c_str(), b.m_Name.c_str(), MAX_OVERLAP_ASSIGNMENTS, (unsigned long long)nAssignments );
+				++report.m_nWarnings;
+			}
+
+			if ( bClash )
+			{
+				std::string when = ValuesText( vars, fixed );
+				printf( "%s(%d): error: %s %s overlaps %s %s (%s(%d))%s%s\n", FileNameOnly( b.m_FileName ).c_str(), b.m_nLine,
+					b.m_Name.c_str(), RangeText( b.m_cClass, b.m_nFirst, b.m_nCount ).c_str(), a.m_Name.c_str(),
+					RangeText( a.m_cClass, a.m_nFirst, a.m_nCount ).c_str(), FileNameOnly( a.m_FileName ).c_str(), a.m_nLine,
+					when.empty() ? "" : " when ", when.c_str() );
+				++report.m_nErrors;
+			}
+		}
+	}
+
+	for ( size_t i = 0; i < shader.m_Decls.size(); ++i )
+	{
+		const RegisterDecl_t &decl = shader.m_Decls[i];
+		// Not always a mistake, vs_3_0 flex weights live at c1024
+		if ( decl.m_cClass == 'c' && decl.m_nFirst + decl.m_nCount > shader.m_nMaxConstants )
+		{
+			printf( "%s(%d): warning: %s %s is past the last %s constant (c%d)\n", FileNameOnly( decl.m_FileName ).c_str(), decl.m_nLine,
+				decl.m_Name.c_str(), RangeText( 'c', decl.m_nFirst, decl.m_nCount ).c_str(), shaderModelDefine.c_str() + 13,
+				shader.m_nMaxConstants - 1 );
+			++report.m_nWarnings;
+		}
+	}
+	return true;
+}
+
+static bool DeclSortLess( const RegisterDecl_t &a, const RegisterDecl_t &b )
+{
+	if ( a.m_cClass != b.m_cClass )
+		return a.m_cClass < b.m_cClass;
+	return a.m_nFirst < b.m_nFirst;
+}
+
+static void PrintShader( ShaderRegisters_t &shader )
+{
+	const std::vector< FxcComboVar_t > &vars = shader.m_Vars;
+	std::stable_sort( shader.m_Decls.begin(), shader.m_Decls.end(), DeclSortLess );
+
+	printf( "%s\n", shader.m_Name.c_str() );
+	for ( size_t i = 0; i < shader.m_Decls.size(); ++i )
+	{
+		const RegisterDecl_t &decl = shader.m_Decls[i];
+		std::string conditions;
+		for ( size_t k = 0; k < decl.m_DependsOn.size(); ++k )
+		{
+			conditions += ( k ? ", " : "  [" ) + vars[decl.m_DependsOn[k]].m_Name;
+		}
+		if ( !conditions.empty() )
+		{
+			conditions += "]";
+		}
+		else if ( decl.m_bMaybe )
+		{
+			conditions = "  [conditional]";
+		}
+
+		printf( "    %-10s %-32s %-36s %s(%d)%s\n", RangeText( decl.m_cClass, decl.m_nFirst, decl.m_nCount ).c_str(),
+			decl.m_Name.c_str(), decl.m_RegisterArg.c_str(), FileNameOnly( decl.m_FileName ).c_str(), decl.m_nLine, conditions.c_str() );
+	}
+
+	// Float registers nothing uses, below the highest one that is
+	std::vector< bool > used;
+	for ( size_t i = 0; i < shader.m_Decls.size(); ++i )
+	{
+		const RegisterDecl_t &decl = shader.m_Decls[i];
+		if ( decl.m_cClass != 'c' || decl.m_nFirst + decl.m_nCount > shader.m_nMaxConstants )
+			continue;
+		if ( used.size() < (size_t)( decl.m_nFirst + decl.m_nCount ) )
+		{
+			used.resize( decl.m_nFirst + decl.m_nCount, false );
+		}
+		std::fill( used.begin() + decl.m_nFirst, used.begin() + decl.m_nFirst + decl.m_nCount, true );
+	}
+
+	std::string gaps;
+	int nFree = 0;
+	for ( size_t i = 0; i < used.size(); ++i )
+	{
+		if ( used[i] )
+			continue;
+		size_t nEnd = i;
+		while ( nEnd < used.size() && !used[nEnd] )
+		{
+			++nEnd;
+		}
+		gaps += ( gaps.empty() ? "" : " " ) + RangeText( 'c', (int)i, (int)( nEnd - i ) );
+		nFree += (int)( nEnd - i );
+		i = nEnd;
+	}
+	if ( !used.empty() )
+	{
+		printf( "  c0-c%d: %d used, %d free%s%s\n", (int)used.size() - 1, (int)used.size() - nFree, nFree,
+			gaps.empty() ? "" : ": ", gaps.c_str() );
+	}
+	printf( "\n" );
+}
+
+
+//-----------------------------------------------------------------------------
+// Declarations against the register map
+//-----------------------------------------------------------------------------
+static void CheckAgainstMap( const ShaderRegisters_t &shader, const std::vector< RegisterMapEntry_t > &entries, RegisterReport_t &report )
+{
+	for ( size_t i = 0; i < shader.m_Decls.size(); ++i )
+	{
+		const RegisterDecl_t &decl = shader.m_Decls[i];
+		if ( decl.m_cClass != 'c' )
+			continue;
+
+		std::string file = FileNameOnly( decl.m_FileName );
+		const RegisterMapEntry_t *pEntry = FindMapEntry( entries, decl.m_RegisterArg );
+		if ( pEntry )
+		{
+			if ( decl.m_nCount > pEntry->m_nCount )
+			{
+				printf( "%s(%d): error: %s needs %d registers, %s has %d\n", file.c_str(), decl.m_nLine, decl.m_Name.c_str(),
+					decl.m_nCount, pEntry->m_Name.c_str(), pEntry->m_nCount );
+				++report.m_nErrors;
+			}
+			continue;
+		}
+
+		if ( decl.m_RegisterArg.compare( 0, 6, "PSREG_" ) == 0 )
+			continue;
+
+		// A hard-coded register. Only an overlap if another declaration uses
+		// the map name, which the overlap check reports.
+		if ( decl.m_RegisterArg[0] == 'c' && isdigit( (unsigned char)decl.m_RegisterArg[1] ) )
+		{
+			pEntry = NULL;
+			for ( int nRegister = decl.m_nFirst; nRegister < decl.m_nFirst + decl.m_nCount && !pEntry; ++nRegister )
+			{
+				pEntry = FindMapEntry( entries, nRegister );
+			}
+			printf( "%s(%d): warning: %s uses %s directly%s%s\n", file.c_str(), decl.m_nLine, decl.m_Name.c_str(),
+				RangeText( 'c', decl.m_nFirst, decl.m_nCount ).c_str(), pEntry ? ", the register map calls it " : "; add it to the register map",
+				pEntry ? pEntry->m_Name.c_str() : "" );
+			++report.m_nWarnings;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// SetPixelShaderConstant( 50, ... ) in the C++ code
+//-----------------------------------------------------------------------------
+static bool CheckCppFile( const std::string &fileName, const std::vector< ShaderRegisters_t > &shaders,
+						  const std::vector< RegisterMapEntry_t > &entries, RegisterReport_t &report )
+{
+	FILE *fp = fopen( fileName.c_str(), "rt" );
+	if ( !fp )
+	{
+		fprintf( stderr, "unable to open %s\n", fileName.c_str() );
+		return false;
+	}
+
+	static const char s_Call[] = "SetPixelShaderConstant";
+	char szLine[4096];
+	int nLine = 0;
+	while ( fgets( szLine, sizeof( szLine ), fp ) )
+	{
+		++nLine;
+		const char *pText = szLine;
+		while ( ( pText = strstr( pText, s_Call ) ) != NULL )
+		{
+			pText += sizeof( s_Call ) - 1;
+			const char *pArgs = pText;
+			while ( isalnum( (unsigned char)*pArgs ) || *pArgs == '_' )
+			{
+				++pArgs;
+			}
+			while ( isspace( (unsigned char)*pArgs ) )
+			{
+				++pArgs;
+			}
+			if ( *pArgs != '(' )
+				continue;
+			++pArgs;
+			while ( isspace( (unsigned char)*pArgs ) )
+			{
+				++pArgs;
+			}
+			if ( !isdigit( (unsigned char)*pArgs ) )
+				continue;
+
+			int nRegister = atoi( pArgs );
+			std::string owner;
+			const RegisterMapEntry_t *pEntry = FindMapEntry( entries, nRegister );
+			if ( pEntry )
+			{
+				owner = ", the register map calls it " + pEntry->m_Name;
+			}
+			for ( size_t i = 0; i < shaders.size(); ++i )
+			{
+				for ( size_t j = 0; j < shaders[i].m_Decls.size() && shaders[i].m_bPixelShader; ++j )
+				{
+					const RegisterDecl_t &decl = shaders[i].m_Decls[j];
+					if ( decl.m_cClass == 'c' && nRegister >= decl.m_nFirst && nRegister < decl.m_nFirst + decl.m_nCount )
+					{
+						owner += ", " + shaders[i].m_Name + " reads it as " + decl.m_Name;
+					}
+				}
+			}
+
+			printf( "%s(%d): warning: pixel shader constant c%d is hard-coded%s\n", FileNameOnly( fileName ).c_str(), nLine,
+				nRegister, owner.c_str() );
+			++report.m_nWarnings;
+		}
+	}
+	fclose( fp );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// A block of consecutive registers for the given map entries
+//-----------------------------------------------------------------------------
+static bool PrintPackedLayout( const std::string &packList, const std::vector< ShaderRegisters_t > &shaders,
+							   const std::vector< RegisterMapEntry_t > &entries, RegisterReport_t &report )
+{
+	std::vector< std::string > names;
+	size_t nStart = 0;
+	while ( nStart <= packList.size() )
+	{
+		size_t nEnd = packList.find( ',', nStart );
+		if ( nEnd == std::string::npos )
+		{
+			nEnd = packList.size();
+		}
+		std::string name = Trim( packList.substr( nStart, nEnd - nStart ) );
+		if ( !name.empty() )
+		{
+			names.push_back( name );
+		}
+		nStart = nEnd + 1;
+	}
+
+	// Size of each: the map entry, or more if a shader declares more. Names
+	// that aren't in the map yet take one register.
+	std::vector< int > sizes;
+	int nTotal = 0;
+	for ( size_t i = 0; i < names.size(); ++i )
+	{
+		const RegisterMapEntry_t *pEntry = FindMapEntry( entries, names[i] );
+		int nSize = pEntry ? pEntry->m_nCount : 1;
+		for ( size_t j = 0; j < shaders.size(); ++j )
+		{
+			for ( size_t k = 0; k < shaders[j].m_Decls.size(); ++k )
+			{
+				if ( shaders[j].m_Decls[k].m_RegisterArg == names[i] )
+				{
+					nSize = std::max( nSize, shaders[j].m_Decls[k].m_nCount );
+				}
+			}
+		}
+		sizes.push_back( nSize );
+		nTotal += nSize;
+	}
+
+	// Registers the map or a shader gives to anything else
+	int nMaxConstants = PS_3_0_CONSTANTS;
+	std::vector< bool > taken( VS_CONSTANTS, false );
+	for ( size_t i = 0; i < entries.size(); ++i )
+	{
+		if ( std::find( names.begin(), names.end(), entries[i].m_Name ) != names.end() )
+			continue;
+		for ( int nRegister = entries[i].m_nFirst; nRegister < entries[i].m_nFirst + entries[i].m_nCount && nRegister < VS_CONSTANTS; ++nRegister )
+		{
+			taken[nRegister] = true;
+		}
+	}
+	for ( size_t i = 0; i < shaders.size(); ++i )
+	{
+		if ( !shaders[i].m_bPixelShader )
+			continue;
+		nMaxConstants = std::min( nMaxConstants, shaders[i].m_nMaxConstants );
+		for ( size_t j = 0; j < shaders[i].m_Decls.size(); ++j )
+		{
+			const RegisterDecl_t &decl = shaders[i].m_Decls[j];
+			if ( decl.m_cClass != 'c' || std::find( names.begin(), names.end(), decl.m_RegisterArg ) != names.end() )
+				continue;
+			for ( int nRegister = decl.m_nFirst; nRegister < decl.m_nFirst + decl.m_nCount && nRegister < VS_CONSTANTS; ++nRegister )
+			{
+				taken[nRegister] = true;
+			}
+		}
+	}
+
+	int nFirst = 0;
+	for ( ; nFirst + nTotal <= nMaxConstants; ++nFirst )
+	{
+		if ( std::find( taken.begin() + nFirst, taken.begin() + nFirst + nTotal, true ) == taken.begin() + nFirst + nTotal )
+			break;
+	}
+	if ( nFirst + nTotal > nMaxConstants )
+	{
+		printf( "error: -pack: no %d free registers in a row below c%d\n", nTotal, nMaxConstants );
+		++report.m_nErrors;
+		return false;
+	}
+
+	printf( "packed layout, %s:\n", RangeText( 'c', nFirst, nTotal ).c_str() );
+	int nRegister = nFirst;
+	for ( size_t i = 0; i < names.size(); ++i )
+	{
+		const RegisterMapEntry_t *pEntry = FindMapEntry( entries, names[i] );
+		printf( "#define %-39s PSREG_CONSTANT_%02d%s\n", names[i].c_str(), nRegister,
+			!pEntry ? "\t// new" : ( pEntry->m_nFirst == nRegister ? "" : "\t// moved" ) );
+		for ( int k = 1; k < sizes[i]; ++k )
+		{
+			printf( "//      %-39s PSREG_CONSTANT_%02d\n", names[i].c_str(), nRegister + k );
+		}
+		nRegister += sizes[i];
+	}
+	printf( "upload: SetPixelShaderConstant( %s, pData, %d )\n\n", names[0].c_str(), nTotal );
+	return true;
+}
+
+
+int main( int argc, char **argv )
+{
+	int nShaderModel = 30;
+	std::vector< std::string > files;
+	std::vector< std::string > cppFiles;
+	std::string packList;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !strcmp( argv[i], "-ver" ) && i + 1 < argc )
+		{
+			nShaderModel = atoi( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-cpp" ) && i + 1 < argc )
+		{
+			cppFiles.push_back( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "-pack" ) && i + 1 < argc )
+		{
+			packList = argv[++i];
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else if ( !FxcAddShaderArgument( argv[i], files ) )
+		{
+			fprintf( stderr, "unable to open %s\n", argv[i] );
+			return 1;
+		}
+	}
+
+	if ( files.empty() )
+	{
+		PrintUsage();
+		return 2;
+	}
+
+	RegisterReport_t report;
+	report.m_nErrors = 0;
+	report.m_nWarnings = 0;
+
+	CFxcSourceCache sourceCache;
+	std::vector< ShaderRegisters_t > shaders( files.size() );
+	std::string registerMapFile;
+	for ( size_t i = 0; i < files.size(); ++i )
+	{
+		if ( !ScanShader( sourceCache, files[i], nShaderModel, shaders[i], registerMapFile, report ) )
+			return 1;
+	}
+
+	std::vector< RegisterMapEntry_t > entries;
+	if ( !registerMapFile.empty() && !LoadRegisterMap( registerMapFile, entries, report ) )
+	{
+		fprintf( stderr, "unable to open %s\n", registerMapFile.c_str() );
+		return 1;
+	}
+
+	for ( size_t i = 0; i < shaders.size(); ++i )
+	{
+		if ( shaders[i].m_bPixelShader )
+		{
+			CheckAgainstMap( shaders[i], entries, report );
+		}
+	}
+	for ( size_t i = 0; i < cppFiles.size(); ++i )
+	{
+		if ( !CheckCppFile( cppFiles[i], shaders, entries, report ) )
+			return 1;
+	}
+
+	printf( "\n" );
+	for ( size_t i = 0; i < shaders.size(); ++i )
+	{
+		PrintShader( shaders[i] );
+	}
+
+	if ( !packList.empty() )
+	{
+		if ( entries.empty() )
+		{
+			printf( "error: -pack: none of the shaders include shader_constant_register_map.h\n" );
+			++report.m_nErrors;
+		}
+		else
+		{
+			PrintPackedLayout( packList, shaders, entries, report );
+		}
+	}
+
+	printf( "%d errors, %d warnings\n", report.m_nErrors, report.m_nWarnings );
+	return report.m_nErrors ? 1 : 0;
+}
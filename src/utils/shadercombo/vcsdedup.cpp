@@ -0,0 +1,64 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Rewrites a .vcs so static combos with identical data are stored
+//			once and aliased, and reports the space saved.
+//
+//			vcsdedup <in.vcs> <out.vcs>
+//
+//			g++ -O2 -I../../public -o vcsdedup vcsdedup.cpp vcswriter.cpp vcsreader.cpp shaderhash.cpp
+//
+//===========================================================================//
+
+#include "vcswriter.h"
+#include <stdio.h>
+
+
+int main( int argc, char **argv )
+{
+	if ( argc != 3 )
+	{
+		printf( "usage: vcsdedup <in.vcs> <out.vcs>\n" );
+		return 2;
+	}
+
+	CVcsReader reader;
+	std::string error;
+	if ( !reader.Open( argv[1], error ) )
+	{
+		fprintf( stderr, "%s\n", error.c_str() );
+		return 1;
+	}
+
+	CVcsWriter writer;
+	writer.SetHeader( reader.GetHeader() );
+	for ( int i = 0; i < reader.GetStaticComboCount(); ++i )
+	{
+		const uint8_t *pData;
+		uint32 nSize;
+		reader.GetStaticComboData( i, &pData, &nSize );
+		writer.AddStaticCombo( reader.GetStaticComboRecord( i ).m_nStaticComboID, pData, nSize );
+	}
+	for ( int i = 0; i < reader.GetAliasCount(); ++i )
+	{
+		writer.AddAlias( reader.GetAliasRecord( i ).m_nStaticComboID, reader.GetAliasRecord( i ).m_nSourceStaticCombo );
+	}
+
+	// The reader keeps the input mapped until the writer is done with it
+	VcsWriteStats_t stats;
+	if ( !writer.Write( argv[2], &stats, error ) )
+	{
+		fprintf( stderr, "%s\n", error.c_str() );
+		return 1;
+	}
+
+	int nNewAliases = stats.m_nAliasedCombos - reader.GetAliasCount();
+	printf( "%s: %d static combos, %d with data, %d aliased (%d new)\n", argv[2], stats.m_nStaticCombos,
+		stats.m_nUniqueCombos, stats.m_nAliasedCombos, nNewAliases );
+	printf( "  static combo data %llu -> %llu bytes, saved %llu (%.1f%%)\n",
+		(unsigned long long)stats.m_nDataBytesIn, (unsigned long long)stats.m_nDataBytesOut,
+		(unsigned long long)( stats.m_nDataBytesIn - stats.m_nDataBytesOut ),
+		stats.m_nDataBytesIn ? 100.0 * ( stats.m_nDataBytesIn - stats.m_nDataBytesOut ) / stats.m_nDataBytesIn : 0.0 );
+	printf( "  file is %llu bytes\n", (unsigned long long)stats.m_nFileBytes );
+
+	return 0;
+}
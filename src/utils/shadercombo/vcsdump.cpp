@@ -0,0 +1,128 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Prints the static combo table of a .vcs and, with -combo, the
+//			shaders of one static combo. -verify decodes every static combo.
+//
+//			vcsdump [-combo <static id>] [-verify] <file.vcs>
+//
+//			Only stored blocks are decoded; this tool has no bzip2 or LZMA
+//			decoder, so combos with packed blocks are reported as such.
+//
+//			g++ -O2 -I../../public -o vcsdump vcsdump.cpp vcsreader.cpp
+//
+//===========================================================================//
+
+#include "vcsreader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int main( int argc, char **argv )
+{
+	const char *pFileName = NULL;
+	bool bVerify = false;
+	bool bDumpCombo = false;
+	uint32 nStaticComboID = 0;
+
+	for ( int i = 1; i < argc; ++i )
+	{
+		if ( !strcmp( argv[i], "-combo" ) && i + 1 < argc )
+		{
+			bDumpCombo = true;
+			nStaticComboID = (uint32)strtoul( argv[++i], NULL, 0 );
+		}
+		else if ( !strcmp( argv[i], "-verify" ) )
+		{
+			bVerify = true;
+		}
+		else if ( argv[i][0] != '-' && !pFileName )
+		{
+			pFileName = argv[i];
+		}
+		else
+		{
+			pFileName = NULL;
+			break;
+		}
+	}
+
+	if ( !pFileName )
+	{
+		printf( "usage: vcsdump [-combo <static id>] [-verify] <file.vcs>\n" );
+		return 2;
+	}
+
+	CVcsReader reader;
+	std::string error;
+	if ( !reader.Open( pFileName, error ) )
+	{
+		fprintf( stderr, "%s\n", error.c_str() );
+		return 1;
+	}
+
+	const ShaderHeader_t &header = reader.GetHeader();
+	printf( "%s\n", pFileName );
+	printf( "  version %d, %d combos, %d dynamic, flags 0x%x, centroid mask 0x%x, crc 0x%08x\n", header.m_nVersion,
+		header.m_nTotalCombos, header.m_nDynamicCombos, header.m_nFlags, header.m_nCentroidMask, header.m_nSourceCRC32 );
+	printf( "  %d static combos, %d aliases\n", reader.GetStaticComboCount(), reader.GetAliasCount() );
+
+	if ( bDumpCombo )
+	{
+		int nRecord = reader.FindStaticCombo( nStaticComboID );
+		if ( nRecord < 0 )
+		{
+			printf( "  static combo %u is not in the file\n", nStaticComboID );
+			return 1;
+		}
+
+		const VcsDynamicCombo_t *pCombos;
+		int nCount;
+		if ( !reader.GetDynamicCombos( nStaticComboID, &pCombos, &nCount ) )
+		{
+			printf( "  static combo %u (record %d) is packed or damaged\n", nStaticComboID, nRecord );
+			return 1;
+		}
+
+		printf( "  static combo %u (record %d, static combo %u): %d shaders\n", nStaticComboID, nRecord,
+			reader.GetStaticComboRecord( nRecord ).m_nStaticComboID, nCount );
+		for ( int i = 0; i < nCount; ++i )
+		{
+			printf( "    dynamic %6u  %6u bytes\n", pCombos[i].m_nDynamicComboID, pCombos[i].m_nSize );
+		}
+	}
+
+	if ( bVerify )
+	{
+		int nBad = 0;
+		int nShaders = 0;
+		for ( int i = 0; i < reader.GetStaticComboCount(); ++i )
+		{
+			const VcsDynamicCombo_t *pCombos;
+			int nCount;
+			if ( reader.GetDynamicCombos( reader.GetStaticComboRecord( i ).m_nStaticComboID, &pCombos, &nCount ) )
+			{
+				nShaders += nCount;
+			}
+			else
+			{
+				++nBad;
+			}
+		}
+
+		for ( int i = 0; i < reader.GetAliasCount(); ++i )
+		{
+			if ( reader.FindStaticCombo( reader.GetAliasRecord( i ).m_nStaticComboID ) < 0 )
+			{
+				printf( "  alias %u points at missing static combo %u\n", reader.GetAliasRecord( i ).m_nStaticComboID,
+					reader.GetAliasRecord( i ).m_nSourceStaticCombo );
+				++nBad;
+			}
+		}
+
+		printf( "  %d shaders decoded, %d static combos packed or damaged\n", nShaders, nBad );
+		return nBad ? 1 : 0;
+	}
+
+	return 0;
+}
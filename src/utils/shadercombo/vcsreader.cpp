@@ -0,0 +1,448 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Portable, memory mapped reader for version 6 .vcs files.
+//
+// File layout:
+//	ShaderHeader_t
+//	StaticComboRecord_t[m_nNumStaticCombos]		sorted by ID, last is the sentinel
+//	uint32 nAliases
+//	StaticComboAliasRecord_t[nAliases]
+//	static combo data, at the record offsets
+//
+// The data of a static combo is a run of blocks ended by 0xffffffff. Each
+// block starts with a uint32 size whose top two bits give the packing (0
+// bzip2, 0x40000000 stored, 0x80000000 lzma) and unpacks to a run of
+// uint32 dynamic combo ID, uint32 size, shader bytes.
+//
+//===========================================================================//
+
+#include "vcsreader.h"
+#include <algorithm>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define VCS_BLOCK_END				0xffffffff
+#define VCS_BLOCK_FORMAT_MASK		0xc0000000
+#define VCS_BLOCK_SIZE_MASK			0x3fffffff
+#define VCS_BLOCK_FORMAT_STORED		0x40000000
+#define VCS_BLOCK_FORMAT_LZMA		0x80000000
+
+#define DEFAULT_CACHE_SIZE			64
+
+
+CVcsReader::CVcsReader() :
+	m_pBase( NULL ),
+	m_nFileSize( 0 ),
+#ifdef _WIN32
+	m_hFile( INVALID_HANDLE_VALUE ),
+	m_hMapping( NULL ),
+#endif
+	m_pHeader( NULL ),
+	m_pRecords( NULL ),
+	m_pAliases( NULL ),
+	m_nAliases( 0 ),
+	m_bAliasesSorted( true ),
+	m_pDecompressor( NULL ),
+	m_nCacheSize( DEFAULT_CACHE_SIZE ),
+	m_nDecodes( 0 )
+{
+}
+
+CVcsReader::~CVcsReader()
+{
+	Close();
+}
+
+
+//-----------------------------------------------------------------------------
+// Mapping
+//-----------------------------------------------------------------------------
+static uint32 ReadUInt32( const uint8_t *p )
+{
+	uint32 nValue;
+	memcpy( &nValue, p, sizeof( nValue ) );
+	return nValue;
+}
+
+bool CVcsReader::Open( const char *pFileName, std::string &error )
+{
+	Close();
+
+#ifdef _WIN32
+	m_hFile = CreateFileA( pFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( m_hFile == INVALID_HANDLE_VALUE )
+	{
+		error = std::string( "unable to open " ) + pFileName;
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx( m_hFile, &size );
+	m_nFileSize = (size_t)size.QuadPart;
+	if ( m_nFileSize )
+	{
+		m_hMapping = CreateFileMappingA( m_hFile, NULL, PAGE_READONLY, 0, 0, NULL );
+		m_pBase = m_hMapping ? (const uint8_t *)MapViewOfFile( m_hMapping, FILE_MAP_READ, 0, 0, 0 ) : NULL;
+	}
+#else
+	int fd = open( pFileName, O_RDONLY );
+	if ( fd < 0 )
+	{
+		error = std::string( "unable to open " ) + pFileName;
+		return false;
+	}
+
+	struct stat st;
+	fstat( fd, &st );
+	m_nFileSize = (size_t)st.st_size;
+	if ( m_nFileSize )
+	{
+		void *pMapped = mmap( NULL, m_nFileSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+		m_pBase = ( pMapped != MAP_FAILED ) ? (const uint8_t *)pMapped : NULL;
+	}
+	close( fd );
+#endif
+
+	if ( !m_pBase )
+	{
+		Close();
+		error = std::string( "unable to map " ) + pFileName;
+		return false;
+	}
+
+	// Validate the tables once so lookups don't have to
+	m_pHeader = (const ShaderHeader_t *)m_pBase;
+	if ( m_nFileSize < sizeof( ShaderHeader_t ) || m_pHeader->m_nVersion != SHADER_VCS_VERSION_NUMBER )
+	{
+		error = std::string( pFileName ) + " is not a version 6 .vcs";
+	}
+	else if ( m_pHeader->m_nNumStaticCombos < 1 ||
+			  sizeof( ShaderHeader_t ) + (size_t)m_pHeader->m_nNumStaticCombos * sizeof( StaticComboRecord_t ) + sizeof( uint32 ) > m_nFileSize )
+	{
+		error = std::string( pFileName ) + ": bad static combo table";
+	}
+	else
+	{
+		size_t nRecordsEnd = sizeof( ShaderHeader_t ) + (size_t)m_pHeader->m_nNumStaticCombos * sizeof( StaticComboRecord_t );
+		m_pRecords = (const StaticComboRecord_t *)( m_pBase + sizeof( ShaderHeader_t ) );
+		m_nAliases = ReadUInt32( m_pBase + nRecordsEnd );
+		m_pAliases = (const StaticComboAliasRecord_t *)( m_pBase + nRecordsEnd + sizeof( uint32 ) );
+
+		size_t nDataStart = nRecordsEnd + sizeof( uint32 ) + (size_t)m_nAliases * sizeof( StaticComboAliasRecord_t );
+		if ( nDataStart > m_nFileSize )
+		{
+			error = std::string( pFileName ) + ": bad alias table";
+			m_nAliases = 0;
+		}
+
+		for ( uint32 i = 0; i < m_pHeader->m_nNumStaticCombos && error.empty(); ++i )
+		{
+			bool bBadOffset = m_pRecords[i].m_nFileOffset < nDataStart || m_pRecords[i].m_nFileOffset > m_nFileSize;
+			bool bBadOrder = i > 0 && ( m_pRecords[i].m_nStaticComboID <= m_pRecords[i - 1].m_nStaticComboID ||
+										m_pRecords[i].m_nFileOffset < m_pRecords[i - 1].m_nFileOffset );
+			if ( bBadOffset || bBadOrder )
+			{
+				error = std::string( pFileName ) + ": bad static combo record";
+			}
+		}
+
+		// The compiler writes the aliases sorted, but older tools may not have
+		m_bAliasesSorted = true;
+		for ( uint32 i = 1; i < m_nAliases; ++i )
+		{
+			m_bAliasesSorted = m_bAliasesSorted && m_pAliases[i].m_nStaticComboID > m_pAliases[i - 1].m_nStaticComboID;
+		}
+	}
+
+	if ( !error.empty() )
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void CVcsReader::Close()
+{
+#ifdef _WIN32
+	if ( m_pBase )
+	{
+		UnmapViewOfFile( m_pBase );
+	}
+	if ( m_hMapping )
+	{
+		CloseHandle( m_hMapping );
+	}
+	if ( m_hFile != INVALID_HANDLE_VALUE )
+	{
+		CloseHandle( m_hFile );
+	}
+	m_hMapping = NULL;
+	m_hFile = INVALID_HANDLE_VALUE;
+#else
+	if ( m_pBase )
+	{
+		munmap( (void *)m_pBase, m_nFileSize );
+	}
+#endif
+
+	m_pBase = NULL;
+	m_nFileSize = 0;
+	m_pHeader = NULL;
+	m_pRecords = NULL;
+	m_pAliases = NULL;
+	m_nAliases = 0;
+	m_Cache.clear();
+	m_CacheLookup.clear();
+	m_nDecodes = 0;
+}
+
+void CVcsReader::SetCacheSize( int nStaticCombos )
+{
+	m_nCacheSize = ( nStaticCombos < 1 ) ? 1 : (size_t)nStaticCombos;
+	while ( m_Cache.size() > m_nCacheSize )
+	{
+		m_CacheLookup.erase( m_Cache.back().m_nRecord );
+		m_Cache.pop_back();
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Lookup
+//-----------------------------------------------------------------------------
+static int FindRecord( const StaticComboRecord_t *pRecords, int nCount, uint32 nStaticComboID )
+{
+	int nLow = 0;
+	int nHigh = nCount - 1;
+	while ( nLow <= nHigh )
+	{
+		int nMid = ( nLow + nHigh ) / 2;
+		if ( pRecords[nMid].m_nStaticComboID == nStaticComboID )
+			return nMid;
+
+		if ( pRecords[nMid].m_nStaticComboID < nStaticComboID )
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid - 1;
+		}
+	}
+	return -1;
+}
+
+int CVcsReader::FindStaticCombo( uint32 nStaticComboID ) const
+{
+	if ( !m_pBase )
+		return -1;
+
+	int nRecord = FindRecord( m_pRecords, GetStaticComboCount(), nStaticComboID );
+	if ( nRecord >= 0 )
+		return nRecord;
+
+	// Duplicate combos only have an alias record pointing at the real one
+	const StaticComboAliasRecord_t *pAlias = NULL;
+	if ( m_bAliasesSorted )
+	{
+		int nLow = 0;
+		int nHigh = (int)m_nAliases - 1;
+		while ( nLow <= nHigh && !pAlias )
+		{
+			int nMid = ( nLow + nHigh ) / 2;
+			if ( m_pAliases[nMid].m_nStaticComboID == nStaticComboID )
+			{
+				pAlias = &m_pAliases[nMid];
+			}
+			else if ( m_pAliases[nMid].m_nStaticComboID < nStaticComboID )
+			{
+				nLow = nMid + 1;
+			}
+			else
+			{
+				nHigh = nMid - 1;
+			}
+		}
+	}
+	else
+	{
+		for ( uint32 i = 0; i < m_nAliases && !pAlias; ++i )
+		{
+			if ( m_pAliases[i].m_nStaticComboID == nStaticComboID )
+			{
+				pAlias = &m_pAliases[i];
+			}
+		}
+	}
+
+	return pAlias ? FindRecord( m_pRecords, GetStaticComboCount(), pAlias->m_nSourceStaticCombo ) : -1;
+}
+
+
+void CVcsReader::GetStaticComboData( int nRecord, const uint8_t **ppData, uint32 *pSize ) const
+{
+	*ppData = m_pBase + m_pRecords[nRecord].m_nFileOffset;
+	*pSize = m_pRecords[nRecord + 1].m_nFileOffset - m_pRecords[nRecord].m_nFileOffset;
+}
+
+
+//-----------------------------------------------------------------------------
+// Decoding
+//-----------------------------------------------------------------------------
+bool CVcsReader::DecodeCombo( int nRecord, DecodedCombo_t &decoded )
+{
+	const uint8_t *pRead = m_pBase + m_pRecords[nRecord].m_nFileOffset;
+	const uint8_t *pEnd = m_pBase + m_pRecords[nRecord + 1].m_nFileOffset;
+
+	decoded.m_nRecord = nRecord;
+	decoded.m_Combos.clear();
+	decoded.m_Unpacked.clear();
+
+	// Stored blocks are used in place. Packed ones are unpacked into one buffer,
+	// which is only pointed into once every block is done so it can grow.
+	struct Block_t
+	{
+		const uint8_t *m_pData;		// NULL for blocks in m_Unpacked
+		size_t m_nOffset;
+		uint32 m_nSize;
+	};
+	std::vector< Block_t > blocks;
+
+	for ( ;; )
+	{
+		if ( pRead + sizeof( uint32 ) > pEnd )
+			return false;
+
+		uint32 nBlockSize = ReadUInt32( pRead );
+		pRead += sizeof( uint32 );
+		if ( nBlockSize == VCS_BLOCK_END )
+			break;
+
+		uint32 nPackedSize = nBlockSize & VCS_BLOCK_SIZE_MASK;
+		if ( pRead + nPackedSize > pEnd )
+			return false;
+
+		Block_t block;
+		if ( ( nBlockSize & VCS_BLOCK_FORMAT_MASK ) == VCS_BLOCK_FORMAT_STORED )
+		{
+			block.m_pData = pRead;
+			block.m_nOffset = 0;
+			block.m_nSize = nPackedSize;
+		}
+		else
+		{
+			if ( !m_pDecompressor )
+				return false;
+
+			VcsBlockFormat_t nFormat = ( ( nBlockSize & VCS_BLOCK_FORMAT_MASK ) == VCS_BLOCK_FORMAT_LZMA ) ? VCS_BLOCK_LZMA : VCS_BLOCK_BZIP2;
+			size_t nOffset = decoded.m_Unpacked.size();
+			decoded.m_Unpacked.resize( nOffset + MAX_SHADER_UNPACKED_BLOCK_SIZE );
+
+			uint32 nUnpacked = m_pDecompressor( nFormat, pRead, nPackedSize, &decoded.m_Unpacked[nOffset], MAX_SHADER_UNPACKED_BLOCK_SIZE );
+			if ( nUnpacked == 0 || nUnpacked > MAX_SHADER_UNPACKED_BLOCK_SIZE )
+				return false;
+
+			decoded.m_Unpacked.resize( nOffset + nUnpacked );
+			block.m_pData = NULL;
+			block.m_nOffset = nOffset;
+			block.m_nSize = nUnpacked;
+		}
+		blocks.push_back( block );
+		pRead += nPackedSize;
+	}
+
+	for ( size_t i = 0; i < blocks.size(); ++i )
+	{
+		const uint8_t *pBlock = blocks[i].m_pData ? blocks[i].m_pData : &decoded.m_Unpacked[blocks[i].m_nOffset];
+		const uint8_t *pBlockEnd = pBlock + blocks[i].m_nSize;
+		while ( pBlock < pBlockEnd )
+		{
+			if ( pBlock + 2 * sizeof( uint32 ) > pBlockEnd )
+				return false;
+
+			VcsDynamicCombo_t combo;
+			combo.m_nDynamicComboID = ReadUInt32( pBlock );
+			combo.m_nSize = ReadUInt32( pBlock + sizeof( uint32 ) );
+			combo.m_pData = pBlock + 2 * sizeof( uint32 );
+			if ( combo.m_pData + combo.m_nSize > pBlockEnd )
+				return false;
+
+			decoded.m_Combos.push_back( combo );
+			pBlock = combo.m_pData + combo.m_nSize;
+		}
+	}
+
+	std::sort( decoded.m_Combos.begin(), decoded.m_Combos.end(),
+		[]( const VcsDynamicCombo_t &a, const VcsDynamicCombo_t &b ) { return a.m_nDynamicComboID < b.m_nDynamicComboID; } );
+
+	++m_nDecodes;
+	return true;
+}
+
+CVcsReader::DecodedCombo_t *CVcsReader::GetDecodedCombo( int nRecord )
+{
+	std::unordered_map< int, std::list< DecodedCombo_t >::iterator >::iterator it = m_CacheLookup.find( nRecord );
+	if ( it != m_CacheLookup.end() )
+	{
+		// Move to the front; list splicing keeps the combo pointers valid
+		m_Cache.splice( m_Cache.begin(), m_Cache, it->second );
+		return &m_Cache.front();
+	}
+
+	DecodedCombo_t decoded;
+	if ( !DecodeCombo( nRecord, decoded ) )
+		return NULL;
+
+	if ( m_Cache.size() >= m_nCacheSize )
+	{
+		m_CacheLookup.erase( m_Cache.back().m_nRecord );
+		m_Cache.pop_back();
+	}
+
+	// Moving the vectors keeps m_Unpacked's storage, so the combo pointers stay good
+	m_Cache.push_front( DecodedCombo_t() );
+	m_Cache.front().m_nRecord = decoded.m_nRecord;
+	m_Cache.front().m_Combos.swap( decoded.m_Combos );
+	m_Cache.front().m_Unpacked.swap( decoded.m_Unpacked );
+	m_CacheLookup[nRecord] = m_Cache.begin();
+	return &m_Cache.front();
+}
+
+bool CVcsReader::GetDynamicCombos( uint32 nStaticComboID, const VcsDynamicCombo_t **ppCombos, int *pCount )
+{
+	int nRecord = FindStaticCombo( nStaticComboID );
+	DecodedCombo_t *pDecoded = ( nRecord >= 0 ) ? GetDecodedCombo( nRecord ) : NULL;
+	if ( !pDecoded )
+	{
+		*ppCombos = NULL;
+		*pCount = 0;
+		return false;
+	}
+
+	*ppCombos = pDecoded->m_Combos.empty() ? NULL : &pDecoded->m_Combos[0];
+	*pCount = (int)pDecoded->m_Combos.size();
+	return true;
+}
+
+const VcsDynamicCombo_t *CVcsReader::FindDynamicCombo( uint32 nStaticComboID, uint32 nDynamicComboID )
+{
+	const VcsDynamicCombo_t *pCombos;
+	int nCount;
+	if ( !GetDynamicCombos( nStaticComboID, &pCombos, &nCount ) )
+		return NULL;
+
+	const VcsDynamicCombo_t *pEnd = pCombos + nCount;
+	const VcsDynamicCombo_t *pFound = std::lower_bound( pCombos, pEnd, nDynamicComboID,
+		[]( const VcsDynamicCombo_t &combo, uint32 nID ) { return combo.m_nDynamicComboID < nID; } );
+	return ( pFound != pEnd && pFound->m_nDynamicComboID == nDynamicComboID ) ? pFound : NULL;
+}
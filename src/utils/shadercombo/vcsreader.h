@@ -0,0 +1,141 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Portable reader for version 6 .vcs files. The file is memory
+//			mapped, static combos are found by binary search of the record
+//			table (following alias records in place), and a static combo's
+//			dynamic blocks are only decoded the first time one of its
+//			shaders is asked for. Decoded combos are kept in a small LRU.
+//
+//			Static combo IDs are the ones stored in the file, i.e. the static
+//			index from the generated .inc divided by m_nDynamicCombos.
+//
+//			Not thread safe; use one reader per thread.
+//
+//===========================================================================//
+
+#ifndef VCSREADER_H
+#define VCSREADER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifndef PLATFORM_H
+typedef int32_t int32;
+typedef uint32_t uint32;
+#endif
+#include "materialsystem/shader_vcs_version.h"
+
+
+//-----------------------------------------------------------------------------
+// Compressed blocks are handed to the application, the reader itself only
+// understands stored blocks. nFormat is the VCS_BLOCK_* value of the block.
+// Returns the unpacked size, or 0 on failure.
+//-----------------------------------------------------------------------------
+enum VcsBlockFormat_t
+{
+	VCS_BLOCK_BZIP2 = 0,
+	VCS_BLOCK_STORED = 1,
+	VCS_BLOCK_LZMA = 2,
+};
+
+typedef uint32 ( *VcsDecompressFn_t )( VcsBlockFormat_t nFormat, const uint8_t *pPacked, uint32 nPackedSize,
+									   uint8_t *pOut, uint32 nOutSize );
+
+
+//-----------------------------------------------------------------------------
+// One compiled shader of a static combo
+//-----------------------------------------------------------------------------
+struct VcsDynamicCombo_t
+{
+	uint32 m_nDynamicComboID;
+	uint32 m_nSize;
+	const uint8_t *m_pData;
+};
+
+
+class CVcsReader
+{
+public:
+	CVcsReader();
+	~CVcsReader();
+
+	bool Open( const char *pFileName, std::string &error );
+	void Close();
+	bool IsOpen() const { return m_pBase != NULL; }
+
+	void SetDecompressor( VcsDecompressFn_t pDecompressor ) { m_pDecompressor = pDecompressor; }
+
+	// Number of decoded static combos kept around. At least 1.
+	void SetCacheSize( int nStaticCombos );
+
+	const ShaderHeader_t &GetHeader() const { return *m_pHeader; }
+
+	// Static combos with their own data, not counting the sentinel record
+	int GetStaticComboCount() const { return (int)m_pHeader->m_nNumStaticCombos - 1; }
+	const StaticComboRecord_t &GetStaticComboRecord( int i ) const { return m_pRecords[i]; }
+
+	int GetAliasCount() const { return (int)m_nAliases; }
+	const StaticComboAliasRecord_t &GetAliasRecord( int i ) const { return m_pAliases[i]; }
+
+	// Raw data of a static combo record as stored in the file: its blocks and
+	// the end marker, still packed
+	void GetStaticComboData( int nRecord, const uint8_t **ppData, uint32 *pSize ) const;
+
+	// Index of the record holding the data for a static combo, after following
+	// aliases, or -1 if the combo isn't in the file (it was skipped)
+	int FindStaticCombo( uint32 nStaticComboID ) const;
+
+	// The pointer stays valid until the static combo is evicted from the
+	// cache, which can only happen in a later call. NULL if the combo was
+	// skipped or its data is bad.
+	const VcsDynamicCombo_t *FindDynamicCombo( uint32 nStaticComboID, uint32 nDynamicComboID );
+
+	// All shaders of a static combo, sorted by dynamic combo ID
+	bool GetDynamicCombos( uint32 nStaticComboID, const VcsDynamicCombo_t **ppCombos, int *pCount );
+
+	// Number of times a static combo was decoded (cache misses)
+	int GetDecodeCount() const { return m_nDecodes; }
+
+private:
+	struct DecodedCombo_t
+	{
+		int m_nRecord;
+		std::vector< VcsDynamicCombo_t > m_Combos;
+		std::vector< uint8_t > m_Unpacked;	// empty when every block was stored
+	};
+
+	DecodedCombo_t *GetDecodedCombo( int nRecord );
+	bool DecodeCombo( int nRecord, DecodedCombo_t &decoded );
+
+	// Mapping
+	const uint8_t *m_pBase;
+	size_t m_nFileSize;
+#ifdef _WIN32
+	void *m_hFile;
+	void *m_hMapping;
+#endif
+
+	const ShaderHeader_t *m_pHeader;
+	const StaticComboRecord_t *m_pRecords;
+	const StaticComboAliasRecord_t *m_pAliases;
+	uint32 m_nAliases;
+	bool m_bAliasesSorted;
+
+	VcsDecompressFn_t m_pDecompressor;
+
+	// Most recently used first
+	std::list< DecodedCombo_t > m_Cache;
+	std::unordered_map< int, std::list< DecodedCombo_t >::iterator > m_CacheLookup;
+	size_t m_nCacheSize;
+	int m_nDecodes;
+};
+
+
+#endif // VCSREADER_H
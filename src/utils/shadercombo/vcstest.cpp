@@ -0,0 +1,655 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Tests for vcsreader and vcswriter on synthetic .vcs files: stored
+//			and packed blocks, aliases, an unsorted alias table, the LRU of
+//			decoded combos, and truncated or corrupt tables.
+//
+//			vcstest [temp dir]
+//
+//			The files are written to the temp dir (default .) and removed
+//			again. Exits with 1 if a check failed.
+//
+//			g++ -O2 -I../../public -o vcstest vcstest.cpp vcswriter.cpp vcsreader.cpp shaderhash.cpp
+//
+//===========================================================================//
+
+#include "vcswriter.h"
+#include <stdio.h>
+#include <string.h>
+
+#define VCS_BLOCK_END				0xffffffff
+#define VCS_BLOCK_FORMAT_LZMA		0x80000000
+
+// Packed blocks in these tests are the stored block XORed with this
+#define TEST_PACK_KEY				0x5a
+
+static int s_nChecks = 0;
+static int s_nFailed = 0;
+
+#define CHECK( expr ) \
+	do \
+	{ \
+		++s_nChecks; \
+		if ( !( expr ) ) \
+		{ \
+			++s_nFailed; \
+			printf( "  FAILED %s:%d: %s\n", __FILE__, __LINE__, #expr ); \
+		} \
+	} while ( 0 )
+
+static std::string s_TempDir = ".";
+
+
+//-----------------------------------------------------------------------------
+// Synthetic shaders
+//-----------------------------------------------------------------------------
+// A compiled shader whose bytes depend on the seed, so different shaders
+// never compare equal by accident
+struct TestShader_t
+{
+	uint32 m_nDynamicComboID;
+	std::vector< uint8_t > m_Bytes;
+};
+
+static TestShader_t MakeShader( uint32 nDynamicComboID, uint32 nSize, uint32 nSeed )
+{
+	TestShader_t shader;
+	shader.m_nDynamicComboID = nDynamicComboID;
+	shader.m_Bytes.resize( nSize );
+	uint32 nState = nSeed * 2654435761u + nDynamicComboID + 1;
+	for ( uint32 i = 0; i < nSize; ++i )
+	{
+		nState = nState * 1664525u + 1013904223u;
+		shader.m_Bytes[i] = (uint8_t)( nState >> 24 );
+	}
+	return shader;
+}
+
+// The shaders of a static combo: every other dynamic combo, so the odd IDs are skipped
+static std::vector< TestShader_t > MakeStaticCombo( uint32 nSeed, int nDynamicCombos, uint32 nShaderSize )
+{
+	std::vector< TestShader_t > shaders;
+	for ( int i = 0; i < nDynamicCombos; i += 2 )
+	{
+		shaders.push_back( MakeShader( i, nShaderSize + i, nSeed ) );
+	}
+	return shaders;
+}
+
+static std::vector< VcsDynamicCombo_t > GetCombos( const std::vector< TestShader_t > &shaders )
+{
+	std::vector< VcsDynamicCombo_t > combos;
+	for ( size_t i = 0; i < shaders.size(); ++i )
+	{
+		VcsDynamicCombo_t combo;
+		combo.m_nDynamicComboID = shaders[i].m_nDynamicComboID;
+		combo.m_nSize = (uint32)shaders[i].m_Bytes.size();
+		combo.m_pData = shaders[i].m_Bytes.data();
+		combos.push_back( combo );
+	}
+	return combos;
+}
+
+// True if the reader returns exactly these shaders for the static combo, and
+// nothing for the skipped dynamic combos between them
+static bool CheckShaders( CVcsReader &reader, uint32 nStaticComboID, const std::vector< TestShader_t > &shaders )
+{
+	for ( size_t i = 0; i < shaders.size(); ++i )
+	{
+		const VcsDynamicCombo_t *pCombo = reader.FindDynamicCombo( nStaticComboID, shaders[i].m_nDynamicComboID );
+		if ( !pCombo || pCombo->m_nSize != shaders[i].m_Bytes.size() ||
+			 memcmp( pCombo->m_pData, shaders[i].m_Bytes.data(), pCombo->m_nSize ) )
+			return false;
+
+		if ( reader.FindDynamicCombo( nStaticComboID, shaders[i].m_nDynamicComboID + 1 ) )
+			return false;
+	}
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Files
+//-----------------------------------------------------------------------------
+static std::string TempFile( const char *pName )
+{
+	return s_TempDir + "/" + pName;
+}
+
+static bool ReadFileBytes( const std::string &fileName, std::vector< uint8_t > &bytes )
+{
+	FILE *fp = fopen( fileName.c_str(), "rb" );
+	if ( !fp )
+		return false;
+
+	fseek( fp, 0, SEEK_END );
+	bytes.resize( (size_t)ftell( fp ) );
+	fseek( fp, 0, SEEK_SET );
+	bool bOk = bytes.empty() || fread( bytes.data(), 1, bytes.size(), fp ) == bytes.size();
+	fclose( fp );
+	return bOk;
+}
+
+static bool WriteFileBytes( const std::string &fileName, const std::vector< uint8_t > &bytes, size_t nSize )
+{
+	FILE *fp = fopen( fileName.c_str(), "wb" );
+	if ( !fp )
+		return false;
+
+	bool bOk = nSize == 0 || fwrite( bytes.data(), 1, nSize, fp ) == nSize;
+	return ( fclose( fp ) == 0 ) && bOk;
+}
+
+static uint32 GetUInt32( const std::vector< uint8_t > &bytes, size_t nOffset )
+{
+	uint32 nValue;
+	memcpy( &nValue, &bytes[nOffset], sizeof( nValue ) );
+	return nValue;
+}
+
+static void SetUInt32( std::vector< uint8_t > &bytes, size_t nOffset, uint32 nValue )
+{
+	memcpy( &bytes[nOffset], &nValue, sizeof( nValue ) );
+}
+
+// Offsets of the tables in a file
+static size_t RecordOffset( int i )
+{
+	return sizeof( ShaderHeader_t ) + i * sizeof( StaticComboRecord_t );
+}
+
+static size_t AliasCountOffset( const std::vector< uint8_t > &bytes )
+{
+	return RecordOffset( (int)GetUInt32( bytes, offsetof( ShaderHeader_t, m_nNumStaticCombos ) ) );
+}
+
+static bool OpenFails( const std::string &fileName, const char *pExpectedError )
+{
+	CVcsReader reader;
+	std::string error;
+	if ( reader.Open( fileName.c_str(), error ) || reader.IsOpen() )
+		return false;
+	return error.find( pExpectedError ) != std::string::npos;
+}
+
+static ShaderHeader_t MakeHeader( int nStaticCombos, int nDynamicCombos )
+{
+	ShaderHeader_t header;
+	memset( &header, 0, sizeof( header ) );
+	header.m_nTotalCombos = nStaticCombos * nDynamicCombos;
+	header.m_nDynamicCombos = nDynamicCombos;
+	header.m_nSourceCRC32 = 0x12345678;
+	return header;
+}
+
+
+//-----------------------------------------------------------------------------
+// Stored blocks, aliases and lookups
+//-----------------------------------------------------------------------------
+// Static combos 0, 2, 3, 5, 6 and 9, where 3 and 9 are copies of 0 and 6 is a
+// copy of 5. 1, 4, 7 and 8 are skipped.
+static const int TEST_DYNAMIC_COMBOS = 8;
+
+static void TestStoredAndAliases()
+{
+	printf( "stored blocks and aliases\n" );
+
+	std::vector< TestShader_t > combo0 = MakeStaticCombo( 0, TEST_DYNAMIC_COMBOS, 40 );
+	std::vector< TestShader_t > combo2 = MakeStaticCombo( 2, TEST_DYNAMIC_COMBOS, 24 );
+	std::vector< TestShader_t > combo5 = MakeStaticCombo( 5, TEST_DYNAMIC_COMBOS, 64 );
+	std::vector< VcsDynamicCombo_t > combos0 = GetCombos( combo0 );
+	std::vector< VcsDynamicCombo_t > combos2 = GetCombos( combo2 );
+	std::vector< VcsDynamicCombo_t > combos5 = GetCombos( combo5 );
+
+	// Added out of order: the writer sorts the records
+	CVcsWriter writer;
+	writer.SetHeader( MakeHeader( 10, TEST_DYNAMIC_COMBOS ) );
+	writer.AddStaticCombo( 9, combos0.data(), (int)combos0.size() );
+	writer.AddStaticCombo( 5, combos5.data(), (int)combos5.size() );
+	writer.AddStaticCombo( 0, combos0.data(), (int)combos0.size() );
+	writer.AddStaticCombo( 2, combos2.data(), (int)combos2.size() );
+	writer.AddStaticCombo( 3, combos0.data(), (int)combos0.size() );
+	writer.AddAlias( 6, 5 );
+
+	std::string fileName = TempFile( "vcstest_stored.vcs" );
+	std::string error;
+	VcsWriteStats_t stats;
+	CHECK( writer.Write( fileName.c_str(), &stats, error ) );
+	CHECK( stats.m_nStaticCombos == 6 );
+	CHECK( stats.m_nUniqueCombos == 3 );
+	CHECK( stats.m_nAliasedCombos == 3 );
+
+	CVcsReader reader;
+	CHECK( reader.Open( fileName.c_str(), error ) );
+	CHECK( reader.GetHeader().m_nSourceCRC32 == 0x12345678 );
+	CHECK( reader.GetStaticComboCount() == 3 );
+	CHECK( reader.GetAliasCount() == 3 );
+
+	// Records are found by ID, aliases resolve to the record of their source
+	const uint32 nExpectedOwner[10] = { 0, (uint32)-1, 2, 0, (uint32)-1, 5, 5, (uint32)-1, (uint32)-1, 0 };
+	for ( uint32 i = 0; i < 10; ++i )
+	{
+		int nRecord = reader.FindStaticCombo( i );
+		if ( nExpectedOwner[i] == (uint32)-1 )
+		{
+			CHECK( nRecord == -1 );
+			CHECK( !reader.FindDynamicCombo( i, 0 ) );
+		}
+		else
+		{
+			CHECK( nRecord >= 0 && reader.GetStaticComboRecord( nRecord ).m_nStaticComboID == nExpectedOwner[i] );
+		}
+	}
+	CHECK( reader.FindStaticCombo( 0xffffffff ) == -1 );
+	CHECK( reader.FindStaticCombo( 1000 ) == -1 );
+
+	CHECK( CheckShaders( reader, 0, combo0 ) );
+	CHECK( CheckShaders( reader, 2, combo2 ) );
+	CHECK( CheckShaders( reader, 3, combo0 ) );
+	CHECK( CheckShaders( reader, 5, combo5 ) );
+	CHECK( CheckShaders( reader, 6, combo5 ) );
+	CHECK( CheckShaders( reader, 9, combo0 ) );
+
+	// Aliases share the decoded combo of their source: 0, 2 and 5 were decoded once each
+	CHECK( reader.GetDecodeCount() == 3 );
+
+	// Shaders point into the mapped file, not into copies
+	const uint8_t *pData;
+	uint32 nSize;
+	reader.GetStaticComboData( reader.FindStaticCombo( 2 ), &pData, &nSize );
+	const VcsDynamicCombo_t *pCombo = reader.FindDynamicCombo( 2, 4 );
+	CHECK( pCombo && pCombo->m_pData > pData && pCombo->m_pData + pCombo->m_nSize <= pData + nSize );
+
+	const VcsDynamicCombo_t *pAll;
+	int nCount;
+	CHECK( reader.GetDynamicCombos( 5, &pAll, &nCount ) && nCount == (int)combo5.size() );
+	for ( int i = 1; i < nCount; ++i )
+	{
+		CHECK( pAll[i - 1].m_nDynamicComboID < pAll[i].m_nDynamicComboID );
+	}
+
+	reader.Close();
+	CHECK( !reader.IsOpen() );
+	CHECK( reader.FindStaticCombo( 0 ) == -1 );
+	remove( fileName.c_str() );
+}
+
+// A static combo bigger than one block is split across several stored blocks
+static void TestMultipleBlocks()
+{
+	printf( "multiple stored blocks\n" );
+
+	const uint32 nShaderSize = MAX_SHADER_UNPACKED_BLOCK_SIZE / 3;
+	std::vector< TestShader_t > combo = MakeStaticCombo( 7, 12, nShaderSize );
+	std::vector< VcsDynamicCombo_t > combos = GetCombos( combo );
+
+	std::vector< uint8_t > data;
+	CVcsWriter::PackStoredBlocks( combos.data(), (int)combos.size(), data );
+	int nBlocks = 0;
+	for ( size_t nOffset = 0; GetUInt32( data, nOffset ) != VCS_BLOCK_END; ++nBlocks )
+	{
+		nOffset += sizeof( uint32 ) + ( GetUInt32( data, nOffset ) & 0x3fffffff );
+	}
+	CHECK( nBlocks == 3 );
+
+	CVcsWriter writer;
+	writer.SetHeader( MakeHeader( 1, 12 ) );
+	writer.AddStaticCombo( 0, combos.data(), (int)combos.size() );
+
+	std::string fileName = TempFile( "vcstest_blocks.vcs" );
+	std::string error;
+	CHECK( writer.Write( fileName.c_str(), NULL, error ) );
+
+	CVcsReader reader;
+	CHECK( reader.Open( fileName.c_str(), error ) );
+	CHECK( CheckShaders( reader, 0, combo ) );
+	CHECK( reader.GetDecodeCount() == 1 );
+	remove( fileName.c_str() );
+}
+
+
+//-----------------------------------------------------------------------------
+// Packed blocks go through the decompressor
+//-----------------------------------------------------------------------------
+static int s_nDecompressCalls = 0;
+
+static uint32 TestDecompress( VcsBlockFormat_t nFormat, const uint8_t *pPacked, uint32 nPackedSize, uint8_t *pOut, uint32 nOutSize )
+{
+	++s_nDecompressCalls;
+	if ( nFormat != VCS_BLOCK_LZMA || nPackedSize > nOutSize )
+		return 0;
+
+	for ( uint32 i = 0; i < nPackedSize; ++i )
+	{
+		pOut[i] = pPacked[i] ^ TEST_PACK_KEY;
+	}
+	return nPackedSize;
+}
+
+// The stored data of a static combo with its blocks turned into "LZMA" ones
+static void PackBlocks( const std::vector< uint8_t > &stored, std::vector< uint8_t > &packed )
+{
+	packed = stored;
+	size_t nOffset = 0;
+	while ( GetUInt32( packed, nOffset ) != VCS_BLOCK_END )
+	{
+		uint32 nSize = GetUInt32( packed, nOffset ) & 0x3fffffff;
+		SetUInt32( packed, nOffset, VCS_BLOCK_FORMAT_LZMA | nSize );
+		for ( uint32 i = 0; i < nSize; ++i )
+		{
+			packed[nOffset + sizeof( uint32 ) + i] ^= TEST_PACK_KEY;
+		}
+		nOffset += sizeof( uint32 ) + nSize;
+	}
+}
+
+static void TestPackedBlocks()
+{
+	printf( "packed blocks\n" );
+
+	std::vector< TestShader_t > comboA = MakeStaticCombo( 11, TEST_DYNAMIC_COMBOS, 100 );
+	std::vector< TestShader_t > comboB = MakeStaticCombo( 12, TEST_DYNAMIC_COMBOS, 30 );
+	std::vector< VcsDynamicCombo_t > combosA = GetCombos( comboA );
+	std::vector< VcsDynamicCombo_t > combosB = GetCombos( comboB );
+
+	std::vector< uint8_t > storedA, packedA;
+	CVcsWriter::PackStoredBlocks( combosA.data(), (int)combosA.size(), storedA );
+	PackBlocks( storedA, packedA );
+
+	// A packed combo, a stored one, and a packed copy of the first that becomes an alias
+	CVcsWriter writer;
+	writer.SetHeader( MakeHeader( 3, TEST_DYNAMIC_COMBOS ) );
+	writer.AddStaticCombo( 0, packedA.data(), (uint32)packedA.size() );
+	writer.AddStaticCombo( 1, combosB.data(), (int)combosB.size() );
+	writer.AddStaticCombo( 2, packedA.data(), (uint32)packedA.size() );
+
+	std::string fileName = TempFile( "vcstest_packed.vcs" );
+	std::string error;
+	VcsWriteStats_t stats;
+	CHECK( writer.Write( fileName.c_str(), &stats, error ) );
+	CHECK( stats.m_nAliasedCombos == 1 );
+
+	// Without a decompressor only the stored combo can be read
+	CVcsReader reader;
+	CHECK( reader.Open( fileName.c_str(), error ) );
+	CHECK( reader.FindStaticCombo( 0 ) >= 0 );
+	CHECK( !reader.FindDynamicCombo( 0, 0 ) );
+	CHECK( CheckShaders( reader, 1, comboB ) );
+	CHECK( reader.GetDecodeCount() == 1 );
+
+	reader.SetDecompressor( TestDecompress );
+	s_nDecompressCalls = 0;
+	CHECK( CheckShaders( reader, 0, comboA ) );
+	CHECK( CheckShaders( reader, 2, comboA ) );
+	CHECK( reader.GetDecodeCount() == 2 );
+	CHECK( s_nDecompressCalls == 1 );
+	remove( fileName.c_str() );
+}
+
+
+//-----------------------------------------------------------------------------
+// Alias tables written by tools that didn't sort them
+//-----------------------------------------------------------------------------
+static void TestUnsortedAliases()
+{
+	printf( "unsorted alias table\n" );
+
+	std::vector< TestShader_t > combo = MakeStaticCombo( 21, TEST_DYNAMIC_COMBOS, 16 );
+	std::vector< VcsDynamicCombo_t > combos = GetCombos( combo );
+
+	CVcsWriter writer;
+	writer.SetHeader( MakeHeader( 64, TEST_DYNAMIC_COMBOS ) );
+	writer.AddStaticCombo( 10, combos.data(), (int)combos.size() );
+	for ( uint32 i = 20; i < 60; i += 5 )
+	{
+		writer.AddAlias( i, 10 );
+	}
+
+	std::string fileName = TempFile( "vcstest_aliases.vcs" );
+	std::string error;
+	CHECK( writer.Write( fileName.c_str(), NULL, error ) );
+
+	// Reverse the alias records in the file
+	std::vector< uint8_t > bytes;
+	CHECK( ReadFileBytes( fileName, bytes ) );
+	size_t nAliasCount = AliasCountOffset( bytes );
+	uint32 nAliases = GetUInt32( bytes, nAliasCount );
+	CHECK( nAliases == 8 );
+	StaticComboAliasRecord_t *pAliases = (StaticComboAliasRecord_t *)&bytes[nAliasCount + sizeof( uint32 )];
+	for ( uint32 i = 0; i < nAliases / 2; ++i )
+	{
+		StaticComboAliasRecord_t temp = pAliases[i];
+		pAliases[i] = pAliases[nAliases - 1 - i];
+		pAliases[nAliases - 1 - i] = temp;
+	}
+	CHECK( WriteFileBytes( fileName, bytes, bytes.size() ) );
+
+	CVcsReader reader;
+	CHECK( reader.Open( fileName.c_str(), error ) );
+	CHECK( reader.GetAliasRecord( 0 ).m_nStaticComboID == 55 );
+	int nRecord = reader.FindStaticCombo( 10 );
+	CHECK( nRecord == 0 );
+	for ( uint32 i = 20; i < 60; ++i )
+	{
+		CHECK( reader.FindStaticCombo( i ) == ( ( i % 5 ) ? -1 : nRecord ) );
+	}
+	CHECK( CheckShaders( reader, 35, combo ) );
+	remove( fileName.c_str() );
+}
+
+
+//-----------------------------------------------------------------------------
+// LRU of decoded combos
+//-----------------------------------------------------------------------------
+static void TestCache()
+{
+	printf( "decoded combo cache\n" );
+
+	std::vector< std::vector< TestShader_t > > shaders;
+	CVcsWriter writer;
+	writer.SetHeader( MakeHeader( 4, TEST_DYNAMIC_COMBOS ) );
+	for ( uint32 i = 0; i < 4; ++i )
+	{
+		shaders.push_back( MakeStaticCombo( 31 + i, TEST_DYNAMIC_COMBOS, 20 ) );
+	}
+	std::vector< std::vector< VcsDynamicCombo_t > > combos;
+	for ( uint32 i = 0; i < 4; ++i )
+	{
+		combos.push_back( GetCombos( shaders[i] ) );
+		writer.AddStaticCombo( i, combos[i].data(), (int)combos[i].size() );
+	}
+
+	std::string fileName = TempFile( "vcstest_cache.vcs" );
+	std::string error;
+	CHECK( writer.Write( fileName.c_str(), NULL, error ) );
+
+	CVcsReader reader;
+	CHECK( reader.Open( fileName.c_str(), error ) );
+	reader.SetCacheSize( 2 );
+
+	// Nothing is decoded until a shader is asked for
+	CHECK( reader.FindStaticCombo( 0 ) == 0 );
+	CHECK( reader.GetDecodeCount() == 0 );
+
+	const VcsDynamicCombo_t *p0 = reader.FindDynamicCombo( 0, 2 );
+	CHECK( p0 && reader.GetDecodeCount() == 1 );
+	CHECK( reader.FindDynamicCombo( 0, 4 ) && reader.GetDecodeCount() == 1 );
+	CHECK( reader.FindDynamicCombo( 1, 0 ) && reader.GetDecodeCount() == 2 );
+
+	// 0 was used more recently than 1, so 2 evicts 1
+	CHECK( reader.FindDynamicCombo( 0, 0 ) == p0 - 1 && reader.GetDecodeCount() == 2 );
+	CHECK( reader.FindDynamicCombo( 2, 0 ) && reader.GetDecodeCount() == 3 );
+	CHECK( reader.FindDynamicCombo( 0, 2 ) == p0 && reader.GetDecodeCount() == 3 );
+	CHECK( reader.FindDynamicCombo( 1, 0 ) && reader.GetDecodeCount() == 4 );
+
+	// Now 2 was least recently used
+	CHECK( reader.FindDynamicCombo( 0, 0 ) && reader.GetDecodeCount() == 4 );
+	CHECK( reader.FindDynamicCombo( 2, 0 ) && reader.GetDecodeCount() == 5 );
+	CHECK( CheckShaders( reader, 2, shaders[2] ) );
+
+	// Shrinking the cache evicts down to the new size, least recently used first
+	reader.SetCacheSize( 1 );
+	CHECK( reader.FindDynamicCombo( 2, 0 ) && reader.GetDecodeCount() == 5 );
+	CHECK( reader.FindDynamicCombo( 0, 0 ) && reader.GetDecodeCount() == 6 );
+	CHECK( reader.FindDynamicCombo( 2, 0 ) && reader.GetDecodeCount() == 7 );
+
+	// A cache size below 1 still keeps one combo
+	reader.SetCacheSize( 0 );
+	CHECK( reader.FindDynamicCombo( 2, 2 ) && reader.GetDecodeCount() == 7 );
+	CHECK( CheckShaders( reader, 3, shaders[3] ) && reader.GetDecodeCount() == 8 );
+	remove( fileName.c_str() );
+}
+
+
+//-----------------------------------------------------------------------------
+// Truncated and corrupt files
+//-----------------------------------------------------------------------------
+static void TestCorrupt()
+{
+	printf( "truncated and corrupt files\n" );
+
+	std::vector< TestShader_t > combo0 = MakeStaticCombo( 41, TEST_DYNAMIC_COMBOS, 48 );
+	std::vector< TestShader_t > combo1 = MakeStaticCombo( 42, TEST_DYNAMIC_COMBOS, 48 );
+	std::vector< VcsDynamicCombo_t > combos0 = GetCombos( combo0 );
+	std::vector< VcsDynamicCombo_t > combos1 = GetCombos( combo1 );
+
+	CVcsWriter writer;
+	writer.SetHeader( MakeHeader( 4, TEST_DYNAMIC_COMBOS ) );
+	writer.AddStaticCombo( 0, combos0.data(), (int)combos0.size() );
+	writer.AddStaticCombo( 1, combos1.data(), (int)combos1.size() );
+	writer.AddStaticCombo( 3, combos0.data(), (int)combos0.size() );
+
+	std::string goodName = TempFile( "vcstest_good.vcs" );
+	std::string badName = TempFile( "vcstest_bad.vcs" );
+	std::string error;
+	CHECK( writer.Write( goodName.c_str(), NULL, error ) );
+
+	std::vector< uint8_t > good;
+	CHECK( ReadFileBytes( goodName, good ) );
+	size_t nAliasCount = AliasCountOffset( good );
+	size_t nDataStart = nAliasCount + sizeof( uint32 ) + GetUInt32( good, nAliasCount ) * sizeof( StaticComboAliasRecord_t );
+
+	// Missing files, and files cut short anywhere in the tables
+	CHECK( OpenFails( TempFile( "vcstest_missing.vcs" ), "unable to open" ) );
+	CHECK( WriteFileBytes( badName, good, 0 ) && OpenFails( badName, "unable to map" ) );
+	for ( size_t nSize = 1; nSize < sizeof( ShaderHeader_t ); ++nSize )
+	{
+		CHECK( WriteFileBytes( badName, good, nSize ) && OpenFails( badName, "not a version 6" ) );
+	}
+	for ( size_t nSize = sizeof( ShaderHeader_t ); nSize < nAliasCount + sizeof( uint32 ); ++nSize )
+	{
+		CHECK( WriteFileBytes( badName, good, nSize ) && OpenFails( badName, "bad static combo table" ) );
+	}
+	for ( size_t nSize = nAliasCount + sizeof( uint32 ); nSize < nDataStart; ++nSize )
+	{
+		CHECK( WriteFileBytes( badName, good, nSize ) && OpenFails( badName, "bad alias table" ) );
+	}
+
+	// Cut inside the data: the records point past the end
+	CHECK( WriteFileBytes( badName, good, good.size() - 1 ) && OpenFails( badName, "bad static combo record" ) );
+
+	std::vector< uint8_t > bad;
+
+	bad = good;
+	SetUInt32( bad, offsetof( ShaderHeader_t, m_nVersion ), SHADER_VCS_VERSION_NUMBER - 1 );
+	CHECK( WriteFileBytes( badName, bad, bad.size() ) && OpenFails( badName, "not a version 6" ) );
+
+	bad = good;
+	SetUInt32( bad, offsetof( ShaderHeader_t, m_nNumStaticCombos ), 0 );
+	CHECK( WriteFileBytes( badName, bad, bad.size() ) && OpenFails( badName, "bad static combo table" ) );
+
+	bad = good;
+	SetUInt32( bad, offsetof( ShaderHeader_t, m_nNumStaticCombos ), 0x7fffffff );
+	CHECK( WriteFileBytes( badName, bad, bad.size() ) && OpenFails( badName, "bad static combo table" ) );
+
+	bad = good;
+	SetUInt32( bad, nAliasCount, 0xffffffff );
+	CHECK( WriteFileBytes( badName, bad, bad.size() ) && OpenFails( badName, "bad alias table" ) );
+
+	// Records out of order, duplicated, or pointing into the tables
+	bad = good;
+	SetUInt32( bad, RecordOffset( 1 ), 0 );
+	CHECK( WriteFileBytes( badName, bad, bad.size() ) && OpenFails( badName, "bad static combo record" ) );
+
+	bad = good;
+	SetUInt32( bad, RecordOffset( 0 ) + sizeof( uint32 ), (uint32)nDataStart - 1 );
+	CHECK( WriteFileBytes( badName, bad, bad.size() ) && OpenFails( badName, "bad static combo record" ) );
+
+	bad = good;
+	SetUInt32( bad, RecordOffset( 1 ) + sizeof( uint32 ), GetUInt32( good, RecordOffset( 2 ) + sizeof( uint32 ) ) + 1 );
+	CHECK( WriteFileBytes( badName, bad, bad.size() ) && OpenFails( badName, "bad static combo record" ) );
+
+	// Bad data opens, but only the combo it belongs to fails to decode
+	size_t nCombo1 = GetUInt32( good, RecordOffset( 1 ) + sizeof( uint32 ) );
+	size_t nCombo1End = GetUInt32( good, RecordOffset( 2 ) + sizeof( uint32 ) );
+
+	const uint32 nBadBlockSizes[] =
+	{
+		0x40000000 | ( (uint32)( nCombo1End - nCombo1 ) ),		// runs into the next combo
+		0x40000000 | 0x3fffffff,								// runs past the file
+		0x40000000 | 3,											// cuts the first shader's header
+	};
+	for ( size_t i = 0; i < sizeof( nBadBlockSizes ) / sizeof( nBadBlockSizes[0] ); ++i )
+	{
+		bad = good;
+		SetUInt32( bad, nCombo1, nBadBlockSizes[i] );
+		CVcsReader reader;
+		CHECK( WriteFileBytes( badName, bad, bad.size() ) && reader.Open( badName.c_str(), error ) );
+		CHECK( !reader.FindDynamicCombo( 1, 0 ) );
+		CHECK( CheckShaders( reader, 0, combo0 ) );
+		CHECK( reader.GetDecodeCount() == 1 );
+	}
+
+	// A shader whose size runs past its block
+	bad = good;
+	SetUInt32( bad, nCombo1 + 2 * sizeof( uint32 ), 0x10000 );
+	{
+		CVcsReader reader;
+		CHECK( WriteFileBytes( badName, bad, bad.size() ) && reader.Open( badName.c_str(), error ) );
+		CHECK( !reader.FindDynamicCombo( 1, 0 ) );
+		CHECK( CheckShaders( reader, 3, combo0 ) );
+	}
+
+	// No end marker before the next combo
+	bad = good;
+	SetUInt32( bad, nCombo1End - sizeof( uint32 ), 0x40000000 );
+	{
+		CVcsReader reader;
+		CHECK( WriteFileBytes( badName, bad, bad.size() ) && reader.Open( badName.c_str(), error ) );
+		CHECK( !reader.FindDynamicCombo( 1, 0 ) );
+	}
+
+	// The untouched file still reads
+	{
+		CVcsReader reader;
+		CHECK( reader.Open( goodName.c_str(), error ) );
+		CHECK( CheckShaders( reader, 1, combo1 ) && CheckShaders( reader, 3, combo0 ) );
+	}
+
+	remove( goodName.c_str() );
+	remove( badName.c_str() );
+}
+
+
+int main( int argc, char **argv )
+{
+	if ( argc > 2 || ( argc == 2 && argv[1][0] == '-' ) )
+	{
+		printf( "usage: vcstest [temp dir]\n" );
+		return 2;
+	}
+	if ( argc == 2 )
+	{
+		s_TempDir = argv[1];
+	}
+
+	TestStoredAndAliases();
+	TestMultipleBlocks();
+	TestPackedBlocks();
+	TestUnsortedAliases();
+	TestCache();
+	TestCorrupt();
+
+	printf( "%d checks, %d failed\n", s_nChecks, s_nFailed );
+	return s_nFailed ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Writes version 6 .vcs files, turning byte identical static combos
+//			into alias records.
+//
+// Static combos are keyed by their CRC32, a 64-bit hash and their size, and
+// combos with the same key are compared byte for byte before one is aliased
+// to the other, so a hash collision can't merge different shaders. Packed
+// blocks are compared as stored; the compressors are deterministic, so equal
+// shaders give equal packed data.
+//
+//===========================================================================//
+
+#include "vcswriter.h"
+#include "shaderhash.h"
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+
+#define VCS_BLOCK_END				0xffffffff
+#define VCS_BLOCK_FORMAT_STORED		0x40000000
+
+
+CVcsWriter::CVcsWriter()
+{
+	memset( &m_Header, 0, sizeof( m_Header ) );
+	m_Header.m_nVersion = SHADER_VCS_VERSION_NUMBER;
+}
+
+void CVcsWriter::AddStaticCombo( uint32 nStaticComboID, const uint8_t *pData, uint32 nSize )
+{
+	StaticCombo_t combo;
+	combo.m_nStaticComboID = nStaticComboID;
+	combo.m_pData = pData;
+	combo.m_nSize = nSize;
+	combo.m_nOwnedData = -1;
+	m_Combos.push_back( combo );
+}
+
+static void AppendUInt32( std::vector< uint8_t > &out, uint32 nValue )
+{
+	uint8_t bytes[sizeof( uint32 )];
+	memcpy( bytes, &nValue, sizeof( nValue ) );
+	out.insert( out.end(), bytes, bytes + sizeof( bytes ) );
+}
+
+void CVcsWriter::PackStoredBlocks( const VcsDynamicCombo_t *pCombos, int nCount, std::vector< uint8_t > &data )
+{
+	data.clear();
+
+	// Fill stored blocks up to the size the engine unpacks into
+	std::vector< uint8_t > block;
+	for ( int i = 0; i <= nCount; ++i )
+	{
+		size_t nEntrySize = ( i < nCount ) ? 2 * sizeof( uint32 ) + pCombos[i].m_nSize : 0;
+		bool bFlush = ( i == nCount ) || ( !block.empty() && block.size() + nEntrySize > MAX_SHADER_UNPACKED_BLOCK_SIZE );
+		if ( bFlush && !block.empty() )
+		{
+			AppendUInt32( data, VCS_BLOCK_FORMAT_STORED | (uint32)block.size() );
+			data.insert( data.end(), block.begin(), block.end() );
+			block.clear();
+		}
+
+		if ( i < nCount )
+		{
+			AppendUInt32( block, pCombos[i].m_nDynamicComboID );
+			AppendUInt32( block, pCombos[i].m_nSize );
+			block.insert( block.end(), pCombos[i].m_pData, pCombos[i].m_pData + pCombos[i].m_nSize );
+		}
+	}
+	AppendUInt32( data, VCS_BLOCK_END );
+}
+
+void CVcsWriter::AddStaticCombo( uint32 nStaticComboID, const VcsDynamicCombo_t *pCombos, int nCount )
+{
+	m_OwnedData.push_back( std::vector< uint8_t >() );
+	PackStoredBlocks( pCombos, nCount, m_OwnedData.back() );
+
+	StaticCombo_t combo;
+	combo.m_nStaticComboID = nStaticComboID;
+	combo.m_pData = NULL;
+	combo.m_nSize = (uint32)m_OwnedData.back().size();
+	combo.m_nOwnedData = (int)m_OwnedData.size() - 1;
+	m_Combos.push_back( combo );
+}
+
+void CVcsWriter::AddAlias( uint32 nStaticComboID, uint32 nSourceStaticComboID )
+{
+	StaticComboAliasRecord_t alias;
+	alias.m_nStaticComboID = nStaticComboID;
+	alias.m_nSourceStaticCombo = nSourceStaticComboID;
+	m_Aliases.push_back( alias );
+}
+
+
+//-----------------------------------------------------------------------------
+// Writing
+//-----------------------------------------------------------------------------
+struct ComboKey_t
+{
+	uint32_t m_nCRC;
+	uint64_t m_nHash;
+	uint32 m_nSize;
+
+	bool operator<( const ComboKey_t &other ) const
+	{
+		if ( m_nCRC != other.m_nCRC )
+			return m_nCRC < other.m_nCRC;
+		if ( m_nHash != other.m_nHash )
+			return m_nHash < other.m_nHash;
+		return m_nSize < other.m_nSize;
+	}
+};
+
+bool CVcsWriter::Write( const char *pFileName, VcsWriteStats_t *pStats, std::string &error )
+{
+	for ( size_t i = 0; i < m_Combos.size(); ++i )
+	{
+		if ( m_Combos[i].m_nOwnedData >= 0 )
+		{
+			m_Combos[i].m_pData = m_OwnedData[m_Combos[i].m_nOwnedData].data();
+		}
+	}
+
+	std::sort( m_Combos.begin(), m_Combos.end(),
+		[]( const StaticCombo_t &a, const StaticCombo_t &b ) { return a.m_nStaticComboID < b.m_nStaticComboID; } );
+
+	// Data owner of every combo ID, before and after deduplication
+	std::map< uint32, uint32 > owners;
+	std::map< ComboKey_t, std::vector< size_t > > keys;
+	std::vector< size_t > unique;
+	std::vector< StaticComboAliasRecord_t > aliases;
+	uint64_t nDataBytesIn = 0;
+	uint64_t nDataBytesOut = 0;
+
+	for ( size_t i = 0; i < m_Combos.size(); ++i )
+	{
+		const StaticCombo_t &combo = m_Combos[i];
+		if ( i > 0 && combo.m_nStaticComboID == m_Combos[i - 1].m_nStaticComboID )
+		{
+			char szError[64];
+			snprintf( szError, sizeof( szError ), "static combo %u added twice", combo.m_nStaticComboID );
+			error = szError;
+			return false;
+		}
+
+		nDataBytesIn += combo.m_nSize;
+
+		ComboKey_t key;
+		key.m_nCRC = ShaderCRC32_ProcessSingleBuffer( combo.m_pData, combo.m_nSize );
+		key.m_nHash = ShaderHash64( combo.m_pData, combo.m_nSize );
+		key.m_nSize = combo.m_nSize;
+
+		std::vector< size_t > &candidates = keys[key];
+		const StaticCombo_t *pOwner = NULL;
+		for ( size_t j = 0; j < candidates.size() && !pOwner; ++j )
+		{
+			const StaticCombo_t &candidate = m_Combos[candidates[j]];
+			if ( !memcmp( candidate.m_pData, combo.m_pData, combo.m_nSize ) )
+			{
+				pOwner = &candidate;
+			}
+		}
+
+		if ( pOwner )
+		{
+			StaticComboAliasRecord_t alias;
+			alias.m_nStaticComboID = combo.m_nStaticComboID;
+			alias.m_nSourceStaticCombo = pOwner->m_nStaticComboID;
+			aliases.push_back( alias );
+			owners[combo.m_nStaticComboID] = pOwner->m_nStaticComboID;
+		}
+		else
+		{
+			candidates.push_back( i );
+			unique.push_back( i );
+			owners[combo.m_nStaticComboID] = combo.m_nStaticComboID;
+			nDataBytesOut += combo.m_nSize;
+		}
+	}
+
+	// Aliases that came with the input point at combos that may have been
+	// aliased themselves, or at other input aliases
+	int nPendingAliases = (int)m_Aliases.size();
+	std::vector< bool > resolved( m_Aliases.size(), false );
+	while ( nPendingAliases > 0 )
+	{
+		int nResolved = 0;
+		for ( size_t i = 0; i < m_Aliases.size(); ++i )
+		{
+			if ( resolved[i] )
+				continue;
+
+			std::map< uint32, uint32 >::const_iterator it = owners.find( m_Aliases[i].m_nSourceStaticCombo );
+			if ( it == owners.end() )
+				continue;
+
+			if ( owners.count( m_Aliases[i].m_nStaticComboID ) )
+			{
+				char szError[64];
+				snprintf( szError, sizeof( szError ), "static combo %u added twice", m_Aliases[i].m_nStaticComboID );
+				error = szError;
+				return false;
+			}
+
+			StaticComboAliasRecord_t alias;
+			alias.m_nStaticComboID = m_Aliases[i].m_nStaticComboID;
+			alias.m_nSourceStaticCombo = it->second;
+			aliases.push_back( alias );
+			owners[alias.m_nStaticComboID] = it->second;
+			resolved[i] = true;
+			++nResolved;
+		}
+
+		if ( nResolved == 0 )
+		{
+			error = "alias records point at static combos that have no data";
+			return false;
+		}
+		nPendingAliases -= nResolved;
+	}
+
+	std::sort( aliases.begin(), aliases.end(),
+		[]( const StaticComboAliasRecord_t &a, const StaticComboAliasRecord_t &b ) { return a.m_nStaticComboID < b.m_nStaticComboID; } );
+
+	// Tables, then the data in record order
+	ShaderHeader_t header = m_Header;
+	header.m_nVersion = SHADER_VCS_VERSION_NUMBER;
+	header.m_nNumStaticCombos = (uint32)unique.size() + 1;
+
+	uint64_t nOffset = sizeof( ShaderHeader_t ) + header.m_nNumStaticCombos * sizeof( StaticComboRecord_t ) +
+		sizeof( uint32 ) + aliases.size() * sizeof( StaticComboAliasRecord_t );
+
+	std::vector< StaticComboRecord_t > records;
+	for ( size_t i = 0; i < unique.size(); ++i )
+	{
+		StaticComboRecord_t record;
+		record.m_nStaticComboID = m_Combos[unique[i]].m_nStaticComboID;
+		record.m_nFileOffset = (uint32)nOffset;
+		records.push_back( record );
+		nOffset += m_Combos[unique[i]].m_nSize;
+	}
+
+	if ( nOffset > 0xffffffff )
+	{
+		error = "static combo data doesn't fit in a .vcs";
+		return false;
+	}
+
+	StaticComboRecord_t sentinel;
+	sentinel.m_nStaticComboID = 0xffffffff;
+	sentinel.m_nFileOffset = (uint32)nOffset;
+	records.push_back( sentinel );
+
+	FILE *fp = fopen( pFileName, "wb" );
+	if ( !fp )
+	{
+		error = std::string( "unable to write " ) + pFileName;
+		return false;
+	}
+
+	uint32 nAliases = (uint32)aliases.size();
+	bool bOk = fwrite( &header, sizeof( header ), 1, fp ) == 1;
+	bOk = bOk && fwrite( records.data(), sizeof( StaticComboRecord_t ), records.size(), fp ) == records.size();
+	bOk = bOk && fwrite( &nAliases, sizeof( nAliases ), 1, fp ) == 1;
+	bOk = bOk && ( aliases.empty() || fwrite( aliases.data(), sizeof( StaticComboAliasRecord_t ), aliases.size(), fp ) == aliases.size() );
+	for ( size_t i = 0; i < unique.size() && bOk; ++i )
+	{
+		const StaticCombo_t &combo = m_Combos[unique[i]];
+		bOk = fwrite( combo.m_pData, 1, combo.m_nSize, fp ) == combo.m_nSize;
+	}
+	bOk = ( fclose( fp ) == 0 ) && bOk;
+
+	if ( !bOk )
+	{
+		error = std::string( "error writing " ) + pFileName;
+		return false;
+	}
+
+	if ( pStats )
+	{
+		pStats->m_nStaticCombos = (int)owners.size();
+		pStats->m_nUniqueCombos = (int)unique.size();
+		pStats->m_nAliasedCombos = (int)aliases.size();
+		pStats->m_nDataBytesIn = nDataBytesIn;
+		pStats->m_nDataBytesOut = nDataBytesOut;
+		pStats->m_nFileBytes = nOffset;
+	}
+
+	return true;
+}
@@ -0,0 +1,70 @@
+//===== Copyright  1996-2005, Valve Corporation, All rights reserved. ======//
+//
+// Purpose: Writes version 6 .vcs files. Static combos whose data is byte
+//			identical are written once; the others get a
+//			StaticComboAliasRecord_t pointing at the first copy.
+//
+//===========================================================================//
+
+#ifndef VCSWRITER_H
+#define VCSWRITER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "vcsreader.h"
+#include <string>
+#include <vector>
+
+
+struct VcsWriteStats_t
+{
+	int m_nStaticCombos;			// combos added, with or without data
+	int m_nUniqueCombos;			// combos written with their own data
+	int m_nAliasedCombos;			// combos written as alias records
+	uint64_t m_nDataBytesIn;		// static combo data before deduplication
+	uint64_t m_nDataBytesOut;
+	uint64_t m_nFileBytes;
+};
+
+
+class CVcsWriter
+{
+public:
+	CVcsWriter();
+
+	// m_nNumStaticCombos is filled in on write
+	void SetHeader( const ShaderHeader_t &header ) { m_Header = header; }
+
+	// pData is the static combo as it is stored in the file: its blocks and the
+	// end marker. The data isn't copied and has to stay valid until Write.
+	void AddStaticCombo( uint32 nStaticComboID, const uint8_t *pData, uint32 nSize );
+
+	// Packs compiled shaders into stored blocks owned by the writer
+	void AddStaticCombo( uint32 nStaticComboID, const VcsDynamicCombo_t *pCombos, int nCount );
+
+	// Builds the stored data of a static combo from its compiled shaders
+	static void PackStoredBlocks( const VcsDynamicCombo_t *pCombos, int nCount, std::vector< uint8_t > &data );
+
+	// A combo that was already known to be a copy of another
+	void AddAlias( uint32 nStaticComboID, uint32 nSourceStaticComboID );
+
+	bool Write( const char *pFileName, VcsWriteStats_t *pStats, std::string &error );
+
+private:
+	struct StaticCombo_t
+	{
+		uint32 m_nStaticComboID;
+		const uint8_t *m_pData;
+		uint32 m_nSize;
+		int m_nOwnedData;		// index into m_OwnedData, or -1
+	};
+
+	ShaderHeader_t m_Header;
+	std::vector< StaticCombo_t > m_Combos;
+	std::vector< StaticComboAliasRecord_t > m_Aliases;
+	std::vector< std::vector< uint8_t > > m_OwnedData;
+};
+
+
+#endif // VCSWRITER_H